@@ -13,15 +13,241 @@ BENCH.icarus:
          -o ../femtosoc_bench.vvp)
 	vvp femtosoc_bench.vvp
 
+# Verilator flags and sources shared by the BENCH.verilator_xxx targets.
+# --savable lets sim_main.cpp save and restore checkpoints:
+#    obj_dir/VfemtoRV32_bench -save 100000000 warm.ckpt
+#    obj_dir/VfemtoRV32_bench -restore warm.ckpt
+# (not compatible with --threads, not used by BENCH.verilator_mt)
+# The UART is connected to the C++ terminal model (SIM/UART.h), through
+# $c() calls (fast path). To simulate the real UART and its pins, use:
+#    make BENCH.verilator BENCH_UART="-DBENCH_UART_PINS -CFLAGS -DBENCH_UART_PINS"
+# Interactive firmware can be scripted or used through a pseudo-terminal:
+#    obj_dir/VfemtoRV32_bench -uart_in commands.txt
+#    obj_dir/VfemtoRV32_bench -uart_pty
+# Cycle profile by function (the symbols are read from the ELF executable):
+#    obj_dir/VfemtoRV32_bench -profile prof firmware.baremetal.elf
+#    flamegraph.pl prof.folded > prof.svg
+# Lock-step comparison with the instruction set simulator (SIM/Cosim.h),
+# stops at the first divergence:
+#    obj_dir/VfemtoRV32_bench -cosim firmware.baremetal.elf
+# The firmware can also be converted once by firmware_words to run-length
+# compressed binary words, faster to load than an ELF or readmemh() text:
+#    FIRMWARE/TOOLS/firmware_words firmware.baremetal.elf -ram 0x20000 \
+#       -out firmware.rle
+#    obj_dir/VfemtoRV32_bench firmware.rle
+BENCH_UART=
+BENCH_VERILATOR_FLAGS=-DBENCH_VERILATOR --top-module femtoRV32_bench \
+         -IRTL -IRTL/PROCESSOR -IRTL/DEVICES -IRTL/PLL -FI FPU_funcs.h \
+         -FI UART.h $(BENCH_UART)
+BENCH_VERILATOR_CFLAGS=-I../SIM -I../FIRMWARE/LIBFEMTORV32 -DSTANDALONE_FEMTOELF
+BENCH_VERILATOR_SAVABLE=--savable -CFLAGS -DSIM_SAVABLE
+BENCH_VERILATOR_SOURCES=SIM/sim_main.cpp SIM/FPU_funcs.cpp SIM/SSD1351.cpp \
+         SIM/SimStats.cpp SIM/UART.cpp SIM/Trace.cpp \
+         SIM/ElfSymbols.cpp SIM/Profiler.cpp \
+         SIM/ISS.cpp SIM/FemtoSocIO.cpp SIM/Cosim.cpp \
+         FIRMWARE/LIBFEMTORV32/femto_elf.c \
+         SIM/femtosoc_bench.vlt RTL/femtosoc_bench.v
+
 BENCH.verilator:
-	verilator -DBENCH_VERILATOR --top-module femtoRV32_bench \
-         -IRTL -IRTL/PROCESSOR -IRTL/DEVICES -IRTL/PLL  \
-	 -CFLAGS '-I../SIM' -LDFLAGS '-lglfw -lGL' \
-         -FI FPU_funcs.h \
-	 --cc --exe SIM/sim_main.cpp SIM/FPU_funcs.cpp SIM/SSD1351.cpp RTL/femtosoc_bench.v
+	verilator $(BENCH_VERILATOR_FLAGS) $(BENCH_VERILATOR_SAVABLE) \
+	 -CFLAGS '$(BENCH_VERILATOR_CFLAGS)' -LDFLAGS '-lglfw -lGL' \
+	 --cc --exe $(BENCH_VERILATOR_SOURCES)
 	(cd obj_dir; make -f VfemtoRV32_bench.mk)	 
 	obj_dir/VfemtoRV32_bench
 
+# Same as BENCH.verilator, without the OLED display window (does not depend
+# on GLFW/OpenGL, runs at full speed, for batch jobs on headless machines).
+# Snapshots of the OLED display can be saved using:
+#    obj_dir/VfemtoRV32_bench -ppm basename -ppm_frames N
+BENCH.verilator_headless: BENCH.verilator_headless_build
+	obj_dir/VfemtoRV32_bench
+
+BENCH.verilator_headless_build:
+	verilator $(BENCH_VERILATOR_FLAGS) $(BENCH_VERILATOR_SAVABLE) \
+	 -CFLAGS '$(BENCH_VERILATOR_CFLAGS) -DSSD1351_HEADLESS' \
+	 --cc --exe $(BENCH_VERILATOR_SOURCES)
+	(cd obj_dir; make -f VfemtoRV32_bench.mk)
+
+# Tuned build of the headless bench, for long batch simulations:
+#  - verilator -O3, --x-assign fast and --x-initial fast (uninitialized
+#    values are not randomized, the femtosoc does not depend on them)
+#  - the generated C++ is split in small files (--output-split), compiled
+#    in parallel and cached by ccache if it is installed
+#  - the C++ is compiled with BENCH_OPT_FAST (-O3 -march=native)
+#  - obj_dir_fast/VfemtoRV32_bench is only rebuilt when a source changed
+# Compiler profile-guided optimization (gcc): BENCH.verilator_pgo builds an
+# instrumented bench in obj_dir_pgo, runs it on BENCH_PGO_FIRMWARE
+# (tinyraytracer, the raystones benchmark, make tinyraytracer.baremetal.elf
+# in FIRMWARE/EXAMPLES) and recompiles it with the profile.
+# To measure the speedup on the same firmware:
+#    make BENCH.verilator_speedup
+# (compares the simulated frequency with the default build in obj_dir)
+BENCH_OUTPUT_SPLIT=20000
+BENCH_VERILATOR_FAST=-O3 --x-assign fast --x-initial fast \
+         --output-split $(BENCH_OUTPUT_SPLIT) \
+         --output-split-cfuncs $(BENCH_OUTPUT_SPLIT)
+BENCH_OPT_FAST=-O3 -march=native
+BENCH_OBJCACHE=$(shell command -v ccache 2>/dev/null)
+BENCH_JOBS=$(shell nproc 2>/dev/null || echo 4)
+BENCH_VERILATOR_DEPS=$(wildcard RTL/*.v RTL/PROCESSOR/*.v RTL/DEVICES/*.v \
+         RTL/PLL/*.v SIM/*.cpp SIM/*.h SIM/*.vlt) \
+         FIRMWARE/LIBFEMTORV32/femto_elf.c
+BENCH_PGO_FIRMWARE=FIRMWARE/EXAMPLES/tinyraytracer.baremetal.elf
+BENCH_PGO_CYCLES=50000000
+
+# $(1): directory, $(2): flags of the C++ compiler, $(3): flags of the linker
+define bench_verilator_fast
+	verilator $(BENCH_VERILATOR_FLAGS) $(BENCH_VERILATOR_FAST) --Mdir $(1) \
+	 -CFLAGS '$(BENCH_VERILATOR_CFLAGS) -DSSD1351_HEADLESS' \
+	 --cc --exe $(BENCH_VERILATOR_SOURCES)
+	$(MAKE) -C $(1) -j $(BENCH_JOBS) -f VfemtoRV32_bench.mk \
+	 OPT_FAST='$(2)' OPT_SLOW='-O1' LDFLAGS='$(3)' OBJCACHE='$(BENCH_OBJCACHE)'
+endef
+
+BENCH.verilator_fast: obj_dir_fast/VfemtoRV32_bench
+	obj_dir_fast/VfemtoRV32_bench
+
+obj_dir_fast/VfemtoRV32_bench: $(BENCH_VERILATOR_DEPS)
+	$(call bench_verilator_fast,obj_dir_fast,$(BENCH_OPT_FAST),)
+
+BENCH.verilator_pgo:
+	rm -rf obj_dir_pgo
+	$(call bench_verilator_fast,obj_dir_pgo,$(BENCH_OPT_FAST) -fprofile-generate,-fprofile-generate)
+	obj_dir_pgo/VfemtoRV32_bench -max_cycles $(BENCH_PGO_CYCLES) $(BENCH_PGO_FIRMWARE)
+	rm -f obj_dir_pgo/*.o obj_dir_pgo/*.a obj_dir_pgo/VfemtoRV32_bench
+	$(MAKE) -C obj_dir_pgo -j $(BENCH_JOBS) -f VfemtoRV32_bench.mk \
+	 OPT_FAST='$(BENCH_OPT_FAST) -fprofile-use -fprofile-correction -Wno-missing-profile' \
+	 OPT_SLOW='-O1' OBJCACHE=
+
+BENCH.verilator_speedup: BENCH.verilator_headless_build obj_dir_fast/VfemtoRV32_bench
+	obj_dir/VfemtoRV32_bench -max_cycles $(BENCH_PGO_CYCLES) $(BENCH_PGO_FIRMWARE)
+	obj_dir_fast/VfemtoRV32_bench -max_cycles $(BENCH_PGO_CYCLES) $(BENCH_PGO_FIRMWARE)
+	if [ -x obj_dir_pgo/VfemtoRV32_bench ]; then \
+	   obj_dir_pgo/VfemtoRV32_bench -max_cycles $(BENCH_PGO_CYCLES) $(BENCH_PGO_FIRMWARE); \
+	fi
+
+# Multithreaded version of BENCH.verilator: the verilated model runs on
+# BENCH_THREADS threads, and the OLED display model runs on its own thread
+# (see SIM_MT in SIM/sim_main.cpp). The UART model stays on the simulation
+# thread, also with BENCH_UART_PINS: it drives RXD and times the bits in
+# clock cycles, so it cannot be fed with pin transitions through a queue.
+# Use for instance:
+#    make BENCH.verilator_mt BENCH_THREADS=2
+BENCH_THREADS=4
+BENCH.verilator_mt:
+	verilator $(BENCH_VERILATOR_FLAGS) --threads $(BENCH_THREADS) \
+	 -CFLAGS '$(BENCH_VERILATOR_CFLAGS) -DSIM_MT' \
+	 -LDFLAGS '-lglfw -lGL -pthread' \
+	 --cc --exe $(BENCH_VERILATOR_SOURCES)
+	(cd obj_dir; make -f VfemtoRV32_bench.mk)
+	obj_dir/VfemtoRV32_bench
+
+# Batch regression runner: simulates a list of firmwares in parallel with
+# the headless bench, captures their UART output and writes a JSON/CSV
+# report in regression/ (see SIM/sim_batch.cpp). The firmwares are bare
+# metal ELF executables (e.g. make hello.baremetal.elf in FIRMWARE/EXAMPLES):
+#    make BENCH.regression BENCH_FIRMWARES="FIRMWARE/EXAMPLES/*.baremetal.elf"
+# A previous report can be used as a baseline to detect cycle regressions:
+#    make BENCH.regression BENCH_BATCH_FLAGS="-baseline regression/report.csv"
+BENCH_FIRMWARES=FIRMWARE/EXAMPLES/*.baremetal.elf
+BENCH_MAX_CYCLES=200000000
+BENCH_BATCH_FLAGS=
+BENCH.regression: BENCH.verilator_headless_build
+	g++ -O2 -o sim_batch SIM/sim_batch.cpp
+	./sim_batch -out regression $(BENCH_BATCH_FLAGS) $(BENCH_FIRMWARES) \
+	   -- obj_dir/VfemtoRV32_bench -max_cycles $(BENCH_MAX_CYCLES)
+
+# Same with the tuned build (see BENCH.verilator_fast)
+BENCH.regression_fast: obj_dir_fast/VfemtoRV32_bench
+	g++ -O2 -o sim_batch SIM/sim_batch.cpp
+	./sim_batch -out regression $(BENCH_BATCH_FLAGS) $(BENCH_FIRMWARES) \
+	   -- obj_dir_fast/VfemtoRV32_bench -max_cycles $(BENCH_MAX_CYCLES)
+
+# Instruction set simulator (does not simulate the RTL, see SIM/ISS.h),
+# to develop and benchmark firmware quickly:
+#    ./femtorv32_iss -stats FIRMWARE/EXAMPLES/hello.baremetal.elf
+# It takes the same options as the bench for sim_batch:
+#    make BENCH.regression_iss
+BENCH_ISS_SOURCES=SIM/iss_main.cpp SIM/ISS.cpp SIM/FemtoSocIO.cpp \
+         SIM/UART.cpp SIM/FPU_funcs.cpp SIM/Trace.cpp SIM/SimStats.cpp \
+         SIM/ElfSymbols.cpp
+BENCH.iss:
+	g++ -O3 -DSTANDALONE_UART -DSTANDALONE_FEMTOELF -ISIM \
+	   -IFIRMWARE/LIBFEMTORV32 -o femtorv32_iss $(BENCH_ISS_SOURCES) \
+	   -x c++ FIRMWARE/LIBFEMTORV32/femto_elf.c
+
+BENCH.regression_iss: BENCH.iss
+	g++ -O2 -o sim_batch SIM/sim_batch.cpp
+	./sim_batch -out regression_iss $(BENCH_BATCH_FLAGS) $(BENCH_FIRMWARES) \
+	   -- ./femtorv32_iss -max_cycles $(BENCH_MAX_CYCLES)
+
+# Reader for the execution traces saved by the bench:
+#    obj_dir/VfemtoRV32_bench -trace trace.bin -trace_ring 16
+#    ./trace_tool -stats trace.bin
+BENCH.trace_tool:
+	g++ -O2 -o trace_tool SIM/trace_tool.cpp SIM/Trace.cpp
+
+# Checks the execution traces of the cores that do not issue loads and
+# stores like the others: the tachyon (in EXECUTE2, after the retire cycle)
+# and quark_bicycle (mem_rstrb is raised for all non-store instructions).
+# For each core in BENCH_CHECK_CPUS, builds the headless bench in
+# obj_dir_<core>, runs BENCH_CHECK_FIRMWARE with -cosim and -trace, and
+# verifies that the trace has loads and stores. The firmware needs to be
+# compiled for RV32I, for instance:
+#    BOARD=testbench TOOLS/make_config.sh \
+#       "-DBENCH_VERILATOR -DBENCH_PROCESSOR_SET -DNRV_FEMTORV32_TACHYON"
+#    (cd FIRMWARE; make libs; cd EXAMPLES; make hello.baremetal.elf)
+#    make BENCH.trace_check
+BENCH_CHECK_CPUS=TACHYON QUARK_BICYCLE
+BENCH_CHECK_FIRMWARE=FIRMWARE/EXAMPLES/hello.baremetal.elf
+BENCH_CHECK_CYCLES=10000000
+BENCH.trace_check: BENCH.trace_tool
+	for cpu in $(BENCH_CHECK_CPUS); do \
+	   verilator $(BENCH_VERILATOR_FLAGS) -DBENCH_PROCESSOR_SET \
+	    -DNRV_FEMTORV32_$$cpu --Mdir obj_dir_$$cpu \
+	    -CFLAGS '$(BENCH_VERILATOR_CFLAGS) -DSSD1351_HEADLESS' \
+	    --cc --exe $(BENCH_VERILATOR_SOURCES) && \
+	   $(MAKE) -C obj_dir_$$cpu -f VfemtoRV32_bench.mk && \
+	   obj_dir_$$cpu/VfemtoRV32_bench -max_cycles $(BENCH_CHECK_CYCLES) \
+	    -cosim -trace trace_$$cpu.bin $(BENCH_CHECK_FIRMWARE) && \
+	   ./trace_tool -stats trace_$$cpu.bin && \
+	   ./trace_tool -stats trace_$$cpu.bin | \
+	    awk '/^(loads|stores) /{ if($$3 == 0) { print "no " $$1; exit 1 } }' \
+	   || exit 1; \
+	done
+
+# Estimates the cycles of a firmware on each femtorv core from a trace
+# (see SIM/TimingModel.h), for instance:
+#    ./femtorv32_iss -trace trace.bin firmware.baremetal.elf
+#    ./timing_tool -elf firmware.baremetal.elf trace.bin
+# With a trace of the bench, the cycles of the simulated core validate its
+# model (-classes compares them for each instruction class).
+BENCH.timing_tool:
+	g++ -O2 -DSTANDALONE_FEMTOELF -ISIM -IFIRMWARE/LIBFEMTORV32 \
+	   -o timing_tool SIM/timing_tool.cpp SIM/TimingModel.cpp SIM/Trace.cpp \
+	   -x c++ FIRMWARE/LIBFEMTORV32/femto_elf.c
+
+# Verifies the C++ model of the FPU of petitbateau (FPU class in
+# SIM/FPU_funcs.cpp) against the FPU of the host, for instance:
+#    ./fpu_verify -op FADD -n 100000000 -print 10
+BENCH.fpu_verify:
+	g++ -O3 -march=native -o fpu_verify SIM/fpu_verify.cpp SIM/FPU_funcs.cpp
+
+# Compares algorithms for FDIV and FSQRT (Newton-Raphson, Goldschmidt,
+# seeds) built on the FPU class: cycles of the microprogram and error in
+# ulps, for instance:
+#    ./fpu_divsqrt -op FDIV -ieee
+#    ./fpu_divsqrt -alg nr_fma-linear-3-corr -stride 1 (exhaustive)
+BENCH.fpu_divsqrt:
+	g++ -O3 -march=native -pthread -o fpu_divsqrt SIM/fpu_divsqrt.cpp SIM/FPU_funcs.cpp
+
+# Conformance of the FPU functions (host and soft paths) to IEEE-754 and
+# the RISC-V spec, on exhaustive, edge and random inputs, for instance:
+#    ./fpu_conformance -out report.csv
+#    ./fpu_conformance -path soft -baseline report.csv (regressions)
+BENCH.fpu_conformance:
+	g++ -O3 -march=native -pthread -o fpu_conformance SIM/fpu_conformance.cpp SIM/FPU_funcs.cpp
+
 BENCH.lint:
 	verilator -DBENCH --lint-only --top-module femtoRV32_bench \
          -IRTL -IRTL/PROCESSOR -IRTL/DEVICES -IRTL/PLL femtosoc_bench.v
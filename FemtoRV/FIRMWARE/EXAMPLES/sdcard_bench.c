@@ -0,0 +1,160 @@
+#include <femtorv32.h>
+#include <fat_io_lib/fat_filelib.h>
+#include <fat_io_lib/fat_cache.h>
+#include <string.h>
+
+/*
+ * Throughput of the SDCard, in KB/s:
+ *  - raw reads, one sector per command (CMD17)
+ *  - raw reads, MULTI sectors per command (CMD18)
+ *  - reading a file with fl_fread() (if a filename is given), by large
+ *    and by small chunks, through the sector cache (see sd_cache.c)
+ *  - writing a file with fl_fwrite() (if -w is given, creates SDBENCH.BIN)
+ * Usage, from the commander: sdcard_bench <file> <-w>
+ */
+
+#define MULTI   16
+#define NB_SECTORS 256
+#define WRITE_SIZE (128*1024)
+#define SMALL_CHUNK 64
+
+static uint8_t buffer[MULTI*512];
+
+/* cycles of a call are accumulated, to support 32 bits counters */
+static uint64_t cycles_total;
+static uint64_t cycles_start;
+
+static inline void chrono_start() {
+    cycles_start = cycles();
+}
+
+static inline void chrono_stop() {
+    cycles_total += cycles() - cycles_start;
+}
+
+static void print_speed(const char* what, uint32_t bytes) {
+    uint64_t KBs = 0;
+    if(cycles_total != 0) {
+	KBs = (uint64_t)bytes * FEMTORV32_FREQ * 1000000 / cycles_total / 1024;
+    }
+    printf("%s: %d KB/s\n", what, (int)KBs);
+    cycles_total = 0;
+}
+
+static void bench_raw(int sectors_per_read) {
+    for(int s=0; s<NB_SECTORS; s+=sectors_per_read) {
+	chrono_start();
+	int OK = sd_readsector(s, buffer, sectors_per_read);
+	chrono_stop();
+	if(!OK) {
+	    printf("Read error\n");
+	    return;
+	}
+    }
+    print_speed(sectors_per_read == 1 ? "CMD17" : "CMD18", NB_SECTORS*512);
+}
+
+static void print_cache_stats() {
+    printf(
+	"   sector cache: %d hits %d misses %d direct\n",
+	sd_cache_stats.hits, sd_cache_stats.misses, sd_cache_stats.direct
+    );
+    printf(
+	"   cluster cache: %d hits %d misses\n",
+	fatfs_cluster_cache_hits, fatfs_cluster_cache_misses
+    );
+    sd_cache_reset_stats();
+    fatfs_cluster_cache_hits = 0;
+    fatfs_cluster_cache_misses = 0;
+}
+
+static void bench_fread(const char* filename, int chunk) {
+    FL_FILE* f = fl_fopen(filename, "rb");
+    if(f == NULL) {
+	printf("Could not open %s\n", filename);
+	return;
+    }
+    uint32_t bytes = 0;
+    for(;;) {
+	chrono_start();
+	int nb = fl_fread(buffer, 1, chunk, f);
+	chrono_stop();
+	if(nb <= 0) {
+	    break;
+	}
+	bytes += nb;
+    }
+    fl_fclose(f);
+    print_speed(chunk == SMALL_CHUNK ? "fread (small)" : "fread", bytes);
+    print_cache_stats();
+}
+
+static void bench_fwrite() {
+    for(int i=0; i<sizeof(buffer); ++i) {
+	buffer[i] = i;
+    }
+    FL_FILE* f = fl_fopen("/SDBENCH.BIN", "wb");
+    if(f == NULL) {
+	printf("Could not create SDBENCH.BIN\n");
+	return;
+    }
+    uint32_t bytes = 0;
+    while(bytes < WRITE_SIZE) {
+	chrono_start();
+	int nb = fl_fwrite(buffer, 1, sizeof(buffer), f);
+	chrono_stop();
+	if(nb <= 0) {
+	    printf("Write error\n");
+	    break;
+	}
+	bytes += nb;
+    }
+    chrono_start();
+    fl_fclose(f);
+    chrono_stop();
+    print_speed("fwrite", bytes);
+    print_cache_stats();
+}
+
+int main(int argc, char** argv) {
+    femtosoc_tty_init();
+
+    const char* filename = NULL;
+    int write = 0;
+    for(int i=1; i<argc; ++i) {
+	if(!strcmp(argv[i],"-w")) {
+	    write = 1;
+	} else {
+	    filename = argv[i];
+	}
+    }
+
+    if(sd_init()) {
+	printf("Could not initialize SDCard\n");
+	return 1;
+    }
+
+    printf("SDCard bench, %d MHz\n", FEMTORV32_FREQ);
+    bench_raw(1);
+    bench_raw(MULTI);
+
+    if(filename == NULL && !write) {
+	return 0;
+    }
+
+    printf("Sector cache: %d bytes\n", sd_cache_init(0));
+    fl_init();
+    if(fl_attach_media((fn_diskio_read)sd_cache_readsector, (fn_diskio_write)sd_cache_writesector) != FAT_INIT_OK) {
+	printf("ERROR: Failed to init file system\n");
+	return -1;
+    }
+    if(filename != NULL) {
+	sd_cache_reset_stats();
+	bench_fread(filename, sizeof(buffer));
+	bench_fread(filename, SMALL_CHUNK);
+    }
+    if(write) {
+	bench_fwrite();
+    }
+    return 0;
+}
@@ -13,6 +13,8 @@
 #define IO_BUTTONS_bit 9
 #define IO_FGA_CNTL_bit 10
 #define IO_FGA_DAT_bit 11
+#define IO_SDCARD_SPI_DAT_bit 12
+#define IO_SDCARD_SPI_CNTL_bit 13
 #define IO_HW_CONFIG_RAM_bit 17
 #define IO_HW_CONFIG_DEVICES_bit 18
 #define IO_HW_CONFIG_CPUINFO_bit 19
@@ -15,11 +15,15 @@ int exec(const char* filename, int argc, char** argv) {
 
 /************************************************************************/
 
-typedef void (*funptr)(int argc, char** argv);
+typedef int (*funptr)(int argc, char** argv);
+
+/* Maximum number of arguments passed to main() */
+#define EXEC_MAX_ARGS 16
 
 int exec_elf(const char* filename, int argc, char** argv) {
   Elf32Info info;
   int errcode;
+  char* args[EXEC_MAX_ARGS+1];
    
   errcode = elf32_load(filename, &info);
 
@@ -28,18 +32,24 @@ int exec_elf(const char* filename, int argc, char** argv) {
   }
 
   LEDS(0);
+
+  // argv[0] is the name of the program, and argv[argc] is NULL.
+  if(argc <= 0 || argv == NULL) {
+    args[0] = (char*)filename;
+    argc = 1;
+  } else {
+    if(argc > EXEC_MAX_ARGS) {
+      argc = EXEC_MAX_ARGS;
+    }
+    for(int i=0; i<argc; ++i) {
+      args[i] = argv[i];
+    }
+  }
+  args[argc] = NULL;
   
-  // Now we can transfer execution to beginning of text segment.
-  // It where main() resides, so we can pass it argc and argv.
-  ((funptr)(info.text_address))(argc, argv);
-
-  // Note: there is also elf_header.e_entry = 0x101cc,
-  //             whereas text segment start = 0x10074
-  // Calling elf_header.e_entry does not work. 
-  // It is probably where crt0.S is implanted. It would be better
-  // to call it (but it did not work when I tried). There are
-  // complicated things to setup for argc/argv/envp to work.
+  // Now we can transfer execution to the entry point (_start in
+  // CRT/crt0_exec.S), that calls main(argc, argv) and returns here.
+  ((funptr)(info.entry))(argc, args);
   
   return 0;
 }
-
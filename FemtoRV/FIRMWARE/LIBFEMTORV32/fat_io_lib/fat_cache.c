@@ -36,6 +36,10 @@
 // This does not have to be enabled for architectures with low
 // memory space.
 
+// Statistics (lookups found / not found in the cache)
+uint32 fatfs_cluster_cache_hits = 0;
+uint32 fatfs_cluster_cache_misses = 0;
+
 //-----------------------------------------------------------------------------
 // fatfs_cache_init:
 //-----------------------------------------------------------------------------
@@ -64,10 +68,12 @@ int fatfs_cache_get_next_cluster(struct fatfs *fs, FL_FILE *file, uint32 cluster
     if (file->cluster_cache_idx[slot] == clusterIdx)
     {
         *pNextCluster = file->cluster_cache_data[slot];
+        fatfs_cluster_cache_hits++;
         return 1;
     }
 #endif
 
+    fatfs_cluster_cache_misses++;
     return 0;
 }
 //-----------------------------------------------------------------------------
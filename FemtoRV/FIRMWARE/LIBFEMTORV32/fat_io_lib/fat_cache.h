@@ -10,4 +10,10 @@ int fatfs_cache_init(struct fatfs *fs, FL_FILE *file);
 int fatfs_cache_get_next_cluster(struct fatfs *fs, FL_FILE *file, uint32 clusterIdx, uint32 *pNextCluster);
 int fatfs_cache_set_next_cluster(struct fatfs *fs, FL_FILE *file, uint32 clusterIdx, uint32 nextCluster);
 
+//-----------------------------------------------------------------------------
+// Statistics
+//-----------------------------------------------------------------------------
+extern uint32 fatfs_cluster_cache_hits;
+extern uint32 fatfs_cluster_cache_misses;
+
 #endif
@@ -545,6 +545,8 @@ static FL_FILE* _create_file(const char *filename)
 #endif
 //-----------------------------------------------------------------------------
 // _read_sectors: Read sector(s) from disk to file
+// (spans the following clusters as long as they are contiguous on disk,
+// so that large reads are done with a single multi-sector read)
 //-----------------------------------------------------------------------------
 static uint32 _read_sectors(FL_FILE* file, uint32 offset, uint8 *buffer, uint32 count)
 {
@@ -553,6 +555,7 @@ static uint32 _read_sectors(FL_FILE* file, uint32 offset, uint8 *buffer, uint32
     uint32 Cluster = 0;
     uint32 i;
     uint32 lba;
+    uint32 total = count;
 
     // Find cluster index within file & sector with cluster
     ClusterIdx = offset / _fs.sectors_per_cluster;
@@ -615,6 +618,37 @@ static uint32 _read_sectors(FL_FILE* file, uint32 offset, uint8 *buffer, uint32
     // Calculate sector address
     lba = fatfs_lba_of_cluster(&_fs, Cluster) + Sector;
 
+    // Extend read to the next clusters in the chain if contiguous
+    while (count < total)
+    {
+        uint32 nextCluster;
+
+        // Does the entry exist in the cache?
+        if (!fatfs_cache_get_next_cluster(&_fs, file, ClusterIdx, &nextCluster))
+        {
+            // Scan file linked list to find next entry
+            nextCluster = fatfs_find_next_cluster(&_fs, Cluster);
+
+            // Push entry into cache
+            fatfs_cache_set_next_cluster(&_fs, file, ClusterIdx, nextCluster);
+        }
+
+        if (nextCluster != Cluster + 1)
+            break;
+
+        Cluster = nextCluster;
+        ClusterIdx++;
+
+        if ((total - count) > _fs.sectors_per_cluster)
+            count += _fs.sectors_per_cluster;
+        else
+            count = total;
+
+        // Record current cluster lookup details
+        file->last_fat_lookup.CurrentCluster = Cluster;
+        file->last_fat_lookup.ClusterIdx = ClusterIdx;
+    }
+
     // Read sector of file
     if (fatfs_sector_read(&_fs, lba, buffer, count))
         return count;
@@ -1052,7 +1086,12 @@ int fl_fread(void * buffer, int size, int length, void *f )
         // Read whole sector, read from media directly into target buffer
         if ((offset == 0) && ((count - bytesRead) >= FAT_SECTOR_SIZE))
         {
+            // Flush un-written data to file (the sector buffer is bypassed)
+            if (file->file_data_dirty)
+                fl_fflush(file);
+
             // Read as many sectors as possible into target buffer
+            // (zero-copy, across contiguous clusters)
             uint32 sectorsRead = _read_sectors(file, sector, (uint8*)((uint8*)buffer + bytesRead), (count - bytesRead) / FAT_SECTOR_SIZE);
             if (sectorsRead)
             {
@@ -38,7 +38,9 @@
 // Size of cluster chain cache (can be undefined)
 // Mem used = FAT_CLUSTER_CACHE_ENTRIES * 4 * 2
 // Improves access speed considerably
-//#define FAT_CLUSTER_CACHE_ENTRIES         128
+#ifndef FAT_CLUSTER_CACHE_ENTRIES
+    #define FAT_CLUSTER_CACHE_ENTRIES       128
+#endif
 
 // Include support for writing files (1 / 0)?
 #ifndef FATFS_INC_WRITE_SUPPORT
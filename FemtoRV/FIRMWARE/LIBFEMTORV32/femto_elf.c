@@ -14,27 +14,40 @@
 
 /****************************************************************************/
 
-static int elf32_parse(const char* filename, Elf32Info* info);
+static int elf32_parse(
+  const char* filename, Elf32Info* info,
+  Elf32SegmentFunc func, void* client_data
+);
 
 int elf32_load(const char* filename, Elf32Info* info) {
   info->base_address = NULL;
   info->text_address = 0;
   info->max_address = 0;
-  return elf32_parse(filename, info);
+  return elf32_parse(filename, info, NULL, NULL);
 }
 
 int elf32_load_at(const char* filename, Elf32Info* info, void* addr) {
   info->base_address = addr;
   info->text_address = 0;
   info->max_address = 0;
-  return elf32_parse(filename, info);
+  return elf32_parse(filename, info, NULL, NULL);
 }
 
 int elf32_stat(const char* filename, Elf32Info* info) {
   info->base_address = NO_ADDRESS;
   info->text_address = 0;
   info->max_address = 0;
-  return elf32_parse(filename, info);
+  return elf32_parse(filename, info, NULL, NULL);
+}
+
+int elf32_segments(
+  const char* filename, Elf32Info* info,
+  Elf32SegmentFunc func, void* client_data
+) {
+  info->base_address = NO_ADDRESS;
+  info->text_address = 0;
+  info->max_address = 0;
+  return elf32_parse(filename, info, func, client_data);
 }
 
 /****************************************************************************/
@@ -73,37 +86,56 @@ typedef struct
 
 typedef struct
 {
-  Elf32_Word	sh_name;		/* Section name (string tbl index) */
-  Elf32_Word	sh_type;		/* Section type */
-  Elf32_Word	sh_flags;		/* Section flags */
-  Elf32_Addr	sh_addr;		/* Section virtual addr at execution */
-  Elf32_Off	sh_offset;		/* Section file offset */
-  Elf32_Word	sh_size;		/* Section size in bytes */
-  Elf32_Word	sh_link;		/* Link to another section */
-  Elf32_Word	sh_info;		/* Additional section information */
-  Elf32_Word	sh_addralign;		/* Section alignment */
-  Elf32_Word	sh_entsize;		/* Entry size if section holds table */
-} Elf32_Shdr;
-
-/* Section header type */
-#define SHT_NULL	  0		/* Section header table entry unused */
-#define SHT_PROGBITS	  1		/* Program data */
-#define SHT_NOBITS	  8		/* Program space with no data (bss) */
-#define SHT_INIT_ARRAY	  14		/* Array of constructors */
-#define SHT_FINI_ARRAY	  15		/* Array of destructors */
-
-/* Section header flags */
-#define SHF_ALLOC	     (1 << 1)	/* Occupies memory during execution */
+  Elf32_Word	p_type;			/* Segment type */
+  Elf32_Off	p_offset;		/* Segment file offset */
+  Elf32_Addr	p_vaddr;		/* Segment virtual address */
+  Elf32_Addr	p_paddr;		/* Segment physical address */
+  Elf32_Word	p_filesz;		/* Segment size in file */
+  Elf32_Word	p_memsz;		/* Segment size in memory */
+  Elf32_Word	p_flags;		/* Segment flags */
+  Elf32_Word	p_align;		/* Segment alignment */
+} Elf32_Phdr;
+
+/* Segment types */
+#define PT_LOAD		  1		/* Loadable program segment */
+
+/* Segment flags */
+#define PF_X		  (1 << 0)	/* Segment is executable */
+
+/* Maximum number of program headers (read all at once) */
+#define ELF32_MAX_PHDR	  16
 
 /****************************************************************************/
 
-int elf32_parse(const char* filename, Elf32Info* info) {
+/*
+ * Clears memory with word stores (the RAM is organized by words), and
+ * bytes stores for the unaligned head and tail.
+ */
+static void elf32_clear(uint8_t* p, uint32_t size) {
+  while(size != 0 && ((uintptr_t)p & 3) != 0) {
+    *p = 0; ++p; --size;
+  }
+  uint32_t* w = (uint32_t*)p;
+  while(size >= 4) {
+    *w = 0; ++w; size -= 4;
+  }
+  p = (uint8_t*)w;
+  while(size != 0) {
+    *p = 0; ++p; --size;
+  }
+}
+
+int elf32_parse(
+  const char* filename, Elf32Info* info,
+  Elf32SegmentFunc func, void* client_data
+) {
   Elf32_Ehdr elf_header;
-  Elf32_Shdr sec_header;
+  Elf32_Phdr prog_header[ELF32_MAX_PHDR];
   FILE* f = fopen(filename,"r");
   uint8_t* base_mem = (uint8_t*)(info->base_address);
   
   info->text_address = 0;
+  info->entry = 0;
 
   if(f == NULL) {
     return ELF32_FILE_NOT_FOUND;
@@ -111,71 +143,88 @@ int elf32_parse(const char* filename, Elf32Info* info) {
 
   /* read elf header */
   if(fread(&elf_header, 1, sizeof(elf_header), f) != sizeof(elf_header)) {
+    fclose(f);
     return ELF32_READ_ERROR;
   }
 
   /* sanity check */
-  if(elf_header.e_ehsize != sizeof(elf_header)) {
+  if(
+    elf_header.e_ident[0] != 0x7f || elf_header.e_ident[1] != 'E' ||
+    elf_header.e_ident[2] != 'L'  || elf_header.e_ident[3] != 'F' ||
+    elf_header.e_ehsize != sizeof(elf_header) ||
+    elf_header.e_phentsize != sizeof(Elf32_Phdr) ||
+    elf_header.e_phnum > ELF32_MAX_PHDR
+  ) {
+    fclose(f);
     return ELF32_HEADER_SIZE_MISMATCH;
   }
 
-  /* sanity check */  
-  if(elf_header.e_shentsize != sizeof(Elf32_Shdr)) {
-    return ELF32_HEADER_SIZE_MISMATCH;
-  }
+  info->entry = elf_header.e_entry;
   
   LEDS(8);
 
-  /* read all section headers */  
-  for(int i=0; i<elf_header.e_shnum; ++i) {
-    
-    fseek(f,elf_header.e_shoff + i*sizeof(sec_header), SEEK_SET);
-    if(fread(&sec_header, 1, sizeof(sec_header), f) != sizeof(sec_header)) {
-      return ELF32_READ_ERROR;
-    }
+  /* read all program headers at once */
+  uint32_t phdr_size = elf_header.e_phnum * sizeof(Elf32_Phdr);
+  if(
+     fseek(f, elf_header.e_phoff, SEEK_SET) != 0 ||
+     fread(prog_header, 1, phdr_size, f) != phdr_size
+  ) {
+    fclose(f);
+    return ELF32_READ_ERROR;
+  }
+
+  /* 
+   * The loadable segments, in file order (the linker sorts them by
+   * address, so that the reads go forward in the file).
+   */ 
+  for(int i=0; i<elf_header.e_phnum; ++i) {
+    Elf32_Phdr* P = &prog_header[i];
     
     LEDS(i);
 
-    /* The sections we are interested in are the ALLOC sections. */
-    if(!(sec_header.sh_flags & SHF_ALLOC)) {
+    if(P->p_type != PT_LOAD || P->p_memsz == 0) {
       continue;
     }
 
-    /* I assume that the first PROGBITS section is the text segment */
-    /* TODO: verify using the name of the section (but requires to  */
-    /* load the strings table, painful...)                          */ 
-    if(sec_header.sh_type == SHT_PROGBITS && info->text_address == 0) {
-      info->text_address = sec_header.sh_addr;
+    if((P->p_flags & PF_X) && info->text_address == 0) {
+      info->text_address = P->p_vaddr;
     }
 
     /* Update max address */ 
-    info->max_address = MAX(
-      info->max_address, 
-      sec_header.sh_addr + sec_header.sh_size
-    );
-
-    /* PROGBIT, INI_ARRAY and FINI_ARRAY need to be loaded. */
-    if(
-       sec_header.sh_type == SHT_PROGBITS ||
-       sec_header.sh_type == SHT_INIT_ARRAY ||
-       sec_header.sh_type == SHT_FINI_ARRAY
-    ) {
-	if(info->base_address != NO_ADDRESS) {
-	  fseek(f,sec_header.sh_offset, SEEK_SET);
-	  if(
-	     fread(
-		   base_mem + sec_header.sh_addr, 1,
-		   sec_header.sh_size, f
-	     ) != sec_header.sh_size
-	  ) {
-	    return ELF32_READ_ERROR;
-	  }
-	}
+    info->max_address = MAX(info->max_address, P->p_vaddr + P->p_memsz);
+
+    if(func != NULL) {
+      if(P->p_filesz != 0) {
+	func(client_data, P->p_vaddr, P->p_filesz, P->p_offset);
+      }
+      if(P->p_memsz > P->p_filesz) {
+	func(
+	   client_data, P->p_vaddr + P->p_filesz,
+	   P->p_memsz - P->p_filesz, ELF32_NO_DATA
+	);
+      }
+    }
+
+    if(info->base_address == NO_ADDRESS) {
+      continue;
+    }
+
+    /* The data of the segment, in one read, directly to its destination */
+    if(P->p_filesz != 0) {
+      if(
+	 fseek(f, P->p_offset, SEEK_SET) != 0 ||
+	 fread(base_mem + P->p_vaddr, 1, P->p_filesz, f) != P->p_filesz
+      ) {
+	fclose(f);
+	return ELF32_READ_ERROR;
+      }
     }
 
-    /* NOBITS need to be cleared. */    
-    if(sec_header.sh_type == SHT_NOBITS && info->base_address != NO_ADDRESS) {	
-      memset(base_mem + sec_header.sh_addr, 0, sec_header.sh_size);
+    /* The rest of the segment (.bss) needs to be cleared. */
+    if(P->p_memsz > P->p_filesz) {
+      elf32_clear(
+	 base_mem + P->p_vaddr + P->p_filesz, P->p_memsz - P->p_filesz
+      );
     }
   }  
   fclose(f);
@@ -2,6 +2,8 @@
  * A minimalistic ELF loader. Probably many things are missing.
  * Disclaimer: I do not understand everything here !
  * Bruno Levy, 12/2020
+ * The loadable segments (PT_LOAD program headers) are read in one
+ * contiguous read each, directly to their destination.
  */
 
 #ifdef STANDALONE_FEMTOELF
@@ -16,6 +18,7 @@ typedef struct {
   void*      base_address; /* Base memory address (NULL on normal operation). */
   elf32_addr text_address; /* The address of the text segment.                */
   elf32_addr max_address;  /* The maximum address of a segment.               */
+  elf32_addr entry;        /* The entry point (e_entry).                      */
 } Elf32Info;
 
 #define ELF32_OK                   0
@@ -23,12 +26,28 @@ typedef struct {
 #define ELF32_HEADER_SIZE_MISMATCH 2
 #define ELF32_READ_ERROR           3
 
+/* File offset of the segments with no data (.bss), see elf32_segments() */
+#define ELF32_NO_DATA              0xffffffff
+
+/**
+ * \brief A function called for each segment of an ELF executable.
+ * \param[in] client_data the pointer passed to elf32_segments()
+ * \param[in] addr the address of the segment
+ * \param[in] size the size of the segment in bytes
+ * \param[in] offset the offset of the data of the segment in the file,
+ *  or ELF32_NO_DATA if the segment is to be cleared.
+ */
+typedef void (*Elf32SegmentFunc)(
+  void* client_data, elf32_addr addr, uint32_t size, uint32_t offset
+);
+
 /**
  * \brief Loads an ELF executable to RAM.
  * \param[in] filename the name of the file that contains the ELF executable.
  * \param[out] info a pointer to an Elf32Info. On exit, base_adress is NULL,
- *  text_address contains the starting address of the text segment, and
- *  max_address the maximum address used by the segments.
+ *  text_address contains the starting address of the text segment (the
+ *  first executable segment), max_address the maximum address used by the
+ *  segments and entry the entry point of the executable.
  * \return ELF32_OK or an error code.
  */
 int elf32_load(const char* filename, Elf32Info* info);
@@ -38,8 +57,9 @@ int elf32_load(const char* filename, Elf32Info* info);
  * \details Used by programs that convert ELF executables to other formats.
  * \param[in] filename the name of the file that contains the ELF executable.
  * \param[out] info a pointer to an Elf32Info. On exit, base_adress is NULL,
- *  text_address contains the starting address of the text segment, and
- *  max_address the maximum address used by the segments.
+ *  text_address contains the starting address of the text segment (the
+ *  first executable segment), max_address the maximum address used by the
+ *  segments and entry the entry point of the executable.
  * \param[in] addr the address where to load the ELF segments.
  * \return ELF32_OK or an error code.
  */
@@ -49,9 +69,24 @@ int elf32_load_at(const char* filename, Elf32Info* info, void* addr);
  * \brief Analyzes an ELF executable.
  * \param[in] filename the name of the file that contains the ELF executable.
  * \param[out] info a pointer to an Elf32Info. On exit, base_adress is NULL,
- *  text_address contains the starting address of the text segment, and
- *  max_address the maximum address used by the segments.
+ *  text_address contains the starting address of the text segment (the
+ *  first executable segment), max_address the maximum address used by the
+ *  segments and entry the entry point of the executable.
  * \return ELF32_OK or an error code.
  */
 int elf32_stat(const char* filename, Elf32Info* info);
 
+/**
+ * \brief Enumerates the segments of an ELF executable, without loading them.
+ * \details Used by programs that convert ELF executables to other formats,
+ *  and that read the data of the segments directly from the file.
+ * \param[in] filename the name of the file that contains the ELF executable.
+ * \param[out] info a pointer to an Elf32Info, initialized as in elf32_stat()
+ * \param[in] func the function called for each segment
+ * \param[in] client_data passed to \p func
+ * \return ELF32_OK or an error code.
+ */
+int elf32_segments(
+  const char* filename, Elf32Info* info,
+  Elf32SegmentFunc func, void* client_data
+);
@@ -64,6 +64,19 @@ int sd_init(); /* Return 0 on success, non-zero on failure */
 int sd_readsector(uint32_t sector, uint8_t* buffer, uint32_t sector_count); /* 1:success, 0:failure*/
 int sd_writesector(uint32_t sector, uint8_t* buffer, uint32_t sector_count); /* 1:success, 0:failure*/
 
+/* SDCard sector cache (LRU, by lines of consecutive sectors, see sd_cache.c) */
+int sd_cache_init(int nb_bytes); /* 0: sized from RAM (at most SD_CACHE_LINES). Returns cache size (0: no cache) */
+int sd_cache_readsector(uint32_t sector, uint8_t* buffer, uint32_t sector_count); /* 1:success, 0:failure*/
+int sd_cache_writesector(uint32_t sector, uint8_t* buffer, uint32_t sector_count); /* 1:success, 0:failure*/
+void sd_cache_invalidate();
+void sd_cache_reset_stats();
+struct SDCacheStats {
+   uint32_t hits;   /* accesses to a cached line */
+   uint32_t misses; /* lines read from the SDCard */
+   uint32_t direct; /* sectors read without the cache (large reads) */
+};
+extern struct SDCacheStats sd_cache_stats;
+
 
 /********************* Memory-mapped IO *******************************************************/
 
@@ -83,6 +96,8 @@ int sd_writesector(uint32_t sector, uint8_t* buffer, uint32_t sector_count); /*
 #define IO_MAX7219           IO_BIT_TO_OFFSET(IO_MAX7219_DAT_bit)
 #define IO_SPI_FLASH         IO_BIT_TO_OFFSET(IO_SPI_FLASH_bit)
 #define IO_SDCARD            IO_BIT_TO_OFFSET(IO_SDCARD_bit)
+#define IO_SDCARD_SPI_DAT    IO_BIT_TO_OFFSET(IO_SDCARD_SPI_DAT_bit)
+#define IO_SDCARD_SPI_CNTL   IO_BIT_TO_OFFSET(IO_SDCARD_SPI_CNTL_bit)
 #define IO_BUTTONS           IO_BIT_TO_OFFSET(IO_BUTTONS_bit)
 #define IO_FGA_CNTL          IO_BIT_TO_OFFSET(IO_FGA_CNTL_bit)
 #define IO_FGA_DAT           IO_BIT_TO_OFFSET(IO_FGA_DAT_bit)    
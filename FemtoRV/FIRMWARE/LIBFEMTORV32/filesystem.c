@@ -6,11 +6,12 @@ int filesystem_init() {
     printf("ERROR:\nCould not init\n SDCard\n");
     return -1;
   }
+  sd_cache_init(0);
   fl_init();
   LEDS(2);  
   if(fl_attach_media(
-      (fn_diskio_read)sd_readsector,
-      (fn_diskio_write)sd_writesector) != FAT_INIT_OK
+      (fn_diskio_read)sd_cache_readsector,
+      (fn_diskio_write)sd_cache_writesector) != FAT_INIT_OK
   ) {
     printf("ERROR:\nCould not init\nfile system\n");
     return -1;
@@ -0,0 +1,149 @@
+// SDCard sector cache, between fat_io_lib and spi_sd.c
+//
+// The cache is organized by lines of SD_CACHE_LINE_SECTORS consecutive
+// sectors, aligned on a multiple of SD_CACHE_LINE_SECTORS. A miss reads
+// the whole line with a single multi-block command, which acts as a
+// read-ahead for sequential accesses (fl_fread() by small chunks, FAT
+// table, directories). Lines are replaced in LRU order.
+// Reads of a whole line or more go directly to the SDCard (no copy).
+// Writes go through the cache (write-through), cached copies are updated.
+// The cache is a static array (no malloc(): the commander is linked without
+// sbrk, and its memory ends where exec() loads the programs). On boards
+// with little RAM, the number of lines used is reduced.
+
+#include <femtorv32.h>
+#include <string.h>
+
+// Number of cache lines (can be overridden)
+// Mem used = SD_CACHE_LINES * SD_CACHE_LINE_SECTORS * 512
+#ifndef SD_CACHE_LINES
+#define SD_CACHE_LINES        4
+#endif
+
+#define SD_CACHE_LINE_SECTORS 4
+#define SD_CACHE_LINE_SIZE    (SD_CACHE_LINE_SECTORS * 512)
+#define SD_CACHE_RAM_RATIO    32   // default: at most 1/32th of the RAM
+#define SD_CACHE_INVALID      0xFFFFFFFF
+
+struct SDCacheStats sd_cache_stats;
+
+static uint8_t  cache_data[SD_CACHE_LINES * SD_CACHE_LINE_SIZE];
+static int      cache_nb_lines = 0;
+static uint32_t cache_lba[SD_CACHE_LINES];   // first sector of the line
+static uint32_t cache_stamp[SD_CACHE_LINES]; // last access, for LRU
+static uint32_t cache_time = 0;
+
+int sd_cache_init(int nb_bytes) {
+    if(nb_bytes == 0) {
+	nb_bytes = IO_IN(IO_HW_CONFIG_RAM) / SD_CACHE_RAM_RATIO;
+    }
+    int nb_lines = MIN(nb_bytes / SD_CACHE_LINE_SIZE, SD_CACHE_LINES);
+    // Less than two lines: the FAT table and the data would evict each other
+    if(nb_lines < 2) {
+	cache_nb_lines = 0;
+	return 0;
+    }
+    cache_nb_lines = nb_lines;
+    sd_cache_invalidate();
+    sd_cache_reset_stats();
+    return nb_lines * SD_CACHE_LINE_SIZE;
+}
+
+void sd_cache_invalidate() {
+    for(int i=0; i<cache_nb_lines; ++i) {
+	cache_lba[i] = SD_CACHE_INVALID;
+	cache_stamp[i] = 0;
+    }
+    cache_time = 0;
+}
+
+void sd_cache_reset_stats() {
+    memset(&sd_cache_stats, 0, sizeof(sd_cache_stats));
+}
+
+// Returns the index of the line that contains the sector, -1 if not cached.
+static int sd_cache_find(uint32_t line_lba) {
+    for(int i=0; i<cache_nb_lines; ++i) {
+	if(cache_lba[i] == line_lba) {
+	    return i;
+	}
+    }
+    return -1;
+}
+
+// Returns the index of the line that contains the sector, reads it
+// from the SDCard if needed. Returns -1 on read error.
+static int sd_cache_get(uint32_t line_lba) {
+    int line = sd_cache_find(line_lba);
+    if(line >= 0) {
+	++sd_cache_stats.hits;
+	cache_stamp[line] = ++cache_time;
+	return line;
+    }
+    // Evict the least recently used line (invalid lines have stamp 0)
+    line = 0;
+    for(int i=1; i<cache_nb_lines; ++i) {
+	if(cache_stamp[i] < cache_stamp[line]) {
+	    line = i;
+	}
+    }
+    ++sd_cache_stats.misses;
+    if(!sd_readsector(
+	   line_lba, cache_data + line * SD_CACHE_LINE_SIZE, SD_CACHE_LINE_SECTORS
+       )) {
+	cache_lba[line] = SD_CACHE_INVALID;
+	cache_stamp[line] = 0;
+	return -1;
+    }
+    cache_lba[line] = line_lba;
+    cache_stamp[line] = ++cache_time;
+    return line;
+}
+
+int sd_cache_readsector(uint32_t sector, uint8_t* buffer, uint32_t sector_count) {
+    if(cache_nb_lines == 0 || sector_count >= SD_CACHE_LINE_SECTORS) {
+	sd_cache_stats.direct += sector_count;
+	return sd_readsector(sector, buffer, sector_count);
+    }
+    while(sector_count > 0) {
+	uint32_t line_lba = sector & ~(SD_CACHE_LINE_SECTORS-1);
+	uint32_t offset = sector - line_lba;
+	uint32_t nb = MIN(sector_count, SD_CACHE_LINE_SECTORS - offset);
+	int line = sd_cache_get(line_lba);
+	if(line < 0) {
+	    return 0;
+	}
+	memcpy(
+	    buffer, cache_data + line * SD_CACHE_LINE_SIZE + offset * 512, nb * 512
+	);
+	buffer += nb * 512;
+	sector += nb;
+	sector_count -= nb;
+    }
+    return 1;
+}
+
+int sd_cache_writesector(uint32_t sector, uint8_t* buffer, uint32_t sector_count) {
+    int OK = sd_writesector(sector, buffer, sector_count);
+    // Update (or invalidate on error) the cached copies
+    for(int i=0; i<cache_nb_lines; ++i) {
+	if(cache_lba[i] == SD_CACHE_INVALID ||
+	   cache_lba[i] + SD_CACHE_LINE_SECTORS <= sector ||
+	   cache_lba[i] >= sector + sector_count) {
+	    continue;
+	}
+	if(!OK) {
+	    cache_lba[i] = SD_CACHE_INVALID;
+	    cache_stamp[i] = 0;
+	    continue;
+	}
+	uint32_t first = MAX(cache_lba[i], sector);
+	uint32_t last  = MIN(cache_lba[i] + SD_CACHE_LINE_SECTORS, sector + sector_count);
+	memcpy(
+	    cache_data + i * SD_CACHE_LINE_SIZE + (first - cache_lba[i]) * 512,
+	    buffer + (first - sector) * 512,
+	    (last - first) * 512
+	);
+    }
+    return OK;
+}
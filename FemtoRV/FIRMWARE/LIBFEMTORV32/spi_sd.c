@@ -5,8 +5,9 @@
 
 #include <femtorv32.h>
 
-// For now, does software bitbanging.
-// TODO: a hardware shift register, will be cleaner...
+// Uses the hardware SPI master if the SDCard device has one
+// (NRV_IO_SDCARD_SPI, see RTL/DEVICES/SDCard.v), else does software
+// bitbanging. CS_N is always driven by bitbanging.
 
 #define MOSI_MASK 1
 #define CLK_MASK  2
@@ -61,44 +62,82 @@ static inline void DLY_US(int t) {
   microwait(t); 
 }
 
+// Hardware SPI master (control register bits)
+#define SPI_HW_WORD       (1 << 8)  // 32 bits per transfer
+#define SPI_HW_DISCARD    (1 << 9)  // do not store received data
+#define SPI_HW_BUSY       1
+#define SPI_HW_RX_VALID   2
+#define SPI_HW_TX_FULL    4
+#define SPI_HW_FIFO_SIZE  4
+
+#define SPI_HW_SLOW_KHZ   400       // SDCard initialization
+#define SPI_HW_FAST_MHZ   25        // SDCard max frequency (default speed)
+
+static int spi_hw = 0;
+static uint32_t spi_hw_divider = 255;
+
+// Changes divider and mode, the SPI master needs to be idle.
+static inline void spi_hw_mode(uint32_t mode) {
+    IO_OUT(IO_SDCARD_SPI_CNTL, spi_hw_divider | mode);
+}
+
+// SPI clk = clk / (2*(divider+1)), rounded to the frequency just below.
+static void spi_hw_set_speed(uint32_t khz) {
+    uint32_t divider = (FEMTORV32_FREQ * 1000 + 2*khz - 1) / (2*khz);
+    divider = (divider == 0) ? 0 : divider - 1;
+    spi_hw_divider = (divider > 255) ? 255 : divider;
+    spi_hw_mode(0);
+}
+
+// Sends one byte (or word in word mode) and returns the received one.
+static inline uint32_t spi_hw_xfer(uint32_t d) {
+    IO_OUT(IO_SDCARD_SPI_DAT, d);
+    while(!(IO_IN(IO_SDCARD_SPI_CNTL) & SPI_HW_RX_VALID));
+    return IO_IN(IO_SDCARD_SPI_DAT);
+}
+
+// One bit: MOSI is set with CLK low, then CLK goes high (the card samples
+// MOSI on the rising edge). The next bit sets CLK low and MOSI in the same
+// write, so that a bit takes two writes instead of three.
+#define SPI_SEND_BIT(d,bit)                                  \
+    s = lo | (((d) >> (bit)) & MOSI_MASK);                   \
+    IO_OUT(IO_SDCARD, s);                                    \
+    IO_OUT(IO_SDCARD, s | CLK_MASK);
+
 void spi_send (uint8_t d) {
-    if (d & 0x80) MOSI_H(); else MOSI_L();    // bit7 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    if (d & 0x40) MOSI_H(); else MOSI_L();    // bit6 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    if (d & 0x20) MOSI_H(); else MOSI_L();    // bit5 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    if (d & 0x10) MOSI_H(); else MOSI_L();    // bit4 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    if (d & 0x08) MOSI_H(); else MOSI_L();    // bit3 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    if (d & 0x04) MOSI_H(); else MOSI_L();    // bit2 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    if (d & 0x02) MOSI_H(); else MOSI_L();    // bit1 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    if (d & 0x01) MOSI_H(); else MOSI_L();    // bit0 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
+    if(spi_hw) {
+	spi_hw_xfer(d);
+	return;
+    }
+    uint32_t lo = spi_state & ~(CLK_MASK | MOSI_MASK);
+    uint32_t s;
+    SPI_SEND_BIT(d,7); SPI_SEND_BIT(d,6); SPI_SEND_BIT(d,5); SPI_SEND_BIT(d,4);
+    SPI_SEND_BIT(d,3); SPI_SEND_BIT(d,2); SPI_SEND_BIT(d,1); SPI_SEND_BIT(d,0);
+    spi_state = s;
+    IO_OUT(IO_SDCARD, spi_state); // CLK low
 }
 
+// One bit: MISO is sampled (bit 0 of the register) before the rising
+// edge of CLK, MOSI stays high (0xFF is sent while receiving).
+#define SPI_RECV_BIT(r)                                      \
+    r = (r << 1) | IO_IN(IO_SDCARD);                         \
+    IO_OUT(IO_SDCARD, hi);                                   \
+    IO_OUT(IO_SDCARD, lo);
+
+#define SPI_RECV_BYTE(r)                                     \
+    r = 0;                                                   \
+    SPI_RECV_BIT(r); SPI_RECV_BIT(r); SPI_RECV_BIT(r); SPI_RECV_BIT(r); \
+    SPI_RECV_BIT(r); SPI_RECV_BIT(r); SPI_RECV_BIT(r); SPI_RECV_BIT(r);
+
 uint8_t spi_receive () {
-    uint8_t r;
+    uint32_t r;
+    if(spi_hw) {
+	return spi_hw_xfer(0xFF);
+    }
     MOSI_H();    // Send 0xFF while receiving 
-    r = 0;   if (MISO()) r++;    // bit7 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    r <<= 1; if (MISO()) r++;    // bit6 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    r <<= 1; if (MISO()) r++;    // bit5 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    r <<= 1; if (MISO()) r++;    // bit4 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    r <<= 1; if (MISO()) r++;    // bit3 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    r <<= 1; if (MISO()) r++;    // bit2 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    r <<= 1; if (MISO()) r++;    // bit1 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
-    r <<= 1; if (MISO()) r++;    // bit0 
-    CK_H(); CLK_DELAY(); CK_L(); CLK_DELAY();
+    uint32_t lo = spi_state;
+    uint32_t hi = lo | CLK_MASK;
+    SPI_RECV_BYTE(r);
     return r;
 }
 
@@ -107,15 +146,93 @@ uint8_t spi_sendrecv(uint8_t cmd) {
     return spi_receive();
 }
 
+// Word-at-a-time with the hardware SPI master, keeps the FIFOs
+// full (at most SPI_HW_FIFO_SIZE words in flight, so that the
+// transmit FIFO never overflows).
+static void spi_hw_readblock(uint8_t *ptr, int length) {
+    if(((uintptr_t)ptr & 3) == 0) {
+	uint32_t* wptr = (uint32_t*)ptr;
+	int nb_words = length >> 2;
+	int sent = 0;
+	spi_hw_mode(SPI_HW_WORD);
+	while(sent < nb_words && sent < SPI_HW_FIFO_SIZE) {
+	    IO_OUT(IO_SDCARD_SPI_DAT, 0xFFFFFFFF);
+	    ++sent;
+	}
+	for(int i=0; i<nb_words; ++i) {
+	    while(!(IO_IN(IO_SDCARD_SPI_CNTL) & SPI_HW_RX_VALID));
+	    *wptr++ = IO_IN(IO_SDCARD_SPI_DAT);
+	    if(sent < nb_words) {
+		IO_OUT(IO_SDCARD_SPI_DAT, 0xFFFFFFFF);
+		++sent;
+	    }
+	}
+	spi_hw_mode(0);
+	ptr = (uint8_t*)wptr;
+	length &= 3;
+    }
+    while(length > 0) {
+	*ptr++ = spi_hw_xfer(0xFF);
+	--length;
+    }
+}
+
+// Word-at-a-time with the hardware SPI master, received data is
+// discarded, the CPU only waits when the transmit FIFO is full.
+static void spi_hw_writeblock(uint8_t *ptr, int length) {
+    if(((uintptr_t)ptr & 3) == 0) {
+	uint32_t* wptr = (uint32_t*)ptr;
+	spi_hw_mode(SPI_HW_WORD | SPI_HW_DISCARD);
+	while(length >= 4) {
+	    while(IO_IN(IO_SDCARD_SPI_CNTL) & SPI_HW_TX_FULL);
+	    IO_OUT(IO_SDCARD_SPI_DAT, *wptr++);
+	    length -= 4;
+	}
+	while(IO_IN(IO_SDCARD_SPI_CNTL) & SPI_HW_BUSY);
+	spi_hw_mode(0);
+	ptr = (uint8_t*)wptr;
+    }
+    while(length > 0) {
+	spi_hw_xfer(*ptr++);
+	--length;
+    }
+}
+
 void spi_readblock(uint8_t *ptr, int length) {
-    int i;
-    for (i=0;i<length;i++) {
-        *ptr++ = spi_receive();
+    if(spi_hw) {
+	spi_hw_readblock(ptr, length);
+	return;
+    }
+    uint32_t lo = (spi_state & ~CLK_MASK) | MOSI_MASK;
+    uint32_t hi = lo | CLK_MASK;
+    uint32_t b0, b1, b2, b3;
+    MOSI_H();
+    // Word-at-a-time, unrolled (the RAM is organized by words)
+    if(((uintptr_t)ptr & 3) == 0) {
+	uint32_t* wptr = (uint32_t*)ptr;
+	while(length >= 4) {
+	    SPI_RECV_BYTE(b0);
+	    SPI_RECV_BYTE(b1);
+	    SPI_RECV_BYTE(b2);
+	    SPI_RECV_BYTE(b3);
+	    *wptr++ = b0 | (b1 << 8) | (b2 << 16) | (b3 << 24);
+	    length -= 4;
+	}
+	ptr = (uint8_t*)wptr;
+    }
+    while(length > 0) {
+	SPI_RECV_BYTE(b0);
+	*ptr++ = b0;
+	--length;
     }
 }
  
 void spi_writeblock(uint8_t *ptr, int length) {
     int i;
+    if(spi_hw) {
+	spi_hw_writeblock(ptr, length);
+	return;
+    }
     for (i=0;i<length;i++) {
         spi_send(*ptr++);
     }
@@ -125,8 +242,11 @@ void spi_writeblock(uint8_t *ptr, int length) {
 #define CMD0_GO_IDLE_STATE              0
 #define CMD1_SEND_OP_COND               1
 #define CMD8_SEND_IF_COND               8
+#define CMD12_STOP_TRANSMISSION         12
 #define CMD17_READ_SINGLE_BLOCK         17
+#define CMD18_READ_MULTIPLE_BLOCK       18
 #define CMD24_WRITE_SINGLE_BLOCK        24
+#define CMD25_WRITE_MULTIPLE_BLOCK      25
 #define CMD32_ERASE_WR_BLK_START        32
 #define CMD33_ERASE_WR_BLK_END          33
 #define CMD38_ERASE                     38
@@ -146,6 +266,8 @@ void spi_writeblock(uint8_t *ptr, int length) {
 #define ACMD41_HOST_SUPPORTS_SDHC       0x40000000
 
 #define CMD_START_OF_BLOCK              0xFE
+#define CMD_START_OF_MULTI_BLOCK        0xFC
+#define CMD_STOP_MULTI_BLOCK            0xFD
 #define CMD_DATA_ACCEPTED               0x05
 
 static int sdhc_card = 0;
@@ -158,7 +280,9 @@ uint8_t sd_send_command(uint8_t cmd, uint32_t arg) {
     if(!sdhc_card) {
         switch (cmd) {
             case CMD17_READ_SINGLE_BLOCK:
+            case CMD18_READ_MULTIPLE_BLOCK:
             case CMD24_WRITE_SINGLE_BLOCK:
+            case CMD25_WRITE_MULTIPLE_BLOCK:
             case CMD32_ERASE_WR_BLK_START:
             case CMD33_ERASE_WR_BLK_END:
 		arg *= 512;
@@ -175,6 +299,11 @@ uint8_t sd_send_command(uint8_t cmd, uint32_t arg) {
     // CRC required for CMD8 (0x87) & CMD0 (0x95) - default to CMD0
     spi_send((cmd == CMD8_SEND_IF_COND) ? CMD8_CRC : CMD0_CRC);
 
+    // CMD12: skip the stuff byte (the card may still be sending data)
+    if(cmd == CMD12_STOP_TRANSMISSION) {
+        spi_receive();
+    }
+
     // Wait for response (i.e MISO not held high)
     int count = 0;
     while((response = spi_receive()) == 0xff) {
@@ -211,6 +340,11 @@ int _sd_init() {
     uint8_t response = 0xFF;
     uint8_t sd_version;
     delay(2);
+
+    spi_hw = (FEMTOSOC_HAS_DEVICE(IO_SDCARD_SPI_DAT_bit) != 0);
+    if(spi_hw) {
+	spi_hw_set_speed(SPI_HW_SLOW_KHZ);
+    }
     
     CS_H();
     MOSI_H();
@@ -282,6 +416,10 @@ int _sd_init() {
        // Standard density only
        sdhc_card = 0;
     }
+
+    if(spi_hw) {
+       spi_hw_set_speed(SPI_HW_FAST_MHZ * 1000);
+    }
     return 0;
 }
 
@@ -297,106 +435,155 @@ int sd_init() {
     return result;
 }
 
+// Waits for the start of block token, reads a block (512 bytes) and
+// ignores its CRC. Returns 1 on success, 0 on timeout.
+static int sd_readblock(uint8_t *buffer) {
+    int retries = 0;
+    
+    // Wait for start of block indicator
+    while(spi_receive() != CMD_START_OF_BLOCK) {
+        // Timeout
+        if(retries > 5000) {
+            printf("sd_readsector: Timeout\n");
+            return 0;
+        }
+        ++retries;
+    }
+
+    // Perform block read (512 bytes)
+    spi_readblock(buffer, 512);
+
+    // Ignore 16-bit CRC
+    spi_receive();
+    spi_receive();
+    return 1;
+}
+
+// Waits while the card is busy (holds MISO low). Returns 1 when it is
+// ready, 0 on timeout.
+static int sd_wait_ready(const char* func) {
+    int retries = 0;
+    while(spi_receive() == 0) {
+        // Timeout
+        if(retries > 5000) {
+            printf("%s: Timeout\n", func);
+            return 0;
+        }
+        ++retries;
+    }
+    return 1;
+}
+
 int sd_readsector(uint32_t start_block, uint8_t *buffer, uint32_t sector_count) {
     uint8_t response;
-    uint32_t ctrl;
-    int retries = 0;
-    int i;
     if (sector_count == 0) {
         return 0;
     }
-    while (sector_count--) {
+
+    if (sector_count == 1) {
         // Request block read
-        response = sd_send_command(CMD17_READ_SINGLE_BLOCK, start_block++);
+        response = sd_send_command(CMD17_READ_SINGLE_BLOCK, start_block);
         if(response != 0x00) {
             printf("sd_readsector: Bad response %x\n", response);
             return 0;
         }
+        if(!sd_readblock(buffer)) {
+            return 0;
+        }
+        // Additional 8 SPI clocks
+        spi_sendrecv(0xFF);
+        return 1;
+    }
 
-        // Wait for start of block indicator
-        while(spi_receive() != CMD_START_OF_BLOCK) {
-            // Timeout
-	    if(retries > 5000) {
-                printf("sd_readsector: Timeout\n");
-                return 0;
-            }
-	    ++retries;
+    // Several blocks: one command for all of them (the card streams the
+    // blocks until it receives CMD12)
+    response = sd_send_command(CMD18_READ_MULTIPLE_BLOCK, start_block);
+    if(response != 0x00) {
+        printf("sd_readsector: Bad response %x\n", response);
+        return 0;
+    }
+    while (sector_count--) {
+        if(!sd_readblock(buffer)) {
+            sd_send_command(CMD12_STOP_TRANSMISSION, 0);
+            return 0;
         }
+        buffer += 512;
+    }
+    response = sd_send_command(CMD12_STOP_TRANSMISSION, 0);
+    if(response != 0x00) {
+        printf("sd_readsector: Bad response %x\n", response);
+        return 0;
+    }
+    return sd_wait_ready("sd_readsector");
+}
 
-        // Perform block read (512 bytes)
-        spi_readblock(buffer, 512);
+// Sends a block (512 bytes) preceded by a start token, and checks the
+// data response. Returns 1 if accepted, 0 otherwise.
+static int sd_writeblock(uint8_t token, uint8_t *buffer) {
+    uint8_t response;
+    
+    // Indicate start of data transfer
+    spi_send(token);
 
-        buffer += 512;
+    // Send data block
+    spi_writeblock(buffer, 512);
 
-        // Ignore 16-bit CRC
-        spi_receive();
-        spi_receive();
+    // Send CRC (ignored)
+    spi_send(0xff);
+    spi_send(0xff);
 
-        // Additional 8 SPI clocks
-        spi_sendrecv(0xFF);
+    // Get response
+    response = spi_receive();
+
+    if((response & 0x1f) != CMD_DATA_ACCEPTED) {
+        printf("sd_writesector: Data rejected %x\n", response);
+        return 0;
     }
-    return 1;
+
+    // Wait for data write complete
+    return sd_wait_ready("sd_writesector");
 }
 
 int sd_writesector(uint32_t start_block, uint8_t *buffer, uint32_t sector_count) {
     uint8_t response;
-    int retries = 0;
-    int i;
 
-    while (sector_count--) {
+    if (sector_count == 1) {
         // Request block write
-        response = sd_send_command(CMD24_WRITE_SINGLE_BLOCK, start_block++);
+        response = sd_send_command(CMD24_WRITE_SINGLE_BLOCK, start_block);
         if(response != 0x00) {
             printf("sd_writesector: Bad response %x\n", response);
             return 0;
         }
-
-        // Indicate start of data transfer
-        spi_send(CMD_START_OF_BLOCK);
-
-        // Send data block
-        spi_writeblock(buffer, 512);
-        buffer += 512;
-
-        // Send CRC (ignored)
-        spi_send(0xff);
-        spi_send(0xff);
-
-        // Get response
-        response = spi_receive(0xFF);
-
-        if((response & 0x1f) != CMD_DATA_ACCEPTED) {
-            printf("sd_writesector: Data rejected %x\n", response);
+        if(!sd_writeblock(CMD_START_OF_BLOCK, buffer)) {
             return 0;
         }
-
-        // Wait for data write complete
-        while(spi_sendrecv(0xFF) == 0) {
-            // Timeout
-	    if(retries > 5000) {
-                printf("sd_writesector: Timeout\n");
-                return 0;
-            }
-	    ++retries;
-        }
-
         // Additional 8 SPI clocks
         spi_send(0xff);
+        return sd_wait_ready("sd_writesector");
+    }
 
-	retries = 0;
-	
-        // Wait for data write complete
-        while(spi_sendrecv(0xFF) == 0) {
-            // Timeout
-	    if(retries > 5000) {
-                printf("sd_writesector: Timeout\n");
-                return 0;
-            }
-	    ++retries;
-        }
+    if (sector_count == 0) {
+        return 1;
     }
 
-    return 1;
+    // Several blocks: one command, then the blocks, each one with
+    // its start token, and the stop token
+    response = sd_send_command(CMD25_WRITE_MULTIPLE_BLOCK, start_block);
+    if(response != 0x00) {
+        printf("sd_writesector: Bad response %x\n", response);
+        return 0;
+    }
+    while (sector_count--) {
+        if(!sd_writeblock(CMD_START_OF_MULTI_BLOCK, buffer)) {
+            spi_send(CMD_STOP_MULTI_BLOCK);
+            spi_send(0xff);
+            sd_wait_ready("sd_writesector");
+            return 0;
+        }
+        buffer += 512;
+    }
+    spi_send(CMD_STOP_MULTI_BLOCK);
+    // Additional 8 SPI clocks, then the card is busy while it programs
+    spi_send(0xff);
+    return sd_wait_ready("sd_writesector");
 }
-
-
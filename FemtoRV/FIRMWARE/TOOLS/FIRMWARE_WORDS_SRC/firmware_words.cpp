@@ -1,11 +1,25 @@
 /**
- * Converts ascii hex firmware files with byte values 
- * into files with word values. 
+ * Converts ascii hex firmware files with byte values
+ * into files with word values.
  * It is required by femtosoc's RAM initialization, that
- * is organized by words, and initialized using verilog's 
+ * is organized by words, and initialized using verilog's
  * $readmemh().
  * Can also directly load an ELF statically-linked binary.
- */ 
+ * The segments of the ELF are streamed from the file to the outputs,
+ * and several regions of the address space can be saved in one pass
+ * (for instance PROGROM and DATARAM of the pipelined cores). Besides
+ * readmemh() text, it can save the regions in raw binary, and in two
+ * binary word formats that the Verilator bench loads directly
+ * (see load_firmware_words() in SIM/sim_main.cpp):
+ *  - .fwb: header, then the words of the region
+ *  - .rle: header, then the words of the region, run-length compressed
+ * The header has three little-endian 32 bits words: the magic number
+ * (FWB_MAGIC or RLE_MAGIC), the address of the region, and its number of
+ * words. In .rle files, the words are encoded as a sequence of records,
+ * starting with a 32 bits word H:
+ *  - bit 31 of H set: the next word is repeated (H & 0x7fffffff) times
+ *  - bit 31 of H clear: H words follow (literals)
+ */
 
 
 #include <iostream>
@@ -14,43 +28,47 @@
 #include <map>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <cstring>
 #include <cstdint>
+#include <cstdio>
 
 #include <femto_elf.h>
 
+/* Magic numbers of the binary word formats ("FWB1" and "FWR1") */
+const uint32_t FWB_MAGIC = 0x31425746;
+const uint32_t RLE_MAGIC = 0x31525746;
+
+/* Runs of identical words shorter than this are stored as literals */
+const uint32_t RLE_MIN_RUN = 3;
+
+/* The regions are streamed to the outputs by chunks of this size */
+const uint32_t CHUNK_SIZE = 65536;
 
 /*********************************************************************/
 
 /**
  * \brief Converts a character into a nibble (half-byte)
  * \param[in] c one of 0..9,A..F,a..f
- * \return the numeric value as an unsigned char
+ * \return the numeric value as an unsigned char, or 255 if \p c is
+ *  not an hexadecimal digit
+ * \details uses a table, initialized on first call
  */
 unsigned char char_to_nibble(char c) {
-    unsigned char result;
-    if(c >= '0' && c <= '9') {
-	result = c - '0';
-    } else if(c >= 'A' && c <= 'F') {
-	result = c - 'A' + 10;
-    } else if(c >= 'a' && c <= 'f') {
-	result = c - 'a' + 10;
-    } else {
-	std::cerr << "Invalid hexadecimal digit: " << c << std::endl;
-	exit(-1);
+    static unsigned char table[256];
+    static bool initialized = false;
+    if(!initialized) {
+	memset(table, 255, sizeof(table));
+	for(int i=0; i<10; ++i) {
+	    table['0'+i] = i;
+	}
+	for(int i=0; i<6; ++i) {
+	    table['A'+i] = 10+i;
+	    table['a'+i] = 10+i;
+	}
+	initialized = true;
     }
-    return result;
-}
-
-/**
- * \brief Converts a two-characters string into a byte
- * \param[in] str a pointer to a two-characters array 
- * \details \p str needs to have exactly two characters and
- *          does not need to be null-terminated
- * \return the numeric value as an unsigned char
- */
-unsigned char string_to_byte(char* str) {
-    return (char_to_nibble(str[0]) << 4) | char_to_nibble(str[1]);
+    return table[(unsigned char)(c)];
 }
 
 /**
@@ -84,12 +102,23 @@ void split_string(
     }
 }
 
+/**
+ * \brief Tests whether a filename has a given extension
+ * \param[in] filename the filename
+ * \param[in] ext the extension, without the dot
+ */
+bool has_extension(const char* filename, const char* ext) {
+    int l = strlen(filename);
+    int e = strlen(ext);
+    return l > e && filename[l-e-1] == '.' && !strcmp(filename+l-e, ext);
+}
+
 /**************************************************************/
 
 /*
  * \brief Parses femtosoc.v and extracts RAM size
  * \param filename the VERILOG file to be parsed
- * \return RAM size or 0 if RAM size (NRV_RAM) is 
+ * \return RAM size or 0 if RAM size (NRV_RAM) is
  *  not specified in \p filename
  */
 int get_RAM_size_from_verilog(const char* filename) {
@@ -116,209 +145,429 @@ int get_RAM_size_from_verilog(const char* filename) {
 
 /**************************************************************************/
 
+/**
+ * \brief A contiguous block of bytes of the firmware
+ * \details For an ELF executable, the data stays in the file (offset) and
+ *  is only read when a region that contains the block is saved. For an
+ *  ASCII hexadecimal file, it is stored in data. Blocks with no data
+ *  (offset is ELF32_NO_DATA and data is empty) are cleared (.bss).
+ */
+struct Block {
+    uint32_t addr;
+    uint32_t size;
+    uint32_t offset;
+    std::vector<unsigned char> data;
+};
 
 /**
- * \brief Loads an ASCII hexadecimal file into a vector of bytes
+ * \brief The blocks of a firmware, sorted by address
+ */
+struct Firmware {
+    std::vector<Block> blocks;
+    FILE* elf_file = nullptr;
+};
+
+/**
+ * \brief Reads the content of the firmware in an interval of addresses
+ * \param[in] firmware the firmware
+ * \param[in] addr , size the interval
+ * \param[out] buffer a pointer to \p size bytes. The addresses not covered
+ *  by the blocks of the firmware are set to zero.
+ * \return true on success, false on read error
+ */
+bool read_firmware(
+    Firmware& firmware, uint32_t addr, uint32_t size, unsigned char* buffer
+) {
+    memset(buffer, 0, size);
+    for(const Block& B: firmware.blocks) {
+	uint64_t from = std::max(uint64_t(addr), uint64_t(B.addr));
+	uint64_t to = std::min(
+	    uint64_t(addr) + size, uint64_t(B.addr) + B.size
+	);
+	if(from >= to) {
+	    continue;
+	}
+	unsigned char* dest = buffer + (from - addr);
+	if(!B.data.empty()) {
+	    memcpy(dest, B.data.data() + (from - B.addr), to - from);
+	} else if(B.offset != ELF32_NO_DATA) {
+	    if(
+		fseek(firmware.elf_file, B.offset + (from - B.addr), SEEK_SET)
+		    != 0 ||
+		fread(dest, 1, to - from, firmware.elf_file) != to - from
+	    ) {
+		std::cerr << "Error while reading ELF file" << std::endl;
+		return false;
+	    }
+	}
+    }
+    return true;
+}
+
+/**
+ * \brief Loads an ASCII hexadecimal file into blocks of bytes
  * \param[in] filename the name of the file to be loaded
- * \param[out] RAM a vector of unsigned char where the content of the
- *  file will be loaded
+ * \param[in] RAM_SIZE the size of the RAM
+ * \param[out] firmware the blocks of the file
  * \return the highest set address or -1 if there was an error
- * \details this function understands the '@' statement in VERILOG 
- *  files that redefine the origin. It performs several sanity checks, 
+ * \details this function understands the '@' statement in VERILOG
+ *  files that redefine the origin. It performs several sanity checks,
  *  including verifying that the same address was not written twice.
  */
-int load_RAM_rawhex(const char* filename, std::vector<unsigned char>& RAM) {
+int load_RAM_rawhex(const char* filename, int RAM_SIZE, Firmware& firmware) {
     std::cerr << "   LOAD RAWHEX: " << filename << std::endl;
-  
-    int RAM_SIZE = RAM.size();
 
-    /* Occupancy array, to make sure we do not set the same byte twice. */
-    std::vector<unsigned char> OCC(RAM_SIZE,0);
+    FILE* f = fopen(filename, "rb");
+    if(f == nullptr) {
+	std::cerr << "Could not open " << filename << std::endl;
+	return -1;
+    }
+    std::string text;
+    char buff[65536];
+    size_t nb_read;
+    while((nb_read = fread(buff, 1, sizeof(buff), f)) != 0) {
+	text.append(buff, nb_read);
+    }
+    fclose(f);
 
     int address = 0;
     int lineno = 0;
     int max_address = 0;
-    std::ifstream in(filename);
-    if(!in) {
-	std::cerr << "Could not open " << filename << std::endl;
-	return -1;
-    }
-  
-    std::string line;
-    while(std::getline(in, line)) {
+    bool new_block = true;
+    size_t pos = 0;
+    while(pos < text.length()) {
+	size_t end = text.find('\n', pos);
+	if(end == std::string::npos) {
+	    end = text.length();
+	}
 	++lineno;
-	if(line[0] == '@') {
-	    sscanf(line.c_str()+1,"%x",&address);
-	} else {
-	    std::string charbytes;
-	    for(int i=0; i<line.length(); ++i) {
-		if(line[i] != ' ' && std::isprint(line[i])) {
-		    charbytes.push_back(line[i]);
-		}
+	const char* line = text.c_str() + pos;
+	size_t length = end - pos;
+	pos = end + 1;
+	if(length != 0 && line[0] == '@') {
+	    sscanf(line+1,"%x",&address);
+	    new_block = true;
+	    continue;
+	}
+	int nb_nibbles = 0;
+	unsigned char byte = 0;
+	for(size_t i=0; i<length; ++i) {
+	    if(line[i] == ' ' || !std::isprint(line[i])) {
+		continue;
 	    }
-
-	    if(charbytes.size() % 2 != 0) {
+	    unsigned char nibble = char_to_nibble(line[i]);
+	    if(nibble == 255) {
 		std::cerr << "Line : " << lineno << std::endl;
-		std::cerr << " invalid number of characters"
+		std::cerr << " Invalid hexadecimal digit: " << line[i]
 			  << std::endl;
 		return -1;
 	    }
-
-	    int i = 0;
-	    while(i < charbytes.size()) {
-		if(address >= RAM_SIZE) {
-		    std::cerr << "Line : " << lineno << std::endl;
-		    std::cerr << " RAM size exceeded"
-			      << std::endl;
-		    return -1;
-		}
-		if(OCC[address] != 0) {
-		    std::cerr << "Line : " << lineno << std::endl;
-		    std::cerr << " same RAM address written twice"
-			      << std::endl;
-		    return -1;
-		}
-		max_address = std::max(max_address, address);
-		RAM[address] = string_to_byte(&charbytes[i]);
-		OCC[address] = 255;
-		i += 2;
-		address++;
+	    byte = (byte << 4) | nibble;
+	    if((++nb_nibbles & 1) != 0) {
+		continue;
+	    }
+	    if(address >= RAM_SIZE) {
+		std::cerr << "Line : " << lineno << std::endl;
+		std::cerr << " RAM size exceeded"
+			  << std::endl;
+		return -1;
 	    }
+	    if(new_block) {
+		firmware.blocks.emplace_back();
+		firmware.blocks.back().addr = address;
+		firmware.blocks.back().size = 0;
+		firmware.blocks.back().offset = ELF32_NO_DATA;
+		new_block = false;
+	    }
+	    Block& B = firmware.blocks.back();
+	    B.data.push_back(byte);
+	    B.size++;
+	    max_address = std::max(max_address, address);
+	    address++;
+	}
+	if((nb_nibbles & 1) != 0) {
+	    std::cerr << "Line : " << lineno << std::endl;
+	    std::cerr << " invalid number of characters"
+		      << std::endl;
+	    return -1;
+	}
+    }
+
+    std::sort(
+	firmware.blocks.begin(), firmware.blocks.end(),
+	[](const Block& A, const Block& B) { return A.addr < B.addr; }
+    );
+    for(size_t i=1; i<firmware.blocks.size(); ++i) {
+	const Block& prev = firmware.blocks[i-1];
+	if(prev.addr + prev.size > firmware.blocks[i].addr) {
+	    std::cerr << " same RAM address written twice: 0x"
+		      << std::hex << firmware.blocks[i].addr << std::dec
+		      << std::endl;
+	    return -1;
 	}
     }
     return max_address;
 }
 
-/* 
- * \brief Loads a statically linked ELF binary into a vector of bytes
- * \param[out] RAM a vector of unsigned char where the content of the
- *  file will be loaded
+/**
+ * \brief Called by elf32_segments() for each segment of the ELF executable
+ */
+static void add_elf_segment(
+    void* client_data, elf32_addr addr, uint32_t size, uint32_t offset
+) {
+    Firmware* firmware = static_cast<Firmware*>(client_data);
+    firmware->blocks.emplace_back();
+    firmware->blocks.back().addr = addr;
+    firmware->blocks.back().size = size;
+    firmware->blocks.back().offset = offset;
+}
+
+/*
+ * \brief Gets the segments of a statically linked ELF binary
+ * \param[in] filename the name of the ELF file
+ * \param[in] RAM_SIZE the size of the RAM
+ * \param[out] firmware the segments of the file. The file remains open,
+ *  the segments are read from it when they are saved.
  * \return the highest set address or -1 if there was an error
  */
-int load_RAM_elf(const char* filename, std::vector<unsigned char>& RAM) {
+int load_RAM_elf(const char* filename, int RAM_SIZE, Firmware& firmware) {
     std::cerr << "   LOAD ELF: " << filename << std::endl;
-    int RAM_SIZE = RAM.size();
     Elf32Info info;
-    if(elf32_stat(filename, &info) != ELF32_OK) {
+    if(
+	elf32_segments(filename, &info, add_elf_segment, &firmware) != ELF32_OK
+    ) {
 	std::cerr << "Error while reading ELF file " << filename << std::endl;
 	return -1;
     }
-    std::cerr << "       max address=" << info.max_address << std::endl; 
-    if(info.max_address >= RAM_SIZE) {
+    std::cerr << "       max address=" << info.max_address << std::endl;
+    if(info.max_address >= elf32_addr(RAM_SIZE)) {
 	std::cerr << "Memory exceeded !" << std::endl;
 	return -1;
     }
-    if(elf32_load_at(filename, &info, RAM.data()) != ELF32_OK) {
-	std::cerr << "Error while reading ELF file " << filename << std::endl;
+    std::stable_sort(
+	firmware.blocks.begin(), firmware.blocks.end(),
+	[](const Block& A, const Block& B) { return A.addr < B.addr; }
+    );
+    firmware.elf_file = fopen(filename, "rb");
+    if(firmware.elf_file == nullptr) {
+	std::cerr << "Could not open " << filename << std::endl;
 	return -1;
     }
     return info.max_address;
 }
 
-/* 
- * \brief Loads a file into a vector of bytes
+/*
+ * \brief Loads a file into blocks of bytes
  * \param[in] filename the name of the file to be loaded, can be an ASCII
  *  hexadecimal file (.hex extension) or a statically linked ELF executable
  *  (.elf extension).
- * \return the highest set address or -1 if there was an error. 
+ * \param[in] RAM_SIZE the size of the RAM
+ * \param[out] firmware the blocks of the file
+ * \return the highest set address or -1 if there was an error.
  */
-int load_RAM(const char* filename, std::vector<unsigned char>& RAM) {
-    int l = strlen(filename);
-    if(l >= 3 && !strcmp(filename+l-3,"hex")) {
-	return load_RAM_rawhex(filename, RAM);
-    } 
-    if(l >= 3 && !strcmp(filename+l-3,"elf")) {
-	return load_RAM_elf(filename, RAM);
+int load_RAM(const char* filename, int RAM_SIZE, Firmware& firmware) {
+    if(has_extension(filename,"hex")) {
+	return load_RAM_rawhex(filename, RAM_SIZE, firmware);
+    }
+    if(has_extension(filename,"elf")) {
+	return load_RAM_elf(filename, RAM_SIZE, firmware);
     }
     std::cerr << filename << ": invalid extension" << std::endl;
     return -1;
 }
 
+/****************************************************************/
+
 /**
- * \brief Saves a vector of bytes into an ASCII hexadecimal file that
- *  can be understood by VERILOG's readmemh() function
- * \param[in] filename the name of the file
- * \param[in] RAM the vector of bytes to be saved
- * \param[in] from_addr , to_addr the optional interval to be saved
- * \details from_addr and to_addr + 1 need to be on a word boundary
+ * \brief An interval of addresses to be saved to a file
+ * \details to_addr is included. The format is deduced from the
+ *  extension of the file:
+ *  - .hex: ASCII hexadecimal words, for VERILOG's readmemh()
+ *  - .bin: raw binary
+ *  - .fwb: binary words with a header
+ *  - .rle: run-length compressed binary words with a header
  */
-void save_RAM_hex(
-    const char* filename, std::vector<unsigned char>& RAM,
-    int from_addr=0, int to_addr=-1
-) {
-    if(to_addr == -1) {
-	to_addr = RAM.size()-1;
+struct Region {
+    std::string filename;
+    int from_addr;
+    int to_addr;
+};
+
+/**
+ * \brief Run-length encoder of the .rle format
+ */
+struct RLEWriter {
+    FILE* f;
+    std::vector<uint32_t> literals;
+    uint32_t run_value = 0;
+    uint32_t run_length = 0;
+
+    void put(uint32_t w) {
+	if(run_length != 0 && w == run_value) {
+	    ++run_length;
+	    return;
+	}
+	end_run();
+	run_value = w;
+	run_length = 1;
     }
-    if((from_addr & 3) != 0) {
-	std::cerr << "save RAM hex:"
-		  << "from_addr needs to be on a word boundary"
-		  << std::endl;
-	exit(-1);
+
+    void end_run() {
+	if(run_length >= RLE_MIN_RUN) {
+	    flush_literals();
+	    uint32_t record[2] = { 0x80000000u | run_length, run_value };
+	    fwrite(record, sizeof(uint32_t), 2, f);
+	} else {
+	    literals.insert(literals.end(), run_length, run_value);
+	}
+	run_length = 0;
     }
 
-    if(((to_addr+1) & 3) != 0) {
-	std::cerr << "save RAM hex:"
-		  << "(to_addr+1) needs to be on a word boundary"
-		  << std::endl;
-	exit(-1);
-    }
-    
-    std::cerr << "   SAVE HEX: " << filename << std::endl;    
-    std::ofstream out(filename);
-    for(int i=from_addr; i<to_addr; i+=4) {
-	char buff[10];
-	sprintf(buff,"%.2x%.2x%.2x%.2x ",RAM[i+3],RAM[i+2],RAM[i+1],RAM[i]);
-	out << buff; 
-	if(((i/4+1) % 4) == 0) {
-	    out << std::endl;
+    void flush_literals() {
+	if(literals.empty()) {
+	    return;
 	}
+	uint32_t H = literals.size();
+	fwrite(&H, sizeof(uint32_t), 1, f);
+	fwrite(literals.data(), sizeof(uint32_t), literals.size(), f);
+	literals.clear();
     }
-}
+
+    void finish() {
+	end_run();
+	flush_literals();
+    }
+};
 
 /**
- * \brief Saves a vector of bytes into a raw binary file
- * \param[in] filename the name of the file
- * \param[in] RAM the vector of bytes to be saved
- * \param[in] from_addr , to_addr the optional interval to be saved
+ * \brief Writes the words of a chunk in VERILOG's readmemh() format
+ * \param[in] f the output file
+ * \param[in] addr the address of the chunk
+ * \param[in] chunk , size the bytes of the chunk (size is a multiple of 4)
+ * \details there is a newline every four words (counting from address 0)
  */
-void save_RAM_bin(
-    const char* filename, std::vector<unsigned char>& RAM,
-    int from_addr=0, int to_addr=-1
+void write_chunk_hex(
+    FILE* f, uint32_t addr, const unsigned char* chunk, uint32_t size
 ) {
-    if(to_addr==-1) {
-	to_addr = RAM.size()-1;
+    static const char digits[] = "0123456789abcdef";
+    std::vector<char> text;
+    text.reserve(size/4*9 + size/16 + 1);
+    for(uint32_t i=0; i<size; i+=4) {
+	for(int j=3; j>=0; --j) {
+	    text.push_back(digits[chunk[i+j] >> 4]);
+	    text.push_back(digits[chunk[i+j] & 15]);
+	}
+	text.push_back(' ');
+	if((((addr+i)/4+1) % 4) == 0) {
+	    text.push_back('\n');
+	}
     }
-    std::cerr << "   SAVE BIN: " << filename << std::endl;
-    printf("        from addr:0x%lx\n",(unsigned long)from_addr);
-    printf("          to addr:0x%lx\n",(unsigned long)to_addr);    
-    FILE* f = fopen(filename,"wb");
-    fwrite(RAM.data()+from_addr, 1, to_addr+1-from_addr,f);
-    fclose(f);
+    fwrite(text.data(), 1, text.size(), f);
 }
 
 /**
- * \brief Saves a vector of bytes into a file.
- * \param[in] filename the name of the file. Extension can be .hex 
- *  (ASCII hexadecimal that can be understood by VERILOG's readmemh
- *   command) or .bin (raw binary file).
- * \param[in] RAM the vector of bytes to be saved
- * \param[in] from_addr , to_addr the optional interval to be saved
- * \details from_addr and to_addr + 1 need to be on a word boundary
+ * \brief Saves a region of the firmware to a file
+ * \param[in] firmware the firmware
+ * \param[in] region the interval of addresses and the file
+ * \details from_addr and to_addr + 1 need to be on a word boundary,
+ *  except for raw binary files
+ * \return true on success, false otherwise
  */
-void save_RAM(
-    const char* filename, std::vector<unsigned char>& RAM,
-    int from_addr=0, int to_addr=-1
-) {
-    int l = strlen(filename);
-    if(l >= 3 && !strcmp(filename+l-3,"hex")) {
-	return save_RAM_hex(filename, RAM, from_addr, to_addr);
-    } 
-    if(l >= 3 && !strcmp(filename+l-3,"elf")) {
-	return save_RAM_bin(filename, RAM, from_addr, to_addr);
-    }
-    std::cerr << "save_RAM:" << filename
-	      << ": invalid extension" << std::endl;
-    exit(-1);
+bool save_region(Firmware& firmware, const Region& region) {
+    const char* filename = region.filename.c_str();
+    enum { HEX, BIN, FWB, RLE } format;
+    if(has_extension(filename,"hex")) {
+	format = HEX;
+    } else if(has_extension(filename,"bin")) {
+	format = BIN;
+    } else if(has_extension(filename,"fwb")) {
+	format = FWB;
+    } else if(has_extension(filename,"rle")) {
+	format = RLE;
+    } else {
+	std::cerr << "save_region:" << filename
+		  << ": invalid extension" << std::endl;
+	return false;
+    }
+
+    uint32_t from_addr = region.from_addr;
+    uint32_t size = region.to_addr + 1 - region.from_addr;
+
+    if(region.to_addr < region.from_addr) {
+	std::cerr << "save_region: to_addr is smaller than from_addr"
+		  << std::endl;
+	return false;
+    }
+    if(format != BIN && (from_addr & 3) != 0) {
+	std::cerr << "save_region:"
+		  << "from_addr needs to be on a word boundary"
+		  << std::endl;
+	return false;
+    }
+    if(format != BIN && (size & 3) != 0) {
+	std::cerr << "save_region:"
+		  << "(to_addr+1) needs to be on a word boundary"
+		  << std::endl;
+	return false;
+    }
+
+    const char* format_name[] = { "HEX", "BIN", "FWB", "RLE" };
+    std::cerr << "   SAVE " << format_name[format] << ": " << filename
+	      << std::endl;
+    printf("        from addr:0x%lx\n",(unsigned long)region.from_addr);
+    printf("          to addr:0x%lx\n",(unsigned long)region.to_addr);
+
+    FILE* f = fopen(filename,"wb");
+    if(f == nullptr) {
+	std::cerr << "Could not create " << filename << std::endl;
+	return false;
+    }
+
+    if(format == FWB || format == RLE) {
+	uint32_t header[3] = {
+	    format == FWB ? FWB_MAGIC : RLE_MAGIC, from_addr, size/4
+	};
+	fwrite(header, sizeof(uint32_t), 3, f);
+    }
+
+    RLEWriter rle;
+    rle.f = f;
+    std::vector<unsigned char> chunk(std::min(size, CHUNK_SIZE));
+    bool OK = true;
+    for(uint32_t offset = 0; offset < size; offset += CHUNK_SIZE) {
+	uint32_t chunk_size = std::min(size - offset, CHUNK_SIZE);
+	uint32_t addr = from_addr + offset;
+	if(!read_firmware(firmware, addr, chunk_size, chunk.data())) {
+	    OK = false;
+	    break;
+	}
+	switch(format) {
+	case HEX:
+	    write_chunk_hex(f, addr, chunk.data(), chunk_size);
+	    break;
+	case BIN:
+	case FWB:
+	    // the words are little-endian, as the bytes in memory
+	    fwrite(chunk.data(), 1, chunk_size, f);
+	    break;
+	case RLE:
+	    for(uint32_t i=0; i<chunk_size; i+=4) {
+		rle.put(
+		    uint32_t(chunk[i])          |
+		    uint32_t(chunk[i+1]) << 8   |
+		    uint32_t(chunk[i+2]) << 16  |
+		    uint32_t(chunk[i+3]) << 24
+		);
+	    }
+	    break;
+	}
+    }
+    if(format == RLE) {
+	rle.finish();
+	printf("       compressed:%ld bytes\n",ftell(f));
+    }
+    fclose(f);
+    return OK;
 }
 
 /****************************************************************/
@@ -328,7 +577,7 @@ void save_RAM(
  * \param[in] str the string to be parsed
  * \return the parsed integer
  * \details if the string starts with "0x", then the integer is
- *  considered to be hexadecimal, else it is considered to be 
+ *  considered to be hexadecimal, else it is considered to be
  *  decimal.
  */
 int parse_int(const char* str) {
@@ -350,30 +599,38 @@ int main(int argc, char** argv) {
     std::string in_filename;
     std::string in_verilog_filename;
     std::string out_filename;
+    std::vector<Region> regions;
     int from_addr = 0;
     int to_addr   = -1;
     int RAM_SIZE  = 0;
     int MAX_ADDR  = 0;
-   
+
     if(argc < 2) {
 	cmdline_error = true;
     } else {
 	in_filename = argv[1];
     }
-  
+
     for(int i=2; i<argc; i+=2) {
 	if(i+1 >= argc) {
 	    cmdline_error = true;
 	    break;
 	}
 	if(!strcmp(argv[i],"-verilog")) {
-	    in_verilog_filename = argv[i+1]; 
+	    in_verilog_filename = argv[i+1];
 	} else if(!strcmp(argv[i],"-out")) {
-	    out_filename = argv[i+1];       
+	    out_filename = argv[i+1];
 	} else if(!strcmp(argv[i],"-from_addr")) {
 	    from_addr = parse_int(argv[i+1]);
 	} else if(!strcmp(argv[i],"-to_addr")) {
 	    to_addr = parse_int(argv[i+1]);
+	} else if(!strcmp(argv[i],"-region") && i+3 < argc) {
+	    Region region;
+	    region.from_addr = parse_int(argv[i+1]);
+	    region.to_addr = parse_int(argv[i+2]);
+	    region.filename = argv[i+3];
+	    regions.push_back(region);
+	    i += 2;
 	} else if (!strcmp(argv[i],"-ram")) {
 	    RAM_SIZE = parse_int(argv[i+1]);
 	} else if (!strcmp(argv[i],"-max_addr")) {
@@ -386,18 +643,26 @@ int main(int argc, char** argv) {
 
     if(cmdline_error) {
 	std::cerr << "usage: " << argv[0]
-		  << " input.rawhex|input.elf <-out out.hex|out.bin>"
+		  << " input.rawhex|input.elf"
+		  << " <-out out.hex|out.bin|out.fwb|out.rle>"
 		  << " <-from_addr addr> <-to_addr addr>"
+		  << " <-region from_addr to_addr out> ..."
 		  << " <-ram ram_amount> <-max_addr max_address>"
 	          << " <-verilog femtosoc.v> "
 		  << std::endl;
-	std::cerr << "  -out out.hex|out.bin         :"
-		  << " VERILOG .hex for readmemh()"
-		  << " or plain binary file" << std::endl;
+	std::cerr << "  -out out.hex|bin|fwb|rle     :"
+		  << " VERILOG .hex for readmemh(),"
+		  << " plain binary file, binary words (.fwb)"
+		  << " or run-length compressed binary words (.rle)"
+		  << std::endl;
 	std::cerr << "  -from_addr addr -to_addr addr:"
 		  << " optional address sequence to be saved"
 		  << " (default: save whole RAM)"
 		  << std::endl;
+	std::cerr << "  -region from_addr to_addr out:"
+		  << " saves an address sequence to out (same formats"
+		  << " as -out), can be repeated"
+		  << std::endl;
 	std::cerr << "  -ram ram_size                :"
 		  << " specify RAM size explicity"
 		  << std::endl;
@@ -410,7 +675,7 @@ int main(int argc, char** argv) {
 		  << std::endl;
 	return 1;
     }
-  
+
     if(in_verilog_filename != "") {
 	std::cerr << "   CONFIG: parsing " << in_verilog_filename << std::endl;
 	RAM_SIZE = get_RAM_size_from_verilog(in_verilog_filename.c_str());
@@ -428,14 +693,13 @@ int main(int argc, char** argv) {
     }
 
     std::cerr << "   RAM SIZE=" << RAM_SIZE << std::endl;
-  
-    std::vector<unsigned char> RAM(RAM_SIZE,0);
 
-    int max_addr = load_RAM(in_filename.c_str(), RAM);
+    Firmware firmware;
+    int max_addr = load_RAM(in_filename.c_str(), RAM_SIZE, firmware);
     if(max_addr == -1) {
 	return 1;
     }
-  
+
     std::cout << "Code size: "
 	      << max_addr/4 << " words"
 	      << " ( total RAM size: "
@@ -444,7 +708,7 @@ int main(int argc, char** argv) {
 	      << std::endl;
 
     int occupancy = (max_addr*100) / RAM_SIZE;
-    
+
     std::cout << "Occupancy: " << occupancy << "%" << std::endl;
 
     if(occupancy > 95) {
@@ -452,7 +716,7 @@ int main(int argc, char** argv) {
                   << "RAM is almost full, program may crash if stack overflows"
                   << std::endl;
     }
-   
+
     if(MAX_ADDR != 0) {
 	std::cout << "testing MAX_ADDR limit: " << MAX_ADDR << std::endl;
 	if(max_addr > MAX_ADDR) {
@@ -462,10 +726,25 @@ int main(int argc, char** argv) {
 	    std::cout << "   max_addr OK" << std::endl;
 	}
     }
-   
+
     if(out_filename != "") {
-	save_RAM(out_filename.c_str(), RAM, from_addr, to_addr);
+	Region region;
+	region.filename = out_filename;
+	region.from_addr = from_addr;
+	region.to_addr = (to_addr == -1) ? RAM_SIZE-1 : to_addr;
+	regions.insert(regions.begin(), region);
+    }
+
+    int status = 0;
+    for(const Region& region: regions) {
+	if(!save_region(firmware, region)) {
+	    status = 1;
+	}
+    }
+
+    if(firmware.elf_file != nullptr) {
+	fclose(firmware.elf_file);
     }
-    
-    return 0;
+
+    return status;
 }
@@ -5,12 +5,16 @@
 `define NRV_FREQ 1
 
 
+// The processor can also be selected from the command line
+// (-DBENCH_PROCESSOR_SET -DNRV_FEMTORV32_XXX, see BENCH.trace_check)
+`ifndef BENCH_PROCESSOR_SET
 //`define NRV_FEMTORV32_QUARK       // RV32I (the most elementary femtorv)
 //`define NRV_FEMTORV32_ELECTRON    // RV32IM
 //`define NRV_FEMTORV32_INTERMISSUM // RV32IMzCSR
 //`define NRV_FEMTORV32_GRACILIS      // RV32IMCzCSR
 `define NRV_FEMTORV32_PETITBATEAU // WIP RF32F !!
 //`define NRV_FEMTORV32_TESTDRIVE
+`endif
 
 `define NRV_RESET_ADDR 0
 `define NRV_RAM 65536
@@ -44,6 +44,9 @@ localparam NRV_DEVICES = 0
 `ifdef NRV_IO_SDCARD
    | (1 << IO_SDCARD_bit) 			 			 
 `endif			    
+`ifdef NRV_IO_SDCARD_SPI
+   | (1 << IO_SDCARD_SPI_DAT_bit) | (1 << IO_SDCARD_SPI_CNTL_bit)
+`endif			    
 `ifdef NRV_IO_BUTTONS
    | (1 << IO_BUTTONS_bit) 			 			 			 
 `endif 
@@ -12,6 +12,8 @@ localparam IO_SDCARD_bit                = 8;  // RW write: bit 0: mosi  bit 1: c
 localparam IO_BUTTONS_bit               = 9;  // R  buttons state
 localparam IO_FGA_CNTL_bit              = 10; // RW write: send command  read: get VSync/HSync/MemBusy/X/Y state
 localparam IO_FGA_DAT_bit               = 11; // W  write: write pixel data
+localparam IO_SDCARD_SPI_DAT_bit        = 12; // RW write: push data to send (8/32 bits) read: pop received data (8/32 bits)
+localparam IO_SDCARD_SPI_CNTL_bit       = 13; // RW write: divider, word mode, discard read: busy, RX not empty, TX full, RX count
 
 // The three constant hardware config registers, using the three last bits of IO address space
 localparam IO_HW_CONFIG_RAM_bit     = 17;  // R  total quantity of RAM, in bytes
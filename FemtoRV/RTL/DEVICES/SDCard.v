@@ -1,18 +1,38 @@
 // femtorv32, a minimalistic RISC-V RV32I core
 //       Bruno Levy, 2020-2021
 //
-// This file: driver for SDCard (does nearly nothing,
-// for now it is just an interface for software bitbanging,
-// see FIRMWARE/LIBFEMTORV32/spi_sd.c)
+// This file: driver for SDCard
+//  - a register directly wired to the pins, for software bitbanging
+//    (see FIRMWARE/LIBFEMTORV32/spi_sd.c)
+//  - with NRV_IO_SDCARD_SPI, a SPI master (mode 0) with a 32 bits shift
+//    register, a clock divider and two small FIFOs, so that the software
+//    sends and receives bytes or words instead of toggling the pins.
 //
+// SPI master registers:
+//  DAT  write: pushes a byte (bits 7:0) or a word to the transmit FIFO
+//              (in word mode, the byte in bits 7:0 is sent first)
+//       read:  pops a byte or a word from the receive FIFO
+//              (in word mode, the first received byte is in bits 7:0)
+//  CNTL write: bits 7:0: clock divider, SPI clk = clk / (2*(divider+1))
+//              bit 8:    word mode (32 bits per transfer, else 8 bits)
+//              bit 9:    discard the received data (for writes)
+//       read:  bit 0:    busy (transmit FIFO not empty or transfer)
+//              bit 1:    receive FIFO not empty
+//              bit 2:    transmit FIFO full
+//              bits 6:4: number of entries in the receive FIFO
+// A transfer waits while the receive FIFO is full (unless the received
+// data is discarded). The pins register controls CS_N, and MOSI and CLK
+// when the SPI master is idle (keep MOSI high and CLK low).
 
 module SDCard(
-    input wire 	       clk,   // system clock
-    input wire 	       rstrb, // read strobe		
-    input wire 	       wstrb, // write strobe
-    input wire 	       sel,   // select (read/write ignored if low)
-    input wire [31:0]  wdata, // data to be written
-    output wire [31:0] rdata, // read data
+    input wire 	       clk,      // system clock
+    input wire 	       rstrb,    // read strobe
+    input wire 	       wstrb,    // write strobe
+    input wire 	       sel,      // select pins register
+    input wire 	       sel_dat,  // select SPI data register
+    input wire 	       sel_cntl, // select SPI control register
+    input wire [31:0]  wdata,    // data to be written
+    output wire [31:0] rdata,    // read data
 
     output wire        MOSI,
     input wire 	       MISO,
@@ -21,20 +41,146 @@ module SDCard(
 );
    reg [2:0] state; // CS_N,CLK,MOSI
 
-   assign CS_N = state[2];
-   assign CLK  = state[1];
-   assign MOSI = state[0];
-   
    initial begin
       state = 3'b100;
    end
-   
-   assign rdata = (sel ? {31'b0, MISO} : 32'b0);
-   
+
    always @(posedge clk) begin
       if(sel && wstrb) begin
 	 state <= wdata[2:0];
       end
    end
-   
+
+   assign CS_N = state[2];
+
+`ifdef NRV_IO_SDCARD_SPI
+
+   // Control register
+   reg [7:0] divider;
+   reg       word_mode;
+   reg       discard;
+   initial begin
+      divider   = 8'd255; // slow, for the initialization of the card
+      word_mode = 1'b0;
+      discard   = 1'b0;
+   end
+
+   always @(posedge clk) begin
+      if(sel_cntl && wstrb) begin
+	 divider   <= wdata[7:0];
+	 word_mode <= wdata[8];
+	 discard   <= wdata[9];
+      end
+   end
+
+   // The FIFOs (four entries each)
+   reg [31:0] tx_fifo[0:3];
+   reg [1:0]  tx_rd, tx_wr;
+   reg [2:0]  tx_count;
+   reg [31:0] rx_fifo[0:3];
+   reg [1:0]  rx_rd, rx_wr;
+   reg [2:0]  rx_count;
+   initial begin
+      tx_rd = 0; tx_wr = 0; tx_count = 0;
+      rx_rd = 0; rx_wr = 0; rx_count = 0;
+   end
+
+   // The shift registers
+   reg [31:0] shift_out;   // MSB is on MOSI
+   reg [31:0] shift_in;    // MISO enters the LSB
+   reg [5:0]  bitcount;    // 0 means idle
+   reg [7:0]  clk_count;
+   reg 	      sclk;
+   reg        cur_word_mode;
+   reg 	      cur_discard;
+   initial begin
+      bitcount = 0;
+      sclk = 1'b0;
+   end
+
+   wire sending = |bitcount;
+   wire tx_empty = (tx_count == 0);
+   wire tx_full  = (tx_count == 4);
+   wire rx_empty = (rx_count == 0);
+   wire rx_full  = (rx_count == 4);
+
+   wire tx_push = sel_dat && wstrb && !tx_full;
+   wire rx_pop  = sel_dat && rstrb && !rx_empty;
+   wire start   = !sending && !tx_empty && (discard || !rx_full);
+   wire done    = sending && (clk_count == 0) && sclk && (bitcount == 1);
+   wire rx_push = done && !cur_discard;
+
+   wire [31:0] tx_head = tx_fifo[tx_rd];
+
+   always @(posedge clk) begin
+      if(tx_push) begin
+	 tx_fifo[tx_wr] <= wdata;
+	 tx_wr <= tx_wr + 1;
+      end
+      if(start) begin
+	 tx_rd <= tx_rd + 1;
+      end
+      tx_count <= tx_count + {2'b0,tx_push} - {2'b0,start};
+   end
+
+   always @(posedge clk) begin
+      if(rx_push) begin
+	 rx_fifo[rx_wr] <= cur_word_mode ?
+			     {shift_in[7:0],  shift_in[15:8],
+			      shift_in[23:16],shift_in[31:24]} :
+			     {24'b0, shift_in[7:0]};
+	 rx_wr <= rx_wr + 1;
+      end
+      if(rx_pop) begin
+	 rx_rd <= rx_rd + 1;
+      end
+      rx_count <= rx_count + {2'b0,rx_push} - {2'b0,rx_pop};
+   end
+
+   always @(posedge clk) begin
+      if(start) begin
+	 shift_out <= word_mode ?
+			{tx_head[7:0],  tx_head[15:8],
+			 tx_head[23:16],tx_head[31:24]} :
+			{tx_head[7:0], 24'b0};
+	 bitcount  <= word_mode ? 6'd32 : 6'd8;
+	 clk_count <= divider;
+	 sclk      <= 1'b0;
+	 cur_word_mode <= word_mode;
+	 cur_discard   <= discard;
+      end else if(sending) begin
+	 if(clk_count == 0) begin
+	    clk_count <= divider;
+	    sclk <= !sclk;
+	    if(!sclk) begin
+	       // rising edge: the card samples MOSI, we sample MISO
+	       shift_in <= {shift_in[30:0], MISO};
+	    end else begin
+	       // falling edge: next bit
+	       shift_out <= {shift_out[30:0], 1'b1};
+	       bitcount  <= bitcount - 1;
+	    end
+	 end else begin
+	    clk_count <= clk_count - 1;
+	 end
+      end
+   end
+
+   assign CLK  = sending ? sclk : state[1];
+   assign MOSI = sending ? shift_out[31] : state[0];
+
+   assign rdata = sel      ? {31'b0, MISO} :
+		  sel_dat  ? rx_fifo[rx_rd] :
+		  sel_cntl ? {25'b0, rx_count, 1'b0, tx_full, !rx_empty,
+			      sending || !tx_empty} :
+		  32'b0;
+
+`else
+
+   assign CLK  = state[1];
+   assign MOSI = state[0];
+   assign rdata = (sel ? {31'b0, MISO} : 32'b0);
+
+`endif
+
 endmodule
@@ -6,9 +6,18 @@
 // Wrapper around modified Claire Wolf's UART
 
 `ifdef BENCH
+`ifndef BENCH_UART_PINS
+`define BENCH_FAKE_UART
+`endif
+`endif
+
+`ifdef BENCH_FAKE_UART
 
-// If BENCH is define, using a fake UART that displays
-// each sent character.
+// If BENCH is defined, using a fake UART.
+// With Verilator, bytes are exchanged with the C++ model of
+// the terminal (SIM/UART.h) through $c() calls. Otherwise,
+// displays each sent character.
+// (define BENCH_UART_PINS to use the real UART in the bench)
 module UART(
     input wire 	       clk,      // system clock
     input wire 	       rstrb,    // read strobe		
@@ -23,8 +32,28 @@ module UART(
 	    
     output reg 	       brk  // goes high one cycle when <ctrl><C> is pressed. 	    
 );
-   assign rdata = 32'b0;
    assign TXD   = 1'b0;
+`ifdef VERILATOR
+   reg [7:0] rx_data;
+   reg       rx_valid;
+   initial rx_valid = 1'b0;
+   assign rdata =   sel_dat  ? {22'b0, 1'b0, rx_valid, rx_data} 
+                  : sel_cntl ? {22'b0, 1'b0, rx_valid, 8'b0   } 
+                  : 32'b0;   
+   always @(posedge clk) begin
+      if(sel_dat && wstrb) begin
+	 $c("UART_tx(",wdata[7:0],");");
+      end
+      if((sel_dat && rstrb) || brk) begin
+	 rx_valid <= 1'b0;
+      end else if(!rx_valid && $c1("UART_rx_ready()")) begin
+	 rx_data  <= $c8("UART_rx()");
+	 rx_valid <= 1'b1;
+      end
+      brk <= rx_valid && (rx_data == 8'd3);
+   end
+`else
+   assign rdata = 32'b0;
    always @(posedge clk) begin
       if(sel_dat && wstrb) begin
 	 if(wdata == 32'd4) begin
@@ -35,6 +64,7 @@ module UART(
 	 $fflush(32'h8000_0001);
       end
    end
+`endif
 endmodule
 
 `else
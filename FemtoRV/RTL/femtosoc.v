@@ -18,7 +18,7 @@
 `include "DEVICES/MappedSPIFlash.v" // Idem, but mapped in memory
 `include "DEVICES/MAX7219.v"        // 8x8 led matrix driven by a MAX7219 chip
 `include "DEVICES/LEDs.v"           // Driver for 4 leds
-`include "DEVICES/SDCard.v"         // Driver for SDCard (just for bitbanging for now)
+`include "DEVICES/SDCard.v"         // Driver for SDCard (bitbanging and SPI master)
 `include "DEVICES/Buttons.v"        // Driver for the buttons
 `include "DEVICES/FGA.v"            // Femto Graphic Adapter
 `include "DEVICES/HardwareConfig.v" // Constant registers to query hardware config.
@@ -483,8 +483,8 @@ HardwareConfig hwconfig(
  * This one has an output register directly wired to the CLK,MOSI,CS_N
  * and an input register directly wired to MISO. The software driver
  * implements the SPI protocol by bit-banging (see FIRMWARE/LIBFEMTORV32/spi_sd.c).
- * One day I'll replace it with a hardware driver... if I have time !
- * ... a generic SPI driver would be good to have also.
+ * With NRV_IO_SDCARD_SPI, it also has a SPI master with FIFOs, used by
+ * the software driver when present (CS_N is still driven by bit-banging).
  */
 `ifdef NRV_IO_SDCARD
    wire [31:0] sdcard_rdata;
@@ -493,6 +493,8 @@ HardwareConfig hwconfig(
       .rstrb(io_rstrb),
       .wstrb(io_wstrb), 
       .sel(io_word_address[IO_SDCARD_bit]),
+      .sel_dat(io_word_address[IO_SDCARD_SPI_DAT_bit]),
+      .sel_cntl(io_word_address[IO_SDCARD_SPI_CNTL_bit]),
       .wdata(io_wdata),
       .rdata(sdcard_rdata),
       .CLK(sd_clk),
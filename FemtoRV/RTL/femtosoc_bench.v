@@ -29,20 +29,37 @@
 `ifdef VERILATOR
 module femtoRV32_bench(
     input pclk, 
-    output oled_DIN, oled_CLK, oled_CS, oled_DC, oled_RST
+    output oled_DIN, oled_CLK, oled_CS, oled_DC, oled_RST,
+    output TXD, input RXD,    // UART pins (used with BENCH_UART_PINS)
+    output reg [63:0] instret, // retired instructions (see SIM/sim_main.cpp)
+
+    // Execution trace (see SIM/Trace.h). Valid when pclk is low, that is,
+    // during the cycle, before the rising edge of the clock.
+    output        trace_retire,    // an instruction is in EXECUTE state
+    output [31:0] trace_PC,        // its address
+    output [31:0] trace_instr,     // the (decompressed) instruction
+    output        trace_wb,        // register write-back
+    output [5:0]  trace_rd,        // destination register (32-63: FP regs)
+    output [31:0] trace_wb_data,   // written value
+    output        trace_load,      // load
+    output        trace_store,     // store
+    output [31:0] trace_mem_addr,  // load/store address
+    output [31:0] trace_mem_wdata, // stored data
+    output [3:0]  trace_mem_wmask  // store mask
 );
 `else
 module femtoRV32_bench();
    reg pclk;
+   wire TXD;
+   wire RXD = 1'b1;
 `endif
 
    wire [4:0] LEDs;
 
-   wire TXD;
    femtosoc uut(
       .pclk(pclk),
       .TXD(TXD),
-      .RXD(1'b0),
+      .RXD(RXD),
       .RESET(1'b0),
 
 `ifdef NRV_IO_SSD1351_1331
@@ -60,6 +77,61 @@ module femtoRV32_bench();
    );
 
 
+`ifdef VERILATOR
+   // Counts retired instructions, so that sim_main.cpp can report the CPI.
+   // Each instruction goes exactly once through the EXECUTE state of the
+   // processor (EXECUTE1 for the tachyon), for a single cycle.
+   // Loads and stores are issued in the BENCH_MEM state, that is the
+   // same state except for the tachyon (EXECUTE2).
+ `ifdef NRV_FEMTORV32_PETITBATEAU
+   `define BENCH_EXECUTE_bit 3
+   `define BENCH_MEM_bit     3
+ `elsif NRV_FEMTORV32_TESTDRIVE
+   `define BENCH_EXECUTE_bit 3
+   `define BENCH_MEM_bit     3
+ `elsif NRV_FEMTORV32_TACHYON
+   `define BENCH_EXECUTE_bit 2
+   `define BENCH_MEM_bit     3
+ `else
+   `define BENCH_EXECUTE_bit 2
+   `define BENCH_MEM_bit     2
+ `endif
+   initial instret = 0;
+   always @(posedge uut.clk) begin
+      if(uut.processor.state[`BENCH_EXECUTE_bit]) begin
+	 instret <= instret + 1;
+      end
+   end
+
+   // Execution trace, observed from the processor and the memory bus.
+   // Note: write-back may happen in a later cycle than EXECUTE (loads,
+   // multi-cycle ALU and FPU operations), and so do loads and stores on
+   // the tachyon. sim_main.cpp attaches them to the last retired
+   // instruction. Loads are decoded from the instruction, because some
+   // cores (quark_bicycle) raise mem_rstrb for all non-store instructions.
+   wire trace_execute = uut.processor.state[`BENCH_EXECUTE_bit];
+   wire trace_mem     = uut.processor.state[`BENCH_MEM_bit];
+   assign trace_retire    = trace_execute;
+   /* verilator lint_off WIDTH */
+   assign trace_PC        = uut.processor.PC;
+   /* verilator lint_on WIDTH */
+   assign trace_instr     = {uut.processor.instr, 2'b11};
+   assign trace_wb        = uut.processor.writeBack;
+ `ifdef NRV_FEMTORV32_PETITBATEAU
+   assign trace_rd        = {uut.processor.rdIsFP, uut.processor.instr[11:7]};
+ `elsif NRV_FEMTORV32_TESTDRIVE
+   assign trace_rd        = {uut.processor.rdIsFP, uut.processor.instr[11:7]};
+ `else
+   assign trace_rd        = {1'b0, uut.processor.instr[11:7]};
+ `endif
+   assign trace_wb_data   = uut.processor.writeBackData;
+   assign trace_load      = trace_mem & uut.processor.isLoad;
+   assign trace_store     = trace_mem & uut.processor.isStore;
+   assign trace_mem_addr  = uut.mem_address;
+   assign trace_mem_wdata = uut.mem_wdata;
+   assign trace_mem_wmask = uut.mem_wmask;
+`endif
+
 `ifndef VERILATOR
    initial begin
       pclk = 0;
@@ -0,0 +1,150 @@
+#include "Cosim.h"
+#include <cstdio>
+
+Cosim::Cosim(const uint8_t* RAM, uint32_t RAM_size) : iss_(RAM_size) {
+  iss_.write_RAM(0, RAM, RAM_size);
+  iss_.set_IO_enabled(false);
+  started_ = false;
+  pending_ = false;
+  diverged_ = false;
+  nb_checked_ = 0;
+  nb_synced_ = 0;
+}
+
+/*
+ * \brief Tests whether the value written back by an instruction cannot
+ *  be predicted by the ISS (loads from the IO page, counter CSRs).
+ */
+bool Cosim::sync(const TraceRecord& iss) const {
+  if(iss.load && (iss.mem_addr & IO_BASE)) {
+    return true;
+  }
+  uint32_t opcode = iss.instr & 127;
+  uint32_t funct3 = (iss.instr >> 12) & 7;
+  if(opcode == 0x73 && funct3 != 0) {
+    uint32_t csr = iss.instr >> 20;
+    // cycle, time, instret and their high words, user and machine mode
+    switch(csr & 0xf7f) {
+    case 0xC00: case 0xC01: case 0xC02:
+    case 0xB00: case 0xB02:
+      return true;
+    }
+  }
+  return false;
+}
+
+void Cosim::check() {
+  if(diverged_) {
+    return;
+  }
+
+  // The ISS starts where the verilated processor executes its first
+  // instruction.
+  if(!started_) {
+    iss_.reset(rtl_.PC);
+    started_ = true;
+  }
+
+  // (what the ISS reports if it does not execute the instruction)
+  TraceRecord iss = rtl_;
+  iss.PC = iss_.PC();
+  iss.instr = 0;
+  iss.wb = false;
+  iss.store = false;
+
+  if(iss_.PC() != rtl_.PC) {
+    diverge("PC", iss);
+    return;
+  }
+
+  if(!iss_.step(&iss)) {
+    diverge(iss_.halt_reason(), iss);
+    return;
+  }
+
+  if(sync(iss) && rtl_.wb && iss.wb && rtl_.rd == iss.rd) {
+    if(rtl_.rd >= 32) {
+      iss_.set_FP_reg(rtl_.rd - 32, rtl_.wb_data);
+    } else {
+      iss_.set_reg(rtl_.rd, rtl_.wb_data);
+    }
+    iss.wb_data = rtl_.wb_data;
+    ++nb_synced_;
+  }
+
+  if(
+    rtl_.wb != iss.wb ||
+    (iss.wb && (rtl_.rd != iss.rd || rtl_.wb_data != iss.wb_data))
+  ) {
+    diverge("write-back", iss);
+    return;
+  }
+
+  if(rtl_.store != iss.store) {
+    diverge("store", iss);
+    return;
+  }
+
+  if(iss.store) {
+    // Only the written bytes are compared.
+    uint32_t mask = 0;
+    for(unsigned int i=0; i<4; ++i) {
+      if(iss.mem_wmask & (1u << i)) {
+	mask |= 255u << (8*i);
+      }
+    }
+    if(
+      (rtl_.mem_addr & ~3u) != (iss.mem_addr & ~3u) ||
+      rtl_.mem_wmask != iss.mem_wmask ||
+      (rtl_.mem_wdata & mask) != (iss.mem_wdata & mask)
+    ) {
+      diverge("store", iss);
+      return;
+    }
+  }
+
+  ++nb_checked_;
+  history_.push_back(rtl_);
+  if(history_.size() > HISTORY_SIZE) {
+    history_.pop_front();
+  }
+}
+
+void Cosim::print_record(const char* prefix, const TraceRecord& R) {
+  fprintf(stderr,"%s PC=%08x instr=%08x",prefix,R.PC,R.instr);
+  if(R.wb) {
+    if(R.rd >= 32) {
+      fprintf(stderr," f%d=%08x",int(R.rd)-32,R.wb_data);
+    } else {
+      fprintf(stderr," x%d=%08x",int(R.rd),R.wb_data);
+    }
+  }
+  if(R.store) {
+    fprintf(
+      stderr," store [%08x]=%08x mask=%x",R.mem_addr,R.mem_wdata,R.mem_wmask
+    );
+  }
+  fprintf(stderr,"\n");
+}
+
+void Cosim::diverge(const char* reason, const TraceRecord& iss) {
+  diverged_ = true;
+  fprintf(
+    stderr,"\n[cosim] divergence (%s) at cycle %llu, after %llu instructions\n",
+    reason, (unsigned long long)(rtl_.cycle),
+    (unsigned long long)(nb_checked_)
+  );
+  fprintf(stderr,"[cosim] last instructions:\n");
+  for(const TraceRecord& R: history_) {
+    print_record("           ",R);
+  }
+  print_record("[cosim] RTL",rtl_);
+  print_record("[cosim] ISS",iss);
+  fprintf(stderr,"[cosim] ISS registers:\n");
+  for(unsigned int i=0; i<32; ++i) {
+    fprintf(
+      stderr,"  x%-2d=%08x f%-2d=%08x%s",
+      i, iss_.reg(i), i, iss_.FP_reg(i), (i%4 == 3) ? "\n" : ""
+    );
+  }
+}
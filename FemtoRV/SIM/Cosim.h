@@ -0,0 +1,111 @@
+/*****************************************************************/
+#ifndef SIM_COSIM_H
+#define SIM_COSIM_H
+
+#include "ISS.h"
+#include "Trace.h"
+#include <stdint.h>
+#include <deque>
+
+// Lock-step co-simulation of the verilated processor with the
+// instruction set simulator (ISS.h) used as a reference model.
+//
+// The instructions executed by the verilated processor are reported like
+// for TraceWriter (the trace_xxx signals of RTL/femtosoc_bench.v). Each
+// of them is compared with the instruction executed by the ISS when it
+// is complete (at the next retire(), since write-back, and stores on the
+// tachyon, may happen after EXECUTE): PC, register write-back (FP
+// registers included) and stores.
+// The first divergence stops the comparison and prints the context
+// (last executed instructions and registers of the ISS).
+//
+// The IO page is not simulated by the ISS: the values read from the IO
+// page and from the counter CSRs (cycle, time, instret) are copied from
+// the verilated processor to the ISS.
+class Cosim {
+ public:
+   /**
+    * \brief Cosim constructor.
+    * \param[in] RAM the initial content of the RAM of the verilated SOC
+    * \param[in] RAM_size the size of the RAM in bytes
+    */
+   Cosim(const uint8_t* RAM, uint32_t RAM_size);
+
+   /**
+    * \brief An instruction is executed by the verilated processor.
+    */
+   void retire(uint64_t cycle, uint32_t PC, uint32_t instr) {
+      if(pending_) {
+	 check();
+      }
+      pending_ = true;
+      rtl_.cycle = cycle;
+      rtl_.PC = PC;
+      rtl_.instr = instr;
+      rtl_.wb = false;
+      rtl_.store = false;
+   }
+
+   /**
+    * \brief The current instruction writes a register.
+    * \details Can be called several times (the last value is kept).
+    */
+   void writeback(uint8_t rd, uint32_t data) {
+      if(rd == 0) {
+	 return;
+      }
+      rtl_.wb = true;
+      rtl_.rd = rd;
+      rtl_.wb_data = data;
+   }
+
+   void store(uint32_t addr, uint32_t wdata, uint8_t wmask) {
+      rtl_.store = true;
+      rtl_.mem_addr = addr;
+      rtl_.mem_wdata = wdata;
+      rtl_.mem_wmask = wmask;
+   }
+
+   /**
+    * \brief Tests whether a divergence was detected.
+    */
+   bool diverged() const {
+      return diverged_;
+   }
+
+   /**
+    * \brief Gets the number of compared instructions.
+    */
+   uint64_t nb_checked() const {
+      return nb_checked_;
+   }
+
+   /**
+    * \brief Gets the number of register values copied from the
+    *  verilated processor (IO page and counters).
+    */
+   uint64_t nb_synced() const {
+      return nb_synced_;
+   }
+
+ private:
+   void check();
+   bool sync(const TraceRecord& iss) const;
+   void diverge(const char* reason, const TraceRecord& iss);
+   static void print_record(const char* prefix, const TraceRecord& R);
+
+ private:
+   static const unsigned int HISTORY_SIZE = 16;
+   static const uint32_t IO_BASE = 0x400000;
+
+   ISS iss_;
+   bool started_;
+   bool pending_;
+   TraceRecord rtl_;
+   bool diverged_;
+   uint64_t nb_checked_;
+   uint64_t nb_synced_;
+   std::deque<TraceRecord> history_;
+};
+
+#endif
@@ -0,0 +1,156 @@
+#include "ElfSymbols.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+/* Borrowed from /usr/include/elf.h of a Linux system (see also femto_elf.c) */
+
+typedef struct {
+  unsigned char e_ident[16];
+  uint16_t      e_type;
+  uint16_t      e_machine;
+  uint32_t      e_version;
+  uint32_t      e_entry;
+  uint32_t      e_phoff;
+  uint32_t      e_shoff;
+  uint32_t      e_flags;
+  uint16_t      e_ehsize;
+  uint16_t      e_phentsize;
+  uint16_t      e_phnum;
+  uint16_t      e_shentsize;
+  uint16_t      e_shnum;
+  uint16_t      e_shstrndx;
+} Elf32_Ehdr;
+
+typedef struct {
+  uint32_t sh_name;
+  uint32_t sh_type;
+  uint32_t sh_flags;
+  uint32_t sh_addr;
+  uint32_t sh_offset;
+  uint32_t sh_size;
+  uint32_t sh_link;
+  uint32_t sh_info;
+  uint32_t sh_addralign;
+  uint32_t sh_entsize;
+} Elf32_Shdr;
+
+typedef struct {
+  uint32_t      st_name;
+  uint32_t      st_value;
+  uint32_t      st_size;
+  unsigned char st_info;
+  unsigned char st_other;
+  uint16_t      st_shndx;
+} Elf32_Sym;
+
+#define SHT_SYMTAB     2
+#define SHF_EXECINSTR  4
+#define STT_NOTYPE     0
+#define STT_FUNC       2
+#define ELF32_ST_TYPE(i) ((i) & 0xf)
+
+static bool read_at(FILE* f, uint32_t offset, void* data, size_t size) {
+  return fseek(f, long(offset), SEEK_SET) == 0 &&
+         fread(data, 1, size, f) == size;
+}
+
+bool ElfSymbols::load(const char* filename) {
+  symbols_.clear();
+  FILE* f = fopen(filename, "rb");
+  if(f == nullptr) {
+    return false;
+  }
+
+  Elf32_Ehdr elf_header;
+  if(
+    !read_at(f, 0, &elf_header, sizeof(elf_header)) ||
+    memcmp(elf_header.e_ident, "\177ELF", 4) != 0 ||
+    elf_header.e_ident[4] != 1 /* ELFCLASS32 */ ||
+    elf_header.e_shentsize != sizeof(Elf32_Shdr)
+  ) {
+    fclose(f);
+    return false;
+  }
+
+  std::vector<Elf32_Shdr> sections(elf_header.e_shnum);
+  if(!read_at(
+      f, elf_header.e_shoff, sections.data(),
+      sections.size() * sizeof(Elf32_Shdr)
+  )) {
+    fclose(f);
+    return false;
+  }
+
+  for(const Elf32_Shdr& symtab: sections) {
+    if(symtab.sh_type != SHT_SYMTAB || symtab.sh_link >= sections.size()) {
+      continue;
+    }
+    const Elf32_Shdr& strtab = sections[symtab.sh_link];
+    std::vector<Elf32_Sym> syms(symtab.sh_size / sizeof(Elf32_Sym));
+    std::vector<char> strings(strtab.sh_size + 1, '\0');
+    if(
+      !read_at(f, symtab.sh_offset, syms.data(), syms.size()*sizeof(Elf32_Sym)) ||
+      !read_at(f, strtab.sh_offset, strings.data(), strtab.sh_size)
+    ) {
+      fclose(f);
+      return false;
+    }
+    for(const Elf32_Sym& sym: syms) {
+      unsigned int type = ELF32_ST_TYPE(sym.st_info);
+      bool in_code =
+	sym.st_shndx != 0 && sym.st_shndx < sections.size() &&
+	(sections[sym.st_shndx].sh_flags & SHF_EXECINSTR) != 0;
+      if(sym.st_name >= strtab.sh_size) {
+	continue;
+      }
+      const char* name = strings.data() + sym.st_name;
+      // Skip local labels generated by the assembler (.L...)
+      if(name[0] == '\0' || (name[0] == '.' && name[1] == 'L')) {
+	continue;
+      }
+      if(type == STT_FUNC || (type == STT_NOTYPE && in_code)) {
+	Symbol S;
+	S.address = sym.st_value;
+	S.size = sym.st_size;
+	S.name = name;
+	symbols_.push_back(S);
+      }
+    }
+  }
+  fclose(f);
+
+  std::sort(
+    symbols_.begin(), symbols_.end(),
+    [](const Symbol& A, const Symbol& B) {
+      // For the symbols at the same address, functions (size != 0) first
+      return (A.address < B.address) ||
+	     (A.address == B.address && A.size > B.size);
+    }
+  );
+  // Keep only one symbol per address
+  symbols_.erase(
+    std::unique(
+      symbols_.begin(), symbols_.end(),
+      [](const Symbol& A, const Symbol& B) { return A.address == B.address; }
+    ),
+    symbols_.end()
+  );
+  return true;
+}
+
+int ElfSymbols::find(uint32_t address) const {
+  // Last symbol with symbol.address <= address
+  auto it = std::upper_bound(
+    symbols_.begin(), symbols_.end(), address,
+    [](uint32_t addr, const Symbol& S) { return addr < S.address; }
+  );
+  if(it == symbols_.begin()) {
+    return -1;
+  }
+  --it;
+  if(it->size != 0 && address >= it->address + it->size) {
+    return -1;
+  }
+  return int(it - symbols_.begin());
+}
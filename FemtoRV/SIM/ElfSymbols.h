@@ -0,0 +1,54 @@
+/*****************************************************************/
+#ifndef SIM_ELF_SYMBOLS_H
+#define SIM_ELF_SYMBOLS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The function symbols of an ELF32 executable, used to map
+// addresses to function names (see Profiler.h).
+class ElfSymbols {
+ public:
+
+   struct Symbol {
+      uint32_t    address;
+      uint32_t    size;     // 0 if unknown (assembly labels)
+      std::string name;
+   };
+
+   /**
+    * \brief Reads the symbol table of an ELF32 executable.
+    * \details Keeps the functions, and the labels that are in
+    *  executable sections.
+    * \param[in] filename the name of the ELF file
+    * \return true on success, false otherwise
+    */
+   bool load(const char* filename);
+
+   /**
+    * \brief Finds the function that contains an address.
+    * \return the index of the function, or -1 if not found
+    */
+   int find(uint32_t address) const;
+
+   unsigned int nb_symbols() const {
+      return (unsigned int)(symbols_.size());
+   }
+
+   const Symbol& symbol(unsigned int i) const {
+      return symbols_[i];
+   }
+
+   /**
+    * \brief Gets the name of a symbol, or "??" if i is -1.
+    */
+   const char* name(int i) const {
+      return (i < 0) ? "??" : symbols_[size_t(i)].name.c_str();
+   }
+
+ private:
+   std::vector<Symbol> symbols_; // sorted by address
+};
+
+#endif
@@ -2,52 +2,136 @@
 #include "FPU_funcs.h"
 #include <cstdio>
 #include <cmath>
-#include <set>
-#include <vector>
 #include <algorithm>
-#include <iostream>
 #include <cstring>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#ifdef __FMA__
+#include <immintrin.h>
+#endif
 /*********************************************/
 
+// Define FPU_NO_LOG to remove the counters
+#ifndef FPU_NO_LOG
 #define FPU_LOG
+#endif
 
 #ifdef FPU_LOG
 
-// Records the calls to FPU functions
-// and displays the list on exit.
+// Counts the calls to FPU functions, the classes of their operands and
+// the mismatches detected by the CHECK_XXX() functions, and displays
+// them on exit.
 // To display log from firmware code, 
 // send '<ctrl><D>' to UART to exit simulation:
 //  UART_putchar(4); 
 
 class FPULogger {
 public:
-  void log(const char* p) {
-    funcs_.insert(std::string(p));
+  enum OperandClass {
+    OPERAND_ZERO, OPERAND_DENORMAL, OPERAND_NORMAL, OPERAND_INFTY, OPERAND_NAN,
+    OPERAND_NB
+  };
+
+  FPULogger() {
+    memset(calls_, 0, sizeof(calls_));
+    memset(operands_, 0, sizeof(operands_));
+    memset(mismatches_, 0, sizeof(mismatches_));
+  }
+  
+  void log(FPUFunc f) {
+    ++calls_[f];
+  }
+
+  void log_operand(FPUFunc f, uint32_t x) {
+    ++operands_[f][operand_class(x)];
+  }
+
+  void log_mismatch(FPUFunc f) {
+    ++mismatches_[f];
   }
+  
   ~FPULogger() {
-    std::vector<std::string> v;
-    for(auto i: funcs_) {
-      v.push_back(i);
+    bool called = false;
+    for(int f=0; f<FPU_FUNC_NB; ++f) {
+      called = called || (calls_[f] != 0);
     }
-    std::sort(v.begin(), v.end());
-     std::cout << std::endl 
-               << "FPU funcs called:" 
-               << std::endl;
-    for(auto i: v) {
-      std::cout << i << std::endl;
+    if(!called) {
+      return;
+    }
+    printf("\nFPU funcs called:\n");
+    printf(
+      "%-8s %12s %12s %12s %12s %12s %12s %10s\n",
+      "func","calls","zero","denormal","normal","infty","NaN","mismatches"
+    );
+    for(int f=0; f<FPU_FUNC_NB; ++f) {
+      if(calls_[f] == 0) {
+        continue;
+      }
+      printf(
+        "%-8s %12llu",FPU_func_name(FPUFunc(f)),(unsigned long long)(calls_[f])
+      );
+      for(int c=0; c<OPERAND_NB; ++c) {
+        printf(" %12llu",(unsigned long long)(operands_[f][c]));
+      }
+      printf(" %10llu\n",(unsigned long long)(mismatches_[f]));
     }
   }
+  
 private:
-  std::set<std::string> funcs_;
+  static OperandClass operand_class(uint32_t x) {
+    uint32_t exp  = (x >> 23) & 255;
+    uint32_t mant = x & 0x7fffff;
+    if(exp == 0) {
+      return (mant == 0) ? OPERAND_ZERO : OPERAND_DENORMAL;
+    }
+    if(exp == 255) {
+      return (mant == 0) ? OPERAND_INFTY : OPERAND_NAN;
+    }
+    return OPERAND_NORMAL;
+  }
+  
+  uint64_t calls_[FPU_FUNC_NB];
+  uint64_t operands_[FPU_FUNC_NB][OPERAND_NB];
+  uint64_t mismatches_[FPU_FUNC_NB];
 };
 
 FPULogger logger;
-inline void L(const char* s) {
-  logger.log(s);
+
+// L(func,operands...): counts a call (the operands are the floating point
+// operands, the integer operands are not counted)
+inline void L(FPUFunc f) {
+  logger.log(f);
+}
+
+inline void L(FPUFunc f, uint32_t x) {
+  logger.log(f);
+  logger.log_operand(f,x);
+}
+
+inline void L(FPUFunc f, uint32_t x, uint32_t y) {
+  logger.log(f);
+  logger.log_operand(f,x);
+  logger.log_operand(f,y);
+}
+
+inline void L(FPUFunc f, uint32_t x, uint32_t y, uint32_t z) {
+  logger.log(f);
+  logger.log_operand(f,x);
+  logger.log_operand(f,y);
+  logger.log_operand(f,z);
+}
+
+// M(func,check(...)): counts a mismatch (check() returns 0)
+inline uint32_t M(FPUFunc f, uint32_t ok) {
+  if(!ok) {
+    logger.log_mismatch(f);
+  }
+  return ok;
 }
 
 #else
-#define L(x)
+#define L(...)
+#define M(f,ok) (ok)
 #endif
 
 /*********************************************/
@@ -62,26 +146,12 @@ inline int test_bit(uint32_t x, int i) {
 
 // Count leading zeroes
 inline int clz(uint32_t x) {
-  int result = 0;
-  for(int i=31; i>=0; --i) {
-    if(test_bit(x,i)) {
-      return result;
-    }
-    ++result;
-  }
-  return result;
+  return (x == 0) ? 32 : __builtin_clz(x);
 }
 
 // Count leading zeroes
 inline int clz(uint64_t x) {
-  int result = 0;
-  for(int i=63; i>=0; --i) {
-    if(test_bit(x,i)) {
-      return result;
-    }
-    ++result;    
-  }
-  return result;
+  return (x == 0) ? 64 : __builtin_clzll(x);
 }
 
 
@@ -229,6 +299,55 @@ int32_t compress(uint32_t mant, int exp, int sign) {
 }
 
 
+/*********************************************/
+
+// Configuration of the simulated FPU (see FPU_set_config())
+static FPUConfig FPU_config_;
+
+// Shifts mant right by shift bits, with rounding
+// (sign: the sign of the number, for FPU_RDN and FPU_RUP)
+inline uint64_t shift_round(
+  uint64_t mant, int shift, int sign, FPURoundingMode rounding
+) {
+  if(shift <= 0) {
+    return mant << -shift;
+  }
+  uint64_t kept;
+  bool guard;  // first lost bit
+  bool sticky; // OR of the other lost bits
+  if(shift > 64) {
+    kept = 0;
+    guard = false;
+    sticky = (mant != 0);
+  } else if(shift == 64) {
+    kept = 0;
+    guard = test_bit(mant,63);
+    sticky = (mant << 1) != 0;
+  } else {
+    kept = mant >> shift;
+    guard = test_bit(mant,shift-1);
+    sticky = (mant & ((uint64_t(1) << (shift-1)) - 1)) != 0;
+  }
+  bool incr = false;
+  switch(rounding) {
+  case FPU_RNE: incr = guard && (sticky || (kept & 1)); break;
+  case FPU_RTZ: incr = false;                           break;
+  case FPU_RDN: incr = sign && (guard || sticky);       break;
+  case FPU_RUP: incr = !sign && (guard || sticky);      break;
+  case FPU_RMM: incr = guard;                           break;
+  }
+  return kept + (incr ? 1 : 0);
+}
+
+// The result of an overflow: infinity or the largest finite number,
+// depending on the rounding mode
+inline uint32_t overflow_result(int sign, FPURoundingMode rounding) {
+  bool infty =
+    rounding == FPU_RNE || rounding == FPU_RMM ||
+    (rounding == FPU_RDN && sign) || (rounding == FPU_RUP && !sign);
+  return (uint32_t(sign) << 31) | (infty ? 0x7f800000 : 0x7f7fffff);
+}
+
 /*********************************************/
 
 uint32_t check(
@@ -280,6 +399,14 @@ uint32_t check(
 // completely in VERILOG.
 class FPU {
 public:
+  // config: rounding mode, gradual underflow and guard bits
+  // log_overflow: displays a message when the exponent overflows
+  // (off for the bulk evaluation, see FPU_soft_bulk())
+  FPU(const FPUConfig& config = FPU_config_, bool log_overflow = true) :
+    config_(config),
+    log_overflow_(log_overflow) {
+  }
+  
   int32_t result() const {
     return compress(uint32_t(A_mant), A_exp, A_sign);
   }
@@ -290,15 +417,15 @@ public:
     uint64_t rs1_mant;
     int      rs1_exp; 
     int      rs1_sign;
-    expand(rs1, rs1_mant, rs1_exp, rs1_sign);
+    unpack(rs1, rs1_mant, rs1_exp, rs1_sign);
 
     uint64_t rs2_mant;
     int      rs2_exp; 
     int      rs2_sign;
-    expand(rs2, rs2_mant, rs2_exp, rs2_sign);
+    unpack(rs2, rs2_mant, rs2_exp, rs2_sign);
     
-    A_mant = rs1_mant*rs2_mant;
-    A_exp  = rs1_exp+rs2_exp-127-23;
+    A_mant = (rs1_mant*rs2_mant) << guard_bits();
+    A_exp  = rs1_exp+rs2_exp-127-23-guard_bits();
     A_sign = rs1_sign ^ rs2_sign;
   }
 
@@ -306,9 +433,9 @@ public:
   // B <- rs3
   // (does not normalize)
   void LOAD_B(uint32_t rs3, bool ch_A_sign, bool ch_B_sign) {
-    expand(rs3, B_mant, B_exp, B_sign);
-    B_mant = B_mant << 24;
-    B_exp -= 24;
+    unpack(rs3, B_mant, B_exp, B_sign);
+    B_mant = B_mant << (24+guard_bits());
+    B_exp -= 24+guard_bits();
     if(ch_A_sign) {
       A_sign = !A_sign;
     }
@@ -319,18 +446,18 @@ public:
   
   // Normalize A 
   void NORM() {
-    normalize23(A_mant, A_exp);
+    normalize23(A_mant, A_exp, A_sign);
   }
 
   // A <= rs1; B <=  rs2 (if !sub)
   // A <= rs1; B <= -rs2 (if  sub)
   void LOAD_AB(uint32_t rs1, uint32_t rs2, bool sub) {
-    expand(rs1, A_mant, A_exp, A_sign);
-    expand(rs2, B_mant, B_exp, B_sign);
-    A_mant = A_mant << 24;
-    A_exp -= 24;
-    B_mant = B_mant << 24;
-    B_exp -= 24;
+    unpack(rs1, A_mant, A_exp, A_sign);
+    unpack(rs2, B_mant, B_exp, B_sign);
+    A_mant = A_mant << (24+guard_bits());
+    A_exp -= 24+guard_bits();
+    B_mant = B_mant << (24+guard_bits());
+    B_exp -= 24+guard_bits();
     if(sub) { B_sign = !B_sign; }
   }
 
@@ -360,12 +487,18 @@ public:
 
   // Normalize operands magnitude by shifting A
   void ADD_SHIFT() {
-    if(B_exp - A_exp > 47) {
+    uint64_t lost;
+    if(B_exp - A_exp > 63) {
+      lost = A_mant;
       A_mant=0;
-      A_exp = B_exp;
     } else {
+      lost = A_mant & ((uint64_t(1) << (B_exp - A_exp)) - 1);
       A_mant = A_mant >> (B_exp - A_exp);
-      A_exp  = B_exp;
+    }
+    // Sticky bit: the lost bits are summarized in the LSB of A
+    // (far below the rounding position)
+    if(config_.guard_bits && lost != 0) {
+      A_mant |= 1;
     }
     A_exp = B_exp;
   }
@@ -376,7 +509,9 @@ public:
     //    - Once they are shifted, the order between A and B may change.
     //    - Can it happen with FADD/FSUB ? 
     A_mant = (A_sign ^ B_sign) ? B_mant - A_mant : B_mant + A_mant;
-    A_sign = (A_mant == 0) ? A_sign && B_sign : B_sign;
+    // exact zero: +0, or -0 if both are negative or if rounding down
+    A_sign = (A_mant == 0) ?
+      ((A_sign == B_sign) ? A_sign : (config_.rounding == FPU_RDN)) : B_sign;
   }
   
 
@@ -397,48 +532,84 @@ public:
   }
 
 
-void normalize23(uint64_t& mant, int& exp) {
+// Normalizes and rounds (mant,exp) to a 24 bits mantissa (bit 23 set
+// for normal numbers)
+void normalize23(uint64_t& mant, int& exp, int sign) {
 
-  if(exp < -255 || exp > 255) {
+  if(log_overflow_ && (exp < -255 || exp > 255)) {
     printf("EXP OVERFLOW !!\n");
   }
   
   int first_bit_set = 63-clz(mant);
   if(first_bit_set == -1) {
     exp = 0;
-  } else {
+    return;
+  }
     
-    // Note: possible optimization for MUL
-    // without denormals and MUL,
-    // first_bit_set = 46 or 47, always
-
-    if(exp+first_bit_set-23 > 0) {
-      exp += (first_bit_set-23);    
-      if(first_bit_set > 23) {
-	mant = mant >> (first_bit_set-23);
-      } else {
-	// Happens sometimes with MADD. TODO: Can it happen with ADD ?
-	mant = mant << (23-first_bit_set);
-      }
-    } else {
-      // Flush all denormals to zero (for now)
-      // See sim_main.cpp
+  // Note: possible optimization for MUL
+  // without denormals and MUL,
+  // first_bit_set = 46 or 47, always
+
+  int shift = first_bit_set-23;
+  exp += shift;
+  if(exp <= 0) {
+    if(!config_.denormals) {
+      // Flush denormals to zero
       mant = 0;
       exp  = 0;
-      
-      // TODO: handle denormals properly
-      //   (mismatch triggered by tinyraytracer)
-      // log("DENORM1");
-      // mant = mant >> (128-exp); // 128-exp or 129-exp I don't know
-      // exp  = 0;      
-      // log("DENORM2");      
-      // mant = 0;
+      return;
+    }
+    // Denormal: exponent of the smallest normal numbers, without the
+    // implicit 1
+    shift += 1-exp;
+    exp = 1;
+  }
+
+  if(shift > 0) {
+    mant = shift_round(mant, shift, sign, config_.rounding);
+    // rounding up may carry to the next power of two
+    if(test_bit(mant,24)) {
+      mant = mant >> 1;
+      ++exp;
     }
+  } else {
+    // Happens sometimes with MADD. TODO: Can it happen with ADD ?
+    mant = mant << -shift;
   }
 
+  if(!test_bit(mant,23)) {
+    // denormal (that was not rounded up to the smallest normal number)
+    exp = 0;
+  } else if(exp >= 255) {
+    uint32_t overflow = overflow_result(sign, config_.rounding);
+    mant = overflow & 0x7fffff;
+    exp  = (overflow >> 23) & 255;
+  }
 }
+
+  // Number of guard bits below the mantissas of the operands (at most 8,
+  // the product of two mantissas has 48 bits)
+  int guard_bits() const {
+    return config_.guard_bits ? 8 : 0;
+  }
+  
+  // Gets the mantissa, exponent and sign of an operand. With gradual
+  // underflow, denormals are normalized (bit 23 set, exponent below the
+  // one of the smallest normal numbers, expand() gives them exponent 0),
+  // so that the exponents can be compared.
+  void unpack(uint32_t x, uint64_t& mant, int& exp, int& sign) const {
+    expand(x, mant, exp, sign);
+    if(config_.denormals && exp == 0 && mant != 0) {
+      int shift = clz(mant) - (63-23);
+      mant = mant << shift;
+      exp = 1 - shift;
+    }
+  }
   
 private:
+  FPUConfig config_;
+  bool log_overflow_;
+  
   // Accumulator and shifter
   uint64_t A_mant;
   int      A_exp;
@@ -453,10 +624,211 @@ private:
 
 /********************************************************************************/
 
-uint32_t FMADD_WITH_SOFT_FPU(uint32_t x, uint32_t y, uint32_t z) {
-  FPU fpu;
+// The FPU of the host computes in double precision (round to nearest),
+// with an exact error term. The result is rounded in software to single
+// precision, with the rounding mode and underflow mode of FPU_config_.
+
+// Rounds s+err to single precision. err is the rounding error of s,
+// only its sign is used (it is much smaller than one ulp of s, and the
+// results of single precision operations are normal doubles).
+static uint32_t round_to_float(double s, double err) {
+  uint64_t bits;
+  memcpy(&bits, &s, sizeof(bits));
+  int sign = int(bits >> 63);
+  int exp  = int((bits >> 52) & 2047);
+  uint64_t mant = bits & ((uint64_t(1) << 52) - 1);
+
+  if(exp == 2047) {
+    // canonical NaN (RISC-V) or infinity
+    return (mant != 0) ? 0x7fc00000 : ((uint32_t(sign) << 31) | 0x7f800000);
+  }
+  if(exp == 0) {
+    return uint32_t(sign) << 31;
+  }
+
+  // Magnitude, with two more bits that encode the error (the rounding
+  // boundaries of single precision are multiples of one ulp of s)
+  mant = ((mant | (uint64_t(1) << 52)) << 2);
+  if(err != 0.0) {
+    bool larger = (err > 0.0) != (sign != 0);
+    mant = larger ? mant + 1 : mant - 1;
+    if(mant < (uint64_t(1) << 54)) {
+      // s is a power of two and s+err is just below it: one more bit
+      mant = (mant << 1) | 1;
+      --exp;
+    }
+  }
+
+  int float_exp = exp - 1023 + 127;
+  int shift = 52 - 23 + 2;
+  if(float_exp <= 0) {
+    if(!FPU_config_.denormals) {
+      // flushed if tiny after rounding (as the x86 FPUs): rounded to the
+      // precision of normal numbers, it may become the smallest normal
+      if(float_exp == 0 &&
+         test_bit(shift_round(mant, shift, sign, FPU_config_.rounding),24)) {
+        return (uint32_t(sign) << 31) | 0x00800000;
+      }
+      return uint32_t(sign) << 31;
+    }
+    shift += 1 - float_exp;
+    float_exp = 0;
+  }
+  
+  mant = shift_round(mant, shift, sign, FPU_config_.rounding);
+  
+  if(float_exp == 0) {
+    // denormal, or smallest normal number if rounded up
+    return (uint32_t(sign) << 31) | uint32_t(mant);
+  }
+  if(test_bit(mant,24)) {
+    mant = mant >> 1;
+    ++float_exp;
+  }
+  if(float_exp >= 255) {
+    return overflow_result(sign, FPU_config_.rounding);
+  }
+  return (uint32_t(sign) << 31) | (uint32_t(float_exp) << 23) |
+         (uint32_t(mant) & 0x7fffff);
+}
+
+// Returns a+b rounded to single precision (a and b are single precision
+// numbers or exact products of them)
+static uint32_t host_sum(double a, double b) {
+  // TwoSum: s+err = a+b exactly
+  double s = a + b;
+  double bb = s - a;
+  double err = (a - (s - bb)) + (b - bb);
+  if(!std::isfinite(s)) {
+    err = 0.0;
+  } else if(s == 0.0 && std::signbit(a) != std::signbit(b)) {
+    // exact zero, +0 except when rounding down
+    s = (FPU_config_.rounding == FPU_RDN) ? -0.0 : 0.0;
+  }
+  return round_to_float(s, err);
+}
+
+uint32_t FADD_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  return host_sum(decodef(x), decodef(y));
+}
+
+uint32_t FSUB_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  return host_sum(decodef(x), -double(decodef(y)));
+}
+
+uint32_t FMUL_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  // exact in double precision
+  return round_to_float(double(decodef(x)) * double(decodef(y)), 0.0);
+}
+
+// (the products are exact in double precision)
+uint32_t FMADD_WITH_HOST_FPU(uint32_t x, uint32_t y, uint32_t z) {
+  return host_sum(double(decodef(x)) * double(decodef(y)), decodef(z));
+}
+
+uint32_t FMSUB_WITH_HOST_FPU(uint32_t x, uint32_t y, uint32_t z) {
+  return host_sum(double(decodef(x)) * double(decodef(y)), -double(decodef(z)));
+}
+
+uint32_t FNMADD_WITH_HOST_FPU(uint32_t x, uint32_t y, uint32_t z) {
+  return host_sum(-double(decodef(x)) * double(decodef(y)), -double(decodef(z)));
+}
+
+uint32_t FNMSUB_WITH_HOST_FPU(uint32_t x, uint32_t y, uint32_t z) {
+  return host_sum(-double(decodef(x)) * double(decodef(y)), decodef(z));
+}
+
+uint32_t FDIV_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  double a = decodef(x);
+  double b = decodef(y);
+  double q = a / b;
+  double err = 0.0;
+  if(std::isfinite(q) && q != 0.0) {
+    // the remainder is exact, a/b-q has the sign of r/b
+    double r = std::fma(-q, b, a);
+    if(r != 0.0) {
+      err = (std::signbit(r) == std::signbit(b)) ? 1.0 : -1.0;
+    }
+  }
+  return round_to_float(q, err);
+}
+
+uint32_t FSQRT_WITH_HOST_FPU(uint32_t x) {
+  double a = decodef(x);
+  double q = std::sqrt(a);
+  double err = 0.0;
+  if(std::isfinite(q) && q > 0.0) {
+    // the remainder a-q*q is exact
+    err = std::fma(-q, q, a);
+  }
+  return round_to_float(q, err);
+}
+
+uint32_t FCVTSW_WITH_HOST_FPU(uint32_t x) {
+  return round_to_float(double(int32_t(x)), 0.0);
+}
+
+uint32_t FCVTSWU_WITH_HOST_FPU(uint32_t x) {
+  return round_to_float(double(x), 0.0);
+}
+
+uint32_t FSGNJ_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  IEEE754 X(x), Y(y);
+  X.sign = Y.sign;
+  return X.i;
+}
+
+uint32_t FSGNJN_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  IEEE754 X(x),Y(y);
+  X.sign = !Y.sign;
+  return X.i;
+}
+
+uint32_t FSGNJX_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  IEEE754 X(x),Y(y);
+  X.sign = X.sign ^ Y.sign;
+  return X.i;
+}
+
+uint32_t FMIN_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  return encodef(fminf(decodef(x),decodef(y)));
+}
+
+uint32_t FMAX_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  return encodef(fmaxf(decodef(x),decodef(y)));  
+}
+
+uint32_t FCVTWS_WITH_HOST_FPU(uint32_t x) {
+  return uint32_t(int32_t(decodef(x)));
+}
+
+uint32_t FCVTWUS_WITH_HOST_FPU(uint32_t x) {
+  return uint32_t(decodef(x));
+}
+
+uint32_t FEQ_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  return uint32_t(decodef(x) == decodef(y));
+}
+
+uint32_t FLT_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  return uint32_t(decodef(x) < decodef(y));
+}
+
+uint32_t FLE_WITH_HOST_FPU(uint32_t x, uint32_t y) {
+  return uint32_t(decodef(x) <= decodef(y));
+}
+
+/********************************************************************************/
+
+// The microprograms of the FPU, shared by the XXX_WITH_SOFT_FPU() functions
+// and by the bulk evaluation.
+
+// FMADD, FMSUB, FNMADD, FNMSUB
+inline uint32_t FPU_MADD(
+  FPU& fpu, uint32_t x, uint32_t y, uint32_t z, bool ch_A_sign, bool ch_B_sign
+) {
   fpu.MUL(x,y);
-  fpu.LOAD_B(z,false,false);
+  fpu.LOAD_B(z,ch_A_sign,ch_B_sign);
   if(fpu.ADD_SWP_EXP()) {
     fpu.ADD_SHIFT();
     fpu.ADD_SWP_FRAC();
@@ -466,72 +838,56 @@ uint32_t FMADD_WITH_SOFT_FPU(uint32_t x, uint32_t y, uint32_t z) {
   return fpu.result();
 }
 
-uint32_t FMSUB_WITH_SOFT_FPU(uint32_t x, uint32_t y, uint32_t z) {
-  FPU fpu;
-  fpu.MUL(x,y);  
-  fpu.LOAD_B(z,false,true);
+// FADD, FSUB
+inline uint32_t FPU_ADD(FPU& fpu, uint32_t x, uint32_t y, bool sub) {
+  fpu.LOAD_AB(x,y,sub);
   if(fpu.ADD_SWP_EXP()) {
     fpu.ADD_SHIFT();
-    fpu.ADD_SWP_FRAC();
     fpu.ADD_FRAC();
   }
   fpu.NORM();
   return fpu.result();
 }
 
-uint32_t FNMADD_WITH_SOFT_FPU(uint32_t x, uint32_t y, uint32_t z) {
-  FPU fpu;
+inline uint32_t FPU_MUL(FPU& fpu, uint32_t x, uint32_t y) {
   fpu.MUL(x,y);
-  fpu.LOAD_B(z,true,true);
-  if(fpu.ADD_SWP_EXP()) {  
-    fpu.ADD_SHIFT();
-    fpu.ADD_SWP_FRAC();
-    fpu.ADD_FRAC();
-  }
   fpu.NORM();
   return fpu.result();
 }
 
+uint32_t FMADD_WITH_SOFT_FPU(uint32_t x, uint32_t y, uint32_t z) {
+  FPU fpu;
+  return FPU_MADD(fpu,x,y,z,false,false);
+}
+
+uint32_t FMSUB_WITH_SOFT_FPU(uint32_t x, uint32_t y, uint32_t z) {
+  FPU fpu;
+  return FPU_MADD(fpu,x,y,z,false,true);
+}
+
+uint32_t FNMADD_WITH_SOFT_FPU(uint32_t x, uint32_t y, uint32_t z) {
+  FPU fpu;
+  return FPU_MADD(fpu,x,y,z,true,true);
+}
+
 uint32_t FNMSUB_WITH_SOFT_FPU(uint32_t x, uint32_t y, uint32_t z) {
   FPU fpu;
-  fpu.MUL(x,y);
-  fpu.LOAD_B(z,true,false);
-  if(fpu.ADD_SWP_EXP()) {  
-    fpu.ADD_SHIFT();
-    fpu.ADD_SWP_FRAC();
-    fpu.ADD_FRAC();
-  }
-  fpu.NORM();
-  return fpu.result();
+  return FPU_MADD(fpu,x,y,z,true,false);
 }
 
 uint32_t FADD_WITH_SOFT_FPU(uint32_t x, uint32_t y) {
   FPU fpu;
-  fpu.LOAD_AB(x,y,false);
-  if(fpu.ADD_SWP_EXP()) {
-    fpu.ADD_SHIFT();
-    fpu.ADD_FRAC();
-  }
-  fpu.NORM();
-  return fpu.result();
+  return FPU_ADD(fpu,x,y,false);
 }
 
 uint32_t FSUB_WITH_SOFT_FPU(uint32_t x, uint32_t y) {
   FPU fpu;
-  fpu.LOAD_AB(x,y,true);
-  if(fpu.ADD_SWP_EXP()) {
-    fpu.ADD_SHIFT();
-    fpu.ADD_FRAC();
-  }
-  fpu.NORM();
-  return fpu.result();
+  return FPU_ADD(fpu,x,y,true);
 }
 
 uint32_t FMUL_WITH_SOFT_FPU(uint32_t x, uint32_t y) {
   FPU fpu;
-  fpu.MUL(x,y);
-  fpu.NORM();
-  return fpu.result();
+  return FPU_MUL(fpu,x,y);
 }
 
 // Stack Overflow - Fast 1/X division (reciprocal)
@@ -544,8 +900,8 @@ float DOOM_approx_inv_sqrt(float x) {
   return y;
 }
 
-// reciprocal (1/x)
-uint32_t FRCP_WITH_SOFT_FPU(uint32_t D_in) {
+// reciprocal (1/x), computed with the operations of fpu
+uint32_t FRCP_WITH_SOFT_FPU(FPU& fpu, uint32_t D_in) {
 
   // version 0: use simulator's FPU
   if(0) {
@@ -596,7 +952,9 @@ uint32_t FRCP_WITH_SOFT_FPU(uint32_t D_in) {
     const uint32_t CONST_2          = 0x40000000;
     const uint32_t CONST_1          = 0x3f800000;
     
-    uint32_t X0_ = FNMSUB(CONST_32_over_17,D_prime_,CONST_48_over_17);
+    uint32_t X0_ = FPU_MADD(
+      fpu,CONST_32_over_17,D_prime_,CONST_48_over_17,true,false
+    );
     
     // version 1 of iteration, like in Wikipedia page
     // uint32_t X1_ = FMADD(X0_,FNMSUB(D_prime_,X0_,CONST_1),X0_);
@@ -605,8 +963,8 @@ uint32_t FRCP_WITH_SOFT_FPU(uint32_t D_in) {
 
     // version 2 of iteration, using one FMA and one MUL per iteration
     // (faster, but probably not as accurate, to be checked)
-    uint32_t X1_ = FMUL(X0_, FNMSUB(X0_,D_prime_,CONST_2));
-    uint32_t X2_ = FMUL(X1_, FNMSUB(X1_,D_prime_,CONST_2));
+    uint32_t X1_ = FPU_MUL(fpu,X0_,FPU_MADD(fpu,X0_,D_prime_,CONST_2,true,false));
+    uint32_t X2_ = FPU_MUL(fpu,X1_,FPU_MADD(fpu,X1_,D_prime_,CONST_2,true,false));
     // uint32_t X3_ = FMUL(X2_, FNMSUB(D_prime_,X2_,CONST_2));
     // Note: does not pass compliance test yet, and two iters
     // may not suffice (but not the only reason)
@@ -623,18 +981,34 @@ uint32_t FRCP_WITH_SOFT_FPU(uint32_t D_in) {
   }
 }
 
+uint32_t FRCP_WITH_SOFT_FPU(uint32_t D_in) {
+  FPU fpu;
+  return FRCP_WITH_SOFT_FPU(fpu, D_in);
+}
+
+// FDIV, FSQRT
+inline uint32_t FPU_DIV(FPU& fpu, uint32_t x, uint32_t y) {
+  return FPU_MUL(fpu, x, FRCP_WITH_SOFT_FPU(fpu, y));
+}
+
+inline uint32_t FPU_SQRT(FPU& fpu, uint32_t x) {
+  return FPU_MUL(fpu, x, encodef(DOOM_approx_inv_sqrt(decodef(x))));
+}
+
 uint32_t FDIV_WITH_SOFT_FPU(uint32_t x, uint32_t y) {
-  return FMUL_WITH_SOFT_FPU(x, FRCP_WITH_SOFT_FPU(y));
+  FPU fpu;
+  return FPU_DIV(fpu,x,y);
 }
 
 uint32_t FSQRT_WITH_SOFT_FPU(uint32_t x) {
-  return FMUL_WITH_SOFT_FPU(x,encodef(DOOM_approx_inv_sqrt(decodef(x))));
+  FPU fpu;
+  return FPU_SQRT(fpu,x);
 }
 
 uint32_t FSGNJ_WITH_SOFT_FPU(uint32_t x, uint32_t y) {
   IEEE754 X(x), Y(y);
   X.sign = Y.sign;
-  return Y.i;
+  return X.i;
 }
 
 uint32_t FSGNJN_WITH_SOFT_FPU(uint32_t x, uint32_t y) {
@@ -658,7 +1032,6 @@ uint32_t FMAX_WITH_SOFT_FPU(uint32_t x, uint32_t y) {
 }
 
 uint32_t FCVTWS_WITH_SOFT_FPU(uint32_t x) { 
-  L("FCVTWS");
   // TODO: overflow detect
   uint32_t result;
   IEEE754 X(x);
@@ -681,7 +1054,6 @@ uint32_t FCVTWS_WITH_SOFT_FPU(uint32_t x) {
 
 uint32_t FCVTWUS_WITH_SOFT_FPU(uint32_t x) {
   // TODO: overflow detect
-  L("FCVTWUS");
   uint32_t result;
   IEEE754 X(x);
   if(X.exp == 0) {
@@ -726,280 +1098,557 @@ uint32_t FLE_WITH_SOFT_FPU(uint32_t x, uint32_t y) {
 }
 
 uint32_t FCLASS_WITH_SOFT_FPU(uint32_t x) {
-  printf("FCLASS - not implemented yet\n");
-  return 0;
+  IEEE754 X(x);
+  if(X.is_infty()) {
+    return X.sign ? (1u << 0) : (1u << 7);
+  }
+  if(X.is_NaN()) {
+    // bit 22 of the mantissa: quiet NaN
+    return (X.mant & (1u << 22)) ? (1u << 9) : (1u << 8);
+  }
+  if(X.is_zero()) {
+    return X.sign ? (1u << 3) : (1u << 4);
+  }
+  if(X.is_denormal()) {
+    return X.sign ? (1u << 2) : (1u << 5);
+  }
+  return X.sign ? (1u << 1) : (1u << 6);
 }
 
 uint32_t FCVTSW_WITH_SOFT_FPU(uint32_t x) {
-  return encodef(float(int32_t(x)));
+  return FCVTSW_WITH_HOST_FPU(x);
 }
 
 uint32_t FCVTSWU_WITH_SOFT_FPU(uint32_t x) {
-  return encodef(float(x));
+  return FCVTSWU_WITH_HOST_FPU(x);
+}
+
+/*****************************************************************************/
+
+void FPU_set_config(const FPUConfig& config) {
+  FPU_config_ = config;
+}
+
+const FPUConfig& FPU_config() {
+  return FPU_config_;
+}
+
+static const char* FPU_rounding_names[] = { "rne", "rtz", "rdn", "rup", "rmm" };
+
+const char* FPU_rounding_name(FPURoundingMode mode) {
+  return (mode <= FPU_RMM) ? FPU_rounding_names[mode] : "???";
+}
+
+bool FPU_rounding_from_name(const char* name, FPURoundingMode& mode) {
+  for(int i=0; i<=FPU_RMM; ++i) {
+    if(!strcmp(name, FPU_rounding_names[i])) {
+      mode = FPURoundingMode(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* FPU_func_name(FPUFunc f) {
+  static const char* names[FPU_FUNC_NB] = {
+    "FMADD", "FMSUB", "FNMADD", "FNMSUB", "FADD", "FSUB", "FMUL", "FDIV",
+    "FSQRT", "FSGNJ", "FSGNJN", "FSGNJX", "FMIN", "FMAX", "FCVTWS",
+    "FCVTWUS", "FEQ", "FLT", "FLE", "FCLASS", "FCVTSW", "FCVTSWU"
+  };
+  return (f < FPU_FUNC_NB) ? names[f] : "???";
 }
 
 /*****************************************************************************/
 
+
 static int use_soft_fpu = 0;
 
 uint32_t FMADD(uint32_t x, uint32_t y, uint32_t z) {
+  L(FPU_FUNC_FMADD,x,y,z);
   if(use_soft_fpu) {
     return FMADD_WITH_SOFT_FPU(x,y,z);
   }
-  L("FMADD");
-  return encodef(fma(decodef(x),decodef(y),decodef(z)));
+  return FMADD_WITH_HOST_FPU(x,y,z);
 }
 
 uint32_t FMSUB(uint32_t x, uint32_t y, uint32_t z) {
+  L(FPU_FUNC_FMSUB,x,y,z);
   if(use_soft_fpu) {
     return FMSUB_WITH_SOFT_FPU(x,y,z);
   }
-  L("FMSUB");
-  return encodef(fma(decodef(x),decodef(y),-decodef(z)));
+  return FMSUB_WITH_HOST_FPU(x,y,z);
 }
 
 uint32_t FNMADD(uint32_t x, uint32_t y, uint32_t z) {
+  L(FPU_FUNC_FNMADD,x,y,z);
   if(use_soft_fpu) {
     return FNMADD_WITH_SOFT_FPU(x,y,z);
   }
-  L("FNMADD");
-  return encodef(fma(-decodef(x),decodef(y),-decodef(z)));
+  return FNMADD_WITH_HOST_FPU(x,y,z);
 }
 
 uint32_t FNMSUB(uint32_t x, uint32_t y, uint32_t z) {
+  L(FPU_FUNC_FNMSUB,x,y,z);
   if(use_soft_fpu) {
     return FNMSUB_WITH_SOFT_FPU(x,y,z);
   }
-  L("FNMSUB");
-  return encodef(fma(-decodef(x),decodef(y),decodef(z)));
+  return FNMSUB_WITH_HOST_FPU(x,y,z);
 }
 
 uint32_t FADD(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FADD,x,y);
   if(use_soft_fpu) {
     return FADD_WITH_SOFT_FPU(x,y);
   }
-  L("FADD");
-  return encodef(decodef(x)+decodef(y));
+  return FADD_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FSUB(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FSUB,x,y);
   if(use_soft_fpu) {
     return FSUB_WITH_SOFT_FPU(x,y);
   }
-  L("FSUB");
-  return encodef(decodef(x)-decodef(y));  
+  return FSUB_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FMUL(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FMUL,x,y);
   if(use_soft_fpu) {
     return FMUL_WITH_SOFT_FPU(x,y);
   }
-  L("FMUL");
-  return encodef(decodef(x)*decodef(y));    
+  return FMUL_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FDIV(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FDIV,x,y);
   if(use_soft_fpu) {
     return FDIV_WITH_SOFT_FPU(x,y);
   }
-  L("FDIV");    
-  return encodef(decodef(x)/decodef(y));
+  return FDIV_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FSQRT(uint32_t x) {
+  L(FPU_FUNC_FSQRT,x);
   if(use_soft_fpu) {
     return FSQRT_WITH_SOFT_FPU(x);
   }
-  L("FSQRT");
-  return encodef(sqrtf(decodef(x)));
+  return FSQRT_WITH_HOST_FPU(x);
 }
 
 uint32_t FSGNJ(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FSGNJ,x,y);
   if(use_soft_fpu) {
     return FSGNJ_WITH_SOFT_FPU(x,y);
   }
-  L("FSGNJ");  
-  IEEE754 X(x), Y(y);
-  X.sign = Y.sign;
-  return Y.i;
+  return FSGNJ_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FSGNJN(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FSGNJN,x,y);
   if(use_soft_fpu) {
     return FSGNJN_WITH_SOFT_FPU(x,y);
   }
-  L("FSGNJN");    
-  IEEE754 X(x),Y(y);
-  X.sign = !Y.sign;
-  return X.i;
+  return FSGNJN_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FSGNJX(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FSGNJX,x,y);
   if(use_soft_fpu) {
     return FSGNJX_WITH_SOFT_FPU(x,y);
   }
-  L("FSGNJX");    
-  IEEE754 X(x),Y(y);
-  X.sign = X.sign ^ Y.sign;
-  return X.i;
+  return FSGNJX_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FMIN(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FMIN,x,y);
   if(use_soft_fpu) {
     return FMIN_WITH_SOFT_FPU(x,y);
   }
-  L("FMIN");    
-  return encodef(fminf(decodef(x),decodef(y)));
+  return FMIN_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FMAX(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FMAX,x,y);
   if(use_soft_fpu) {
     return FMAX_WITH_SOFT_FPU(x,y);
   }
-  L("FMAX");      
-  return encodef(fmaxf(decodef(x),decodef(y)));  
+  return FMAX_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FCVTWS(uint32_t x) {
+  L(FPU_FUNC_FCVTWS,x);
   if(use_soft_fpu) {
     return FCVTWS_WITH_SOFT_FPU(x);
   }
-  L("FCVTWS");
-  return uint32_t(int32_t(decodef(x)));
+  return FCVTWS_WITH_HOST_FPU(x);
 }
 
 uint32_t FCVTWUS(uint32_t x) {
+  L(FPU_FUNC_FCVTWUS,x);
   if(use_soft_fpu) {
     return FCVTWUS_WITH_SOFT_FPU(x);
   }
-  L("FCVTWUS");
-  return uint32_t(decodef(x));
+  return FCVTWUS_WITH_HOST_FPU(x);
 }
 
 uint32_t FEQ(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FEQ,x,y);
   if(use_soft_fpu) {
     return FEQ_WITH_SOFT_FPU(x,y);
   }
-  L("FEQ");
-  return uint32_t(decodef(x) == decodef(y));
+  return FEQ_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FLT(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FLT,x,y);
   if(use_soft_fpu) {
     return FLT_WITH_SOFT_FPU(x,y);
   }
-  L("FLT");
-  return uint32_t(decodef(x) < decodef(y));
+  return FLT_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FLE(uint32_t x, uint32_t y) {
+  L(FPU_FUNC_FLE,x,y);
   if(use_soft_fpu) {
     return FLE_WITH_SOFT_FPU(x,y);
   }
-  L("FLE");           
-  return uint32_t(decodef(x) <= decodef(y));
+  return FLE_WITH_HOST_FPU(x,y);
 }
 
 uint32_t FCLASS(uint32_t x) {
+  L(FPU_FUNC_FCLASS,x);
   if(use_soft_fpu) {
     return FCLASS_WITH_SOFT_FPU(x);
   }
-  L("FCLASS");             
-  printf("FCLASS - not implemented yet\n");
-  return 0;
+  return FCLASS_WITH_SOFT_FPU(x);
 }
 
 uint32_t FCVTSW(uint32_t x) {
+  L(FPU_FUNC_FCVTSW);
   if(use_soft_fpu) {
     return FCVTSW_WITH_SOFT_FPU(x);
   }
-  L("FCVTSW");             
-  return encodef(float(int32_t(x)));
+  return FCVTSW_WITH_HOST_FPU(x);
 }
 
 uint32_t FCVTSWU(uint32_t x) {
+  L(FPU_FUNC_FCVTSWU);
   if(use_soft_fpu) {
     return FCVTSWU_WITH_SOFT_FPU(x);
   }
-  L("FCVTSWU");               
-  return encodef(float(x));
+  return FCVTSWU_WITH_HOST_FPU(x);
 }
 
 /***********************************************************/
 
 uint32_t CHECK_FADD(uint32_t result, uint32_t x, uint32_t y) { 
-  return check("FADD", x, y, 0, result, encodef(decodef(x) + decodef(y)),2);
+  return M(FPU_FUNC_FADD, check("FADD", x, y, 0, result, FADD_WITH_HOST_FPU(x,y),2));
 }
 
 uint32_t CHECK_FSUB(uint32_t result, uint32_t x, uint32_t y) {
-  return check("FSUB", x, y, 0, result, encodef(decodef(x) - decodef(y)),2);  
+  return M(FPU_FUNC_FSUB, check("FSUB", x, y, 0, result, FSUB_WITH_HOST_FPU(x,y),2));  
 }
 
 uint32_t CHECK_FMUL(uint32_t result, uint32_t x, uint32_t y) {
-  return check("FMUL", x, y, 0, result, encodef(decodef(x) * decodef(y)),2);  
+  return M(FPU_FUNC_FMUL, check("FMUL", x, y, 0, result, FMUL_WITH_HOST_FPU(x,y),2));  
 }
 
 uint32_t CHECK_FMADD(uint32_t result, uint32_t x, uint32_t y, uint32_t z) {
-  return check("FMADD", x, y, 0, result, encodef(fma(decodef(x),decodef(y),decodef(z))),3);  
+  return M(FPU_FUNC_FMADD, check("FMADD", x, y, 0, result, FMADD_WITH_HOST_FPU(x,y,z),3));  
 }
 
 uint32_t CHECK_FMSUB(uint32_t result, uint32_t x, uint32_t y, uint32_t z) {
-  return check("FMSUB", x, y, 0, result, encodef(fma(decodef(x),decodef(y),-decodef(z))),3);  
+  return M(FPU_FUNC_FMSUB, check("FMSUB", x, y, 0, result, FMSUB_WITH_HOST_FPU(x,y,z),3));  
 }
 
 uint32_t CHECK_FNMADD(uint32_t result, uint32_t x, uint32_t y, uint32_t z) {
-  return check("FNMADD", x, y, 0, result, encodef(fma(-decodef(x),decodef(y),-decodef(z))),3);    
+  return M(FPU_FUNC_FNMADD, check("FNMADD", x, y, 0, result, FNMADD_WITH_HOST_FPU(x,y,z),3));    
 }
 
 uint32_t CHECK_FNMSUB(uint32_t result, uint32_t x, uint32_t y, uint32_t z) {
-  return check("FNMSUB", x, y, 0, result, encodef(fma(-decodef(x),decodef(y),decodef(z))),3);      
+  return M(FPU_FUNC_FNMSUB, check("FNMSUB", x, y, 0, result, FNMSUB_WITH_HOST_FPU(x,y,z),3));      
 }
 
 uint32_t CHECK_FEQ(uint32_t result, uint32_t x, uint32_t y) {
-  return check("FEQ", x, y, 0, result,(decodef(x)==decodef(y)),2,true);    
+  return M(FPU_FUNC_FEQ, check("FEQ", x, y, 0, result,(decodef(x)==decodef(y)),2,true));    
 }
 
 uint32_t CHECK_FLT(uint32_t result, uint32_t x, uint32_t y) {
-  return check("FLT", x, y, 0, result,(decodef(x)<decodef(y)),2,true);      
+  return M(FPU_FUNC_FLT, check("FLT", x, y, 0, result,(decodef(x)<decodef(y)),2,true));      
 }
 
 uint32_t CHECK_FLE(uint32_t result, uint32_t x, uint32_t y) {
-  return check("FLE", x, y, 0, result,(decodef(x)<=decodef(y)),2,true);        
+  return M(FPU_FUNC_FLE, check("FLE", x, y, 0, result,(decodef(x)<=decodef(y)),2,true));        
 }
 
 uint32_t CHECK_FCVTWS(uint32_t result, uint32_t x) {
-  return check("FCVT.W.S", x, 0, 0, result, uint32_t(int32_t(decodef(x))),1,true);
+  return M(FPU_FUNC_FCVTWS, check("FCVT.W.S", x, 0, 0, result, uint32_t(int32_t(decodef(x))),1,true));
 }
 
 uint32_t CHECK_FCVTWUS(uint32_t result, uint32_t x) {
-  return check("FCVT.WU.S", x, 0, 0, result, int32_t(decodef(x)),1,true);
+  return M(FPU_FUNC_FCVTWUS, check("FCVT.WU.S", x, 0, 0, result, int32_t(decodef(x)),1,true));
 }
 
 uint32_t CHECK_FCVTSW(uint32_t result, uint32_t x) {
-  return check("FCVT.S.W", x, 0, 0, result, encodef(float(int32_t(x))),1,false,true);  
+  return M(FPU_FUNC_FCVTSW, check("FCVT.S.W", x, 0, 0, result, FCVTSW_WITH_HOST_FPU(x),1,false,true));  
 }
 
 uint32_t CHECK_FCVTSWU(uint32_t result, uint32_t x) {
-  return check("FCVT.S.W", x, 0, 0, result, encodef(float(x)),1,false,true);  
+  return M(FPU_FUNC_FCVTSWU, check("FCVT.S.W", x, 0, 0, result, FCVTSWU_WITH_HOST_FPU(x),1,false,true));  
 }
 
 uint32_t CHECK_FDIV(uint32_t result, uint32_t x, uint32_t y) {
-  return check("FDIV", x, y, 0, result, encodef(decodef(x) / decodef(y)),2);  
+  return M(FPU_FUNC_FDIV, check("FDIV", x, y, 0, result, FDIV_WITH_HOST_FPU(x,y),2));  
 }
 
 uint32_t CHECK_FSQRT(uint32_t result, uint32_t x) {
-  return check("FSQRT", x, 0, 0, result, encodef(sqrtf(decodef(x))),1);  
+  return M(FPU_FUNC_FSQRT, check("FSQRT", x, 0, 0, result, FSQRT_WITH_HOST_FPU(x),1));  
 }
 
 uint32_t CHECK_FMIN(uint32_t result, uint32_t x, uint32_t y) {
-  return check("FMIN", x, y, 0, result, encodef(fminf(decodef(x),decodef(y))),2);    
+  return M(FPU_FUNC_FMIN, check("FMIN", x, y, 0, result, encodef(fminf(decodef(x),decodef(y))),2));    
 }
 
 uint32_t CHECK_FMAX(uint32_t result, uint32_t x, uint32_t y) {
-  return check("FMAX", x, y, 0, result, encodef(fmaxf(decodef(x),decodef(y))),2);      
+  return M(FPU_FUNC_FMAX, check("FMAX", x, y, 0, result, encodef(fmaxf(decodef(x),decodef(y))),2));      
 }
 
 uint32_t CHECK_FSGNJ(uint32_t result, uint32_t x, uint32_t y) { return 1; }
 uint32_t CHECK_FSGNJN(uint32_t result, uint32_t x, uint32_t y) { return 1; }
 uint32_t CHECK_FSGNJX(uint32_t result, uint32_t x, uint32_t y) { return 1; }
 uint32_t CHECK_FCLASS(uint32_t result, uint32_t x) { return 1; }
+
+/***********************************************************/
+
+const char* FPU_op_name(FPUOp op) {
+  static const char* names[FPU_OP_NB] = {
+    "FADD", "FSUB", "FMUL", "FMADD", "FMSUB", "FNMADD", "FNMSUB"
+  };
+  return (op < FPU_OP_NB) ? names[op] : "???";
+}
+
+unsigned int FPU_op_nb_args(FPUOp op) {
+  return (op >= FPU_OP_FMADD) ? 3 : 2;
+}
+
+template <FPUOp OP> inline uint32_t soft_op(
+  FPU& fpu, uint32_t x, uint32_t y, uint32_t z
+) {
+  switch(OP) {
+  case FPU_OP_FADD:   return FPU_ADD(fpu,x,y,false);
+  case FPU_OP_FSUB:   return FPU_ADD(fpu,x,y,true);
+  case FPU_OP_FMUL:   return FPU_MUL(fpu,x,y);
+  case FPU_OP_FMADD:  return FPU_MADD(fpu,x,y,z,false,false);
+  case FPU_OP_FMSUB:  return FPU_MADD(fpu,x,y,z,false,true);
+  case FPU_OP_FNMADD: return FPU_MADD(fpu,x,y,z,true,true);
+  case FPU_OP_FNMSUB: return FPU_MADD(fpu,x,y,z,true,false);
+  default: return 0;
+  }
+}
+
+template <FPUOp OP> static void soft_bulk(
+  const uint32_t* x, const uint32_t* y, const uint32_t* z,
+  uint32_t* result, size_t N
+) {
+  // Overflows are reported by the caller (with the result of the host)
+  FPU fpu(FPU_config_, false);
+  for(size_t i=0; i<N; ++i) {
+    result[i] = soft_op<OP>(fpu, x[i], y[i], (z == nullptr) ? 0 : z[i]);
+  }
+}
+
+// Scalar version
+template <FPUOp OP> inline uint32_t host_op(uint32_t x, uint32_t y, uint32_t z) {
+  switch(OP) {
+  case FPU_OP_FADD:   return FADD_WITH_HOST_FPU(x,y);
+  case FPU_OP_FSUB:   return FSUB_WITH_HOST_FPU(x,y);
+  case FPU_OP_FMUL:   return FMUL_WITH_HOST_FPU(x,y);
+  case FPU_OP_FMADD:  return FMADD_WITH_HOST_FPU(x,y,z);
+  case FPU_OP_FMSUB:  return FMSUB_WITH_HOST_FPU(x,y,z);
+  case FPU_OP_FNMADD: return FNMADD_WITH_HOST_FPU(x,y,z);
+  case FPU_OP_FNMSUB: return FNMSUB_WITH_HOST_FPU(x,y,z);
+  default: return 0;
+  }
+}
+
+// Evaluates 4 operations at a time with SSE (and FMA if the compiler
+// targets it, else with the scalar version). The rounding mode and
+// flush-to-zero mode of SSE are set from FPU_config_ during the loop, and
+// restored after. FPU_RMM is not supported by SSE (scalar version).
+template <FPUOp OP> static void host_bulk(
+  const uint32_t* x, const uint32_t* y, const uint32_t* z,
+  uint32_t* result, size_t N
+) {
+  size_t i = 0;
+  bool simd = (FPU_config_.rounding != FPU_RMM);
+#ifndef __FMA__
+  simd = simd && (OP < FPU_OP_FMADD);
+#endif
+  if(simd) {
+    unsigned int csr = _mm_getcsr();
+    unsigned int rounding = _MM_ROUND_NEAREST;
+    switch(FPU_config_.rounding) {
+    case FPU_RTZ: rounding = _MM_ROUND_TOWARD_ZERO; break;
+    case FPU_RDN: rounding = _MM_ROUND_DOWN;        break;
+    case FPU_RUP: rounding = _MM_ROUND_UP;          break;
+    default: break;
+    }
+    _mm_setcsr(
+      (csr & ~(_MM_ROUND_MASK | _MM_FLUSH_ZERO_MASK)) | rounding |
+      (FPU_config_.denormals ? _MM_FLUSH_ZERO_OFF : _MM_FLUSH_ZERO_ON)
+    );
+    for(; i+4 <= N; i += 4) {
+      __m128 X = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(x+i)));
+      __m128 Y = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(y+i)));
+      __m128 R = X;
+      switch(OP) {
+      case FPU_OP_FADD: R = _mm_add_ps(X,Y); break;
+      case FPU_OP_FSUB: R = _mm_sub_ps(X,Y); break;
+      case FPU_OP_FMUL: R = _mm_mul_ps(X,Y); break;
+#ifdef __FMA__
+      case FPU_OP_FMADD:
+      case FPU_OP_FMSUB:
+      case FPU_OP_FNMADD:
+      case FPU_OP_FNMSUB: {
+        __m128 Z = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(z+i)));
+        switch(OP) {
+        case FPU_OP_FMADD:  R = _mm_fmadd_ps(X,Y,Z);  break; //  x*y + z
+        case FPU_OP_FMSUB:  R = _mm_fmsub_ps(X,Y,Z);  break; //  x*y - z
+        case FPU_OP_FNMADD: R = _mm_fnmsub_ps(X,Y,Z); break; // -x*y - z
+        default:            R = _mm_fnmadd_ps(X,Y,Z); break; // -x*y + z
+        }
+      } break;
+#endif
+      default: break;
+      }
+      _mm_storeu_si128((__m128i*)(result+i), _mm_castps_si128(R));
+    }
+    _mm_setcsr(csr);
+  }
+  for(; i<N; ++i) {
+    result[i] = host_op<OP>(x[i], y[i], (z == nullptr) ? 0 : z[i]);
+  }
+}
+
+#define FPU_BULK_DISPATCH(func)                                     \
+  switch(op) {                                                      \
+  case FPU_OP_FADD:   func<FPU_OP_FADD>(x,y,z,result,N); break;     \
+  case FPU_OP_FSUB:   func<FPU_OP_FSUB>(x,y,z,result,N); break;     \
+  case FPU_OP_FMUL:   func<FPU_OP_FMUL>(x,y,z,result,N); break;     \
+  case FPU_OP_FMADD:  func<FPU_OP_FMADD>(x,y,z,result,N); break;    \
+  case FPU_OP_FMSUB:  func<FPU_OP_FMSUB>(x,y,z,result,N); break;    \
+  case FPU_OP_FNMADD: func<FPU_OP_FNMADD>(x,y,z,result,N); break;   \
+  case FPU_OP_FNMSUB: func<FPU_OP_FNMSUB>(x,y,z,result,N); break;   \
+  default: break;                                                   \
+  }
+
+void FPU_soft_bulk(
+  FPUOp op, const uint32_t* x, const uint32_t* y, const uint32_t* z,
+  uint32_t* result, size_t N
+) {
+  FPU_BULK_DISPATCH(soft_bulk);
+}
+
+void FPU_host_bulk(
+  FPUOp op, const uint32_t* x, const uint32_t* y, const uint32_t* z,
+  uint32_t* result, size_t N
+) {
+  FPU_BULK_DISPATCH(host_bulk);
+}
+
+#undef FPU_BULK_DISPATCH
+
+uint32_t FPU_soft_op(
+  FPUOp op, uint32_t x, uint32_t y, uint32_t z, const FPUConfig& config
+) {
+  FPU fpu(config, false);
+  switch(op) {
+  case FPU_OP_FADD:   return soft_op<FPU_OP_FADD>(fpu,x,y,z);
+  case FPU_OP_FSUB:   return soft_op<FPU_OP_FSUB>(fpu,x,y,z);
+  case FPU_OP_FMUL:   return soft_op<FPU_OP_FMUL>(fpu,x,y,z);
+  case FPU_OP_FMADD:  return soft_op<FPU_OP_FMADD>(fpu,x,y,z);
+  case FPU_OP_FMSUB:  return soft_op<FPU_OP_FMSUB>(fpu,x,y,z);
+  case FPU_OP_FNMADD: return soft_op<FPU_OP_FNMADD>(fpu,x,y,z);
+  case FPU_OP_FNMSUB: return soft_op<FPU_OP_FNMSUB>(fpu,x,y,z);
+  default: return 0;
+  }
+}
+
+/***********************************************************/
+
+unsigned int FPU_func_nb_args(FPUFunc f) {
+  switch(f) {
+  case FPU_FUNC_FMADD:
+  case FPU_FUNC_FMSUB:
+  case FPU_FUNC_FNMADD:
+  case FPU_FUNC_FNMSUB:
+    return 3;
+  case FPU_FUNC_FSQRT:
+  case FPU_FUNC_FCVTWS:
+  case FPU_FUNC_FCVTWUS:
+  case FPU_FUNC_FCLASS:
+  case FPU_FUNC_FCVTSW:
+  case FPU_FUNC_FCVTSWU:
+    return 1;
+  default:
+    return 2;
+  }
+}
+
+uint32_t FPU_host_func(FPUFunc f, uint32_t x, uint32_t y, uint32_t z) {
+  switch(f) {
+  case FPU_FUNC_FMADD:   return FMADD_WITH_HOST_FPU(x,y,z);
+  case FPU_FUNC_FMSUB:   return FMSUB_WITH_HOST_FPU(x,y,z);
+  case FPU_FUNC_FNMADD:  return FNMADD_WITH_HOST_FPU(x,y,z);
+  case FPU_FUNC_FNMSUB:  return FNMSUB_WITH_HOST_FPU(x,y,z);
+  case FPU_FUNC_FADD:    return FADD_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FSUB:    return FSUB_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FMUL:    return FMUL_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FDIV:    return FDIV_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FSQRT:   return FSQRT_WITH_HOST_FPU(x);
+  case FPU_FUNC_FSGNJ:   return FSGNJ_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FSGNJN:  return FSGNJN_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FSGNJX:  return FSGNJX_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FMIN:    return FMIN_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FMAX:    return FMAX_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FCVTWS:  return FCVTWS_WITH_HOST_FPU(x);
+  case FPU_FUNC_FCVTWUS: return FCVTWUS_WITH_HOST_FPU(x);
+  case FPU_FUNC_FEQ:     return FEQ_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FLT:     return FLT_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FLE:     return FLE_WITH_HOST_FPU(x,y);
+  case FPU_FUNC_FCLASS:  return FCLASS_WITH_SOFT_FPU(x); // (same as FCLASS())
+  case FPU_FUNC_FCVTSW:  return FCVTSW_WITH_HOST_FPU(x);
+  case FPU_FUNC_FCVTSWU: return FCVTSWU_WITH_HOST_FPU(x);
+  default: return 0;
+  }
+}
+
+uint32_t FPU_soft_func(FPUFunc f, uint32_t x, uint32_t y, uint32_t z) {
+  // Overflows are detected by the caller
+  FPU fpu(FPU_config_, false);
+  switch(f) {
+  case FPU_FUNC_FMADD:   return FPU_MADD(fpu,x,y,z,false,false);
+  case FPU_FUNC_FMSUB:   return FPU_MADD(fpu,x,y,z,false,true);
+  case FPU_FUNC_FNMADD:  return FPU_MADD(fpu,x,y,z,true,true);
+  case FPU_FUNC_FNMSUB:  return FPU_MADD(fpu,x,y,z,true,false);
+  case FPU_FUNC_FADD:    return FPU_ADD(fpu,x,y,false);
+  case FPU_FUNC_FSUB:    return FPU_ADD(fpu,x,y,true);
+  case FPU_FUNC_FMUL:    return FPU_MUL(fpu,x,y);
+  case FPU_FUNC_FDIV:    return FPU_DIV(fpu,x,y);
+  case FPU_FUNC_FSQRT:   return FPU_SQRT(fpu,x);
+  case FPU_FUNC_FSGNJ:   return FSGNJ_WITH_SOFT_FPU(x,y);
+  case FPU_FUNC_FSGNJN:  return FSGNJN_WITH_SOFT_FPU(x,y);
+  case FPU_FUNC_FSGNJX:  return FSGNJX_WITH_SOFT_FPU(x,y);
+  case FPU_FUNC_FMIN:    return FMIN_WITH_SOFT_FPU(x,y);
+  case FPU_FUNC_FMAX:    return FMAX_WITH_SOFT_FPU(x,y);
+  case FPU_FUNC_FCVTWS:  return FCVTWS_WITH_SOFT_FPU(x);
+  case FPU_FUNC_FCVTWUS: return FCVTWUS_WITH_SOFT_FPU(x);
+  case FPU_FUNC_FEQ:     return FEQ_WITH_SOFT_FPU(x,y);
+  case FPU_FUNC_FLT:     return FLT_WITH_SOFT_FPU(x,y);
+  case FPU_FUNC_FLE:     return FLE_WITH_SOFT_FPU(x,y);
+  case FPU_FUNC_FCLASS:  return FCLASS_WITH_SOFT_FPU(x);
+  case FPU_FUNC_FCVTSW:  return FCVTSW_WITH_SOFT_FPU(x);
+  case FPU_FUNC_FCVTSWU: return FCVTSWU_WITH_SOFT_FPU(x);
+  default: return 0;
+  }
+}
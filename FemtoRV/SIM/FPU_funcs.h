@@ -1,8 +1,61 @@
 // FPU: for now simulated / implemented in C++
 #include <stdint.h>
+#include <stddef.h>
 
 void print_float(uint32_t x);
 
+// Rounding modes (encoding of the frm CSR and of the rm field of the
+// instructions)
+enum FPURoundingMode {
+  FPU_RNE = 0, // to nearest, ties to even
+  FPU_RTZ = 1, // towards zero
+  FPU_RDN = 2, // down (towards -infinity)
+  FPU_RUP = 3, // up (towards +infinity)
+  FPU_RMM = 4  // to nearest, ties to max magnitude
+};
+
+// Configuration of the simulated FPU. The default one is the FPU of
+// petitbateau (truncation, denormal results flushed to zero).
+struct FPUConfig {
+  FPUConfig() :
+    rounding(FPU_RTZ),
+    denormals(false),
+    guard_bits(false) {
+  }
+
+  // IEEE754 compliant (round to nearest even, gradual underflow)
+  static FPUConfig IEEE754() {
+    FPUConfig result;
+    result.rounding = FPU_RNE;
+    result.denormals = true;
+    result.guard_bits = true;
+    return result;
+  }
+  
+  FPURoundingMode rounding;
+  
+  // Gradual underflow (else denormal results are flushed to zero)
+  bool denormals;
+
+  // FPU class: 8 guard bits, and the bits lost when aligning the operands
+  // of an addition are summarized in a sticky bit (needed for correct
+  // rounding, else these bits are ignored like in petitbateau)
+  bool guard_bits;
+};
+
+// The functions below compute with this configuration. The FPU of the host
+// is used in its default mode (double precision, round to nearest, no flush
+// to zero), then the results are rounded in software: the floating
+// point environment of the host is never changed.
+void FPU_set_config(const FPUConfig& config);
+const FPUConfig& FPU_config();
+
+const char* FPU_rounding_name(FPURoundingMode mode);
+
+// Gets a rounding mode from its name (rne, rtz, rdn, rup, rmm)
+// Returns false if the name is unknown.
+bool FPU_rounding_from_name(const char* name, FPURoundingMode& mode);
+
 uint32_t FMADD(uint32_t x, uint32_t y, uint32_t z);
 uint32_t FMSUB(uint32_t x, uint32_t y, uint32_t z);
 uint32_t FNMADD(uint32_t x, uint32_t y, uint32_t z);
@@ -31,6 +84,29 @@ uint32_t FCLASS(uint32_t x);
 uint32_t FCVTSW(uint32_t x);
 uint32_t FCVTSWU(uint32_t x);
 
+// The functions above, for the counters (see FPU_NO_LOG in FPU_funcs.cpp)
+// and for the conformance tests (see fpu_conformance.cpp)
+enum FPUFunc {
+  FPU_FUNC_FMADD, FPU_FUNC_FMSUB, FPU_FUNC_FNMADD, FPU_FUNC_FNMSUB,
+  FPU_FUNC_FADD, FPU_FUNC_FSUB, FPU_FUNC_FMUL, FPU_FUNC_FDIV, FPU_FUNC_FSQRT,
+  FPU_FUNC_FSGNJ, FPU_FUNC_FSGNJN, FPU_FUNC_FSGNJX, FPU_FUNC_FMIN,
+  FPU_FUNC_FMAX, FPU_FUNC_FCVTWS, FPU_FUNC_FCVTWUS, FPU_FUNC_FEQ,
+  FPU_FUNC_FLT, FPU_FUNC_FLE, FPU_FUNC_FCLASS, FPU_FUNC_FCVTSW,
+  FPU_FUNC_FCVTSWU,
+  FPU_FUNC_NB
+};
+
+const char* FPU_func_name(FPUFunc f);
+unsigned int FPU_func_nb_args(FPUFunc f);
+
+// f(x,y,z), computed by the FPU of the host (XXX_WITH_HOST_FPU()) or by
+// the C++ model of the FPU of petitbateau (XXX_WITH_SOFT_FPU()), with
+// FPU_config(), whatever the dispatch of the functions above. The unused
+// operands are ignored. These functions are not counted, and can be called
+// from several threads.
+uint32_t FPU_host_func(FPUFunc f, uint32_t x, uint32_t y, uint32_t z);
+uint32_t FPU_soft_func(FPUFunc f, uint32_t x, uint32_t y, uint32_t z);
+
 /*******************************************/
 
 uint32_t CHECK_FMADD(uint32_t result, uint32_t x, uint32_t y, uint32_t z);
@@ -60,3 +136,39 @@ uint32_t CHECK_FLE(uint32_t result, uint32_t x, uint32_t y);
 uint32_t CHECK_FCLASS(uint32_t result, uint32_t x);
 uint32_t CHECK_FCVTSW(uint32_t result, uint32_t x);
 uint32_t CHECK_FCVTSWU(uint32_t result, uint32_t x);
+
+/*******************************************/
+
+// Bulk evaluation of the operations of the C++ model of the FPU of
+// petitbateau (the FPU class in FPU_funcs.cpp), to verify it against the
+// FPU of the host (see fpu_verify.cpp).
+
+enum FPUOp {
+  FPU_OP_FADD, FPU_OP_FSUB, FPU_OP_FMUL,
+  FPU_OP_FMADD, FPU_OP_FMSUB, FPU_OP_FNMADD, FPU_OP_FNMSUB,
+  FPU_OP_NB
+};
+
+const char* FPU_op_name(FPUOp op);
+unsigned int FPU_op_nb_args(FPUOp op);
+
+// result[i] = op(x[i],y[i],z[i]), computed by the FPU class
+// (z is only used by the 3-operands operations)
+void FPU_soft_bulk(
+  FPUOp op, const uint32_t* x, const uint32_t* y, const uint32_t* z,
+  uint32_t* result, size_t N
+);
+
+// result[i] = op(x[i],y[i],z[i]), computed by the FPU of the host (SIMD),
+// with the rounding and flush-to-zero modes of FPU_config()
+void FPU_host_bulk(
+  FPUOp op, const uint32_t* x, const uint32_t* y, const uint32_t* z,
+  uint32_t* result, size_t N
+);
+
+// op(x,y,z) computed by the FPU class with a given configuration, to
+// evaluate algorithms built on the operations of the FPU (see
+// fpu_divsqrt.cpp). Can be called from several threads.
+uint32_t FPU_soft_op(
+  FPUOp op, uint32_t x, uint32_t y, uint32_t z, const FPUConfig& config
+);
@@ -0,0 +1,168 @@
+#include "FemtoSocIO.h"
+#include "UART.h"
+#include <cstdio>
+#include <cstring>
+
+FemtoSocIO::FemtoSocIO() {
+  uart_ = nullptr;
+  leds_ = 0;
+  RAM_size_ = 65536;
+  freq_ = 1;
+  counter_bits_ = 64;
+  memset(framebuffer_, 0, sizeof(framebuffer_));
+  cur_command_ = 0;
+  cur_arg_[0] = 0;
+  cur_arg_[1] = 0;
+  cur_arg_index_ = 0;
+  prev_byte_ = 0;
+  fetch_next_half_ = false;
+  x_ = 0; x1_ = 0; x2_ = 127;
+  y_ = 0; y1_ = 0; y2_ = 127;
+  start_line_ = 0;
+  nb_frames_ = 0;
+}
+
+uint32_t FemtoSocIO::read(uint32_t offset) {
+  uint32_t word_offset = offset >> 2;
+  uint32_t result = 0;
+  if(selected(word_offset, IO_LEDS_bit)) {
+    result |= leds_ & 15;
+  }
+  // bit 8: data ready, bit 9: busy (never, output is buffered)
+  if(selected(word_offset, IO_UART_DAT_bit)) {
+    if(uart_ != nullptr && uart_->rx_ready()) {
+      result |= 256 | uint32_t(uart_->rx());
+    }
+  } else if(selected(word_offset, IO_UART_CNTL_bit)) {
+    if(uart_ != nullptr && uart_->rx_ready()) {
+      result |= 256;
+    }
+  }
+  if(selected(word_offset, IO_HW_CONFIG_RAM_bit)) {
+    result |= RAM_size_;
+  }
+  if(selected(word_offset, IO_HW_CONFIG_DEVICES_bit)) {
+    result |=
+      (1u << IO_LEDS_bit) |
+      (1u << IO_UART_DAT_bit) | (1u << IO_UART_CNTL_bit) |
+      (1u << IO_SSD1351_CNTL_bit) | (1u << IO_SSD1351_CMD_bit) |
+      (1u << IO_SSD1351_DAT_bit);
+  }
+  if(selected(word_offset, IO_HW_CONFIG_CPUINFO_bit)) {
+    result |= (freq_ << 16) | counter_bits_;
+  }
+  return result;
+}
+
+void FemtoSocIO::write(uint32_t offset, uint32_t wdata) {
+  uint32_t word_offset = offset >> 2;
+  if(selected(word_offset, IO_LEDS_bit)) {
+    leds_ = wdata;
+  }
+  if(selected(word_offset, IO_UART_DAT_bit)) {
+    if(uart_ != nullptr) {
+      uart_->tx(uint8_t(wdata));
+    } else {
+      putchar(int(wdata & 255));
+    }
+  }
+  if(selected(word_offset, IO_SSD1351_CMD_bit)) {
+    OLED_command(wdata & 255);
+  }
+  if(selected(word_offset, IO_SSD1351_DAT_bit)) {
+    OLED_data(wdata & 255);
+  }
+  if(selected(word_offset, IO_SSD1351_DAT16_bit)) {
+    OLED_pixel(wdata & 65535);
+  }
+}
+
+bool FemtoSocIO::finished() const {
+  return uart_ != nullptr && uart_->finished();
+}
+
+/*************************************************************************/
+
+// Same subset of the SSD1351 commands as in SSD1351.cpp (the model of
+// the display connected to the pins of the verilated femtosoc).
+
+void FemtoSocIO::OLED_command(uint32_t cmd) {
+  cur_command_ = cmd;
+  cur_arg_index_ = 0;
+  fetch_next_half_ = false;
+}
+
+void FemtoSocIO::OLED_data(uint32_t data) {
+  // draw pixels: two bytes per pixel, most significant first
+  if(cur_command_ == 0x5c) {
+    if(fetch_next_half_) {
+      fetch_next_half_ = false;
+      OLED_pixel((prev_byte_ << 8) | data);
+    } else {
+      prev_byte_ = data;
+      fetch_next_half_ = true;
+    }
+    return;
+  }
+
+  if(cur_arg_index_ < 2) {
+    cur_arg_[cur_arg_index_] = data;
+    cur_arg_index_++;
+  }
+
+  // set x range
+  if(cur_command_ == 0x15 && cur_arg_index_ == 2) {
+    x1_ = cur_arg_[0]; x2_ = cur_arg_[1]; x_ = x1_;
+  }
+
+  // set y range
+  if(cur_command_ == 0x75 && cur_arg_index_ == 2) {
+    y1_ = cur_arg_[0]; y2_ = cur_arg_[1]; y_ = y1_;
+  }
+
+  // set display start line
+  if(cur_command_ == 0xa1 && cur_arg_index_ == 1) {
+    start_line_ = cur_arg_[0] & 127;
+    ++nb_frames_;
+  }
+}
+
+void FemtoSocIO::OLED_pixel(uint32_t pixel) {
+  if(x_ < 128 && y_ < 128) {
+    framebuffer_[y_*128+x_] = (unsigned short)(pixel);
+  }
+  ++x_;
+  if(x_ > x2_) {
+    ++y_;
+    x_ = x1_;
+    if(y_ == y2_+1) {
+      ++nb_frames_;
+      y_ = y1_;
+    }
+  }
+}
+
+bool FemtoSocIO::save_OLED_PPM(const char* filename) const {
+  FILE* f = fopen(filename,"wb");
+  if(f == nullptr) {
+    return false;
+  }
+  fprintf(f,"P6\n128 128\n255\n");
+  unsigned char row[128*3];
+  for(unsigned int y=0; y<128; ++y) {
+    // the display starts at start_line_.
+    unsigned int yy = (y + start_line_) & 127;
+    for(unsigned int x=0; x<128; ++x) {
+      unsigned short pixel = framebuffer_[yy*128+x];
+      unsigned int R = (pixel >> 11) & 31;
+      unsigned int G = (pixel >> 5)  & 63;
+      unsigned int B =  pixel        & 31;
+      row[3*x]   = (unsigned char)((R << 3) | (R >> 2));
+      row[3*x+1] = (unsigned char)((G << 2) | (G >> 4));
+      row[3*x+2] = (unsigned char)((B << 3) | (B >> 2));
+    }
+    fwrite(row, 1, sizeof(row), f);
+  }
+  fclose(f);
+  return true;
+}
@@ -0,0 +1,111 @@
+/*****************************************************************/
+#ifndef SIM_FEMTOSOC_IO_H
+#define SIM_FEMTOSOC_IO_H
+
+#include "HardwareConfig_bits.h"
+#include <stdint.h>
+
+class UART;
+
+// The IO page of the femtosoc (RTL/femtosoc.v), at the level of the
+// memory-mapped registers (see FIRMWARE/LIBFEMTORV32/femtorv32.h), for
+// the instruction set simulator (ISS.h).
+//
+// Each bit of the word offset in the IO page selects a device, so that
+// one access can address several devices (like in the RTL):
+//   LEDS, UART (data and control), SSD1351 (command, 8 and 16 bits data)
+//   and the hardware configuration registers (RAM, devices, CPU info).
+// The other devices read as 0 and ignore writes.
+class FemtoSocIO {
+ public:
+   FemtoSocIO();
+
+   /**
+    * \brief Connects the model of the terminal.
+    * \param[in] uart the UART, or nullptr (then output goes to stdout
+    *  and there is no input).
+    */
+   void set_UART(UART* uart) {
+      uart_ = uart;
+   }
+
+   /**
+    * \brief Sets the values returned by the hardware configuration
+    *  registers.
+    * \param[in] RAM_size the size of the RAM in bytes
+    * \param[in] freq the frequency of the processor in MHz
+    * \param[in] counter_bits the width of the cycles counter
+    */
+   void set_config(uint32_t RAM_size, uint32_t freq, uint32_t counter_bits) {
+      RAM_size_ = RAM_size;
+      freq_ = freq;
+      counter_bits_ = counter_bits;
+   }
+
+   /**
+    * \brief Reads a word from the IO page.
+    * \param[in] offset the byte offset in the IO page (address[21:0])
+    */
+   uint32_t read(uint32_t offset);
+
+   /**
+    * \brief Writes a word to the IO page.
+    * \param[in] offset the byte offset in the IO page (address[21:0])
+    * \param[in] wdata the written data
+    */
+   void write(uint32_t offset, uint32_t wdata);
+
+   /**
+    * \brief Tests whether the firmware terminated the simulation
+    *  (by sending EOT to the UART).
+    */
+   bool finished() const;
+
+   uint32_t leds() const {
+      return leds_;
+   }
+
+   /**
+    * \brief Gets the number of frames sent to the OLED display.
+    * \details A frame is complete when the last pixel of the current
+    *  window is written, or when the display start line changes.
+    */
+   unsigned int nb_frames() const {
+      return nb_frames_;
+   }
+
+   /**
+    * \brief Saves the content of the OLED display to a PPM file.
+    * \return true on success, false otherwise.
+    */
+   bool save_OLED_PPM(const char* filename) const;
+
+ private:
+   static bool selected(uint32_t word_offset, unsigned int bit) {
+      return (word_offset & (1u << bit)) != 0;
+   }
+   void OLED_command(uint32_t cmd);
+   void OLED_data(uint32_t data);
+   void OLED_pixel(uint32_t pixel);
+
+ private:
+   UART* uart_;
+   uint32_t leds_;
+   uint32_t RAM_size_;
+   uint32_t freq_;
+   uint32_t counter_bits_;
+
+   // SSD1351 display
+   unsigned short framebuffer_[128*128];
+   uint32_t cur_command_;
+   uint32_t cur_arg_[2];
+   unsigned int cur_arg_index_;
+   uint32_t prev_byte_;
+   bool fetch_next_half_;
+   unsigned int x_, x1_, x2_;
+   unsigned int y_, y1_, y2_;
+   unsigned int start_line_;
+   unsigned int nb_frames_;
+};
+
+#endif
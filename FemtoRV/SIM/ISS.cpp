@@ -0,0 +1,937 @@
+#include "ISS.h"
+#include "FPU_funcs.h"
+#include "femto_elf.h"
+#include <cstdio>
+#include <cstring>
+
+// Note: RAM is accessed with memcpy(), this supposes a little-endian host.
+
+/*************************************************************************/
+
+// Encoders for the 32-bits instructions, used to expand the compressed ones.
+
+static inline uint32_t enc_R(
+  uint32_t opcode, uint32_t rd, uint32_t funct3,
+  uint32_t rs1, uint32_t rs2, uint32_t funct7
+) {
+  return opcode | (rd << 7) | (funct3 << 12) | (rs1 << 15) | (rs2 << 20) |
+	 (funct7 << 25);
+}
+
+static inline uint32_t enc_I(
+  uint32_t opcode, uint32_t rd, uint32_t funct3, uint32_t rs1, int32_t imm
+) {
+  return opcode | (rd << 7) | (funct3 << 12) | (rs1 << 15) |
+	 (uint32_t(imm) << 20);
+}
+
+static inline uint32_t enc_S(
+  uint32_t opcode, uint32_t funct3, uint32_t rs1, uint32_t rs2, int32_t imm
+) {
+  uint32_t I = uint32_t(imm);
+  return opcode | ((I & 31) << 7) | (funct3 << 12) | (rs1 << 15) |
+	 (rs2 << 20) | (((I >> 5) & 127) << 25);
+}
+
+static inline uint32_t enc_B(
+  uint32_t funct3, uint32_t rs1, uint32_t rs2, int32_t imm
+) {
+  uint32_t I = uint32_t(imm);
+  return 0x63 | (((I >> 11) & 1) << 7) | (((I >> 1) & 15) << 8) |
+	 (funct3 << 12) | (rs1 << 15) | (rs2 << 20) |
+	 (((I >> 5) & 63) << 25) | (((I >> 12) & 1) << 31);
+}
+
+static inline uint32_t enc_J(uint32_t rd, int32_t imm) {
+  uint32_t I = uint32_t(imm);
+  return 0x6f | (rd << 7) | (I & 0xff000) | (((I >> 11) & 1) << 20) |
+	 (((I >> 1) & 1023) << 21) | (((I >> 20) & 1) << 31);
+}
+
+// Gets bit i of x at position j
+static inline uint32_t bit(uint32_t x, unsigned int i, unsigned int j) {
+  return ((x >> i) & 1) << j;
+}
+
+// Sign-extends the nb_bits LSBs of x
+static inline int32_t sext(uint32_t x, unsigned int nb_bits) {
+  return int32_t(x << (32 - nb_bits)) >> (32 - nb_bits);
+}
+
+uint32_t ISS::decompress(uint32_t c) {
+  uint32_t funct3 = (c >> 13) & 7;
+  uint32_t rd     = (c >> 7) & 31;   // also rs1
+  uint32_t rs2    = (c >> 2) & 31;
+  uint32_t rdp    = 8 + ((c >> 2) & 7); // rd', rs2'
+  uint32_t rs1p   = 8 + ((c >> 7) & 7); // rs1'
+
+  // offsets of C.LW, C.SW, C.FLW, C.FSW
+  uint32_t lw_imm = bit(c,6,2) | bit(c,10,3) | bit(c,11,4) | bit(c,12,5) |
+		    bit(c,5,6);
+  // immediate of C.ADDI, C.LI, C.ANDI
+  int32_t  imm6   = sext(((c >> 2) & 31) | bit(c,12,5), 6);
+
+  switch(c & 3) {
+  case 0:
+    switch(funct3) {
+    case 0: { // C.ADDI4SPN
+      uint32_t imm = bit(c,6,2) | bit(c,5,3) | bit(c,11,4) | bit(c,12,5) |
+		     bit(c,7,6) | bit(c,8,7) | bit(c,9,8) | bit(c,10,9);
+      return (imm == 0) ? 0 : enc_I(0x13, rdp, 0, 2, int32_t(imm));
+    }
+    case 2: return enc_I(0x03, rdp, 2, rs1p, int32_t(lw_imm));   // C.LW
+    case 3: return enc_I(0x07, rdp, 2, rs1p, int32_t(lw_imm));   // C.FLW
+    case 6: return enc_S(0x23, 2, rs1p, rdp, int32_t(lw_imm));   // C.SW
+    case 7: return enc_S(0x27, 2, rs1p, rdp, int32_t(lw_imm));   // C.FSW
+    }
+    return 0;
+  case 1:
+    switch(funct3) {
+    case 0: return enc_I(0x13, rd, 0, rd, imm6);                 // C.ADDI
+    case 1:                                                      // C.JAL
+    case 5: {                                                    // C.J
+      int32_t imm = sext(
+	bit(c,3,1) | bit(c,4,2) | bit(c,5,3) | bit(c,11,4) | bit(c,2,5) |
+	bit(c,7,6) | bit(c,6,7) | bit(c,9,8) | bit(c,10,9) | bit(c,8,10) |
+	bit(c,12,11), 12
+      );
+      return enc_J(funct3 == 1 ? 1 : 0, imm);
+    }
+    case 2: return enc_I(0x13, rd, 0, 0, imm6);                  // C.LI
+    case 3:
+      if(rd == 2) {                                              // C.ADDI16SP
+	int32_t imm = sext(
+	  bit(c,6,4) | bit(c,2,5) | bit(c,5,6) | bit(c,3,7) | bit(c,4,8) |
+	  bit(c,12,9), 10
+	);
+	return (imm == 0) ? 0 : enc_I(0x13, 2, 0, 2, imm);
+      } else {                                                   // C.LUI
+	int32_t imm = imm6;
+	return (imm == 0) ? 0 : (0x37 | (rd << 7) | (uint32_t(imm) << 12));
+      }
+    case 4: {
+      uint32_t shamt = (c >> 2) & 31;
+      switch((c >> 10) & 3) {
+      case 0:                                                    // C.SRLI
+	return (c & (1 << 12)) ? 0 : enc_R(0x13, rs1p, 5, rs1p, shamt, 0x00);
+      case 1:                                                    // C.SRAI
+	return (c & (1 << 12)) ? 0 : enc_R(0x13, rs1p, 5, rs1p, shamt, 0x20);
+      case 2:                                                    // C.ANDI
+	return enc_I(0x13, rs1p, 7, rs1p, imm6);
+      case 3:
+	if(c & (1 << 12)) {
+	  return 0;
+	}
+	switch((c >> 5) & 3) {
+	case 0: return enc_R(0x33, rs1p, 0, rs1p, rdp, 0x20);    // C.SUB
+	case 1: return enc_R(0x33, rs1p, 4, rs1p, rdp, 0x00);    // C.XOR
+	case 2: return enc_R(0x33, rs1p, 6, rs1p, rdp, 0x00);    // C.OR
+	case 3: return enc_R(0x33, rs1p, 7, rs1p, rdp, 0x00);    // C.AND
+	}
+      }
+      return 0;
+    }
+    case 6:                                                      // C.BEQZ
+    case 7: {                                                    // C.BNEZ
+      int32_t imm = sext(
+	bit(c,3,1) | bit(c,4,2) | bit(c,10,3) | bit(c,11,4) | bit(c,2,5) |
+	bit(c,5,6) | bit(c,6,7) | bit(c,12,8), 9
+      );
+      return enc_B(funct3 == 6 ? 0 : 1, rs1p, 0, imm);
+    }
+    }
+    return 0;
+  case 2:
+    switch(funct3) {
+    case 0:                                                      // C.SLLI
+      return (c & (1 << 12)) ? 0 : enc_R(0x13, rd, 1, rd, rs2, 0x00);
+    case 2:                                                      // C.LWSP
+    case 3: {                                                    // C.FLWSP
+      uint32_t imm = bit(c,4,2) | bit(c,5,3) | bit(c,6,4) | bit(c,12,5) |
+		     bit(c,2,6) | bit(c,3,7);
+      if(funct3 == 2) {
+	return (rd == 0) ? 0 : enc_I(0x03, rd, 2, 2, int32_t(imm));
+      }
+      return enc_I(0x07, rd, 2, 2, int32_t(imm));
+    }
+    case 4:
+      if(!(c & (1 << 12))) {
+	if(rs2 == 0) {                                           // C.JR
+	  return (rd == 0) ? 0 : enc_I(0x67, 0, 0, rd, 0);
+	}
+	return enc_R(0x33, rd, 0, 0, rs2, 0x00);                 // C.MV
+      }
+      if(rs2 == 0) {
+	if(rd == 0) {
+	  return 0x00100073;                                     // C.EBREAK
+	}
+	return enc_I(0x67, 1, 0, rd, 0);                         // C.JALR
+      }
+      return enc_R(0x33, rd, 0, rd, rs2, 0x00);                  // C.ADD
+    case 6:                                                      // C.SWSP
+    case 7: {                                                    // C.FSWSP
+      uint32_t imm = bit(c,9,2) | bit(c,10,3) | bit(c,11,4) | bit(c,12,5) |
+		     bit(c,7,6) | bit(c,8,7);
+      return enc_S(funct3 == 6 ? 0x23 : 0x27, 2, 2, rs2, int32_t(imm));
+    }
+    }
+    return 0;
+  }
+  return 0;
+}
+
+/*************************************************************************/
+
+ISS::ISS(uint32_t RAM_size) {
+  if(RAM_size > IO_BASE) {
+    RAM_size = IO_BASE;
+  }
+  RAM_size_ = RAM_size;
+  // 4 additional bytes, so that an instruction can be fetched at the
+  // last address as a 32-bits word.
+  RAM_.assign(size_t(RAM_size) + 4, 0);
+  decoded_.resize(RAM_size / 2);
+  IO_.set_config(RAM_size, 1, 64);
+  IO_enabled_ = true;
+  decompressed_.resize(65536);
+  for(uint32_t c=0; c<65536; ++c) {
+    decompressed_[c] = ((c & 3) == 3) ? 0 : decompress(c);
+  }
+  exit_address_ = 0xffffffff;
+  reset(0);
+}
+
+void ISS::reset(uint32_t PC) {
+  memset(x_, 0, sizeof(x_));
+  memset(f_, 0, sizeof(f_));
+  PC_ = PC;
+  instret_ = 0;
+  mstatus_ = 0;
+  mtvec_ = 0;
+  mepc_ = 0;
+  mcause_ = 0;
+  halted_ = false;
+  halt_reason_ = "";
+  exit_code_ = -1;
+}
+
+int ISS::load_elf(const char* filename) {
+  Elf32Info info;
+  int elf_status = elf32_stat(filename, &info);
+  if(elf_status != ELF32_OK) {
+    return elf_status;
+  }
+  if(info.max_address > RAM_size_) {
+    fprintf(
+      stderr,"ELF exceeds RAM (%d > %d)\n",
+      int(info.max_address),int(RAM_size_)
+    );
+    return ELF32_READ_ERROR;
+  }
+  std::fill(RAM_.begin(), RAM_.end(), 0);
+  for(Decoded& D: decoded_) {
+    D.op = 0;
+  }
+  elf_status = elf32_load_at(filename, &info, RAM_.data());
+  if(elf_status != ELF32_OK) {
+    return elf_status;
+  }
+  reset(info.entry);
+  return ELF32_OK;
+}
+
+void ISS::write_RAM(uint32_t addr, const void* data, uint32_t size) {
+  memcpy(&RAM_[addr], data, size);
+  for(uint32_t i=addr/2; i<(addr+size+1)/2 && i<decoded_.size(); ++i) {
+    decoded_[i].op = 0;
+  }
+  if(addr/2 > 0) {
+    decoded_[addr/2-1].op = 0;
+  }
+}
+
+void ISS::bus_error(uint32_t addr) {
+  fprintf(stderr,"[ISS] bus error: PC=%08x addr=%08x\n",PC_,addr);
+  halt("bus error");
+}
+
+/*************************************************************************/
+
+// Loads and stores outside of the RAM (IO page or bus error)
+
+uint32_t ISS::load(uint32_t addr, unsigned int size) {
+  if(!(addr & IO_BASE)) {
+    bus_error(addr);
+    return 0;
+  }
+  if(!IO_enabled_) {
+    return 0;
+  }
+  uint32_t word = IO_.read(addr & (IO_BASE - 4));
+  word >>= 8 * (addr & 3);
+  return (size == 4) ? word : word & ((1u << (8*size)) - 1);
+}
+
+void ISS::store(uint32_t addr, uint32_t data, unsigned int size) {
+  (void)size;
+  if(!(addr & IO_BASE)) {
+    bus_error(addr);
+    return;
+  }
+  if(!IO_enabled_) {
+    return;
+  }
+  IO_.write(addr & (IO_BASE - 4), data);
+  if(IO_.finished()) {
+    halt("EOT sent to UART");
+  }
+}
+
+/*************************************************************************/
+
+uint32_t ISS::read_CSR(uint32_t csr) {
+  switch(csr) {
+  case 0xC00: case 0xB00: return uint32_t(cycles());         // (m)cycle
+  case 0xC80: case 0xB80: return uint32_t(cycles() >> 32);   // (m)cycleh
+  case 0xC02: case 0xB02: return uint32_t(instret_);         // (m)instret
+  case 0xC82: case 0xB82: return uint32_t(instret_ >> 32);   // (m)instreth
+  case 0x300: return mstatus_;
+  case 0x305: return mtvec_;
+  case 0x341: return mepc_;
+  case 0x342: return mcause_;
+  }
+  return 0; // including fflags, frm, fcsr (rounding mode is fixed,
+            // see FPU_set_config())
+}
+
+void ISS::write_CSR(uint32_t csr, uint32_t value) {
+  switch(csr) {
+  case 0x300: mstatus_ = value; break;
+  case 0x305: mtvec_   = value; break;
+  case 0x341: mepc_    = value; break;
+  case 0x342: mcause_  = value; break;
+  }
+}
+
+/*************************************************************************/
+
+template <bool RECORD> inline void ISS::execute(TraceRecord* R) {
+
+  if(PC_ == exit_address_) {
+    exit_code_ = int32_t(x_[10]);
+    halt("exit");
+    return;
+  }
+
+  if(PC_ >= RAM_size_) {
+    bus_error(PC_);
+    return;
+  }
+
+  uint32_t instr;
+  memcpy(&instr, &RAM_[PC_], 4);
+  uint32_t next_PC = PC_ + 4;
+  if((instr & 3) != 3) {
+    instr = decompressed_[instr & 0xffff];
+    next_PC = PC_ + 2;
+  }
+
+  if(RECORD) {
+    R->cycle = cycles();
+    R->PC = PC_;
+    R->instr = instr;
+    R->wb = false;
+    R->rd = 0;
+    R->wb_data = 0;
+    R->load = false;
+    R->store = false;
+    R->mem_addr = 0;
+    R->mem_wdata = 0;
+    R->mem_wmask = 0;
+  }
+
+  uint32_t rd     = (instr >> 7)  & 31;
+  uint32_t funct3 = (instr >> 12) & 7;
+  uint32_t rs1    = (instr >> 15) & 31;
+  uint32_t rs2    = (instr >> 20) & 31;
+  uint32_t funct7 = instr >> 25;
+  uint32_t X1     = x_[rs1];
+  uint32_t X2     = x_[rs2];
+  int32_t  Iimm   = int32_t(instr) >> 20;
+
+  // Register write-back
+  auto wb = [&](uint32_t value) {
+    x_[rd] = value;
+    if(RECORD && rd != 0) {
+      R->wb = true;
+      R->rd = uint8_t(rd);
+      R->wb_data = value;
+    }
+  };
+
+  auto wb_FP = [&](uint32_t value) {
+    f_[rd] = value;
+    if(RECORD) {
+      R->wb = true;
+      R->rd = uint8_t(rd + 32);
+      R->wb_data = value;
+    }
+  };
+
+  auto do_load = [&](uint32_t addr, unsigned int size) -> uint32_t {
+    if(RECORD) {
+      R->load = true;
+      R->mem_addr = addr;
+    }
+    if(addr < RAM_size_) {
+      uint32_t result = 0;
+      memcpy(&result, &RAM_[addr], size);
+      return result;
+    }
+    return load(addr, size);
+  };
+
+  auto do_store = [&](uint32_t addr, uint32_t data, unsigned int size) {
+    // Data and mask as on the bus of femtorv32 (the byte or halfword is
+    // replicated on the other lanes)
+    uint32_t wdata = data;
+    uint8_t  wmask = 15;
+    if(size == 1) {
+      wdata = (data & 0xff) * 0x01010101u;
+      wmask = uint8_t(1 << (addr & 3));
+    } else if(size == 2) {
+      wdata = (data & 0xffff) * 0x00010001u;
+      wmask = (addr & 2) ? 12 : 3;
+    }
+    if(RECORD) {
+      R->store = true;
+      R->mem_addr = addr;
+      R->mem_wdata = wdata;
+      R->mem_wmask = wmask;
+    }
+    if(addr < RAM_size_) {
+      memcpy(&RAM_[addr], &data, size);
+      invalidate(addr);
+      return;
+    }
+    store(addr, wdata, size);
+  };
+
+  switch(instr & 127) {
+
+  case 0x37: // LUI
+    wb(instr & 0xfffff000);
+    break;
+
+  case 0x17: // AUIPC
+    wb(PC_ + (instr & 0xfffff000));
+    break;
+
+  case 0x6f: { // JAL
+    int32_t imm = sext(
+      (instr & 0xff000) | bit(instr,20,11) | (((instr >> 21) & 1023) << 1) |
+      bit(instr,31,20), 21
+    );
+    wb(next_PC);
+    next_PC = PC_ + uint32_t(imm);
+  } break;
+
+  case 0x67: // JALR
+    wb(next_PC);
+    next_PC = (X1 + uint32_t(Iimm)) & ~1u;
+    break;
+
+  case 0x63: { // Branch
+    bool taken;
+    switch(funct3) {
+    case 0: taken = (X1 == X2); break;
+    case 1: taken = (X1 != X2); break;
+    case 4: taken = (int32_t(X1) <  int32_t(X2)); break;
+    case 5: taken = (int32_t(X1) >= int32_t(X2)); break;
+    case 6: taken = (X1 <  X2); break;
+    case 7: taken = (X1 >= X2); break;
+    default: halt("illegal instruction"); return;
+    }
+    if(taken) {
+      int32_t imm = sext(
+	bit(instr,7,11) | (((instr >> 8) & 15) << 1) |
+	(((instr >> 25) & 63) << 5) | bit(instr,31,12), 13
+      );
+      next_PC = PC_ + uint32_t(imm);
+    }
+  } break;
+
+  case 0x03: { // Load
+    uint32_t addr = X1 + uint32_t(Iimm);
+    uint32_t value;
+    switch(funct3) {
+    case 0: value = uint32_t(sext(do_load(addr,1),8));  break; // LB
+    case 1: value = uint32_t(sext(do_load(addr,2),16)); break; // LH
+    case 2: value = do_load(addr,4);                    break; // LW
+    case 4: value = do_load(addr,1);                    break; // LBU
+    case 5: value = do_load(addr,2);                    break; // LHU
+    default: halt("illegal instruction"); return;
+    }
+    wb(value);
+  } break;
+
+  case 0x23: { // Store
+    int32_t imm = sext(((instr >> 7) & 31) | (funct7 << 5), 12);
+    uint32_t addr = X1 + uint32_t(imm);
+    switch(funct3) {
+    case 0: do_store(addr, X2, 1); break; // SB
+    case 1: do_store(addr, X2, 2); break; // SH
+    case 2: do_store(addr, X2, 4); break; // SW
+    default: halt("illegal instruction"); return;
+    }
+  } break;
+
+  case 0x13: { // ALU immediate
+    uint32_t imm = uint32_t(Iimm);
+    uint32_t shamt = rs2;
+    uint32_t value;
+    switch(funct3) {
+    case 0: value = X1 + imm; break;
+    case 1: value = X1 << shamt; break;
+    case 2: value = (int32_t(X1) < Iimm); break;
+    case 3: value = (X1 < imm); break;
+    case 4: value = X1 ^ imm; break;
+    case 5: value = (funct7 & 0x20) ? uint32_t(int32_t(X1) >> shamt)
+				     : (X1 >> shamt); break;
+    case 6: value = X1 | imm; break;
+    default: value = X1 & imm; break;
+    }
+    wb(value);
+  } break;
+
+  case 0x33: { // ALU register
+    uint32_t value;
+    if(funct7 == 1) { // M extension
+      int32_t A = int32_t(X1);
+      int32_t B = int32_t(X2);
+      switch(funct3) {
+      case 0: value = X1 * X2; break; // MUL
+      case 1: value = uint32_t((int64_t(A) * int64_t(B)) >> 32); break;
+      case 2: value = uint32_t((int64_t(A) * int64_t(uint64_t(X2))) >> 32);
+	break;                                                   // MULHSU
+      case 3: value = uint32_t((uint64_t(X1) * uint64_t(X2)) >> 32); break;
+      case 4: // DIV
+	value = (B == 0) ? 0xffffffff :
+		(A == int32_t(0x80000000) && B == -1) ? X1 :
+		uint32_t(A / B);
+	break;
+      case 5: // DIVU
+	value = (X2 == 0) ? 0xffffffff : X1 / X2;
+	break;
+      case 6: // REM
+	value = (B == 0) ? X1 :
+		(A == int32_t(0x80000000) && B == -1) ? 0 :
+		uint32_t(A % B);
+	break;
+      default: // REMU
+	value = (X2 == 0) ? X1 : X1 % X2;
+	break;
+      }
+    } else {
+      uint32_t shamt = X2 & 31;
+      switch(funct3) {
+      case 0: value = (funct7 & 0x20) ? X1 - X2 : X1 + X2; break;
+      case 1: value = X1 << shamt; break;
+      case 2: value = (int32_t(X1) < int32_t(X2)); break;
+      case 3: value = (X1 < X2); break;
+      case 4: value = X1 ^ X2; break;
+      case 5: value = (funct7 & 0x20) ? uint32_t(int32_t(X1) >> shamt)
+				       : (X1 >> shamt); break;
+      case 6: value = X1 | X2; break;
+      default: value = X1 & X2; break;
+      }
+    }
+    wb(value);
+  } break;
+
+  case 0x0f: // FENCE
+    break;
+
+  case 0x73: { // SYSTEM
+    if(funct3 == 0) {
+      if(instr == 0x00100073) {
+	halt("EBREAK");
+	return;
+      } else if(instr == 0x30200073) { // MRET
+	next_PC = mepc_;
+      } else if(instr == 0x00000073) {
+	halt("ECALL");
+	return;
+      }
+      break;
+    }
+    uint32_t csr = instr >> 20;
+    uint32_t old_value = read_CSR(csr);
+    uint32_t modifier = (funct3 & 4) ? rs1 : X1;
+    switch(funct3 & 3) {
+    case 1: write_CSR(csr, modifier); break;
+    case 2: if(rs1 != 0) { write_CSR(csr, old_value | modifier);  } break;
+    case 3: if(rs1 != 0) { write_CSR(csr, old_value & ~modifier); } break;
+    }
+    wb(old_value);
+  } break;
+
+  case 0x07: { // FLW
+    if(funct3 != 2) {
+      halt("illegal instruction");
+      return;
+    }
+    wb_FP(do_load(X1 + uint32_t(Iimm), 4));
+  } break;
+
+  case 0x27: { // FSW
+    if(funct3 != 2) {
+      halt("illegal instruction");
+      return;
+    }
+    int32_t imm = sext(((instr >> 7) & 31) | (funct7 << 5), 12);
+    do_store(X1 + uint32_t(imm), f_[rs2], 4);
+  } break;
+
+  case 0x43: wb_FP(FMADD (f_[rs1], f_[rs2], f_[instr >> 27])); break;
+  case 0x47: wb_FP(FMSUB (f_[rs1], f_[rs2], f_[instr >> 27])); break;
+  case 0x4b: wb_FP(FNMSUB(f_[rs1], f_[rs2], f_[instr >> 27])); break;
+  case 0x4f: wb_FP(FNMADD(f_[rs1], f_[rs2], f_[instr >> 27])); break;
+
+  case 0x53: { // OP-FP
+    uint32_t F1 = f_[rs1];
+    uint32_t F2 = f_[rs2];
+    switch(funct7) {
+    case 0x00: wb_FP(FADD(F1,F2));  break;
+    case 0x04: wb_FP(FSUB(F1,F2));  break;
+    case 0x08: wb_FP(FMUL(F1,F2));  break;
+    case 0x0c: wb_FP(FDIV(F1,F2));  break;
+    case 0x2c: wb_FP(FSQRT(F1));    break;
+    case 0x10:
+      switch(funct3) {
+      case 0: wb_FP(FSGNJ(F1,F2));  break;
+      case 1: wb_FP(FSGNJN(F1,F2)); break;
+      case 2: wb_FP(FSGNJX(F1,F2)); break;
+      default: halt("illegal instruction"); return;
+      }
+      break;
+    case 0x14:
+      switch(funct3) {
+      case 0: wb_FP(FMIN(F1,F2)); break;
+      case 1: wb_FP(FMAX(F1,F2)); break;
+      default: halt("illegal instruction"); return;
+      }
+      break;
+    case 0x60: wb(rs2 == 0 ? FCVTWS(F1) : FCVTWUS(F1)); break;
+    case 0x70:
+      switch(funct3) {
+      case 0: wb(F1);         break; // FMV.X.W
+      case 1: wb(FCLASS(F1)); break;
+      default: halt("illegal instruction"); return;
+      }
+      break;
+    case 0x50:
+      switch(funct3) {
+      case 0: wb(FLE(F1,F2)); break;
+      case 1: wb(FLT(F1,F2)); break;
+      case 2: wb(FEQ(F1,F2)); break;
+      default: halt("illegal instruction"); return;
+      }
+      break;
+    case 0x68: wb_FP(rs2 == 0 ? FCVTSW(X1) : FCVTSWU(X1)); break;
+    case 0x78: wb_FP(X1); break; // FMV.W.X
+    default: halt("illegal instruction"); return;
+    }
+  } break;
+
+  default:
+    halt("illegal instruction");
+    return;
+  }
+
+  x_[0] = 0;
+  PC_ = next_PC;
+  ++instret_;
+}
+
+/*************************************************************************/
+
+// Operations of the decoded instructions (see run())
+enum {
+  OP_DECODE = 0, // not decoded yet (or invalidated by a store)
+  OP_GENERIC,    // executed by execute()
+  OP_LUI, OP_AUIPC, OP_JAL, OP_JALR,
+  OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU,
+  OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU,
+  OP_SB, OP_SH, OP_SW,
+  OP_ADDI, OP_SLTI, OP_SLTIU, OP_XORI, OP_ORI, OP_ANDI,
+  OP_SLLI, OP_SRLI, OP_SRAI,
+  OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA,
+  OP_OR, OP_AND,
+  OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU
+};
+
+void ISS::decode(uint32_t PC) {
+  Decoded& D = decoded_[PC >> 1];
+  uint32_t instr;
+  memcpy(&instr, &RAM_[PC], 4);
+  D.len = 4;
+  if((instr & 3) != 3) {
+    instr = decompressed_[instr & 0xffff];
+    D.len = 2;
+  }
+  uint32_t funct3 = (instr >> 12) & 7;
+  uint32_t funct7 = instr >> 25;
+  D.rd  = uint8_t((instr >> 7)  & 31);
+  D.rs1 = uint8_t((instr >> 15) & 31);
+  D.rs2 = uint8_t((instr >> 20) & 31);
+  D.imm = int32_t(instr) >> 20;
+  D.op  = OP_GENERIC;
+
+  // exit() and the instructions that write x0 (hints) go through execute()
+  if(PC == exit_address_) {
+    return;
+  }
+
+  switch(instr & 127) {
+  case 0x37:
+    D.op = OP_LUI;
+    D.imm = int32_t(instr & 0xfffff000);
+    break;
+  case 0x17:
+    D.op = OP_AUIPC;
+    D.imm = int32_t(instr & 0xfffff000);
+    break;
+  case 0x6f:
+    D.op = OP_JAL;
+    D.imm = sext(
+      (instr & 0xff000) | bit(instr,20,11) | (((instr >> 21) & 1023) << 1) |
+      bit(instr,31,20), 21
+    );
+    break;
+  case 0x67:
+    if(funct3 == 0) {
+      D.op = OP_JALR;
+    }
+    break;
+  case 0x63: {
+    static const uint8_t ops[8] = {
+      OP_BEQ, OP_BNE, OP_GENERIC, OP_GENERIC, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU
+    };
+    D.op = ops[funct3];
+    D.imm = sext(
+      bit(instr,7,11) | (((instr >> 8) & 15) << 1) |
+      (((instr >> 25) & 63) << 5) | bit(instr,31,12), 13
+    );
+  } break;
+  case 0x03: {
+    static const uint8_t ops[8] = {
+      OP_LB, OP_LH, OP_LW, OP_GENERIC, OP_LBU, OP_LHU, OP_GENERIC, OP_GENERIC
+    };
+    D.op = ops[funct3];
+  } break;
+  case 0x23: {
+    static const uint8_t ops[8] = {
+      OP_SB, OP_SH, OP_SW, OP_GENERIC, OP_GENERIC, OP_GENERIC, OP_GENERIC,
+      OP_GENERIC
+    };
+    D.op = ops[funct3];
+    D.imm = sext(((instr >> 7) & 31) | (funct7 << 5), 12);
+  } break;
+  case 0x13: {
+    static const uint8_t ops[8] = {
+      OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU, OP_XORI, OP_SRLI, OP_ORI, OP_ANDI
+    };
+    D.op = ops[funct3];
+    if(funct3 == 5 && (funct7 & 0x20)) {
+      D.op = OP_SRAI;
+    }
+  } break;
+  case 0x33:
+    if(funct7 == 1) {
+      static const uint8_t ops[8] = {
+	OP_MUL, OP_MULH, OP_MULHSU, OP_MULHU, OP_DIV, OP_DIVU, OP_REM, OP_REMU
+      };
+      D.op = ops[funct3];
+    } else {
+      static const uint8_t ops[8] = {
+	OP_ADD, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_OR, OP_AND
+      };
+      D.op = ops[funct3];
+      if(funct7 & 0x20) {
+	if(funct3 == 0) {
+	  D.op = OP_SUB;
+	} else if(funct3 == 5) {
+	  D.op = OP_SRA;
+	}
+      }
+    }
+    break;
+  }
+
+  if(D.rd == 0 && D.op != OP_JAL && D.op != OP_JALR &&
+     !(D.op >= OP_BEQ && D.op <= OP_BGEU) && !(D.op >= OP_SB && D.op <= OP_SW)
+  ) {
+    D.op = OP_GENERIC;
+  }
+}
+
+uint64_t ISS::run(uint64_t max_instr) {
+  uint64_t start = instret_;
+  uint64_t end = start + max_instr;
+  uint32_t RAM_size = RAM_size_;
+  uint8_t* RAM = RAM_.data();
+  Decoded* decoded = decoded_.data();
+  uint32_t* x = x_;
+  uint32_t PC = PC_;
+  uint64_t instret = instret_;
+
+  while(instret < end) {
+    if(PC >= RAM_size) {
+      goto generic;
+    }
+    {
+      const Decoded& D = decoded[PC >> 1];
+      uint32_t X1 = x[D.rs1];
+      uint32_t X2 = x[D.rs2];
+      uint32_t next_PC = PC + D.len;
+      uint32_t addr;
+
+      switch(D.op) {
+      case OP_DECODE:
+	decode(PC);
+	continue;
+      case OP_GENERIC:
+	goto generic;
+
+      case OP_LUI:   x[D.rd] = uint32_t(D.imm);      break;
+      case OP_AUIPC: x[D.rd] = PC + uint32_t(D.imm); break;
+      case OP_JAL:
+	x[D.rd] = next_PC;
+	next_PC = PC + uint32_t(D.imm);
+	break;
+      case OP_JALR:
+	x[D.rd] = next_PC;
+	next_PC = (X1 + uint32_t(D.imm)) & ~1u;
+	break;
+
+      case OP_BEQ:  if(X1 == X2) { next_PC = PC + uint32_t(D.imm); } break;
+      case OP_BNE:  if(X1 != X2) { next_PC = PC + uint32_t(D.imm); } break;
+      case OP_BLT:
+	if(int32_t(X1) < int32_t(X2))  { next_PC = PC + uint32_t(D.imm); }
+	break;
+      case OP_BGE:
+	if(int32_t(X1) >= int32_t(X2)) { next_PC = PC + uint32_t(D.imm); }
+	break;
+      case OP_BLTU: if(X1 <  X2) { next_PC = PC + uint32_t(D.imm); } break;
+      case OP_BGEU: if(X1 >= X2) { next_PC = PC + uint32_t(D.imm); } break;
+
+      // Loads and stores outside of the RAM go through execute()
+      case OP_LB: case OP_LH: case OP_LW: case OP_LBU: case OP_LHU: {
+	addr = X1 + uint32_t(D.imm);
+	if(addr >= RAM_size) {
+	  goto generic;
+	}
+	uint32_t value = 0;
+	switch(D.op) {
+	case OP_LB:  value = uint32_t(int32_t(int8_t(RAM[addr])));  break;
+	case OP_LH:  {
+	  int16_t h;
+	  memcpy(&h, RAM + addr, 2);
+	  value = uint32_t(int32_t(h));
+	} break;
+	case OP_LW:  memcpy(&value, RAM + addr, 4); break;
+	case OP_LBU: value = RAM[addr];             break;
+	case OP_LHU: memcpy(&value, RAM + addr, 2); break;
+	}
+	x[D.rd] = value;
+      } break;
+
+      case OP_SB: case OP_SH: case OP_SW: {
+	addr = X1 + uint32_t(D.imm);
+	if(addr >= RAM_size) {
+	  goto generic;
+	}
+	memcpy(RAM + addr, &X2, size_t(1) << (D.op - OP_SB));
+	invalidate(addr);
+      } break;
+
+      case OP_ADDI:  x[D.rd] = X1 + uint32_t(D.imm); break;
+      case OP_SLTI:  x[D.rd] = (int32_t(X1) < D.imm); break;
+      case OP_SLTIU: x[D.rd] = (X1 < uint32_t(D.imm)); break;
+      case OP_XORI:  x[D.rd] = X1 ^ uint32_t(D.imm); break;
+      case OP_ORI:   x[D.rd] = X1 | uint32_t(D.imm); break;
+      case OP_ANDI:  x[D.rd] = X1 & uint32_t(D.imm); break;
+      case OP_SLLI:  x[D.rd] = X1 << D.rs2; break;
+      case OP_SRLI:  x[D.rd] = X1 >> D.rs2; break;
+      case OP_SRAI:  x[D.rd] = uint32_t(int32_t(X1) >> D.rs2); break;
+
+      case OP_ADD:  x[D.rd] = X1 + X2; break;
+      case OP_SUB:  x[D.rd] = X1 - X2; break;
+      case OP_SLL:  x[D.rd] = X1 << (X2 & 31); break;
+      case OP_SLT:  x[D.rd] = (int32_t(X1) < int32_t(X2)); break;
+      case OP_SLTU: x[D.rd] = (X1 < X2); break;
+      case OP_XOR:  x[D.rd] = X1 ^ X2; break;
+      case OP_SRL:  x[D.rd] = X1 >> (X2 & 31); break;
+      case OP_SRA:  x[D.rd] = uint32_t(int32_t(X1) >> (X2 & 31)); break;
+      case OP_OR:   x[D.rd] = X1 | X2; break;
+      case OP_AND:  x[D.rd] = X1 & X2; break;
+
+      case OP_MUL:
+	x[D.rd] = X1 * X2;
+	break;
+      case OP_MULH:
+	x[D.rd] = uint32_t((int64_t(int32_t(X1)) * int64_t(int32_t(X2))) >> 32);
+	break;
+      case OP_MULHSU:
+	x[D.rd] = uint32_t((int64_t(int32_t(X1)) * int64_t(uint64_t(X2))) >> 32);
+	break;
+      case OP_MULHU:
+	x[D.rd] = uint32_t((uint64_t(X1) * uint64_t(X2)) >> 32);
+	break;
+      case OP_DIV: case OP_REM: case OP_DIVU: case OP_REMU:
+	// division by zero and overflow
+	if(X2 == 0 || (D.op <= OP_REM && X1 == 0x80000000 && X2 == 0xffffffff)) {
+	  goto generic;
+	}
+	switch(D.op) {
+	case OP_DIV:  x[D.rd] = uint32_t(int32_t(X1) / int32_t(X2)); break;
+	case OP_DIVU: x[D.rd] = X1 / X2; break;
+	case OP_REM:  x[D.rd] = uint32_t(int32_t(X1) % int32_t(X2)); break;
+	case OP_REMU: x[D.rd] = X1 % X2; break;
+	}
+	break;
+      }
+      x[0] = 0;
+      PC = next_PC;
+      ++instret;
+      continue;
+    }
+
+  generic:
+    PC_ = PC;
+    instret_ = instret;
+    execute<false>(nullptr);
+    PC = PC_;
+    instret = instret_;
+    if(halted_) {
+      break;
+    }
+  }
+
+  PC_ = PC;
+  instret_ = instret;
+  return instret_ - start;
+}
+
+bool ISS::step(TraceRecord* record) {
+  if(halted_) {
+    return false;
+  }
+  if(record == nullptr) {
+    execute<false>(nullptr);
+  } else {
+    execute<true>(record);
+  }
+  return !halted_;
+}
@@ -0,0 +1,239 @@
+/*****************************************************************/
+#ifndef SIM_ISS_H
+#define SIM_ISS_H
+
+#include "FemtoSocIO.h"
+#include "Trace.h"
+#include <stdint.h>
+#include <vector>
+
+// Instruction set simulator of a femtorv32 processor (RV32IMFC) in a
+// femtosoc, to develop and benchmark firmware on the host without
+// simulating the RTL.
+//
+// - RAM at address 0, IO page at IO_BASE (0x400000, see FemtoSocIO.h)
+// - F instructions are computed by FPU_funcs.cpp, like the FPU_EMUL
+//   version of petitbateau (see FPU_set_config() for the rounding mode)
+// - CSRs: cycle(h), instret(h), and the machine-mode CSRs of femtorv32
+//   (mstatus, mtvec, mepc, mcause, stored but there is no interrupt)
+// - there is no timing model: one instruction per cycle
+//
+// run() executes the common RV32IM instructions from a table of decoded
+// instructions (one entry per halfword of RAM, decoded on first execution
+// and invalidated by stores). The other ones (F, SYSTEM, IO accesses)
+// and step() go through the complete interpreter (execute()).
+//
+// The simulation stops when the firmware calls exit() (see
+// set_exit_address()), executes EBREAK or an illegal instruction,
+// accesses memory outside of the RAM and the IO page, or sends EOT to
+// the UART.
+class ISS {
+ public:
+
+   /**
+    * \brief ISS constructor.
+    * \param[in] RAM_size the size of the RAM in bytes (at most 4 MB,
+    *  the IO page starts at 4 MB).
+    */
+   ISS(uint32_t RAM_size = 65536);
+
+   /**
+    * \brief Loads an ELF executable into the RAM and resets the processor
+    *  at its entry point.
+    * \return ELF32_OK or an error code (see femto_elf.h)
+    */
+   int load_elf(const char* filename);
+
+   /**
+    * \brief Resets the processor.
+    */
+   void reset(uint32_t PC);
+
+   /**
+    * \brief Stops the simulation when PC reaches an address.
+    * \details Used with the address of exit(), a0 is the exit code.
+    */
+   void set_exit_address(uint32_t address) {
+      invalidate(exit_address_);
+      exit_address_ = address;
+      invalidate(exit_address_);
+   }
+
+   /**
+    * \brief Executes instructions until the simulation stops.
+    * \param[in] max_instr the maximum number of instructions to execute
+    * \return the number of executed instructions
+    */
+   uint64_t run(uint64_t max_instr);
+
+   /**
+    * \brief Executes one instruction.
+    * \param[out] record if non-null, the executed instruction, its
+    *  register write-back and memory access, in the same format as the
+    *  traces of the verilated bench.
+    * \return false if the simulation is stopped
+    */
+   bool step(TraceRecord* record = nullptr);
+
+   bool halted() const {
+      return halted_;
+   }
+
+   /**
+    * \brief Gets the reason why the simulation stopped.
+    */
+   const char* halt_reason() const {
+      return halt_reason_;
+   }
+
+   /**
+    * \brief Gets the exit code (a0 when exit() was called), or -1.
+    */
+   int exit_code() const {
+      return exit_code_;
+   }
+
+   uint32_t PC() const {
+      return PC_;
+   }
+
+   uint32_t reg(unsigned int i) const {
+      return x_[i];
+   }
+
+   uint32_t FP_reg(unsigned int i) const {
+      return f_[i];
+   }
+
+   void set_reg(unsigned int i, uint32_t value) {
+      if(i != 0) {
+	 x_[i] = value;
+      }
+   }
+
+   void set_FP_reg(unsigned int i, uint32_t value) {
+      f_[i] = value;
+   }
+
+   uint64_t instret() const {
+      return instret_;
+   }
+
+   /**
+    * \brief Gets a pointer to the instret counter (see SimStats).
+    */
+   const uint64_t* instret_ptr() const {
+      return &instret_;
+   }
+
+   uint64_t cycles() const {
+      return instret_;
+   }
+
+   uint32_t RAM_size() const {
+      return RAM_size_;
+   }
+
+   FemtoSocIO& IO() {
+      return IO_;
+   }
+
+   /**
+    * \brief Connects or disconnects the IO page.
+    * \details When disconnected (co-simulation, see Cosim.h), reads in
+    *  the IO page return 0 and writes are ignored.
+    */
+   void set_IO_enabled(bool enabled) {
+      IO_enabled_ = enabled;
+   }
+
+   /**
+    * \brief Copies data to the RAM.
+    * \param[in] addr the address in the RAM
+    * \param[in] data a pointer to the data
+    * \param[in] size the number of bytes, addr+size should not be larger
+    *  than the size of the RAM
+    */
+   void write_RAM(uint32_t addr, const void* data, uint32_t size);
+
+   /**
+    * \brief Expands a compressed (RVC) instruction.
+    * \return the equivalent 32-bits instruction, or 0 if illegal.
+    */
+   static uint32_t decompress(uint32_t instr);
+
+ private:
+   static const uint32_t IO_BASE = 0x400000;
+
+   template <bool RECORD> void execute(TraceRecord* record);
+
+   // A decoded instruction, for run()
+   struct Decoded {
+      uint8_t op;       // one of OP_xxx (see ISS.cpp)
+      uint8_t rd;
+      uint8_t rs1;
+      uint8_t rs2;
+      int32_t imm;
+      uint32_t len;     // 2 or 4
+   };
+
+   void decode(uint32_t PC);
+
+   /**
+    * \brief Invalidates the decoded instructions that overlap the
+    *  word at an address.
+    */
+   void invalidate(uint32_t addr) {
+      uint32_t i = addr >> 1;
+      if(i < decoded_.size()) {
+	 decoded_[i].op = 0;
+	 if(i > 0) {
+	    decoded_[i-1].op = 0;
+	 }
+	 if(i+1 < decoded_.size()) {
+	    decoded_[i+1].op = 0;
+	 }
+      }
+   }
+
+   void halt(const char* reason) {
+      halted_ = true;
+      halt_reason_ = reason;
+   }
+
+   void bus_error(uint32_t addr);
+
+   uint32_t load(uint32_t addr, unsigned int size);
+   void store(uint32_t addr, uint32_t data, unsigned int size);
+
+   uint32_t read_CSR(uint32_t csr);
+   void write_CSR(uint32_t csr, uint32_t value);
+
+ private:
+   uint32_t x_[32];
+   uint32_t f_[32];
+   uint32_t PC_;
+   uint64_t instret_;
+   uint32_t mstatus_;
+   uint32_t mtvec_;
+   uint32_t mepc_;
+   uint32_t mcause_;
+
+   uint32_t RAM_size_;
+   std::vector<uint8_t> RAM_;
+   FemtoSocIO IO_;
+   bool IO_enabled_;
+
+   // 32-bits equivalent of each 16-bits instruction
+   std::vector<uint32_t> decompressed_;
+
+   // Decoded instruction at each halfword of RAM
+   std::vector<Decoded> decoded_;
+
+   uint32_t exit_address_;
+   bool halted_;
+   const char* halt_reason_;
+   int exit_code_;
+};
+
+#endif
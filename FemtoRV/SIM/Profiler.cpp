@@ -0,0 +1,167 @@
+#include "Profiler.h"
+#include <cstdio>
+#include <string>
+#include <algorithm>
+
+Profiler::Profiler() {
+  cur_page_index_ = 0;
+  cur_page_ = nullptr;
+  nodes_.emplace_back(new Node());
+  root_ = nodes_.back().get();
+  root_->parent = nullptr;
+  root_->function = -1;
+  root_->cycles = 0;
+  node_ = root_;
+  node_begin_ = 0;
+  node_end_ = 0; // empty range: first instruction enters a function
+  pending_call_ = false;
+  pending_ret_ = false;
+}
+
+Profiler::Node* Profiler::child(Node* node, int function) {
+  auto it = node->children.find(function);
+  if(it != node->children.end()) {
+    return it->second;
+  }
+  nodes_.emplace_back(new Node());
+  Node* result = nodes_.back().get();
+  result->parent = node;
+  result->function = function;
+  result->cycles = 0;
+  node->children[function] = result;
+  return result;
+}
+
+void Profiler::enter(Node* node) {
+  node_ = node;
+  if(node->function < 0) {
+    node_begin_ = 0;
+    node_end_ = 0;
+    return;
+  }
+  unsigned int f = (unsigned int)(node->function);
+  const ElfSymbols::Symbol& S = symbols_.symbol(f);
+  node_begin_ = S.address;
+  if(S.size != 0) {
+    node_end_ = S.address + S.size;
+  } else if(f+1 < symbols_.nb_symbols()) {
+    node_end_ = symbols_.symbol(f+1).address;
+  } else {
+    node_end_ = 0xffffffff;
+  }
+}
+
+void Profiler::update_stack(uint32_t PC) {
+  if(pending_call_) {
+    enter(child(node_, symbols_.find(PC)));
+  } else if(pending_ret_ && node_->parent != nullptr) {
+    enter(node_->parent);
+  }
+  pending_call_ = false;
+  pending_ret_  = false;
+
+  // Jumped out of the current function without call or return:
+  // tail call, or return to a function that was called before the
+  // beginning of the profile. Replace the top of the stack.
+  if(PC < node_begin_ || PC >= node_end_) {
+    Node* parent = (node_->parent != nullptr) ? node_->parent : root_;
+    enter(child(parent, symbols_.find(PC)));
+  }
+}
+
+void Profiler::retire(uint32_t PC, uint32_t instr) {
+  ++counter(PC).instret;
+  update_stack(PC);
+
+  uint32_t opcode = instr & 0x7f;
+  uint32_t rd     = (instr >> 7)  & 31;
+  uint32_t rs1    = (instr >> 15) & 31;
+  bool JAL  = (opcode == 0x6f);
+  bool JALR = (opcode == 0x67);
+  if(JAL || JALR) {
+    // link registers: ra (x1), t0 (x5, alternate link register)
+    if(rd == 1 || rd == 5) {
+      pending_call_ = true;
+    } else if(JALR && rd == 0 && (rs1 == 1 || rs1 == 5)) {
+      pending_ret_ = true;
+    }
+  }
+}
+
+bool Profiler::save_flat(const char* filename) const {
+  FILE* f = fopen(filename,"w");
+  if(f == nullptr) {
+    return false;
+  }
+
+  // Accumulate counters by function
+  std::map<int,Counter> by_function;
+  uint64_t total_cycles = 0;
+  uint64_t total_instret = 0;
+  for(const auto& page: pages_) {
+    for(uint32_t i=0; i<PAGE_SIZE; ++i) {
+      const Counter& C = page.second[i];
+      if(C.cycles == 0 && C.instret == 0) {
+	continue;
+      }
+      uint32_t PC = ((page.first << PAGE_SHIFT) | i) << 1;
+      Counter& F = by_function[symbols_.find(PC)];
+      F.cycles  += C.cycles;
+      F.instret += C.instret;
+      total_cycles  += C.cycles;
+      total_instret += C.instret;
+    }
+  }
+
+  std::vector< std::pair<int,Counter> > sorted(
+    by_function.begin(), by_function.end()
+  );
+  std::sort(
+    sorted.begin(), sorted.end(),
+    [](const std::pair<int,Counter>& A, const std::pair<int,Counter>& B) {
+      return A.second.cycles > B.second.cycles;
+    }
+  );
+
+  fprintf(f,"Flat profile: %llu cycles, %llu instructions\n\n",
+	  (unsigned long long)(total_cycles),
+	  (unsigned long long)(total_instret));
+  fprintf(f,"%7s %14s %14s %7s  %s\n","%time","cycles","instret","CPI","function");
+  for(const auto& it: sorted) {
+    const Counter& C = it.second;
+    fprintf(
+      f,"%7.2f %14llu %14llu %7.3f  %s\n",
+      total_cycles != 0 ? 100.0 * double(C.cycles) / double(total_cycles) : 0.0,
+      (unsigned long long)(C.cycles), (unsigned long long)(C.instret),
+      C.instret != 0 ? double(C.cycles) / double(C.instret) : 0.0,
+      symbols_.name(it.first)
+    );
+  }
+  fclose(f);
+  return true;
+}
+
+void Profiler::folded_path(const Node* node, std::string& path) const {
+  if(node->parent != nullptr && node->parent != root_) {
+    folded_path(node->parent, path);
+    path += ";";
+  }
+  path += symbols_.name(node->function);
+}
+
+bool Profiler::save_folded(const char* filename) const {
+  FILE* f = fopen(filename,"w");
+  if(f == nullptr) {
+    return false;
+  }
+  for(const auto& node: nodes_) {
+    if(node->cycles == 0 || node.get() == root_) {
+      continue;
+    }
+    std::string path;
+    folded_path(node.get(), path);
+    fprintf(f,"%s %llu\n",path.c_str(),(unsigned long long)(node->cycles));
+  }
+  fclose(f);
+  return true;
+}
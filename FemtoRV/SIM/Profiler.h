@@ -0,0 +1,120 @@
+/*****************************************************************/
+#ifndef SIM_PROFILER_H
+#define SIM_PROFILER_H
+
+#include "ElfSymbols.h"
+#include <stdint.h>
+#include <vector>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+// Counts the cycles and the instructions spent at each address and in
+// each calling context of the simulated firmware, and maps them to the
+// functions of the ELF executable.
+//
+// Outputs a flat profile (cycles, instructions and CPI per function),
+// and the call stacks in the "folded" format of flamegraph.pl
+// (one line per call stack: main;GL_fill_poly;__mulsi3 cycles).
+//
+// Calls are detected on JAL/JALR that write ra (or t0), returns on
+// JALR zero,ra (or t0). A jump out of the current function that is
+// neither a call nor a return (tail call) replaces the top of the stack.
+class Profiler {
+ public:
+   Profiler();
+
+   /**
+    * \brief Reads the symbols of the executable.
+    * \return true on success, false otherwise
+    */
+   bool load_symbols(const char* elf_filename) {
+      return symbols_.load(elf_filename);
+   }
+
+   /**
+    * \brief To be called at each cycle.
+    * \param[in] PC the program counter of the processor
+    */
+   void tick(uint32_t PC) {
+      // Update the call stack as soon as PC reaches the called function
+      // (or the caller), so that fetch cycles are charged to the right
+      // function.
+      if((pending_call_ || pending_ret_) && (PC < node_begin_ || PC >= node_end_)) {
+	 update_stack(PC);
+      }
+      ++node_->cycles;
+      ++counter(PC).cycles;
+   }
+
+   /**
+    * \brief To be called when an instruction is executed.
+    */
+   void retire(uint32_t PC, uint32_t instr);
+
+   /**
+    * \brief Saves the flat profile (text).
+    * \return true on success, false otherwise
+    */
+   bool save_flat(const char* filename) const;
+
+   /**
+    * \brief Saves the call stacks, in flamegraph.pl format.
+    * \return true on success, false otherwise
+    */
+   bool save_folded(const char* filename) const;
+
+ private:
+
+   struct Counter {
+      uint64_t cycles;
+      uint64_t instret;
+   };
+
+   // A node of the calling context tree
+   struct Node {
+      Node*               parent;
+      int                 function; // index in symbols_, -1 if unknown
+      uint64_t            cycles;
+      std::map<int,Node*> children;
+   };
+
+   // The counters are stored by pages of PAGE_SIZE 16-bit instructions.
+   static const unsigned int PAGE_SHIFT = 12;
+   static const unsigned int PAGE_SIZE  = 1u << PAGE_SHIFT;
+
+   Counter& counter(uint32_t PC) {
+      uint32_t page = PC >> (PAGE_SHIFT+1);
+      if(page != cur_page_index_ || cur_page_ == nullptr) {
+	 std::unique_ptr<Counter[]>& P = pages_[page];
+	 if(!P) {
+	    P.reset(new Counter[PAGE_SIZE]());
+	 }
+	 cur_page_index_ = page;
+	 cur_page_ = P.get();
+      }
+      return cur_page_[(PC >> 1) & (PAGE_SIZE-1)];
+   }
+
+   void update_stack(uint32_t PC);
+   Node* child(Node* node, int function);
+   void enter(Node* node);
+   void folded_path(const Node* node, std::string& path) const;
+
+ private:
+   ElfSymbols symbols_;
+
+   std::unordered_map< uint32_t, std::unique_ptr<Counter[]> > pages_;
+   uint32_t cur_page_index_;
+   Counter* cur_page_;
+
+   std::vector< std::unique_ptr<Node> > nodes_;
+   Node* root_;
+   Node* node_;
+   uint32_t node_begin_; // address range of the function of node_
+   uint32_t node_end_;
+   bool pending_call_;
+   bool pending_ret_;
+};
+
+#endif
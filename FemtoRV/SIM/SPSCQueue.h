@@ -0,0 +1,57 @@
+/*****************************************************************/
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// A lock-free single-producer single-consumer queue, used to send
+// the pin transitions of the devices from the simulation thread to
+// the thread that runs the device models (see sim_main.cpp, SIM_MT).
+// The capacity is (1 << LOG2_SIZE) - 1 elements.
+template <class T, unsigned int LOG2_SIZE> class SPSCQueue {
+ public:
+   SPSCQueue() : head_(0), tail_(0) {
+   }
+
+   /**
+    * \brief Inserts an element (producer side).
+    * \return false if the queue is full, true otherwise.
+    */
+   bool push(const T& x) {
+      size_t head = head_.load(std::memory_order_relaxed);
+      size_t next = (head + 1) & MASK;
+      if(next == tail_.load(std::memory_order_acquire)) {
+	 return false;
+      }
+      buffer_[head] = x;
+      head_.store(next, std::memory_order_release);
+      return true;
+   }
+
+   /**
+    * \brief Removes an element (consumer side).
+    * \return false if the queue is empty, true otherwise.
+    */
+   bool pop(T& x) {
+      size_t tail = tail_.load(std::memory_order_relaxed);
+      if(tail == head_.load(std::memory_order_acquire)) {
+	 return false;
+      }
+      x = buffer_[tail];
+      tail_.store((tail + 1) & MASK, std::memory_order_release);
+      return true;
+   }
+
+ private:
+   static const size_t SIZE = size_t(1) << LOG2_SIZE;
+   static const size_t MASK = SIZE - 1;
+
+   // head_ and tail_ on different cache lines, to avoid false sharing
+   // between the producer and the consumer.
+   alignas(64) std::atomic<size_t> head_;
+   alignas(64) std::atomic<size_t> tail_;
+   alignas(64) T buffer_[SIZE];
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "SSD1351.h"
+#include <cstdio>
+#include <cstring>
 
 SSD1351::SSD1351(
  CData& DIN, CData& CLK, CData& CS, CData& DC, CData& RST
@@ -10,9 +12,18 @@ SSD1351::SSD1351(
   prev_CLK_ = 0;
   prev_CS_  = 1;
   fetch_next_half_ = false;
-  x1_ = 0; x2_ = 127;
-  y1_ = 0; y2_ = 127;
+  cur_arg_index_ = 0;
+  x_ = 0; x1_ = 0; x2_ = 127;
+  y_ = 0; y1_ = 0; y2_ = 127;
   start_line_ = 0;
+  memset(framebuffer_, 0, sizeof(framebuffer_));
+  nb_frames_ = 0;
+  snapshot_basename_ = "oled";
+  snapshot_nb_frames_ = 0;
+  max_fps_ = 60;
+  dirty_ = false;
+#ifndef SSD1351_HEADLESS
+  last_redraw_ = std::chrono::steady_clock::now();
   if(!glfwInit()) {
     fprintf(stderr,"Could not initialize glfw\n");
     exit(-1);
@@ -22,9 +33,10 @@ SSD1351::SSD1351(
   glfwMakeContextCurrent(window_);
   glfwSwapInterval(1);
   glPixelZoom(4.0f,4.0f);
+#endif
 }
 
-void SSD1351::eval() {
+void SSD1351::on_edge() {
   if(prev_CS_ && !CS_) {
     cur_word_ = 0;
     cur_bit_  = 0;
@@ -59,7 +71,8 @@ void SSD1351::eval() {
       // set display start line
       if(cur_command_ == 0xa1 && cur_arg_index_ == 1) {
 	start_line_ = cur_arg_[0];
-	redraw();
+	update();
+	end_frame();
       }
 
       // draw pixels
@@ -85,8 +98,9 @@ void SSD1351::eval() {
 	if(x_ > x2_) {
 	  ++y_;
 	  x_ = x1_;
-	  if(true || x2_ > 63 || y_ > y2_) {
-	    redraw();
+	  update();
+	  if(y_ == y2_+1) {
+	    end_frame();
 	  }
 	}
       } 
@@ -98,7 +112,89 @@ void SSD1351::eval() {
   prev_CS_  = CS_;
 }
 
+#ifdef SIM_SAVABLE
+
+// Note: the pins (references to the signals of the verilated model)
+// are not saved, they are restored with the verilated model.
+
+void SSD1351::save(VerilatedSerialize& os) {
+  os << prev_CLK_ << prev_CS_;
+  os << prev_word_ << cur_word_ << cur_bit_ << cur_command_;
+  os << cur_arg_[0] << cur_arg_[1] << cur_arg_index_;
+  os << x_ << x1_ << x2_ << y_ << y1_ << y2_ << start_line_;
+  os << fetch_next_half_ << nb_frames_;
+  os.write(framebuffer_, sizeof(framebuffer_));
+}
+
+void SSD1351::restore(VerilatedDeserialize& is) {
+  is >> prev_CLK_ >> prev_CS_;
+  is >> prev_word_ >> cur_word_ >> cur_bit_ >> cur_command_;
+  is >> cur_arg_[0] >> cur_arg_[1] >> cur_arg_index_;
+  is >> x_ >> x1_ >> x2_ >> y_ >> y1_ >> y2_ >> start_line_;
+  is >> fetch_next_half_ >> nb_frames_;
+  is.read(framebuffer_, sizeof(framebuffer_));
+  redraw();
+}
+
+#endif
+
+void SSD1351::end_frame() {
+  ++nb_frames_;
+  if(snapshot_nb_frames_ != 0 && (nb_frames_ % snapshot_nb_frames_) == 0) {
+    char filename[1024];
+    snprintf(
+      filename, sizeof(filename), "%s_%.6u.ppm",
+      snapshot_basename_, nb_frames_ / snapshot_nb_frames_
+    );
+    if(!save_PPM(filename)) {
+      fprintf(stderr,"Could not save %s\n",filename);
+    }
+  }
+}
+
+bool SSD1351::save_PPM(const char* filename) const {
+  FILE* f = fopen(filename,"wb");
+  if(f == nullptr) {
+    return false;
+  }
+  fprintf(f,"P6\n128 128\n255\n");
+  unsigned char row[128*3];
+  for(unsigned int y=0; y<128; ++y) {
+    // Framebuffer is stored upside down (for glDrawPixels()),
+    // and the display starts at start_line_.
+    unsigned int yy = 127 - ((y + start_line_) & 127);
+    for(unsigned int x=0; x<128; ++x) {
+      unsigned short pixel = framebuffer_[yy*128+x];
+      unsigned int R = (pixel >> 11) & 31;
+      unsigned int G = (pixel >> 5)  & 63;
+      unsigned int B =  pixel        & 31;
+      row[3*x]   = (unsigned char)((R << 3) | (R >> 2));
+      row[3*x+1] = (unsigned char)((G << 2) | (G >> 4));
+      row[3*x+2] = (unsigned char)((B << 3) | (B >> 2));
+    }
+    fwrite(row, 1, sizeof(row), f);
+  }
+  fclose(f);
+  return true;
+}
+
+void SSD1351::update() {
+  dirty_ = true;
+#ifndef SSD1351_HEADLESS
+  if(max_fps_ != 0) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(now - last_redraw_ < std::chrono::microseconds(1000000 / max_fps_)) {
+      return;
+    }
+  }
+  redraw();
+#endif
+}
+
 void SSD1351::redraw() {
+  dirty_ = false;
+#ifndef SSD1351_HEADLESS
+  last_redraw_ = std::chrono::steady_clock::now();
   glRasterPos2f(-1.0f,-1.0f);
   if(start_line_ != 0) {
     glDrawPixels(
@@ -112,5 +208,6 @@ void SSD1351::redraw() {
 	       framebuffer_
 	       );
   glfwSwapBuffers(window_);
+#endif
 }
 
@@ -1,6 +1,20 @@
 /*****************************************************************/
 #include "verilated.h"
+
+// Define SSD1351_HEADLESS to compile a version of the OLED display
+// emulation that does not open a window (and that does not depend
+// on GLFW/OpenGL). Frames are accumulated in memory, and can be
+// optionally saved to PPM files (see set_snapshots()).
+#ifndef SSD1351_HEADLESS
 #include <GLFW/glfw3.h>
+#include <chrono>
+#endif
+
+// Define SIM_SAVABLE (with verilator --savable) to save/restore the state
+// of the display in simulator checkpoints (see sim_main.cpp).
+#ifdef SIM_SAVABLE
+#include "verilated_save.h"
+#endif
 
 // Emulates the 128x128 OLED display
 class SSD1351 {
@@ -9,10 +23,83 @@ class SSD1351 {
       CData& DIN, CData& CLK, CData& CS, CData& DC, CData& RST
    );
 
-   void eval();
+   /**
+    * \brief To be called when the pins may have changed.
+    * \details Does nothing unless there is an edge on CLK or CS,
+    *  so that it can be called at each clock cycle.
+    */
+   void eval() {
+      if(CLK_ != prev_CLK_ || CS_ != prev_CS_) {
+	 on_edge();
+      }
+   }
+
+   /**
+    * \brief Sets the maximum number of times the window is redrawn
+    *  per second (wall time), whatever the SPI traffic.
+    * \param[in] fps the maximum frame rate, 0 for no limit.
+    */
+   void set_max_fps(unsigned int fps) {
+      max_fps_ = fps;
+   }
+
+   /**
+    * \brief Redraws the window if the display was modified since
+    *  the last redraw.
+    * \details Frames that arrive faster than the maximum frame rate are
+    *  skipped, this displays the last one. To be called periodically
+    *  (it is cheap when there is nothing to redraw).
+    */
+   void present() {
+      if(dirty_) {
+	 redraw();
+      }
+   }
+
+   /**
+    * \brief Saves a PPM snapshot of the display every \p nb_frames
+    *  frames.
+    * \param[in] basename the snapshots are saved to basename_nnnnnn.ppm
+    * \param[in] nb_frames saves one frame every nb_frames, 0 to deactivate
+    */
+   void set_snapshots(const char* basename, unsigned int nb_frames) {
+      snapshot_basename_ = basename;
+      snapshot_nb_frames_ = nb_frames;
+   }
+
+   /**
+    * \brief Saves the current content of the display to a PPM file.
+    * \param[in] filename the name of the file.
+    * \return true on success, false otherwise.
+    */
+   bool save_PPM(const char* filename) const;
+
+   /**
+    * \brief Gets the number of frames.
+    * \details A frame is complete when the last pixel of the current
+    *  window is written, or when the display start line changes.
+    */
+   unsigned int nb_frames() const {
+      return nb_frames_;
+   }
+
+#ifdef SIM_SAVABLE
+   /**
+    * \brief Saves the state of the display to a checkpoint.
+    */
+   void save(VerilatedSerialize& os);
+
+   /**
+    * \brief Restores the state of the display from a checkpoint.
+    */
+   void restore(VerilatedDeserialize& is);
+#endif
 
  private:
+  void on_edge();
   void redraw();
+  void update();
+  void end_frame();
   unsigned int flip(unsigned int x, unsigned int nb) {
       unsigned int result=0;
       for(unsigned int bit=0; bit<nb; ++bit) {
@@ -22,7 +109,7 @@ class SSD1351 {
       }
       return result;
    }
-  
+
  private:
    CData& DIN_;
    CData& CLK_;
@@ -38,14 +125,23 @@ class SSD1351 {
    unsigned int cur_command_;
    unsigned int cur_arg_[2];
    unsigned int cur_arg_index_;
-   
+
+#ifndef SSD1351_HEADLESS
    GLFWwindow* window_;
+   std::chrono::steady_clock::time_point last_redraw_;
+#endif
+   unsigned int max_fps_;
+   bool dirty_;
 
    unsigned short framebuffer_[128*128];
-  
+
    unsigned int x_, x1_, x2_;
    unsigned int y_, y1_, y2_;
    unsigned int start_line_;
 
    bool fetch_next_half_;
+
+   unsigned int nb_frames_;
+   const char* snapshot_basename_;
+   unsigned int snapshot_nb_frames_;
 };
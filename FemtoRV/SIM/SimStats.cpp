@@ -0,0 +1,84 @@
+#include "SimStats.h"
+#include <cstdio>
+
+SimStats::SimStats() {
+  instret_ = nullptr;
+  cycles_ = 0;
+  interval_ = 0;
+  next_report_ = 0;
+  start_ = std::chrono::steady_clock::now();
+  last_time_ = start_;
+  last_cycles_ = 0;
+  last_instret_ = 0;
+}
+
+double SimStats::elapsed(std::chrono::steady_clock::time_point from) const {
+  return std::chrono::duration<double>(
+     std::chrono::steady_clock::now() - from
+  ).count();
+}
+
+void SimStats::periodic_report() {
+  double   t       = elapsed(last_time_);
+  uint64_t cycles  = cycles_ - last_cycles_;
+  uint64_t nb_instr = instret() - last_instret_;
+
+  fprintf(
+    stderr, "[stats] cycles=%llu  %.3f MHz",
+    (unsigned long long)(cycles_), t > 0.0 ? double(cycles)/(t*1e6) : 0.0
+  );
+  if(instret_ != nullptr) {
+    fprintf(
+      stderr, "  instret=%llu  CPI=%.3f",
+      (unsigned long long)(instret()),
+      nb_instr != 0 ? double(cycles)/double(nb_instr) : 0.0
+    );
+  }
+  fprintf(stderr,"\n");
+
+  last_time_    = std::chrono::steady_clock::now();
+  last_cycles_  = cycles_;
+  last_instret_ = instret();
+  next_report_  = cycles_ + interval_;
+}
+
+void SimStats::report() {
+  double t = elapsed(start_);
+  fprintf(stderr,"\n");
+  fprintf(stderr,"Simulation report\n");
+  fprintf(stderr,"-----------------\n");
+  fprintf(stderr,"   simulated cycles: %llu\n",(unsigned long long)(cycles_));
+  if(instret_ != nullptr) {
+    uint64_t nb_instr = instret();
+    fprintf(stderr,"   retired instr.  : %llu\n",(unsigned long long)(nb_instr));
+    fprintf(
+      stderr,"   CPI             : %.3f\n",
+      nb_instr != 0 ? double(cycles_)/double(nb_instr) : 0.0
+    );
+  }
+  fprintf(stderr,"   wall time       : %.3f s\n",t);
+  fprintf(
+    stderr,"   simulated freq. : %.3f MHz\n",
+    t > 0.0 ? double(cycles_)/(t*1e6) : 0.0
+  );
+  if(instret_ != nullptr) {
+    fprintf(
+      stderr,"   simulated MIPS  : %.3f\n",
+      t > 0.0 ? double(instret())/(t*1e6) : 0.0
+    );
+  }
+}
+
+bool SimStats::save_report(const char* filename, const char* status) const {
+  FILE* f = fopen(filename,"w");
+  if(f == nullptr) {
+    return false;
+  }
+  fprintf(
+    f,"status=%s cycles=%llu instret=%llu wall_time=%.6f\n",
+    status, (unsigned long long)(cycles_), (unsigned long long)(instret()),
+    elapsed(start_)
+  );
+  fclose(f);
+  return true;
+}
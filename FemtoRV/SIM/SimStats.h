@@ -0,0 +1,96 @@
+/*****************************************************************/
+#ifndef SIM_STATS_H
+#define SIM_STATS_H
+
+#include <stdint.h>
+#include <chrono>
+
+// Measures the throughput of the simulation itself (simulated
+// cycles per second of wall time) and the CPI of the simulated
+// processor. Reports are printed on stderr, so that they do not
+// get mixed with what the simulated firmware sends to the UART.
+class SimStats {
+ public:
+   SimStats();
+
+   /**
+    * \brief Sets the source of the number of retired instructions.
+    * \param[in] instret a pointer to the instret counter of the
+    *  simulated processor, or nullptr if not available.
+    */
+   void set_instret(const uint64_t* instret) {
+      instret_ = instret;
+   }
+
+   /**
+    * \brief Prints a periodic report every \p nb_cycles simulated
+    *  cycles (0 to deactivate).
+    */
+   void set_interval(uint64_t nb_cycles) {
+      interval_ = nb_cycles;
+      next_report_ = cycles_ + nb_cycles;
+   }
+
+   /**
+    * \brief To be called at each simulated clock cycle.
+    */
+   void tick() {
+      ++cycles_;
+      if(interval_ != 0 && cycles_ >= next_report_) {
+	 periodic_report();
+      }
+   }
+
+   uint64_t cycles() const {
+      return cycles_;
+   }
+
+   /**
+    * \brief Sets the number of simulated cycles (used when the
+    *  simulation is restored from a checkpoint).
+    */
+   void set_cycles(uint64_t cycles) {
+      cycles_ = cycles;
+      last_cycles_ = cycles;
+      last_instret_ = instret();
+      next_report_ = cycles_ + interval_;
+   }
+
+   uint64_t instret() const {
+      return (instret_ == nullptr) ? 0 : *instret_;
+   }
+
+   /**
+    * \brief Prints the final summary (to be called at $finish).
+    */
+   void report();
+
+   /**
+    * \brief Saves a machine-readable summary of the simulation, read
+    *  by the batch regression runner (see sim_batch.cpp).
+    * \details The summary is a single line of key=value pairs.
+    * \param[in] filename the name of the file
+    * \param[in] status "finished" if the firmware terminated, or "max_cycles"
+    *  if the simulation was stopped
+    * \return true on success, false otherwise
+    */
+   bool save_report(const char* filename, const char* status) const;
+
+ private:
+   void periodic_report();
+   double elapsed(std::chrono::steady_clock::time_point from) const;
+
+ private:
+   const uint64_t* instret_;
+   uint64_t cycles_;
+   uint64_t interval_;
+   uint64_t next_report_;
+   std::chrono::steady_clock::time_point start_;
+
+   // Values at last periodic report
+   std::chrono::steady_clock::time_point last_time_;
+   uint64_t last_cycles_;
+   uint64_t last_instret_;
+};
+
+#endif
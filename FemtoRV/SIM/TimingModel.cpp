@@ -0,0 +1,420 @@
+#include "TimingModel.h"
+
+const char* instr_class_name(InstrClass cls) {
+  static const char* names[CLASS_NB] = {
+    "ALU", "shift", "MUL", "DIV",
+    "branch", "JAL", "JALR",
+    "load", "store", "FPU", "system"
+  };
+  return names[cls];
+}
+
+void TimedInstr::decode(
+  uint32_t PC_in, uint32_t instr_in, unsigned int len_in, uint32_t next_PC_in,
+  uint32_t rs2_value
+) {
+  PC = PC_in;
+  instr = instr_in;
+  len = len_in;
+  next_PC = next_PC_in;
+  rd  = uint8_t((instr >> 7)  & 31);
+  rs1 = uint8_t((instr >> 15) & 31);
+  rs2 = uint8_t((instr >> 20) & 31);
+  shamt = 0;
+  uint32_t funct3 = (instr >> 12) & 7;
+  uint32_t funct7 = instr >> 25;
+  switch(instr & 127) {
+  case 0x6f: cls = CLASS_JAL;    break;
+  case 0x67: cls = CLASS_JALR;   break;
+  case 0x63: cls = CLASS_BRANCH; break;
+  case 0x03: case 0x07: case 0x2f: // LOAD, FLW, AMO
+    cls = CLASS_LOAD;
+    break;
+  case 0x23: case 0x27: // STORE, FSW
+    cls = CLASS_STORE;
+    break;
+  case 0x13:
+    cls = CLASS_ALU;
+    if(funct3 == 1 || funct3 == 5) {
+      cls = CLASS_SHIFT;
+      shamt = rs2;
+    }
+    break;
+  case 0x33:
+    cls = CLASS_ALU;
+    if(funct7 == 1) {
+      cls = (funct3 < 4) ? CLASS_MUL : CLASS_DIV;
+    } else if(funct3 == 1 || funct3 == 5) {
+      cls = CLASS_SHIFT;
+      shamt = rs2_value & 31;
+    }
+    break;
+  case 0x43: case 0x47: case 0x4b: case 0x4f: case 0x53:
+    cls = CLASS_FPU;
+    break;
+  case 0x73: case 0x0f:
+    cls = CLASS_SYSTEM;
+    break;
+  default:
+    cls = CLASS_ALU;
+    break;
+  }
+}
+
+TimingModel::~TimingModel() {
+}
+
+/*************************************************************************/
+
+namespace {
+
+  enum {
+    ISA_M = 1,
+    ISA_C = 2,
+    ISA_F = 4,
+    ISA_A = 8
+  };
+
+  bool isa_supports(unsigned int isa, const TimedInstr& I) {
+    uint32_t opcode = I.instr & 127;
+    if(I.len == 2 && !(isa & ISA_C)) {
+      return false;
+    }
+    if((I.cls == CLASS_MUL || I.cls == CLASS_DIV) && !(isa & ISA_M)) {
+      return false;
+    }
+    if(
+      (I.cls == CLASS_FPU || opcode == 0x07 || opcode == 0x27) &&
+      !(isa & ISA_F)
+    ) {
+      return false;
+    }
+    if(opcode == 0x2f && !(isa & ISA_A)) {
+      return false;
+    }
+    return true;
+  }
+
+  // Stores wait in WAIT_ALU_OR_MEM only for the IO page and the flash
+  // (NRV_IS_IO_ADDR in femtosoc_config.v)
+  bool is_IO_or_flash(uint32_t addr) {
+    return ((addr >> 22) & 3) != 0;
+  }
+
+  /*
+   * quark, tachyon, quark_bicycle: RV32I, state machine
+   * FETCH_INSTR, WAIT_INSTR, EXECUTE(1,2), WAIT_ALU_OR_MEM
+   */
+  class QuarkModel : public TimingModel {
+  public:
+    enum Variant { QUARK, TACHYON, BICYCLE };
+
+    QuarkModel(const TimingConfig& config, Variant variant) :
+      TimingModel(config), variant_(variant), prev_waited_(true) {
+    }
+
+    const char* name() const override {
+      switch(variant_) {
+      case TACHYON: return "tachyon";
+      case BICYCLE: return "quark_bicycle";
+      default:      return "quark";
+      }
+    }
+
+    bool supports(const TimedInstr& I) const override {
+      return isa_supports(0, I);
+    }
+
+    unsigned int fetch_cycles(const TimedInstr& I) override {
+      // quark_bicycle goes directly from EXECUTE to WAIT_INSTR
+      unsigned int fetch = (variant_ == BICYCLE && !prev_waited_) ? 0 : 1;
+      return fetch + 1 + read_wait(I.PC);
+    }
+
+    unsigned int execute_cycles(const TimedInstr& I) override {
+      unsigned int execute = (variant_ == TACHYON) ? 2 : 1;
+      unsigned int wait = 0;
+      bool waits = false;
+      if(I.cls == CLASS_LOAD) {
+	waits = true;
+	wait = 1 + read_wait(I.mem_addr);
+      } else if(I.cls == CLASS_STORE && is_IO_or_flash(I.mem_addr)) {
+	waits = true;
+	wait = 1;
+      } else if(I.cls == CLASS_SHIFT && variant_ != BICYCLE) {
+	unsigned int steps = config_.twolevel_shifter ?
+	  (I.shamt / 4 + I.shamt % 4) : I.shamt;
+	if(variant_ == QUARK) {
+	  // shifts always go to WAIT_ALU_OR_MEM
+	  waits = true;
+	  wait = 1 + steps;
+	} else if(steps != 0) {
+	  // tachyon: the first step is done in EXECUTE2
+	  waits = true;
+	  wait = steps;
+	}
+      }
+      prev_waited_ = waits;
+      return execute + wait;
+    }
+
+  private:
+    Variant variant_;
+    bool prev_waited_;
+  };
+
+  /*
+   * electron, intermissum: RV32IM, barrel shifter, 1-cycle MUL,
+   * DIV in 32 cycles.
+   */
+  class ElectronModel : public TimingModel {
+  public:
+    ElectronModel(const TimingConfig& config, const char* name) :
+      TimingModel(config), name_(name) {
+    }
+
+    const char* name() const override {
+      return name_;
+    }
+
+    bool supports(const TimedInstr& I) const override {
+      return isa_supports(ISA_M, I);
+    }
+
+    unsigned int fetch_cycles(const TimedInstr& I) override {
+      return 2 + read_wait(I.PC);
+    }
+
+    unsigned int execute_cycles(const TimedInstr& I) override {
+      switch(I.cls) {
+      case CLASS_LOAD:  return 2 + read_wait(I.mem_addr);
+      case CLASS_STORE: return 2;
+      case CLASS_DIV:   return 1 + 33;
+      default:          return 1;
+      }
+    }
+
+  private:
+    const char* name_;
+  };
+
+  /*
+   * gracilis, individua, petitbateau: RVC, the last fetched word is
+   * cached, and FETCH_INSTR is skipped when the next instruction is in
+   * this word.
+   */
+  class GracilisModel : public TimingModel {
+  public:
+    GracilisModel(const TimingConfig& config, const char* name, unsigned int isa) :
+      TimingModel(config), name_(name), isa_(isa), cached_word_(0xffffffff) {
+    }
+
+    const char* name() const override {
+      return name_;
+    }
+
+    bool supports(const TimedInstr& I) const override {
+      return isa_supports(isa_, I);
+    }
+
+    unsigned int fetch_cycles(const TimedInstr& I) override {
+      uint32_t word = I.PC >> 2;
+      bool unaligned_long = (I.len == 4) && (I.PC & 2);
+      bool hit = (word == cached_word_);
+      unsigned int result;
+      if(hit && !unaligned_long) {
+	result = 1;                             // WAIT_INSTR
+      } else if(hit || !unaligned_long) {
+	result = 2 + read_wait(I.PC);           // FETCH_INSTR, WAIT_INSTR
+      } else {
+	result = 4 + 2 * read_wait(I.PC);       // both halves
+      }
+      cached_word_ = unaligned_long ? word + 1 : word;
+      // petitbateau: DECOMPRESS_GETREGS state
+      if((isa_ & ISA_F) && I.len == 2) {
+	++result;
+      }
+      return result;
+    }
+
+    unsigned int execute_cycles(const TimedInstr& I) override {
+      bool F = (isa_ & ISA_F) != 0;
+      switch(I.cls) {
+      case CLASS_LOAD:
+	return 2 + read_wait(I.mem_addr);
+      case CLASS_STORE:
+	// petitbateau only waits for IO stores (NRV_IS_IO_ADDR)
+	return (F && !is_IO_or_flash(I.mem_addr)) ? 1 : 2;
+      case CLASS_DIV:
+	return F ? 1 + 34 : 1 + 33;
+      case CLASS_FPU:
+	return 2 + FPU_microprogram_length(I.instr);
+      default:
+	return 1;
+      }
+    }
+
+  private:
+    /*
+     * \brief Gets the number of micro-instructions executed by the FPU
+     *  (see the ROM generated in RTL/PROCESSOR/petitbateau.v, with
+     *  PRECISE_DIV)
+     */
+    static unsigned int FPU_microprogram_length(uint32_t instr) {
+      if((instr & 127) != 0x53) {
+	return 5;                             // FMADD, FMSUB, FNMADD, FNMSUB
+      }
+      switch(instr >> 27) {
+      case 0x00: case 0x01: return 5;         // FADD, FSUB
+      case 0x02: return 1;                    // FMUL
+      case 0x03: return 62;                   // FDIV
+      case 0x0b: return 29;                   // FSQRT
+      case 0x05: return 2;                    // FMIN, FMAX
+      case 0x14: return 2;                    // FEQ, FLT, FLE
+      case 0x18: return 2;                    // FCVT.W.S, FCVT.WU.S
+      case 0x1a: return 3;                    // FCVT.S.W, FCVT.S.WU
+      default:   return 0;                    // FSGNJ, FMV, FCLASS
+      }
+    }
+
+  private:
+    const char* name_;
+    unsigned int isa_;
+    uint32_t cached_word_;
+  };
+
+  /*
+   * The pipelined core of TUTORIALS/FROM_BLINKER_TO_RISCV/pipeline8.v
+   * (RV32I, gshare branch predictor, no return address stack).
+   */
+  class PipelineModel : public TimingModel {
+  public:
+    PipelineModel(const TimingConfig& config) :
+      TimingModel(config),
+      BHT_(BHT_SIZE, 0),
+      history_(0),
+      prev_rd_(-1),
+      nb_mispredicts_(0) {
+    }
+
+    const char* name() const override {
+      return "pipeline8";
+    }
+
+    bool supports(const TimedInstr& I) const override {
+      return isa_supports(0, I);
+    }
+
+    unsigned int fetch_cycles(const TimedInstr& I) override {
+      (void)I;
+      return 0;
+    }
+
+    unsigned int execute_cycles(const TimedInstr& I) override {
+      unsigned int result = 1;
+      uint32_t opcode = I.instr & 127;
+
+      // Load-use (and CSRRS-use) hazard: 1 stall
+      bool reads_rs1 = !(opcode == 0x6f || opcode == 0x17 || opcode == 0x37);
+      bool reads_rs2 = (opcode == 0x33 || opcode == 0x63 || opcode == 0x23);
+      if(
+	prev_rd_ >= 0 && (
+	  (reads_rs1 && int(I.rs1) == prev_rd_) ||
+	  (reads_rs2 && int(I.rs2) == prev_rd_)
+	)
+      ) {
+	++result;
+      }
+      bool CSRRS = (opcode == 0x73) && (((I.instr >> 12) & 7) == 2);
+      prev_rd_ = (I.cls == CLASS_LOAD || CSRRS) ? int(I.rd) : -1;
+
+      switch(I.cls) {
+      case CLASS_JAL:
+	result += 1;  // jump in D
+	break;
+      case CLASS_JALR:
+	result += 2;  // jump in E
+	break;
+      case CLASS_BRANCH: {
+	bool taken = (I.next_PC != I.PC + I.len);
+	uint32_t index =
+	  ((I.PC >> 2) ^ (history_ << (BP_ADDR_BITS - BP_HISTO_BITS))) &
+	  (BHT_SIZE - 1);
+	bool predicted = (BHT_[index] & 2) != 0;
+	if(predicted != taken) {
+	  result += 2; // flush in E
+	  ++nb_mispredicts_;
+	} else if(taken) {
+	  result += 1; // jump in D
+	}
+	// 2 bits saturated counter
+	if(taken && BHT_[index] != 3) {
+	  ++BHT_[index];
+	} else if(!taken && BHT_[index] != 0) {
+	  --BHT_[index];
+	}
+	history_ = ((taken ? 1u : 0u) << (BP_HISTO_BITS-1)) | (history_ >> 1);
+      } break;
+      default:
+	break;
+      }
+      return result;
+    }
+
+    uint64_t nb_mispredicts() const override {
+      return nb_mispredicts_;
+    }
+
+  private:
+    static const unsigned int BP_HISTO_BITS = 9;
+    static const unsigned int BP_ADDR_BITS  = 12;
+    static const unsigned int BHT_SIZE = 1u << BP_ADDR_BITS;
+    std::vector<uint8_t> BHT_;
+    uint32_t history_;
+    int prev_rd_;
+    uint64_t nb_mispredicts_;
+  };
+
+}
+
+/*************************************************************************/
+
+std::vector<std::string> TimingModel::names() {
+  return {
+    "quark", "quark_bicycle", "tachyon", "electron", "intermissum",
+    "gracilis", "individua", "petitbateau", "pipeline8"
+  };
+}
+
+TimingModel* TimingModel::create(
+  const std::string& name, const TimingConfig& config
+) {
+  if(name == "quark") {
+    return new QuarkModel(config, QuarkModel::QUARK);
+  }
+  if(name == "quark_bicycle") {
+    return new QuarkModel(config, QuarkModel::BICYCLE);
+  }
+  if(name == "tachyon") {
+    return new QuarkModel(config, QuarkModel::TACHYON);
+  }
+  if(name == "electron") {
+    return new ElectronModel(config, "electron");
+  }
+  if(name == "intermissum") {
+    return new ElectronModel(config, "intermissum");
+  }
+  if(name == "gracilis") {
+    return new GracilisModel(config, "gracilis", ISA_M | ISA_C);
+  }
+  if(name == "individua") {
+    return new GracilisModel(config, "individua", ISA_M | ISA_C | ISA_A);
+  }
+  if(name == "petitbateau") {
+    return new GracilisModel(config, "petitbateau", ISA_M | ISA_C | ISA_F);
+  }
+  if(name == "pipeline8") {
+    return new PipelineModel(config);
+  }
+  return nullptr;
+}
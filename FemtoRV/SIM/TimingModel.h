@@ -0,0 +1,152 @@
+/*****************************************************************/
+#ifndef SIM_TIMING_MODEL_H
+#define SIM_TIMING_MODEL_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Cycle-approximate timing models of the femtorv cores, to estimate the
+// number of cycles of a firmware from its executed instructions (an
+// execution trace of the bench or of the ISS, see timing_tool.cpp),
+// without simulating the RTL.
+//
+// The models follow the state machines of RTL/PROCESSOR/femtorv32_xxx.v:
+//  - quark, tachyon: 1 bit per cycle shifter (4 bits per cycle with
+//    NRV_TWOLEVEL_SHIFTER), tachyon has EXECUTE split in two
+//  - quark_bicycle: barrel shifter, no FETCH state after EXECUTE
+//  - electron, intermissum: barrel shifter, 1-cycle MUL, 32-cycle DIV
+//  - gracilis, individua: electron + RVC with a one-word instruction
+//    cache (no FETCH state when the next instruction is in the same word)
+//  - petitbateau: gracilis + DECOMPRESS state for RVC instructions and
+//    the microprograms of the FPU (RTL/PROCESSOR/petitbateau.v)
+//  - pipeline8: the 5-stages pipeline of
+//    TUTORIALS/FROM_BLINKER_TO_RISCV/pipeline8.v (gshare branch predictor,
+//    1 cycle for predicted taken branches and JAL, 2 cycles for
+//    mispredicted branches and JALR, 1 cycle for load-use hazards)
+// Instruction fetches and loads from the mapped SPI flash
+// (RTL/DEVICES/MappedSPIFlash.v) wait for the flash.
+
+/**
+ * \brief Instruction classes, for the statistics
+ */
+enum InstrClass {
+   CLASS_ALU, CLASS_SHIFT, CLASS_MUL, CLASS_DIV,
+   CLASS_BRANCH, CLASS_JAL, CLASS_JALR,
+   CLASS_LOAD, CLASS_STORE, CLASS_FPU, CLASS_SYSTEM,
+   CLASS_NB
+};
+
+/**
+ * \brief Gets the name of an instruction class
+ */
+const char* instr_class_name(InstrClass cls);
+
+/**
+ * \brief An executed instruction, decoded for the timing models
+ */
+struct TimedInstr {
+   uint32_t   PC;
+   uint32_t   instr;    // 32-bits (decompressed) instruction
+   unsigned int len;    // 2 (RVC) or 4
+   uint32_t   next_PC;  // the address of the next executed instruction
+   InstrClass cls;
+   uint8_t    rd;
+   uint8_t    rs1;
+   uint8_t    rs2;
+   uint32_t   shamt;    // shift amount (immediate or value of rs2)
+   bool       load;
+   bool       store;
+   uint32_t   mem_addr;
+
+   /**
+    * \brief Decodes an instruction.
+    * \param[in] rs2_value the value of rs2 (for register shifts)
+    */
+   void decode(
+      uint32_t PC, uint32_t instr, unsigned int len, uint32_t next_PC,
+      uint32_t rs2_value
+   );
+};
+
+/**
+ * \brief Parameters of the SOC
+ */
+struct TimingConfig {
+   TimingConfig() :
+      flash_read_cycles(64),
+      twolevel_shifter(false) {
+   }
+   // Cycles per 32-bits read of the mapped SPI flash (see the table in
+   // MappedSPIFlash.v: 64 for SPI_FLASH_READ, 72 for FAST_READ, 56 for
+   // FAST_READ_DUAL_OUTPUT, 44 for FAST_READ_DUAL_IO)
+   unsigned int flash_read_cycles;
+   // NRV_TWOLEVEL_SHIFTER (quark and tachyon)
+   bool twolevel_shifter;
+};
+
+/**
+ * \brief Timing model of a core
+ * \details fetch_cycles() and execute_cycles() are called for each
+ *  executed instruction, in order.
+ */
+class TimingModel {
+ public:
+   TimingModel(const TimingConfig& config) : config_(config) {
+   }
+
+   virtual ~TimingModel();
+
+   virtual const char* name() const = 0;
+
+   /**
+    * \brief Tests whether the instruction set of the core has an
+    *  instruction.
+    */
+   virtual bool supports(const TimedInstr& I) const = 0;
+
+   /**
+    * \brief Gets the number of cycles from the end of the previous
+    *  instruction to the EXECUTE state of an instruction.
+    */
+   virtual unsigned int fetch_cycles(const TimedInstr& I) = 0;
+
+   /**
+    * \brief Gets the number of cycles from the EXECUTE state of an
+    *  instruction to its end (wait states included).
+    */
+   virtual unsigned int execute_cycles(const TimedInstr& I) = 0;
+
+   /**
+    * \brief Gets the number of mispredicted branches (pipelined cores).
+    */
+   virtual uint64_t nb_mispredicts() const {
+      return 0;
+   }
+
+   /**
+    * \brief Creates a timing model.
+    * \param[in] name one of names()
+    * \return the model, or nullptr if name is unknown
+    */
+   static TimingModel* create(const std::string& name, const TimingConfig& config);
+
+   static std::vector<std::string> names();
+
+ protected:
+   bool is_flash(uint32_t addr) const {
+      return ((addr >> 22) & 3) == 2;
+   }
+
+   /**
+    * \brief Gets the wait cycles of a memory read.
+    */
+   unsigned int read_wait(uint32_t addr) const {
+      return is_flash(addr) ? config_.flash_read_cycles : 0;
+   }
+
+ protected:
+   TimingConfig config_;
+};
+
+#endif
@@ -0,0 +1,351 @@
+#include "Trace.h"
+#include <cstring>
+
+// Number of records in a chunk
+static const uint32_t CHUNK_RECORDS = 65536;
+
+static const char     TRACE_SIGNATURE[8] = {'F','R','V','T','R','A','C','E'};
+static const uint32_t TRACE_VERSION = 1;
+static const uint32_t CHUNK_MAGIC   = 0x4b4e4843; // "CHNK"
+
+// Bits of the flags byte that starts each record
+enum {
+  TRACE_PC_SEQ     = 1,   // PC = previous PC + 4 (else: delta)
+  TRACE_INSTR_HIT  = 2,   // instruction found in cache (else: 32 bits)
+  TRACE_CYCLES_REP = 4,   // same number of cycles as previous instr.
+  TRACE_WB         = 8,   // rd, value - previous value of rd
+  TRACE_LOAD       = 16,  // address - previous address
+  TRACE_STORE      = 32   // address - previous address, mask, data
+};
+
+static void put_u32(FILE* f, uint32_t x) {
+  unsigned char b[4] = {
+    (unsigned char)(x), (unsigned char)(x >> 8),
+    (unsigned char)(x >> 16), (unsigned char)(x >> 24)
+  };
+  fwrite(b, 1, 4, f);
+}
+
+static bool get_u32(FILE* f, uint32_t& x) {
+  unsigned char b[4];
+  if(fread(b, 1, 4, f) != 4) {
+    return false;
+  }
+  x = uint32_t(b[0]) | uint32_t(b[1]) << 8 |
+      uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24;
+  return true;
+}
+
+/*************************************************************************/
+
+void TracePredictor::reset() {
+  cycle = 0;
+  cycle_delta = 0;
+  PC = 0;
+  mem_addr = 0;
+  memset(regs, 0, sizeof(regs));
+  memset(instr_cache_, 0, sizeof(instr_cache_));
+  // an impossible tag (instructions are at even addresses)
+  memset(instr_cache_tag_, 0xff, sizeof(instr_cache_tag_));
+}
+
+/*************************************************************************/
+
+TraceWriter::TraceWriter() {
+  file_ = nullptr;
+  ring_chunks_ = 0;
+  chunk_records_ = 0;
+  pending_ = false;
+  memset(&record_, 0, sizeof(record_));
+  nb_records_ = 0;
+  nb_bytes_ = 0;
+}
+
+TraceWriter::~TraceWriter() {
+  close();
+}
+
+bool TraceWriter::open(const char* filename, unsigned int ring_chunks) {
+  file_ = fopen(filename, "wb");
+  if(file_ == nullptr) {
+    return false;
+  }
+  ring_chunks_ = ring_chunks;
+  fwrite(TRACE_SIGNATURE, 1, sizeof(TRACE_SIGNATURE), file_);
+  put_u32(file_, TRACE_VERSION);
+  predictor_.reset();
+  chunk_.clear();
+  chunk_.reserve(CHUNK_RECORDS * 4);
+  chunk_records_ = 0;
+  return true;
+}
+
+void TraceWriter::close() {
+  if(file_ == nullptr) {
+    return;
+  }
+  if(pending_) {
+    encode(record_);
+    pending_ = false;
+  }
+  end_chunk();
+  for(auto& chunk: ring_) {
+    write_chunk(chunk.first, chunk.second);
+  }
+  ring_.clear();
+  fclose(file_);
+  file_ = nullptr;
+}
+
+void TraceWriter::put_varint(uint64_t x) {
+  while(x >= 128) {
+    chunk_.push_back(uint8_t(x | 128));
+    x >>= 7;
+  }
+  chunk_.push_back(uint8_t(x));
+}
+
+void TraceWriter::put_signed(int64_t x) {
+  // zigzag encoding: small negative values get small codes
+  put_varint((uint64_t(x) << 1) ^ uint64_t(x >> 63));
+}
+
+void TraceWriter::encode(const TraceRecord& R) {
+  TracePredictor& P = predictor_;
+  size_t flags_pos = chunk_.size();
+  chunk_.push_back(0);
+  uint8_t flags = 0;
+
+  if(R.PC == P.PC + 4) {
+    flags |= TRACE_PC_SEQ;
+  } else {
+    put_signed(int64_t(int32_t(R.PC - P.PC)));
+  }
+  P.PC = R.PC;
+
+  uint32_t* tag;
+  uint32_t* instr = P.instr_cache_entry(R.PC, tag);
+  if(*tag == R.PC && *instr == R.instr) {
+    flags |= TRACE_INSTR_HIT;
+  } else {
+    for(int i=0; i<4; ++i) {
+      chunk_.push_back(uint8_t(R.instr >> (8*i)));
+    }
+    *tag = R.PC;
+    *instr = R.instr;
+  }
+
+  uint64_t cycle_delta = R.cycle - P.cycle;
+  if(cycle_delta == P.cycle_delta) {
+    flags |= TRACE_CYCLES_REP;
+  } else {
+    put_varint(cycle_delta);
+  }
+  P.cycle = R.cycle;
+  P.cycle_delta = cycle_delta;
+
+  if(R.wb) {
+    flags |= TRACE_WB;
+    unsigned int rd = R.rd & 63;
+    chunk_.push_back(uint8_t(rd));
+    put_signed(int64_t(int32_t(R.wb_data - P.regs[rd])));
+    P.regs[rd] = R.wb_data;
+  }
+
+  if(R.load || R.store) {
+    flags |= R.load ? TRACE_LOAD : TRACE_STORE;
+    put_signed(int64_t(int32_t(R.mem_addr - P.mem_addr)));
+    P.mem_addr = R.mem_addr;
+    if(R.store) {
+      chunk_.push_back(R.mem_wmask);
+      put_varint(R.mem_wdata);
+    }
+  }
+
+  chunk_[flags_pos] = flags;
+  ++nb_records_;
+  if(++chunk_records_ == CHUNK_RECORDS) {
+    end_chunk();
+  }
+}
+
+void TraceWriter::end_chunk() {
+  if(chunk_records_ == 0) {
+    return;
+  }
+  if(ring_chunks_ == 0) {
+    write_chunk(chunk_, chunk_records_);
+  } else {
+    ring_.push_back(std::make_pair(chunk_, chunk_records_));
+    if(ring_.size() > ring_chunks_) {
+      ring_.pop_front();
+    }
+  }
+  chunk_.clear();
+  chunk_records_ = 0;
+  predictor_.reset();
+}
+
+void TraceWriter::write_chunk(
+  const std::vector<uint8_t>& chunk, uint32_t nb_records
+) {
+  put_u32(file_, CHUNK_MAGIC);
+  put_u32(file_, nb_records);
+  put_u32(file_, uint32_t(chunk.size()));
+  fwrite(chunk.data(), 1, chunk.size(), file_);
+  nb_bytes_ += chunk.size() + 12;
+}
+
+/*************************************************************************/
+
+TraceReader::TraceReader() {
+  file_ = nullptr;
+  pos_ = 0;
+  chunk_records_ = 0;
+  error_ = false;
+}
+
+TraceReader::~TraceReader() {
+  close();
+}
+
+bool TraceReader::open(const char* filename) {
+  file_ = fopen(filename, "rb");
+  if(file_ == nullptr) {
+    return false;
+  }
+  char signature[8];
+  uint32_t version;
+  if(
+    fread(signature, 1, sizeof(signature), file_) != sizeof(signature) ||
+    memcmp(signature, TRACE_SIGNATURE, sizeof(signature)) != 0 ||
+    !get_u32(file_, version) || version != TRACE_VERSION
+  ) {
+    close();
+    return false;
+  }
+  chunk_records_ = 0;
+  error_ = false;
+  return true;
+}
+
+void TraceReader::close() {
+  if(file_ != nullptr) {
+    fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+bool TraceReader::next_chunk() {
+  uint32_t magic, nb_records, nb_bytes;
+  if(
+    !get_u32(file_, magic) || magic != CHUNK_MAGIC ||
+    !get_u32(file_, nb_records) || !get_u32(file_, nb_bytes)
+  ) {
+    return false;
+  }
+  chunk_.resize(nb_bytes);
+  if(fread(chunk_.data(), 1, nb_bytes, file_) != nb_bytes) {
+    return false;
+  }
+  pos_ = 0;
+  chunk_records_ = nb_records;
+  predictor_.reset();
+  return true;
+}
+
+uint64_t TraceReader::get_varint() {
+  uint64_t result = 0;
+  unsigned int shift = 0;
+  for(;;) {
+    if(pos_ >= chunk_.size() || shift > 63) {
+      error_ = true;
+      return 0;
+    }
+    uint8_t b = chunk_[pos_++];
+    result |= uint64_t(b & 127) << shift;
+    if(!(b & 128)) {
+      return result;
+    }
+    shift += 7;
+  }
+}
+
+int64_t TraceReader::get_signed() {
+  uint64_t x = get_varint();
+  return int64_t(x >> 1) ^ -int64_t(x & 1);
+}
+
+bool TraceReader::next(TraceRecord& R) {
+  if(file_ == nullptr || error_) {
+    return false;
+  }
+  if(chunk_records_ == 0 && !next_chunk()) {
+    return false;
+  }
+  if(pos_ >= chunk_.size()) {
+    error_ = true;
+    return false;
+  }
+
+  TracePredictor& P = predictor_;
+  uint8_t flags = chunk_[pos_++];
+
+  if(flags & TRACE_PC_SEQ) {
+    P.PC += 4;
+  } else {
+    P.PC += uint32_t(get_signed());
+  }
+  R.PC = P.PC;
+
+  uint32_t* tag;
+  uint32_t* instr = P.instr_cache_entry(R.PC, tag);
+  if(!(flags & TRACE_INSTR_HIT)) {
+    if(pos_ + 4 > chunk_.size()) {
+      error_ = true;
+      return false;
+    }
+    *instr = uint32_t(chunk_[pos_])           |
+             uint32_t(chunk_[pos_+1]) << 8    |
+             uint32_t(chunk_[pos_+2]) << 16   |
+             uint32_t(chunk_[pos_+3]) << 24;
+    *tag = R.PC;
+    pos_ += 4;
+  }
+  R.instr = *instr;
+
+  if(!(flags & TRACE_CYCLES_REP)) {
+    P.cycle_delta = get_varint();
+  }
+  P.cycle += P.cycle_delta;
+  R.cycle = P.cycle;
+
+  R.wb = (flags & TRACE_WB) != 0;
+  if(R.wb) {
+    if(pos_ >= chunk_.size()) {
+      error_ = true;
+      return false;
+    }
+    R.rd = chunk_[pos_++] & 63;
+    P.regs[R.rd] += uint32_t(get_signed());
+    R.wb_data = P.regs[R.rd];
+  }
+
+  R.load  = (flags & TRACE_LOAD) != 0;
+  R.store = (flags & TRACE_STORE) != 0;
+  if(R.load || R.store) {
+    P.mem_addr += uint32_t(get_signed());
+    R.mem_addr = P.mem_addr;
+    if(R.store) {
+      if(pos_ >= chunk_.size()) {
+	error_ = true;
+	return false;
+      }
+      R.mem_wmask = chunk_[pos_++];
+      R.mem_wdata = uint32_t(get_varint());
+    }
+  }
+
+  --chunk_records_;
+  return !error_;
+}
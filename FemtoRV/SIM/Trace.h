@@ -0,0 +1,207 @@
+/*****************************************************************/
+#ifndef SIM_TRACE_H
+#define SIM_TRACE_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <vector>
+#include <deque>
+
+// Compact binary execution trace.
+//
+// One record per executed instruction: cycle, PC, instruction, register
+// write-back and memory access. Records are delta-encoded with respect to
+// the previous ones (PC, cycles, memory address, previous value of the
+// destination register) with variable-length integers, and instructions
+// are cached by PC, so that a typical record takes 2 to 4 bytes.
+//
+// The file is a header ("FRVTRACE", version) followed by chunks:
+//   uint32 magic ("CHNK"), uint32 nb_records, uint32 nb_bytes, payload.
+// The encoder state is reset at the beginning of each chunk, so that
+// chunks can be decoded independently (this is what makes the ring
+// buffer mode possible).
+
+/**
+ * \brief An executed instruction
+ */
+struct TraceRecord {
+   uint64_t cycle;      // cycle where the instruction was in EXECUTE state
+   uint32_t PC;
+   uint32_t instr;
+   bool     wb;         // true if a register was written
+   uint8_t  rd;         // written register (32-63: FP registers)
+   uint32_t wb_data;    // written value
+   bool     load;
+   bool     store;
+   uint32_t mem_addr;   // load/store address
+   uint32_t mem_wdata;  // stored data
+   uint8_t  mem_wmask;  // store mask
+};
+
+/**
+ * \brief The state shared by the encoder and the decoder
+ */
+class TracePredictor {
+ public:
+   TracePredictor() {
+      reset();
+   }
+
+   void reset();
+
+   uint32_t* instr_cache_entry(uint32_t PC, uint32_t*& tag) {
+      unsigned int i = (PC >> 1) & (INSTR_CACHE_SIZE - 1);
+      tag = &instr_cache_tag_[i];
+      return &instr_cache_[i];
+   }
+
+   static const unsigned int INSTR_CACHE_SIZE = 4096;
+
+   uint64_t cycle;
+   uint64_t cycle_delta;
+   uint32_t PC;
+   uint32_t mem_addr;
+   uint32_t regs[64];
+
+ private:
+   uint32_t instr_cache_[INSTR_CACHE_SIZE];
+   uint32_t instr_cache_tag_[INSTR_CACHE_SIZE];
+};
+
+/**
+ * \brief Writes an execution trace
+ * \details The write-back and memory access of an instruction are
+ *  reported after retire(), the record is encoded at the next retire()
+ *  (or at close()).
+ */
+class TraceWriter {
+ public:
+   TraceWriter();
+   ~TraceWriter();
+
+   /**
+    * \brief Opens the trace file.
+    * \param[in] filename the name of the file
+    * \param[in] ring_chunks 0 to stream the whole trace to the file,
+    *  otherwise only the last ring_chunks chunks are kept in memory and
+    *  saved by close()
+    * \return true on success, false otherwise
+    */
+   bool open(const char* filename, unsigned int ring_chunks = 0);
+
+   bool is_open() const {
+      return file_ != nullptr;
+   }
+
+   /**
+    * \brief An instruction is executed.
+    */
+   void retire(uint64_t cycle, uint32_t PC, uint32_t instr) {
+      if(pending_) {
+	 encode(record_);
+      }
+      pending_ = true;
+      record_.cycle = cycle;
+      record_.PC = PC;
+      record_.instr = instr;
+      record_.wb = false;
+      record_.load = false;
+      record_.store = false;
+   }
+
+   /**
+    * \brief The current instruction writes a register.
+    * \details Can be called several times (the last value is kept).
+    */
+   void writeback(uint8_t rd, uint32_t data) {
+      if(rd == 0) {
+	 return;
+      }
+      record_.wb = true;
+      record_.rd = rd;
+      record_.wb_data = data;
+   }
+
+   void load(uint32_t addr) {
+      record_.load = true;
+      record_.mem_addr = addr;
+   }
+
+   void store(uint32_t addr, uint32_t wdata, uint8_t wmask) {
+      record_.store = true;
+      record_.mem_addr = addr;
+      record_.mem_wdata = wdata;
+      record_.mem_wmask = wmask;
+   }
+
+   /**
+    * \brief Encodes the last instruction, writes the remaining chunks
+    *  and closes the file.
+    */
+   void close();
+
+   uint64_t nb_records() const {
+      return nb_records_;
+   }
+
+   uint64_t nb_bytes() const {
+      return nb_bytes_;
+   }
+
+ private:
+   void encode(const TraceRecord& record);
+   void end_chunk();
+   void write_chunk(const std::vector<uint8_t>& chunk, uint32_t nb_records);
+   void put_varint(uint64_t x);
+   void put_signed(int64_t x);
+
+ private:
+   FILE* file_;
+   unsigned int ring_chunks_;
+   TracePredictor predictor_;
+   std::vector<uint8_t> chunk_;
+   uint32_t chunk_records_;
+   std::deque< std::pair<std::vector<uint8_t>,uint32_t> > ring_;
+   bool pending_;
+   TraceRecord record_;
+   uint64_t nb_records_;
+   uint64_t nb_bytes_;
+};
+
+/**
+ * \brief Reads an execution trace
+ */
+class TraceReader {
+ public:
+   TraceReader();
+   ~TraceReader();
+
+   /**
+    * \brief Opens a trace file and checks its header.
+    * \return true on success, false otherwise
+    */
+   bool open(const char* filename);
+
+   /**
+    * \brief Decodes the next record.
+    * \return false at the end of the trace (or if the file is corrupted)
+    */
+   bool next(TraceRecord& record);
+
+   void close();
+
+ private:
+   bool next_chunk();
+   uint64_t get_varint();
+   int64_t get_signed();
+
+ private:
+   FILE* file_;
+   TracePredictor predictor_;
+   std::vector<uint8_t> chunk_;
+   size_t pos_;
+   uint32_t chunk_records_;
+   bool error_;
+};
+
+#endif
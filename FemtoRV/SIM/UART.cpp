@@ -0,0 +1,221 @@
+#include "UART.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+// The input (PTY) is read and the output is flushed every
+// POLL_INTERVAL calls to rx_ready() (that is called at each
+// clock cycle by the bench UART when it has no pending byte).
+static const unsigned int POLL_INTERVAL = 4096;
+
+// The output is flushed when the buffer reaches this size.
+static const size_t OUTPUT_BUFFER_SIZE = 4096;
+
+UART* UART::instance_ = nullptr;
+
+UART::UART() {
+  input_pos_ = 0;
+  poll_counter_ = POLL_INTERVAL;
+  PTY_ = -1;
+  finished_ = false;
+  TXD_ = nullptr;
+  RXD_ = nullptr;
+  cycles_per_bit_ = 0;
+  tx_count_ = 0;
+  tx_bit_ = 0;
+  tx_byte_ = 0;
+  rx_count_ = 0;
+  rx_bit_ = 0;
+  rx_byte_ = 0;
+  instance_ = this;
+}
+
+UART::~UART() {
+  flush();
+  if(PTY_ != -1) {
+    close(PTY_);
+  }
+  if(instance_ == this) {
+    instance_ = nullptr;
+  }
+}
+
+bool UART::set_input_file(const char* filename) {
+  FILE* f = fopen(filename,"rb");
+  if(f == nullptr) {
+    return false;
+  }
+  char buffer[4096];
+  size_t nb_read;
+  while((nb_read = fread(buffer,1,sizeof(buffer),f)) != 0) {
+    input_.append(buffer, nb_read);
+  }
+  fclose(f);
+  return true;
+}
+
+bool UART::open_PTY() {
+  PTY_ = posix_openpt(O_RDWR | O_NOCTTY);
+  if(PTY_ == -1) {
+    return false;
+  }
+  if(grantpt(PTY_) != 0 || unlockpt(PTY_) != 0) {
+    close(PTY_);
+    PTY_ = -1;
+    return false;
+  }
+  fcntl(PTY_, F_SETFL, fcntl(PTY_, F_GETFL) | O_NONBLOCK);
+  fprintf(stderr,"[UART] connected to %s\n",ptsname(PTY_));
+  return true;
+}
+
+void UART::connect(CData* TXD, CData* RXD, unsigned int cycles_per_bit) {
+  TXD_ = TXD;
+  RXD_ = RXD;
+  cycles_per_bit_ = cycles_per_bit;
+  *RXD_ = 1; // idle
+}
+
+void UART::eval() {
+
+  // TXD: start bit is detected on the falling edge, then
+  // each bit is sampled in its middle.
+  if(tx_bit_ == 0) {
+    if(!*TXD_) {
+      tx_bit_ = 1;
+      tx_byte_ = 0;
+      tx_count_ = cycles_per_bit_ + cycles_per_bit_/2;
+    }
+  } else if(--tx_count_ == 0) {
+    if(tx_bit_ <= 8) {
+      tx_byte_ |= (unsigned int)(*TXD_ & 1) << (tx_bit_ - 1);
+      ++tx_bit_;
+      tx_count_ = cycles_per_bit_;
+    } else {
+      // stop bit
+      tx_bit_ = 0;
+      tx(uint8_t(tx_byte_));
+    }
+  }
+
+  // RXD: start bit, 8 data bits, two stop bits (so that the
+  // receiver always has time to resynchronize).
+  if(rx_bit_ == 0) {
+    if(rx_ready()) {
+      rx_byte_ = rx();
+      rx_bit_ = 1;
+      rx_count_ = cycles_per_bit_;
+      *RXD_ = 0;
+    }
+  } else if(--rx_count_ == 0) {
+    rx_count_ = cycles_per_bit_;
+    if(rx_bit_ <= 8) {
+      *RXD_ = (rx_byte_ >> (rx_bit_ - 1)) & 1;
+      ++rx_bit_;
+    } else if(rx_bit_ <= 10) {
+      *RXD_ = 1;
+      ++rx_bit_;
+    } else {
+      rx_bit_ = 0;
+    }
+  }
+}
+
+void UART::tx(uint8_t c) {
+  if(c == 4) {
+    flush();
+    printf("<end of simulation> (EOT sent to UART)\n");
+    fflush(stdout);
+    finished_ = true;
+#ifndef STANDALONE_UART
+    Verilated::gotFinish(true);
+#endif
+    return;
+  }
+  output_.push_back(char(c));
+  if(output_.size() >= OUTPUT_BUFFER_SIZE) {
+    flush();
+  }
+}
+
+void UART::flush() {
+  if(output_.empty()) {
+    return;
+  }
+  if(PTY_ != -1) {
+    // Note: output is lost if no terminal is connected to the PTY.
+    ssize_t nb_written = write(PTY_, output_.data(), output_.size());
+    (void)nb_written;
+  } else {
+    fwrite(output_.data(), 1, output_.size(), stdout);
+    fflush(stdout);
+  }
+  output_.clear();
+}
+
+void UART::poll() {
+  poll_counter_ = POLL_INTERVAL;
+  flush();
+  if(input_pos_ == input_.size()) {
+    input_.clear();
+    input_pos_ = 0;
+  }
+  if(PTY_ != -1) {
+    char buffer[256];
+    ssize_t nb_read = read(PTY_, buffer, sizeof(buffer));
+    if(nb_read > 0) {
+      input_.append(buffer, size_t(nb_read));
+    }
+  }
+}
+
+#if defined(SIM_SAVABLE) && !defined(STANDALONE_UART)
+
+// Note: the pins (references to the signals of the verilated model)
+// are not saved, they are restored with the verilated model.
+
+void UART::save(VerilatedSerialize& os) {
+  flush();
+  std::string pending = input_.substr(input_pos_);
+  uint64_t pending_size = pending.size();
+  os << pending_size;
+  os.write(pending.data(), pending.size());
+  os << finished_ << cycles_per_bit_;
+  os << tx_count_ << tx_bit_ << tx_byte_;
+  os << rx_count_ << rx_bit_ << rx_byte_;
+}
+
+void UART::restore(VerilatedDeserialize& is) {
+  uint64_t pending_size;
+  is >> pending_size;
+  std::string pending(size_t(pending_size), '\0');
+  is.read(&pending[0], pending.size());
+  input_ = pending + input_.substr(input_pos_);
+  input_pos_ = 0;
+  is >> finished_ >> cycles_per_bit_;
+  is >> tx_count_ >> tx_bit_ >> tx_byte_;
+  is >> rx_count_ >> rx_bit_ >> rx_byte_;
+}
+
+#endif
+
+/*************************************************************************/
+
+void UART_tx(uint32_t c) {
+  UART* uart = UART::instance();
+  if(uart == nullptr) {
+    putchar(int(c & 255));
+    return;
+  }
+  uart->tx(uint8_t(c));
+}
+
+uint32_t UART_rx_ready() {
+  UART* uart = UART::instance();
+  return (uart != nullptr && uart->rx_ready()) ? 1 : 0;
+}
+
+uint32_t UART_rx() {
+  return UART::instance()->rx();
+}
@@ -0,0 +1,162 @@
+/*****************************************************************/
+#ifndef SIM_UART_H
+#define SIM_UART_H
+
+#include <stdint.h>
+#include <string>
+
+// Define STANDALONE_UART to use the model without Verilator (for
+// instance in the instruction set simulator, see ISS.h).
+#ifdef STANDALONE_UART
+typedef uint8_t CData;
+#else
+#include "verilated.h"
+// Define SIM_SAVABLE (with verilator --savable) to save/restore the state
+// of the model in simulator checkpoints (see sim_main.cpp).
+#ifdef SIM_SAVABLE
+#include "verilated_save.h"
+#endif
+#endif
+
+// Emulates the other end of the UART (the terminal).
+//
+// Two ways of connecting it to the verilated femtosoc:
+// - fast path (default): the bench UART (RTL/DEVICES/uart.v) exchanges
+//   bytes with the model through $c() calls to UART_tx(), UART_rx_ready()
+//   and UART_rx() (below, included in the verilated model with -FI).
+// - pins (BENCH_UART_PINS): the real UART of the femtosoc is simulated,
+//   and the model decodes TXD and drives RXD (see connect() and eval()).
+//
+// Input comes from a script file (set_input_file()) and/or a pseudo
+// terminal (open_PTY()). Output goes to stdout (or to the pseudo
+// terminal), and is buffered.
+// EOT (4) sent by the firmware terminates the simulation.
+class UART {
+ public:
+   UART();
+   ~UART();
+
+   /**
+    * \brief Reads the characters sent to the firmware from a file.
+    * \details The characters are sent as soon as the firmware can
+    *  receive them. The file is read before the PTY (if any).
+    * \return true on success, false otherwise
+    */
+   bool set_input_file(const char* filename);
+
+   /**
+    * \brief Creates a pseudo-terminal, where the firmware can be
+    *  accessed with a terminal emulator (e.g. screen /dev/pts/N).
+    * \details Both input and output go through the pseudo-terminal.
+    * \return true on success, false otherwise
+    */
+   bool open_PTY();
+
+   /**
+    * \brief Connects the model to the pins of the verilated UART
+    * \param[in] TXD the TXD pin (femtosoc to model)
+    * \param[in] RXD the RXD pin (model to femtosoc)
+    * \param[in] cycles_per_bit the duration of a bit, in clock cycles
+    */
+   void connect(CData* TXD, CData* RXD, unsigned int cycles_per_bit);
+
+   /**
+    * \brief To be called at each clock cycle when connected to the pins.
+    */
+   void eval();
+
+   /**
+    * \brief A byte is sent by the firmware.
+    * \details EOT (4) terminates the simulation.
+    */
+   void tx(uint8_t c);
+
+   /**
+    * \brief Tests whether the firmware sent EOT.
+    */
+   bool finished() const {
+      return finished_;
+   }
+
+   /**
+    * \brief Tests whether there is a byte for the firmware.
+    */
+   bool rx_ready() {
+      if(input_pos_ < input_.size()) {
+	 return true;
+      }
+      if(--poll_counter_ == 0) {
+	 poll();
+      }
+      return input_pos_ < input_.size();
+   }
+
+   /**
+    * \brief Gets the next byte for the firmware.
+    * \pre rx_ready()
+    */
+   uint8_t rx() {
+      return uint8_t(input_[input_pos_++]);
+   }
+
+   /**
+    * \brief Writes the buffered output.
+    */
+   void flush();
+
+#if defined(SIM_SAVABLE) && !defined(STANDALONE_UART)
+   /**
+    * \brief Saves the state of the model to a checkpoint.
+    * \details The output is flushed. The input that was not sent to
+    *  the firmware yet is saved, the pseudo-terminal is not.
+    */
+   void save(VerilatedSerialize& os);
+
+   /**
+    * \brief Restores the state of the model from a checkpoint.
+    * \details The saved input is sent to the firmware before the
+    *  input of set_input_file() and open_PTY(). The duration of a bit
+    *  is the one of the checkpoint (a byte may be in transit).
+    */
+   void restore(VerilatedDeserialize& is);
+#endif
+
+   /**
+    * \brief Gets the UART model used by UART_tx(), UART_rx_ready()
+    *  and UART_rx() (the last one that was created).
+    */
+   static UART* instance() {
+      return instance_;
+   }
+
+ private:
+   void poll();
+
+ private:
+   static UART* instance_;
+
+   std::string input_;
+   size_t input_pos_;
+   std::string output_;
+   unsigned int poll_counter_;
+   int PTY_;
+   bool finished_;
+
+   // pins
+   CData* TXD_;
+   CData* RXD_;
+   unsigned int cycles_per_bit_;
+   unsigned int tx_count_;
+   unsigned int tx_bit_;
+   unsigned int tx_byte_;
+   unsigned int rx_count_;
+   unsigned int rx_bit_;
+   unsigned int rx_byte_;
+};
+
+// Called by the bench UART (RTL/DEVICES/uart.v) through $c()
+void UART_tx(uint32_t c);
+uint32_t UART_rx_ready();
+uint32_t UART_rx();
+
+#endif
@@ -0,0 +1,903 @@
+/*
+ * fpu_conformance: conformance tests of the FPU functions of FPU_funcs.h
+ * (the host path XXX_WITH_HOST_FPU() and the soft path XXX_WITH_SOFT_FPU(),
+ * see FPU_host_func() and FPU_soft_func()) against a reference
+ * implementation of the RISC-V F extension.
+ *
+ * Usage: fpu_conformance <options>
+ *   -func name   : only tests this function (FADD, FSQRT, FCVTWS, ...)
+ *   -path name   : only tests this path (host or soft, default: both)
+ *   -n N         : number of random operands of the functions with two or
+ *                  three operands (default: 10000000)
+ *   -stride S    : tests one input out of S for the functions with one
+ *                  operand (default: 1, all the 2^32 inputs)
+ *   -seed S      : seed of the random operands
+ *   -threads N   : number of threads (default: number of cores)
+ *   -examples    : prints the first mismatch of each test
+ *   -out file    : writes the report (CSV)
+ *   -baseline file : compares with a previous report, and reports the
+ *                  tests that changed
+ *   -rounding mode : rounding mode (rne, rtz, rdn, rup, default: rtz)
+ *   -denormals   : gradual underflow (default: flush to zero)
+ *   -guard_bits  : guard bits and sticky bit in the FPU class
+ *   -ieee        : same as -rounding rne -denormals -guard_bits
+ *
+ * Each function is tested on the corpora:
+ *   all     : all the inputs (functions with one operand)
+ *   edge    : all the combinations of special values (zeroes, denormals,
+ *             smallest and largest normals, infinities, NaNs, values
+ *             around 1 and around the limits of the integer conversions)
+ *   random  : structured random operands (normals with close exponents,
+ *             normals with any exponent, operands that cancel, special
+ *             values, denormals, random bit patterns)
+ *
+ * Reference: the arithmetic operations are computed by the SSE
+ * instructions of the host in single precision, with the rounding mode
+ * and flush-to-zero mode (FTZ) of the configuration, and their NaN results
+ * are replaced by the canonical NaN of RISC-V. FSGNJ, FMIN, FMAX, FEQ,
+ * FLT, FLE, FCLASS and the conversions to integer follow the RISC-V
+ * specification (conversions to integer round towards zero, like the
+ * casts of the C compiler, and saturate). SSE has no RMM mode, that is
+ * not supported by this tool.
+ *
+ * Results are compared bit for bit. The mismatches are sorted in
+ * categories:
+ *   NaN/inf op  : an operand is a NaN or an infinity
+ *   denormal op : an operand is a denormal number
+ *   NaN         : both results are NaNs, with different payloads
+ *   zero sign   : both results are zeroes, with different signs
+ *   other       : the other mismatches
+ * The checksum summarizes all the results of a path: two implementations
+ * with the same checksums on all the tests compute the same results
+ * (with a high probability), even where they are not conformant.
+ *
+ * Exit status: without -baseline, 0 if all the tests are conformant;
+ * with -baseline, 0 if no test changed (same number of mismatches and
+ * same checksum). 1 otherwise.
+ */
+
+#include "FPU_funcs.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+#ifdef __FMA__
+#include <immintrin.h>
+#endif
+
+static const uint32_t CANONICAL_NAN = 0x7fc00000;
+
+static inline uint32_t float_exp(uint32_t x) {
+   return (x >> 23) & 255;
+}
+
+static inline uint32_t float_mant(uint32_t x) {
+   return x & 0x7fffff;
+}
+
+static inline bool is_NaN(uint32_t x) {
+   return float_exp(x) == 255 && float_mant(x) != 0;
+}
+
+static inline bool is_NaN_or_infty(uint32_t x) {
+   return float_exp(x) == 255;
+}
+
+static inline bool is_zero(uint32_t x) {
+   return (x & 0x7fffffff) == 0;
+}
+
+static inline bool is_denormal(uint32_t x) {
+   return float_exp(x) == 0 && float_mant(x) != 0;
+}
+
+/*******************************************************************/
+
+/*
+ * \brief Characteristics of the functions, for the reference and the
+ *  categories of mismatches
+ */
+static bool int_operand(FPUFunc f) {
+   return f == FPU_FUNC_FCVTSW || f == FPU_FUNC_FCVTSWU;
+}
+
+static bool int_result(FPUFunc f) {
+   switch(f) {
+   case FPU_FUNC_FCVTWS:
+   case FPU_FUNC_FCVTWUS:
+   case FPU_FUNC_FEQ:
+   case FPU_FUNC_FLT:
+   case FPU_FUNC_FLE:
+   case FPU_FUNC_FCLASS:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static bool arithmetic(FPUFunc f) {
+   switch(f) {
+   case FPU_FUNC_FMADD:
+   case FPU_FUNC_FMSUB:
+   case FPU_FUNC_FNMADD:
+   case FPU_FUNC_FNMSUB:
+   case FPU_FUNC_FADD:
+   case FPU_FUNC_FSUB:
+   case FPU_FUNC_FMUL:
+   case FPU_FUNC_FDIV:
+   case FPU_FUNC_FSQRT:
+   case FPU_FUNC_FCVTSW:
+   case FPU_FUNC_FCVTSWU:
+      return true;
+   default:
+      return false;
+   }
+}
+
+/**
+ * \brief Sets the rounding mode and flush-to-zero mode of SSE, and
+ *  restores them when destroyed.
+ */
+class SSEMode {
+ public:
+   SSEMode(const FPUConfig& config) {
+      csr_ = _mm_getcsr();
+      unsigned int rounding = _MM_ROUND_NEAREST;
+      switch(config.rounding) {
+      case FPU_RTZ: rounding = _MM_ROUND_TOWARD_ZERO; break;
+      case FPU_RDN: rounding = _MM_ROUND_DOWN;        break;
+      case FPU_RUP: rounding = _MM_ROUND_UP;          break;
+      default: break;
+      }
+      _mm_setcsr(
+	 (csr_ & ~(_MM_ROUND_MASK | _MM_FLUSH_ZERO_MASK)) | rounding |
+	 (config.denormals ? _MM_FLUSH_ZERO_OFF : _MM_FLUSH_ZERO_ON)
+      );
+   }
+
+   ~SSEMode() {
+      _mm_setcsr(csr_);
+   }
+
+ private:
+   unsigned int csr_;
+};
+
+static inline __m128 load_ss(uint32_t x) {
+   return _mm_castsi128_ps(_mm_cvtsi32_si128(int(x)));
+}
+
+static inline uint32_t store_ss(__m128 x) {
+   return uint32_t(_mm_cvtsi128_si32(_mm_castps_si128(x)));
+}
+
+/*
+ * \brief Arithmetic operation computed by SSE (in an SSEMode scope)
+ */
+static uint32_t SSE_arithmetic(FPUFunc f, uint32_t x, uint32_t y, uint32_t z) {
+   __m128 X = load_ss(x);
+   __m128 Y = load_ss(y);
+   __m128 Z = load_ss(z);
+   __m128 R = X;
+   switch(f) {
+#ifdef __FMA__
+   case FPU_FUNC_FMADD:  R = _mm_fmadd_ss(X,Y,Z);  break; //  x*y + z
+   case FPU_FUNC_FMSUB:  R = _mm_fmsub_ss(X,Y,Z);  break; //  x*y - z
+   case FPU_FUNC_FNMADD: R = _mm_fnmsub_ss(X,Y,Z); break; // -x*y - z
+   case FPU_FUNC_FNMSUB: R = _mm_fnmadd_ss(X,Y,Z); break; // -x*y + z
+#else
+   // (fmaf() rounds with the rounding mode of the host)
+   case FPU_FUNC_FMADD:  R = _mm_set_ss(fmaf( _mm_cvtss_f32(X),_mm_cvtss_f32(Y), _mm_cvtss_f32(Z))); break;
+   case FPU_FUNC_FMSUB:  R = _mm_set_ss(fmaf( _mm_cvtss_f32(X),_mm_cvtss_f32(Y),-_mm_cvtss_f32(Z))); break;
+   case FPU_FUNC_FNMADD: R = _mm_set_ss(fmaf(-_mm_cvtss_f32(X),_mm_cvtss_f32(Y),-_mm_cvtss_f32(Z))); break;
+   case FPU_FUNC_FNMSUB: R = _mm_set_ss(fmaf(-_mm_cvtss_f32(X),_mm_cvtss_f32(Y), _mm_cvtss_f32(Z))); break;
+#endif
+   case FPU_FUNC_FADD:   R = _mm_add_ss(X,Y);  break;
+   case FPU_FUNC_FSUB:   R = _mm_sub_ss(X,Y);  break;
+   case FPU_FUNC_FMUL:   R = _mm_mul_ss(X,Y);  break;
+   case FPU_FUNC_FDIV:   R = _mm_div_ss(X,Y);  break;
+   case FPU_FUNC_FSQRT:  R = _mm_sqrt_ss(X);   break;
+   case FPU_FUNC_FCVTSW:
+      R = _mm_cvtsi32_ss(_mm_setzero_ps(), int32_t(x));
+      break;
+   case FPU_FUNC_FCVTSWU:
+      R = _mm_cvtsi64_ss(_mm_setzero_ps(), int64_t(x));
+      break;
+   default:
+      break;
+   }
+   uint32_t result = store_ss(R);
+   return is_NaN(result) ? CANONICAL_NAN : result;
+}
+
+/*
+ * \brief Key of a float that is ordered like the float (-0 < +0), for the
+ *  numbers that are not NaNs
+ */
+static inline uint32_t order_key(uint32_t x) {
+   return (x & 0x80000000) ? ~x : (x | 0x80000000);
+}
+
+/*
+ * \brief Conversion to integer, round towards zero, saturated
+ */
+static uint32_t fcvt_to_int(uint32_t x, bool is_unsigned) {
+   if(is_NaN(x)) {
+      return is_unsigned ? 0xffffffff : 0x7fffffff;
+   }
+   bool sign = (x >> 31) != 0;
+   int exp = int(float_exp(x)) - 127;
+   if(exp < 0) {
+      return 0; // |x| < 1 (and also -1 < x <= -0 for unsigned)
+   }
+   if(is_unsigned) {
+      if(sign) {
+	 return 0;
+      }
+      if(exp >= 32) {
+	 return 0xffffffff;
+      }
+   } else if(exp >= 31) {
+      return sign ? 0x80000000 : 0x7fffffff;
+   }
+   uint64_t mant = float_mant(x) | (1u << 23);
+   uint64_t result = (exp >= 23) ? (mant << (exp - 23)) : (mant >> (23 - exp));
+   return sign ? uint32_t(-int64_t(result)) : uint32_t(result);
+}
+
+/*
+ * \brief The functions that are not arithmetic operations, as specified
+ *  by RISC-V
+ */
+static uint32_t RISCV_func(FPUFunc f, uint32_t x, uint32_t y) {
+   switch(f) {
+   case FPU_FUNC_FSGNJ:
+      return (x & 0x7fffffff) | (y & 0x80000000);
+   case FPU_FUNC_FSGNJN:
+      return (x & 0x7fffffff) | (~y & 0x80000000);
+   case FPU_FUNC_FSGNJX:
+      return x ^ (y & 0x80000000);
+   case FPU_FUNC_FMIN:
+   case FPU_FUNC_FMAX: {
+      if(is_NaN(x) && is_NaN(y)) {
+	 return CANONICAL_NAN;
+      }
+      if(is_NaN(x)) {
+	 return y;
+      }
+      if(is_NaN(y)) {
+	 return x;
+      }
+      bool x_le_y = order_key(x) <= order_key(y);
+      return (x_le_y == (f == FPU_FUNC_FMIN)) ? x : y;
+   }
+   case FPU_FUNC_FCVTWS:
+      return fcvt_to_int(x, false);
+   case FPU_FUNC_FCVTWUS:
+      return fcvt_to_int(x, true);
+   case FPU_FUNC_FEQ:
+   case FPU_FUNC_FLT:
+   case FPU_FUNC_FLE: {
+      if(is_NaN(x) || is_NaN(y)) {
+	 return 0;
+      }
+      if(is_zero(x) && is_zero(y)) {
+	 return f != FPU_FUNC_FLT;
+      }
+      if(f == FPU_FUNC_FEQ) {
+	 return x == y;
+      }
+      return (f == FPU_FUNC_FLT) ? (order_key(x) < order_key(y))
+				 : (order_key(x) <= order_key(y));
+   }
+   case FPU_FUNC_FCLASS: {
+      bool sign = (x >> 31) != 0;
+      if(float_exp(x) == 255) {
+	 if(float_mant(x) == 0) {
+	    return sign ? (1u << 0) : (1u << 7);          // infinity
+	 }
+	 return (x & (1u << 22)) ? (1u << 9) : (1u << 8); // quiet, signaling
+      }
+      if(is_zero(x)) {
+	 return sign ? (1u << 3) : (1u << 4);
+      }
+      if(is_denormal(x)) {
+	 return sign ? (1u << 2) : (1u << 5);
+      }
+      return sign ? (1u << 1) : (1u << 6);
+   }
+   default:
+      return 0;
+   }
+}
+
+/*******************************************************************/
+
+/*
+ * \brief Random numbers generator (xorshift64*)
+ */
+class Random {
+ public:
+   Random(uint64_t seed) : state_(seed == 0 ? 1 : seed) {
+   }
+
+   uint32_t next() {
+      state_ ^= state_ >> 12;
+      state_ ^= state_ << 25;
+      state_ ^= state_ >> 27;
+      return uint32_t((state_ * 0x2545F4914F6CDD1Dull) >> 32);
+   }
+
+ private:
+   uint64_t state_;
+};
+
+/*
+ * \brief Hash (splitmix64), for the seeds of the operands and the
+ *  checksums (that do not depend on the number of threads)
+ */
+static inline uint64_t hash(uint64_t x) {
+   x += 0x9e3779b97f4a7c15ull;
+   x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+   x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+   return x ^ (x >> 31);
+}
+
+static const uint32_t edge_values[] = {
+   0x00000000, // 0
+   0x00000001, // smallest denormal
+   0x00400000, // denormal
+   0x007fffff, // largest denormal
+   0x00800000, // smallest normal
+   0x00800001,
+   0x01000000,
+   0x1f800000, // 2^-64
+   0x33800000, // 2^-24
+   0x3effffff, // 0.5 - ulp
+   0x3f000000, // 0.5
+   0x3f000001, // 0.5 + ulp
+   0x3f7fffff, // 1 - ulp
+   0x3f800000, // 1
+   0x3f800001, // 1 + ulp
+   0x3fc00000, // 1.5
+   0x40000000, // 2
+   0x40400000, // 3
+   0x4b000000, // 2^23
+   0x4b7fffff, // 2^24 - 1
+   0x4b800000, // 2^24
+   0x4effffff, // largest float < 2^31
+   0x4f000000, // 2^31
+   0x4f7fffff, // largest float < 2^32
+   0x4f800000, // 2^32
+   0x5f800000, // 2^64
+   0x7effffff,
+   0x7f000000,
+   0x7f7fffff, // largest normal
+   0x7f800000, // infinity
+   0x7fc00000, // quiet NaN
+   0x7fa00000, // signaling NaN
+   0x7fffffff  // quiet NaN, payload
+};
+
+static const unsigned int NB_EDGE_VALUES =
+   2 * sizeof(edge_values) / sizeof(edge_values[0]);
+
+// The edge values and their opposites
+static inline uint32_t edge_value(unsigned int i) {
+   return edge_values[i/2] ^ ((i & 1) ? 0x80000000 : 0);
+}
+
+// A normal number with an exponent in [127-range,127+range]
+static uint32_t random_normal(Random& R, uint32_t range) {
+   uint32_t r = R.next();
+   uint32_t exp = 127 - range + (R.next() % (2*range+1));
+   return (r & 0x807fffff) | (exp << 23);
+}
+
+/*
+ * \brief Generates the operands of the random corpus
+ * \param[in] nb_args number of operands
+ * \param[out] op the operands
+ */
+static void random_operands(Random& R, unsigned int nb_args, uint32_t op[3]) {
+   for(unsigned int i=0; i<3; ++i) {
+      op[i] = 0;
+   }
+   for(unsigned int i=0; i<nb_args; ++i) {
+      uint32_t r = R.next() % 16;
+      if(r < 6) {
+	 op[i] = random_normal(R, 20);
+      } else if(r < 8) {
+	 // any exponent: overflows and underflows
+	 op[i] = (R.next() & 0x807fffff) | ((1 + R.next() % 254) << 23);
+      } else if(r < 11 && i > 0) {
+	 // cancels the previous operand (ADD) or the product of the
+	 // previous operands (FMA), up to some random low bits
+	 uint32_t prev = op[i-1];
+	 if(i == 2) {
+	    float a, b;
+	    memcpy(&a, &op[0], sizeof(a));
+	    memcpy(&b, &op[1], sizeof(b));
+	    float p = float(double(a) * double(b));
+	    memcpy(&prev, &p, sizeof(prev));
+	 }
+	 op[i] = ((prev ^ 0x80000000) & 0xfffff000) | (R.next() & 0xfff);
+      } else if(r < 13) {
+	 op[i] = edge_value(R.next() % NB_EDGE_VALUES);
+      } else if(r < 14) {
+	 op[i] = (R.next() & 0x807fffff);
+      } else {
+	 op[i] = R.next();
+      }
+   }
+}
+
+/*******************************************************************/
+
+enum Path { PATH_HOST, PATH_SOFT, PATH_NB };
+
+static const char* path_name[PATH_NB] = { "host", "soft" };
+
+enum Corpus { CORPUS_ALL, CORPUS_EDGE, CORPUS_RANDOM, CORPUS_NB };
+
+static const char* corpus_name[CORPUS_NB] = { "all", "edge", "random" };
+
+enum MismatchCategory {
+   MISMATCH_NAN_INF_OP, MISMATCH_DENORMAL_OP, MISMATCH_NAN, MISMATCH_ZERO_SIGN,
+   MISMATCH_OTHER,
+   MISMATCH_NB
+};
+
+static const char* mismatch_category_name[MISMATCH_NB] = {
+   "NaN/inf op", "denormal op", "NaN", "zero sign", "other"
+};
+
+static MismatchCategory classify(
+   FPUFunc f, const uint32_t op[3], uint32_t result, uint32_t ref
+) {
+   if(!int_operand(f)) {
+      unsigned int nb_args = FPU_func_nb_args(f);
+      for(unsigned int i=0; i<nb_args; ++i) {
+	 if(is_NaN_or_infty(op[i])) {
+	    return MISMATCH_NAN_INF_OP;
+	 }
+      }
+      for(unsigned int i=0; i<nb_args; ++i) {
+	 if(is_denormal(op[i])) {
+	    return MISMATCH_DENORMAL_OP;
+	 }
+      }
+   }
+   if(!int_result(f)) {
+      if(is_NaN(result) && is_NaN(ref)) {
+	 return MISMATCH_NAN;
+      }
+      if(is_zero(result) && is_zero(ref)) {
+	 return MISMATCH_ZERO_SIGN;
+      }
+   }
+   return MISMATCH_OTHER;
+}
+
+/**
+ * \brief The results of a test (a function, a path and a corpus)
+ */
+struct TestResult {
+   TestResult() :
+      evaluated(0), mismatches(0), checksum(0),
+      first_index(~uint64_t(0)), first_result(0), first_ref(0) {
+      memset(categories, 0, sizeof(categories));
+      memset(first_op, 0, sizeof(first_op));
+   }
+
+   void merge(const TestResult& rhs) {
+      evaluated += rhs.evaluated;
+      mismatches += rhs.mismatches;
+      checksum += rhs.checksum;
+      for(unsigned int c=0; c<MISMATCH_NB; ++c) {
+	 categories[c] += rhs.categories[c];
+      }
+      if(rhs.first_index < first_index) {
+	 first_index = rhs.first_index;
+	 memcpy(first_op, rhs.first_op, sizeof(first_op));
+	 first_result = rhs.first_result;
+	 first_ref = rhs.first_ref;
+      }
+   }
+
+   uint64_t evaluated;
+   uint64_t mismatches;
+   uint64_t categories[MISMATCH_NB];
+   uint64_t checksum;
+
+   // the first mismatch
+   uint64_t first_index;
+   uint32_t first_op[3];
+   uint32_t first_result;
+   uint32_t first_ref;
+};
+
+/*
+ * \brief Runs the tests of a function on a corpus, for all the paths,
+ *  with several threads.
+ */
+static void run_tests(
+   FPUFunc f, Corpus corpus, const bool paths[PATH_NB],
+   const FPUConfig& config, uint64_t N, uint64_t stride, uint64_t seed,
+   unsigned int nb_threads, TestResult results[PATH_NB]
+) {
+   unsigned int nb_args = FPU_func_nb_args(f);
+   uint64_t nb_tests = N;
+   if(corpus == CORPUS_ALL) {
+      nb_tests = ((uint64_t(1) << 32) + stride - 1) / stride;
+   } else if(corpus == CORPUS_EDGE) {
+      nb_tests = 1;
+      for(unsigned int i=0; i<nb_args; ++i) {
+	 nb_tests *= NB_EDGE_VALUES;
+      }
+   }
+
+   const uint64_t CHUNK = 4096;
+   std::atomic<uint64_t> next_chunk(0);
+   std::mutex lock;
+   std::vector<std::thread> threads;
+
+   for(unsigned int t=0; t<nb_threads; ++t) {
+      threads.emplace_back([&]() {
+	 TestResult local[PATH_NB];
+	 std::vector<uint32_t> ops(3*CHUNK);
+	 std::vector<uint32_t> ref(CHUNK);
+	 for(;;) {
+	    uint64_t begin = CHUNK * next_chunk.fetch_add(1);
+	    if(begin >= nb_tests) {
+	       break;
+	    }
+	    uint64_t n = std::min(CHUNK, nb_tests - begin);
+
+	    for(uint64_t k=0; k<n; ++k) {
+	       uint64_t i = begin + k;
+	       uint32_t* op = &ops[3*k];
+	       if(corpus == CORPUS_ALL) {
+		  op[0] = uint32_t(i * stride);
+		  op[1] = op[2] = 0;
+	       } else if(corpus == CORPUS_EDGE) {
+		  uint64_t j = i;
+		  for(unsigned int a=0; a<3; ++a) {
+		     op[a] = (a < nb_args) ? edge_value(j % NB_EDGE_VALUES) : 0;
+		     j /= NB_EDGE_VALUES;
+		  }
+	       } else {
+		  Random R(hash(seed ^ (uint64_t(f) << 56) ^ i));
+		  random_operands(R, nb_args, op);
+	       }
+	    }
+
+	    // Reference (SSE mode only set during the loop, the host path
+	    // computes in the default mode of the host)
+	    if(arithmetic(f)) {
+	       SSEMode mode(config);
+	       for(uint64_t k=0; k<n; ++k) {
+		  ref[k] = SSE_arithmetic(f, ops[3*k], ops[3*k+1], ops[3*k+2]);
+	       }
+	    } else {
+	       for(uint64_t k=0; k<n; ++k) {
+		  ref[k] = RISCV_func(f, ops[3*k], ops[3*k+1]);
+	       }
+	    }
+
+	    for(unsigned int p=0; p<PATH_NB; ++p) {
+	       if(!paths[p]) {
+		  continue;
+	       }
+	       TestResult& T = local[p];
+	       for(uint64_t k=0; k<n; ++k) {
+		  const uint32_t* op = &ops[3*k];
+		  uint32_t result = (p == PATH_HOST) ?
+		     FPU_host_func(f, op[0], op[1], op[2]) :
+		     FPU_soft_func(f, op[0], op[1], op[2]);
+		  uint64_t i = begin + k;
+		  ++T.evaluated;
+		  T.checksum += hash(hash(i) ^ result);
+		  if(result == ref[k]) {
+		     continue;
+		  }
+		  ++T.mismatches;
+		  ++T.categories[classify(f, op, result, ref[k])];
+		  if(i < T.first_index) {
+		     T.first_index = i;
+		     memcpy(T.first_op, op, sizeof(T.first_op));
+		     T.first_result = result;
+		     T.first_ref = ref[k];
+		  }
+	       }
+	    }
+	 }
+	 std::lock_guard<std::mutex> guard(lock);
+	 for(unsigned int p=0; p<PATH_NB; ++p) {
+	    results[p].merge(local[p]);
+	 }
+      });
+   }
+   for(std::thread& thread: threads) {
+      thread.join();
+   }
+}
+
+/*******************************************************************/
+
+/**
+ * \brief A line of the report: evaluated, mismatches, checksum, indexed
+ *  by func,path,corpus
+ */
+struct ReportLine {
+   unsigned long long evaluated;
+   unsigned long long mismatches;
+   unsigned long long checksum;
+};
+
+static bool load_report(
+   const char* filename, std::map<std::string, ReportLine>& report
+) {
+   FILE* f = fopen(filename, "r");
+   if(f == nullptr) {
+      return false;
+   }
+   char line[1024];
+   while(fgets(line, sizeof(line), f)) {
+      char func[64], path[64], corpus[64];
+      ReportLine L;
+      if(
+	 sscanf(
+	    line, "%63[^,],%63[^,],%63[^,],%llu,%llu,%*[^,],%*[^,],%*[^,],"
+	    "%*[^,],%*[^,],%llx", func, path, corpus,
+	    &L.evaluated, &L.mismatches, &L.checksum
+	 ) == 6
+      ) {
+	 report[std::string(func) + "," + path + "," + corpus] = L;
+      }
+   }
+   fclose(f);
+   return true;
+}
+
+static void print_float_or_int(uint32_t x, bool is_int) {
+   if(is_int) {
+      printf("%08x (%d)", x, int32_t(x));
+   } else {
+      float f;
+      memcpy(&f, &x, sizeof(f));
+      printf("%08x (%g)", x, double(f));
+   }
+}
+
+int main(int argc, char** argv) {
+   const char* func_name = nullptr;
+   const char* path_only = nullptr;
+   unsigned long long N = 10000000;
+   unsigned long long stride = 1;
+   unsigned long long seed = 0x5eed;
+   unsigned int nb_threads = std::thread::hardware_concurrency();
+   bool print_examples = false;
+   const char* out_filename = nullptr;
+   const char* baseline_filename = nullptr;
+   FPUConfig config;
+
+   for(int i=1; i<argc; ++i) {
+      if(!strcmp(argv[i],"-func") && i+1 < argc) {
+	 func_name = argv[++i];
+      } else if(!strcmp(argv[i],"-path") && i+1 < argc) {
+	 path_only = argv[++i];
+      } else if(!strcmp(argv[i],"-n") && i+1 < argc) {
+	 N = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-stride") && i+1 < argc) {
+	 stride = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-seed") && i+1 < argc) {
+	 seed = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-threads") && i+1 < argc) {
+	 nb_threads = (unsigned int)(atoi(argv[++i]));
+      } else if(!strcmp(argv[i],"-examples")) {
+	 print_examples = true;
+      } else if(!strcmp(argv[i],"-out") && i+1 < argc) {
+	 out_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-baseline") && i+1 < argc) {
+	 baseline_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-rounding") && i+1 < argc) {
+	 const char* name = argv[++i];
+	 if(!FPU_rounding_from_name(name, config.rounding)) {
+	    fprintf(stderr,"Unknown rounding mode %s\n",name);
+	    return 1;
+	 }
+      } else if(!strcmp(argv[i],"-denormals")) {
+	 config.denormals = true;
+      } else if(!strcmp(argv[i],"-guard_bits")) {
+	 config.guard_bits = true;
+      } else if(!strcmp(argv[i],"-ieee")) {
+	 config = FPUConfig::IEEE754();
+      } else {
+	 fprintf(
+	    stderr,
+	    "usage: %s <-func name> <-path host|soft> <-n N> <-stride S>"
+	    " <-seed S> <-threads N> <-examples> <-out report.csv>"
+	    " <-baseline report.csv> <-rounding rne|rtz|rdn|rup> <-denormals>"
+	    " <-guard_bits> <-ieee>\n",
+	    argv[0]
+	 );
+	 return 1;
+      }
+   }
+   if(config.rounding == FPU_RMM) {
+      fprintf(stderr,"rmm is not supported by the reference (SSE)\n");
+      return 1;
+   }
+   if(stride == 0) {
+      stride = 1;
+   }
+   if(nb_threads == 0) {
+      nb_threads = 1;
+   }
+
+   bool paths[PATH_NB];
+   for(unsigned int p=0; p<PATH_NB; ++p) {
+      paths[p] = (path_only == nullptr || !strcmp(path_only, path_name[p]));
+   }
+   if(!paths[PATH_HOST] && !paths[PATH_SOFT]) {
+      fprintf(stderr,"Unknown path %s\n",path_only);
+      return 1;
+   }
+
+   std::vector<FPUFunc> funcs;
+   for(unsigned int f=0; f<FPU_FUNC_NB; ++f) {
+      if(func_name == nullptr || !strcmp(func_name, FPU_func_name(FPUFunc(f)))) {
+	 funcs.push_back(FPUFunc(f));
+      }
+   }
+   if(funcs.empty()) {
+      fprintf(stderr,"Unknown function %s\n",func_name);
+      return 1;
+   }
+
+   std::map<std::string, ReportLine> baseline;
+   if(
+      baseline_filename != nullptr && !load_report(baseline_filename, baseline)
+   ) {
+      fprintf(stderr,"Could not read %s\n",baseline_filename);
+      return 1;
+   }
+
+   FILE* out = nullptr;
+   if(out_filename != nullptr) {
+      out = fopen(out_filename, "w");
+      if(out == nullptr) {
+	 fprintf(stderr,"Could not create %s\n",out_filename);
+	 return 1;
+      }
+      fprintf(out,"func,path,corpus,evaluated,mismatches");
+      for(unsigned int c=0; c<MISMATCH_NB; ++c) {
+	 fprintf(out,",%s",mismatch_category_name[c]);
+      }
+      fprintf(out,",checksum\n");
+   }
+
+   FPU_set_config(config);
+   printf(
+      "rounding: %s, denormals: %s, guard bits: %s, %u threads\n\n",
+      FPU_rounding_name(config.rounding), config.denormals ? "yes" : "no",
+      config.guard_bits ? "yes" : "no", nb_threads
+   );
+   printf(
+      "%-8s %-5s %-7s %12s %12s", "func", "path", "corpus",
+      "evaluated", "mismatches"
+   );
+   for(unsigned int c=0; c<MISMATCH_NB; ++c) {
+      printf(" %11s", mismatch_category_name[c]);
+   }
+   printf(" %16s %8s\n", "checksum", "time(s)");
+
+   unsigned int nb_tests = 0;
+   unsigned int nb_conformant = 0;
+   unsigned int nb_changed = 0;
+   for(FPUFunc f: funcs) {
+      for(unsigned int corpus=0; corpus<CORPUS_NB; ++corpus) {
+	 // all inputs for one operand, edge and random values otherwise
+	 if((corpus == CORPUS_ALL) != (FPU_func_nb_args(f) == 1)) {
+	    continue;
+	 }
+	 TestResult results[PATH_NB];
+	 auto t0 = std::chrono::steady_clock::now();
+	 run_tests(
+	    f, Corpus(corpus), paths, config, N, stride, seed, nb_threads,
+	    results
+	 );
+	 double time = std::chrono::duration<double>(
+	    std::chrono::steady_clock::now() - t0
+	 ).count();
+
+	 for(unsigned int p=0; p<PATH_NB; ++p) {
+	    if(!paths[p]) {
+	       continue;
+	    }
+	    const TestResult& T = results[p];
+	    ++nb_tests;
+	    if(T.mismatches == 0) {
+	       ++nb_conformant;
+	    }
+	    std::string key = std::string(FPU_func_name(f)) + "," +
+			      path_name[p] + "," + corpus_name[corpus];
+	    const char* change = "";
+	    if(baseline_filename != nullptr) {
+	       auto it = baseline.find(key);
+	       if(it == baseline.end()) {
+		  change = " (new)";
+	       } else if(
+		  it->second.evaluated != T.evaluated ||
+		  it->second.mismatches != T.mismatches ||
+		  it->second.checksum != T.checksum
+	       ) {
+		  change = " (changed)";
+		  ++nb_changed;
+	       }
+	    }
+
+	    printf(
+	       "%-8s %-5s %-7s %12llu %12llu", FPU_func_name(f), path_name[p],
+	       corpus_name[corpus], (unsigned long long)(T.evaluated),
+	       (unsigned long long)(T.mismatches)
+	    );
+	    for(unsigned int c=0; c<MISMATCH_NB; ++c) {
+	       printf(" %11llu", (unsigned long long)(T.categories[c]));
+	    }
+	    printf(
+	       " %016llx %8.2f%s\n", (unsigned long long)(T.checksum),
+	       time, change
+	    );
+
+	    if(print_examples && T.mismatches != 0) {
+	       printf("   ");
+	       for(unsigned int i=0; i<FPU_func_nb_args(f); ++i) {
+		  printf("%c=", "xyz"[i]);
+		  print_float_or_int(T.first_op[i], int_operand(f));
+		  printf(" ");
+	       }
+	       printf("result=");
+	       print_float_or_int(T.first_result, int_result(f));
+	       printf(" ref=");
+	       print_float_or_int(T.first_ref, int_result(f));
+	       printf("\n");
+	    }
+
+	    if(out != nullptr) {
+	       fprintf(
+		  out, "%s,%llu,%llu", key.c_str(),
+		  (unsigned long long)(T.evaluated),
+		  (unsigned long long)(T.mismatches)
+	       );
+	       for(unsigned int c=0; c<MISMATCH_NB; ++c) {
+		  fprintf(out, ",%llu", (unsigned long long)(T.categories[c]));
+	       }
+	       fprintf(out, ",%016llx\n", (unsigned long long)(T.checksum));
+	    }
+	 }
+      }
+   }
+
+   if(out != nullptr) {
+      fclose(out);
+   }
+
+   printf("\n%u/%u tests conformant\n", nb_conformant, nb_tests);
+   if(baseline_filename != nullptr) {
+      printf("%u tests changed since %s\n", nb_changed, baseline_filename);
+      return (nb_changed == 0) ? 0 : 1;
+   }
+   return (nb_conformant == nb_tests) ? 0 : 1;
+}
@@ -0,0 +1,742 @@
+/*
+ * fpu_divsqrt: explores the algorithms for FDIV and FSQRT that can be
+ * micro-programmed on the FMA of petitbateau (RTL/PROCESSOR/petitbateau.v),
+ * to choose the fastest one for a given accuracy.
+ *
+ * Each candidate is a sequence of operations of the FPU class (the C++
+ * model of the FPU of petitbateau in FPU_funcs.cpp), evaluated over the
+ * range of float32 operands with several threads. For each candidate,
+ * the tool reports the cycles of its microprogram, the maximum and mean
+ * error in ulps, and the proportion of correctly rounded results.
+ *
+ * Usage: fpu_divsqrt <options>
+ *   -op name     : only evaluates the algorithms of this operation (FDIV
+ *                  or FSQRT, default: both)
+ *   -alg name    : only evaluates this algorithm (see -list)
+ *   -list        : lists the algorithms
+ *   -stride S    : evaluates one operand out of S (default: 1021, 1 is
+ *                  exhaustive, 2^31 evaluations per algorithm)
+ *   -threads N   : number of threads (default: number of cores)
+ *   -seed S      : seed of the random dividends
+ *   -worst       : prints the operands with the largest error
+ *   -rounding mode : rounding mode (rne, rtz, rdn, rup, rmm, default: rtz)
+ *   -denormals   : gradual underflow (default: flush to zero)
+ *   -guard_bits  : guard bits and sticky bit in the FPU class
+ *   -ieee        : same as -rounding rne -denormals -guard_bits
+ *
+ * The algorithms are named seed-iteration-N[-corr]:
+ *  FDIV: the reciprocal of the divisor (scaled to [0.5,1[) is refined
+ *   from a seed, then multiplied by the dividend:
+ *    seeds:      linear  48/17 - 32/17*D (one FMA)
+ *                table   256 entries x 10 bits ROM
+ *    iterations: nr_fma  X <- X + X*(1-D*X) (two FMAs)
+ *                nr_mul  X <- X*(2-D*X) (one FMA and one MUL)
+ *                gold    Goldschmidt: N <- N*F, D <- D*F, F <- 2-D
+ *                        (computes the quotient directly)
+ *  FSQRT: the reciprocal square root is refined from a seed, then
+ *   multiplied by the operand:
+ *    seeds:      doom    0x5f3759df - (x >> 1)
+ *                table   256 entries x 10 bits ROM (indexed by the parity
+ *                        of the exponent and 7 bits of the mantissa)
+ *    iterations: nr      Y <- Y*(3/2 - x/2*Y*Y)
+ *                gold    Goldschmidt: G <- G+G*R, H <- H+H*R, R <- 1/2-G*H
+ *  N is the number of iterations. With -corr, the approximation is
+ *  rounded to nearest, then corrected with its remainder computed by an
+ *  FMA (q <- q + (x - q*y)/y for FDIV, s <- s + (x - s*s)/(2*sqrt(x)) for
+ *  FSQRT).
+ *  The microprograms of petitbateau are marked with a '*':
+ *    nr_fma-linear-3-corr (PRECISE_DIV=1), nr_mul-linear-3 (PRECISE_DIV=0)
+ *    and nr-doom-2.
+ *
+ * Cycles: the cycles of the microprogram, counted like the ROM of
+ * petitbateau.v: 5 for an FMA, 1 for a MUL, 3 for rounding to nearest,
+ * 1 for each move between the registers of the FPU, load of a constant or
+ * ROM lookup. (The instruction takes 2 more cycles, see TimingModel.cpp).
+ *
+ * Operands: FSQRT is evaluated on the positive normal numbers. FDIV is
+ * evaluated on the positive normal divisors, with random dividends such
+ * that the quotient is a normal number. The errors are measured against
+ * the exact result (computed in double precision). A result is correctly
+ * rounded if it is the exact result rounded with the rounding mode of the
+ * configuration, and faithful if the error is less than 1 ulp. A failure
+ * is a result with an error larger than 1024 ulps (for instance when the
+ * reciprocal of a divisor larger than 2^126 is flushed to zero): failures
+ * are not counted in the maximum and mean errors.
+ */
+
+#include "FPU_funcs.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+static const uint32_t CONST_HALF         = 0x3f000000;
+static const uint32_t CONST_1            = 0x3f800000;
+static const uint32_t CONST_3_over_2     = 0x3fc00000;
+static const uint32_t CONST_2            = 0x40000000;
+static const uint32_t CONST_48_over_17   = 0x4034B4B5;
+static const uint32_t CONST_32_over_17   = 0x3FF0F0F1;
+static const uint32_t RSQRT_DOOM_MAGIC   = 0x5f3759df;
+
+static inline float decode(uint32_t x) {
+   float result;
+   memcpy(&result, &x, sizeof(result));
+   return result;
+}
+
+static inline uint32_t encode(float x) {
+   uint32_t result;
+   memcpy(&result, &x, sizeof(result));
+   return result;
+}
+
+static inline int float_exp(uint32_t x) {
+   return int((x >> 23) & 255);
+}
+
+/*
+ * \brief Replaces the exponent of a float, flushes to zero or saturates
+ *  to infinity if it is out of range.
+ */
+static inline uint32_t with_exp(uint32_t x, int exp) {
+   if(exp <= 0) {
+      return x & 0x80000000;
+   }
+   if(exp >= 255) {
+      return (x & 0x80000000) | 0x7f800000;
+   }
+   return (x & 0x807fffff) | (uint32_t(exp) << 23);
+}
+
+/*
+ * \brief The operations of a microprogram, computed by the FPU class, and
+ *  their cycles.
+ * \details The operations are rounded with the configuration, or to
+ *  nearest if round is set (what petitbateau does after the iterations of
+ *  FDIV, with FPMI_LOAD_Y_ROUND, FPMI_ADD_ADD and FPMI_ADD_NORM).
+ */
+class Microprogram {
+ public:
+   Microprogram(const FPUConfig& config) :
+      config_(config),
+      nearest_(config),
+      cycles_(0) {
+      nearest_.rounding = FPU_RNE;
+   }
+
+   // a*b+c
+   uint32_t fma(uint32_t a, uint32_t b, uint32_t c, bool round = false) {
+      return op(FPU_OP_FMADD, a, b, c, 5, round);
+   }
+
+   // -a*b+c
+   uint32_t fnma(uint32_t a, uint32_t b, uint32_t c, bool round = false) {
+      return op(FPU_OP_FNMSUB, a, b, c, 5, round);
+   }
+
+   // a*b
+   uint32_t mul(uint32_t a, uint32_t b, bool round = false) {
+      return op(FPU_OP_FMUL, a, b, 0, 1, round);
+   }
+
+   // Moves between registers, loads of constants, ROM lookups
+   void mv(unsigned int nb = 1) {
+      cycles_ += nb;
+   }
+
+   unsigned int cycles() const {
+      return cycles_;
+   }
+
+ private:
+   uint32_t op(
+      FPUOp op, uint32_t a, uint32_t b, uint32_t c,
+      unsigned int cycles, bool round
+   ) {
+      cycles_ += cycles + (round ? 3 : 0);
+      return FPU_soft_op(op, a, b, c, round ? nearest_ : config_);
+   }
+
+   FPUConfig config_;
+   FPUConfig nearest_;
+   unsigned int cycles_;
+};
+
+/*******************************************************************/
+
+enum Operation { OP_FDIV, OP_FSQRT, OP_NB };
+
+static const char* operation_name[OP_NB] = { "FDIV", "FSQRT" };
+
+enum Seed { SEED_LINEAR, SEED_DOOM, SEED_TABLE };
+
+static const char* seed_name[] = { "linear", "doom", "table" };
+
+enum Iteration { ITER_NR_FMA, ITER_NR_MUL, ITER_NR, ITER_GOLDSCHMIDT };
+
+static const char* iteration_name[] = { "nr_fma", "nr_mul", "nr", "gold" };
+
+/**
+ * \brief A candidate algorithm for FDIV or FSQRT
+ */
+struct Algorithm {
+   Operation op;
+   Seed seed;
+   Iteration iteration;
+   unsigned int nb_iter;
+   bool correction;
+   bool petitbateau; // the microprogram of petitbateau.v
+
+   std::string name() const {
+      std::string result = std::string(iteration_name[iteration]) + "-" +
+	                   seed_name[seed] + "-" + std::to_string(nb_iter);
+      if(correction) {
+	 result += "-corr";
+      }
+      return result;
+   }
+};
+
+/*
+ * \brief The ROMs of the seeds: 256 entries x 10 significant bits, the
+ *  reciprocal (or reciprocal square root) of the middle of the interval
+ *  of each entry.
+ */
+struct SeedTables {
+   SeedTables() {
+      for(unsigned int i=0; i<256; ++i) {
+	 // 1/D for D in [0.5,1[, indexed by the 8 MSBs of the mantissa
+	 double D = 0.5 * (1.0 + (double(i) + 0.5) / 256.0);
+	 rcp[i] = encode(float(ldexp(nearbyint(ldexp(1.0/D, 9)), -9)));
+	 // 1/sqrt(A) for A in [1,4[, indexed by the parity of the exponent
+	 // and the 7 MSBs of the mantissa
+	 double A = (1.0 + (double(i & 127) + 0.5) / 128.0) * ((i & 128) ? 2.0 : 1.0);
+	 rsqrt[i] = encode(float(ldexp(nearbyint(ldexp(1.0/sqrt(A), 10)), -10)));
+      }
+   }
+   uint32_t rcp[256];
+   uint32_t rsqrt[256];
+};
+
+static SeedTables seed_tables;
+
+/*
+ * \brief x/y for positive normal x and y
+ */
+static uint32_t eval_FDIV(
+   Microprogram& P, const Algorithm& A, uint32_t x, uint32_t y
+) {
+   // D <- y scaled to [0.5,1[
+   uint32_t D = with_exp(y, 126);
+   P.mv();
+
+   uint32_t X;
+   if(A.seed == SEED_TABLE) {
+      X = seed_tables.rcp[(y >> 15) & 255];
+      P.mv();
+   } else {
+      X = P.fnma(D, CONST_32_over_17, CONST_48_over_17);
+   }
+
+   // Round to nearest the last result of the iterations (before correction)
+   bool round = false;
+
+   if(A.iteration == ITER_GOLDSCHMIDT) {
+      // N <- x scaled to [1,2[
+      uint32_t N = with_exp(x, 127);
+      P.mv(2);
+      N = P.mul(N, X);
+      P.mv();
+      D = P.mul(D, X);
+      uint32_t R = X; // reciprocal, for the correction
+      for(unsigned int k=0; k<A.nb_iter; ++k) {
+	 bool last = (k+1 == A.nb_iter);
+	 uint32_t F = P.fnma(D, CONST_1, CONST_2);
+	 P.mv();
+	 N = P.mul(N, F, last && A.correction);
+	 if(!last) {
+	    P.mv();
+	    D = P.mul(D, F);
+	 }
+	 if(A.correction) {
+	    P.mv();
+	    R = P.mul(R, F);
+	 }
+      }
+      // exponent of the quotient
+      uint32_t q = with_exp(N, float_exp(N) + float_exp(x) - float_exp(y) - 1);
+      P.mv();
+      if(!A.correction) {
+	 return q;
+      }
+      R = with_exp(R, float_exp(R) + 126 - float_exp(y));
+      P.mv();
+      uint32_t rem = P.fnma(y, q, x);
+      P.mv(3);
+      return P.fma(rem, R, q);
+   }
+
+   for(unsigned int k=0; k<A.nb_iter; ++k) {
+      round = A.correction && (k+1 == A.nb_iter);
+      P.mv();
+      if(A.iteration == ITER_NR_MUL) {
+	 uint32_t e = P.fnma(D, X, CONST_2);
+	 P.mv();
+	 X = P.mul(X, e, round);
+      } else {
+	 uint32_t e = P.fnma(D, X, CONST_1);
+	 P.mv();
+	 X = P.fma(X, e, X, round);
+      }
+   }
+
+   // reciprocal of y
+   uint32_t R = with_exp(X, float_exp(X) + 126 - float_exp(y));
+   P.mv();
+   uint32_t q = P.mul(R, x);
+   if(!A.correction) {
+      return q;
+   }
+   P.mv(2);
+   uint32_t rem = P.fnma(y, q, x);
+   P.mv(3);
+   return P.fma(rem, R, q);
+}
+
+/*
+ * \brief sqrt(x) for positive normal x
+ */
+static uint32_t eval_FSQRT(Microprogram& P, const Algorithm& A, uint32_t x) {
+   uint32_t Y;
+   if(A.seed == SEED_TABLE) {
+      int e = float_exp(x) - 127;
+      int parity = e & 1;
+      Y = seed_tables.rsqrt[(parity << 7) | ((x >> 16) & 127)];
+      Y = with_exp(Y, float_exp(Y) - (e - parity)/2);
+      P.mv(2);
+   } else {
+      Y = RSQRT_DOOM_MAGIC - (x >> 1);
+      P.mv();
+   }
+
+   uint32_t s;
+   uint32_t H; // 1/(2*sqrt(x)), for the correction
+   if(A.iteration == ITER_GOLDSCHMIDT) {
+      P.mv();
+      uint32_t G = P.mul(x, Y);
+      H = with_exp(Y, float_exp(Y) - 1);
+      P.mv();
+      for(unsigned int k=0; k<A.nb_iter; ++k) {
+	 bool last = (k+1 == A.nb_iter);
+	 P.mv();
+	 uint32_t R = P.fnma(G, H, CONST_HALF);
+	 P.mv();
+	 G = P.fma(G, R, G, last && A.correction);
+	 if(!last || A.correction) {
+	    P.mv();
+	    H = P.fma(H, R, H);
+	 }
+      }
+      s = G;
+   } else {
+      // -x/2
+      uint32_t NH = with_exp(x, float_exp(x) - 1) | 0x80000000;
+      for(unsigned int k=0; k<A.nb_iter; ++k) {
+	 uint32_t YY = P.mul(Y, Y);
+	 P.mv(2);
+	 uint32_t t = P.fma(YY, NH, CONST_3_over_2);
+	 P.mv(2);
+	 Y = P.mul(t, Y);
+	 if(k+1 != A.nb_iter) {
+	    P.mv(3);
+	 }
+      }
+      P.mv(2);
+      s = P.mul(Y, x, A.correction);
+      H = with_exp(Y, float_exp(Y) - 1);
+   }
+
+   if(!A.correction) {
+      return s;
+   }
+   P.mv(2);
+   uint32_t rem = P.fnma(s, s, x);
+   P.mv(2);
+   return P.fma(rem, H, s);
+}
+
+static uint32_t eval(
+   Microprogram& P, const Algorithm& A, uint32_t x, uint32_t y
+) {
+   return (A.op == OP_FDIV) ? eval_FDIV(P, A, x, y) : eval_FSQRT(P, A, x);
+}
+
+static std::vector<Algorithm> algorithms() {
+   std::vector<Algorithm> result;
+   static const Iteration div_iter[]  = {ITER_NR_FMA, ITER_NR_MUL, ITER_GOLDSCHMIDT};
+   static const Seed      div_seed[]  = {SEED_LINEAR, SEED_TABLE};
+   static const Iteration sqrt_iter[] = {ITER_NR, ITER_GOLDSCHMIDT};
+   static const Seed      sqrt_seed[] = {SEED_DOOM, SEED_TABLE};
+   for(unsigned int op=0; op<OP_NB; ++op) {
+      const Iteration* iter = (op == OP_FDIV) ? div_iter : sqrt_iter;
+      unsigned int nb_iter_kinds = (op == OP_FDIV) ? 3 : 2;
+      const Seed* seed = (op == OP_FDIV) ? div_seed : sqrt_seed;
+      for(unsigned int i=0; i<nb_iter_kinds; ++i) {
+	 for(unsigned int s=0; s<2; ++s) {
+	    for(unsigned int n=1; n<=3; ++n) {
+	       for(unsigned int corr=0; corr<2; ++corr) {
+		  Algorithm A;
+		  A.op = Operation(op);
+		  A.iteration = iter[i];
+		  A.seed = seed[s];
+		  A.nb_iter = n;
+		  A.correction = (corr != 0);
+		  A.petitbateau =
+		     (A.op == OP_FDIV && A.seed == SEED_LINEAR && n == 3 && (
+			(A.iteration == ITER_NR_FMA && A.correction) ||
+			(A.iteration == ITER_NR_MUL && !A.correction))) ||
+		     (A.op == OP_FSQRT && A.seed == SEED_DOOM && n == 2 &&
+		      A.iteration == ITER_NR && !A.correction);
+		  result.push_back(A);
+	       }
+	    }
+	 }
+      }
+   }
+   return result;
+}
+
+/*******************************************************************/
+
+/*
+ * \brief Hash of the index of an operand, for the random dividends
+ *  (splitmix64, the operands do not depend on the number of threads)
+ */
+static inline uint64_t hash(uint64_t x) {
+   x += 0x9e3779b97f4a7c15ull;
+   x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+   x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+   return x ^ (x >> 31);
+}
+
+/*
+ * \brief A random dividend such that x/y is a normal number
+ */
+static uint32_t dividend(uint32_t y, uint64_t h) {
+   // exponent of the quotient in [2,253]
+   int ey = float_exp(y);
+   int lo = std::max(2, 128 - ey);
+   int hi = std::min(253, 381 - ey);
+   int eq = lo + int((h >> 32) % uint64_t(hi - lo + 1));
+   return (uint32_t(h) & 0x7fffff) | (uint32_t(eq + ey - 127) << 23);
+}
+
+/*
+ * \brief The exact result rounded with a rounding mode (the operands are
+ *  positive, and the quotients and square roots of floats are never
+ *  exactly between two floats)
+ */
+static uint32_t round_exact(double exact, FPURoundingMode rounding) {
+   float f = float(exact); // to nearest
+   switch(rounding) {
+   case FPU_RTZ:
+   case FPU_RDN:
+      if(double(f) > exact) {
+	 f = nextafterf(f, 0.0f);
+      }
+      break;
+   case FPU_RUP:
+      if(double(f) < exact) {
+	 f = nextafterf(f, INFINITY);
+      }
+      break;
+   default:
+      break;
+   }
+   return encode(f);
+}
+
+/**
+ * \brief Accuracy of an algorithm
+ */
+struct ErrorStats {
+   ErrorStats() :
+      nb(0), correct(0), faithful(0), failures(0),
+      max_ulp(0.0), sum_ulp(0.0), worst_x(0), worst_y(0) {
+   }
+
+   void add(uint32_t x, uint32_t y, uint32_t result, double exact, uint32_t rounded) {
+      ++nb;
+      if(result == rounded) {
+	 ++correct;
+      }
+      double r = double(decode(result));
+      int e;
+      frexp(exact, &e);
+      double ulp = ldexp(1.0, std::max(e-24, -149));
+      double err = fabs(r - exact) / ulp;
+      if(!(err <= 1024.0)) { // (also catches infinities and NaNs)
+	 ++failures;
+	 return;
+      }
+      if(err < 1.0) {
+	 ++faithful;
+      }
+      sum_ulp += err;
+      if(err > max_ulp) {
+	 max_ulp = err;
+	 worst_x = x;
+	 worst_y = y;
+      }
+   }
+
+   void merge(const ErrorStats& rhs) {
+      nb += rhs.nb;
+      correct += rhs.correct;
+      faithful += rhs.faithful;
+      failures += rhs.failures;
+      sum_ulp += rhs.sum_ulp;
+      if(rhs.max_ulp > max_ulp) {
+	 max_ulp = rhs.max_ulp;
+	 worst_x = rhs.worst_x;
+	 worst_y = rhs.worst_y;
+      }
+   }
+
+   uint64_t nb;
+   uint64_t correct;
+   uint64_t faithful;
+   uint64_t failures;
+   double   max_ulp;
+   double   sum_ulp;
+   uint32_t worst_x;
+   uint32_t worst_y;
+};
+
+// The operands: the positive normal numbers, one out of stride
+static const uint64_t FIRST_OPERAND = 0x00800000;
+static const uint64_t END_OPERAND   = 0x7f800000;
+
+/*
+ * \brief Evaluates an algorithm on all the operands, with several threads
+ */
+static ErrorStats evaluate(
+   const Algorithm& A, const FPUConfig& config,
+   uint64_t stride, uint64_t seed, unsigned int nb_threads
+) {
+   uint64_t N = (END_OPERAND - FIRST_OPERAND + stride - 1) / stride;
+   const uint64_t CHUNK = 1 << 14;
+   std::atomic<uint64_t> next_chunk(0);
+   std::vector<ErrorStats> stats(nb_threads);
+   std::vector<std::thread> threads;
+
+   for(unsigned int t=0; t<nb_threads; ++t) {
+      threads.emplace_back([&,t]() {
+	 ErrorStats& S = stats[t];
+	 for(;;) {
+	    uint64_t begin = CHUNK * next_chunk.fetch_add(1);
+	    if(begin >= N) {
+	       break;
+	    }
+	    uint64_t end = std::min(begin + CHUNK, N);
+	    for(uint64_t i=begin; i<end; ++i) {
+	       Microprogram P(config);
+	       uint32_t x, y;
+	       double exact;
+	       if(A.op == OP_FDIV) {
+		  y = uint32_t(FIRST_OPERAND + i*stride);
+		  x = dividend(y, hash(seed ^ i));
+		  exact = double(decode(x)) / double(decode(y));
+	       } else {
+		  x = uint32_t(FIRST_OPERAND + i*stride);
+		  y = 0;
+		  exact = sqrt(double(decode(x)));
+	       }
+	       uint32_t result = eval(P, A, x, y);
+	       S.add(x, y, result, exact, round_exact(exact, config.rounding));
+	    }
+	 }
+      });
+   }
+   for(std::thread& thread: threads) {
+      thread.join();
+   }
+
+   ErrorStats result;
+   for(const ErrorStats& S: stats) {
+      result.merge(S);
+   }
+   return result;
+}
+
+int main(int argc, char** argv) {
+   const char* op_name = nullptr;
+   const char* alg_name = nullptr;
+   bool list = false;
+   unsigned long long stride = 1021;
+   unsigned int nb_threads = std::thread::hardware_concurrency();
+   unsigned long long seed = 0x5eed;
+   bool print_worst = false;
+   FPUConfig config;
+
+   for(int i=1; i<argc; ++i) {
+      if(!strcmp(argv[i],"-op") && i+1 < argc) {
+	 op_name = argv[++i];
+      } else if(!strcmp(argv[i],"-alg") && i+1 < argc) {
+	 alg_name = argv[++i];
+      } else if(!strcmp(argv[i],"-list")) {
+	 list = true;
+      } else if(!strcmp(argv[i],"-stride") && i+1 < argc) {
+	 stride = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-threads") && i+1 < argc) {
+	 nb_threads = (unsigned int)(atoi(argv[++i]));
+      } else if(!strcmp(argv[i],"-seed") && i+1 < argc) {
+	 seed = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-worst")) {
+	 print_worst = true;
+      } else if(!strcmp(argv[i],"-rounding") && i+1 < argc) {
+	 const char* name = argv[++i];
+	 if(!FPU_rounding_from_name(name, config.rounding)) {
+	    fprintf(stderr,"Unknown rounding mode %s\n",name);
+	    return 1;
+	 }
+      } else if(!strcmp(argv[i],"-denormals")) {
+	 config.denormals = true;
+      } else if(!strcmp(argv[i],"-guard_bits")) {
+	 config.guard_bits = true;
+      } else if(!strcmp(argv[i],"-ieee")) {
+	 config = FPUConfig::IEEE754();
+      } else {
+	 fprintf(
+	    stderr,
+	    "usage: %s <-op FDIV|FSQRT> <-alg name> <-list> <-stride S>"
+	    " <-threads N> <-seed S> <-worst>"
+	    " <-rounding rne|rtz|rdn|rup|rmm> <-denormals> <-guard_bits> <-ieee>\n",
+	    argv[0]
+	 );
+	 return 1;
+      }
+   }
+   if(stride == 0) {
+      stride = 1;
+   }
+   if(nb_threads == 0) {
+      nb_threads = 1;
+   }
+
+   std::vector<Algorithm> algs;
+   for(const Algorithm& A: algorithms()) {
+      if(
+	 (op_name == nullptr || !strcmp(op_name, operation_name[A.op])) &&
+	 (alg_name == nullptr || A.name() == alg_name)
+      ) {
+	 algs.push_back(A);
+      }
+   }
+   if(algs.empty()) {
+      fprintf(stderr,"No algorithm\n");
+      return 1;
+   }
+
+   if(list) {
+      for(const Algorithm& A: algs) {
+	 printf("%-6s %s%s\n", operation_name[A.op], A.name().c_str(),
+		A.petitbateau ? " *" : "");
+      }
+      return 0;
+   }
+
+   printf(
+      "rounding: %s, denormals: %s, guard bits: %s, %u threads\n",
+      FPU_rounding_name(config.rounding), config.denormals ? "yes" : "no",
+      config.guard_bits ? "yes" : "no", nb_threads
+   );
+
+   for(unsigned int op=0; op<OP_NB; ++op) {
+      // fastest faithful and fastest correctly rounded algorithms
+      const Algorithm* fastest_faithful = nullptr;
+      const Algorithm* fastest_correct = nullptr;
+      unsigned int fastest_faithful_cycles = 0;
+      unsigned int fastest_correct_cycles = 0;
+      bool header = false;
+
+      for(const Algorithm& A: algs) {
+	 if(A.op != op) {
+	    continue;
+	 }
+	 if(!header) {
+	    printf(
+	       "\n%-22s %6s %9s %9s %9s %9s %10s %8s\n",
+	       operation_name[op], "cycles", "max ulp", "mean ulp",
+	       "correct%", "faithful%", "failures", "time(s)"
+	    );
+	    header = true;
+	 }
+
+	 // The cycles do not depend on the operands
+	 Microprogram P(config);
+	 eval(P, A, CONST_2, CONST_3_over_2);
+	 unsigned int cycles = P.cycles();
+
+	 auto t0 = std::chrono::steady_clock::now();
+	 ErrorStats S = evaluate(A, config, stride, seed, nb_threads);
+	 auto t1 = std::chrono::steady_clock::now();
+
+	 uint64_t nb_ok = S.nb - S.failures;
+	 printf(
+	    "%-22s %6u %9.3f %9.4f %9.3f %9.3f %10llu %8.2f\n",
+	    (A.name() + (A.petitbateau ? " *" : "")).c_str(), cycles,
+	    S.max_ulp, nb_ok != 0 ? S.sum_ulp / double(nb_ok) : 0.0,
+	    100.0 * double(S.correct) / double(S.nb),
+	    100.0 * double(S.faithful) / double(S.nb),
+	    (unsigned long long)(S.failures),
+	    std::chrono::duration<double>(t1-t0).count()
+	 );
+	 if(print_worst) {
+	    if(A.op == OP_FDIV) {
+	       printf(
+		  "   worst: x=%08x (%g) y=%08x (%g)\n",
+		  S.worst_x, decode(S.worst_x), S.worst_y, decode(S.worst_y)
+	       );
+	    } else {
+	       printf("   worst: x=%08x (%g)\n", S.worst_x, decode(S.worst_x));
+	    }
+	 }
+
+	 if(
+	    S.failures == 0 && S.max_ulp < 1.0 &&
+	    (fastest_faithful == nullptr || cycles < fastest_faithful_cycles)
+	 ) {
+	    fastest_faithful = &A;
+	    fastest_faithful_cycles = cycles;
+	 }
+	 if(
+	    S.correct == S.nb &&
+	    (fastest_correct == nullptr || cycles < fastest_correct_cycles)
+	 ) {
+	    fastest_correct = &A;
+	    fastest_correct_cycles = cycles;
+	 }
+      }
+
+      if(!header) {
+	 continue;
+      }
+      printf(
+	 "fastest faithful          : %s\n",
+	 fastest_faithful != nullptr ? fastest_faithful->name().c_str() : "none"
+      );
+      printf(
+	 "fastest correctly rounded : %s\n",
+	 fastest_correct != nullptr ? fastest_correct->name().c_str() : "none"
+      );
+   }
+
+   return 0;
+}
@@ -0,0 +1,341 @@
+/*
+ * fpu_verify: verifies the C++ model of the FPU of petitbateau (the FPU
+ * class in FPU_funcs.cpp, that computes with the same steps as the
+ * microprograms of RTL/PROCESSOR/petitbateau.v) against the FPU of the
+ * host, on batches of random operands.
+ *
+ * Usage: fpu_verify <options>
+ *   -op name     : only verifies this operation (FADD, FSUB, FMUL, FMADD,
+ *                  FMSUB, FNMADD, FNMSUB; default: all of them)
+ *   -n N         : number of evaluations per operation (default: 10000000)
+ *   -seed S      : seed of the random generator
+ *   -dist name   : distribution of the operands:
+ *                    mixed  (default) normal numbers with close exponents,
+ *                           operands that cancel, special values and
+ *                           random bit patterns
+ *                    normal normal numbers with close exponents
+ *                    random random bit patterns
+ *   -print N     : prints the first N mismatches of each category
+ *                  (default: 0)
+ *   -rounding mode : rounding mode (rne, rtz, rdn, rup, rmm, default: rtz)
+ *   -denormals   : gradual underflow (default: flush to zero)
+ *   -guard_bits  : guard bits and sticky bit in the FPU class
+ *   -ieee        : same as -rounding rne -denormals -guard_bits
+ *
+ * The FPU class and the host compute with the same configuration (see
+ * FPUConfig in FPU_funcs.h, the default one is the FPU of petitbateau).
+ * The mismatches are sorted in categories:
+ *   NaN/inf op  : an operand is a NaN or an infinity
+ *   overflow    : the result of the host is an infinity or the largest
+ *                 finite number (overflow with round towards zero)
+ *   denormal op : an operand is a denormal number
+ *   underflow   : the result of the host is zero
+ *   1 ulp       : the results differ by one unit in the last place
+ *                 (rounding)
+ *   other       : the other mismatches
+ * Zeroes of different signs and NaNs with different payloads are
+ * considered equal.
+ */
+
+#include "FPU_funcs.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+enum MismatchCategory {
+   MISMATCH_NAN_INF_OP, MISMATCH_OVERFLOW, MISMATCH_DENORMAL_OP,
+   MISMATCH_UNDERFLOW, MISMATCH_ULP, MISMATCH_OTHER,
+   MISMATCH_NB
+};
+
+static const char* mismatch_category_name[MISMATCH_NB] = {
+   "NaN/inf op", "overflow", "denormal op", "underflow", "1 ulp", "other"
+};
+
+enum Distribution {
+   DIST_MIXED, DIST_NORMAL, DIST_RANDOM
+};
+
+/*
+ * \brief Random numbers generator (xorshift64*)
+ */
+class Random {
+ public:
+   Random(uint64_t seed) : state_(seed == 0 ? 1 : seed) {
+   }
+
+   uint32_t next() {
+      state_ ^= state_ >> 12;
+      state_ ^= state_ << 25;
+      state_ ^= state_ >> 27;
+      return uint32_t((state_ * 0x2545F4914F6CDD1Dull) >> 32);
+   }
+
+ private:
+   uint64_t state_;
+};
+
+static inline uint32_t float_exp(uint32_t x) {
+   return (x >> 23) & 255;
+}
+
+static inline uint32_t float_mant(uint32_t x) {
+   return x & 0x7fffff;
+}
+
+static inline bool is_NaN_or_infty(uint32_t x) {
+   return float_exp(x) == 255;
+}
+
+static inline bool is_NaN(uint32_t x) {
+   return float_exp(x) == 255 && float_mant(x) != 0;
+}
+
+static inline bool is_zero(uint32_t x) {
+   return (x & 0x7fffffff) == 0;
+}
+
+static inline bool is_denormal(uint32_t x) {
+   return float_exp(x) == 0 && float_mant(x) != 0;
+}
+
+/*
+ * \brief A normal number with a random sign and mantissa, and an exponent
+ *  in [127-range,127+range].
+ */
+static uint32_t random_normal(Random& R, uint32_t range) {
+   uint32_t r = R.next();
+   uint32_t exp = 127 - range + (R.next() % (2*range+1));
+   return (r & 0x807fffff) | (exp << 23);
+}
+
+static uint32_t random_special(Random& R) {
+   static const uint32_t special[] = {
+      0x00000000, // +0
+      0x7f800000, // +inf
+      0x7fc00000, // quiet NaN
+      0x7fa00000, // signaling NaN
+      0x00000001, // smallest denormal
+      0x007fffff, // largest denormal
+      0x00800000, // smallest normal
+      0x7f7fffff, // largest normal
+      0x3f800000, // 1.0
+      0x3f7fffff  // 1.0 - ulp
+   };
+   uint32_t r = R.next();
+   return special[r % (sizeof(special)/sizeof(special[0]))] | (r & 0x80000000);
+}
+
+/*
+ * \brief Generates an operand.
+ * \param[in] prev the previous operand, for the operands that cancel
+ */
+static uint32_t random_operand(Random& R, Distribution dist, uint32_t prev) {
+   switch(dist) {
+   case DIST_NORMAL:
+      return random_normal(R,20);
+   case DIST_RANDOM:
+      return R.next();
+   default:
+      break;
+   }
+   uint32_t r = R.next() % 10;
+   if(r < 5) {
+      return random_normal(R,20);
+   }
+   if(r < 7) {
+      // same magnitude as prev (+/- one binade), opposite sign,
+      // random low bits: cancellation in ADD
+      uint32_t exp = float_exp(prev);
+      if(exp != 0 && exp < 254) {
+	 exp = exp - 1 + (R.next() % 3);
+      }
+      uint32_t bits = R.next() & 0xfff;
+      return ((prev ^ 0x80000000) & 0x807ff000) | (exp << 23) | bits;
+   }
+   if(r < 8) {
+      return random_special(R);
+   }
+   return R.next();
+}
+
+static MismatchCategory classify(
+   uint32_t x, uint32_t y, uint32_t z, unsigned int nb_args, uint32_t host
+) {
+   if(
+      is_NaN_or_infty(x) || is_NaN_or_infty(y) ||
+      (nb_args == 3 && is_NaN_or_infty(z))
+   ) {
+      return MISMATCH_NAN_INF_OP;
+   }
+   if((host & 0x7fffffff) >= 0x7f7fffff) {
+      return MISMATCH_OVERFLOW;
+   }
+   if(is_denormal(x) || is_denormal(y) || (nb_args == 3 && is_denormal(z))) {
+      return MISMATCH_DENORMAL_OP;
+   }
+   if(is_zero(host)) {
+      return MISMATCH_UNDERFLOW;
+   }
+   return MISMATCH_OTHER;
+}
+
+static bool same_result(uint32_t soft, uint32_t host) {
+   return soft == host ||
+	  (is_zero(soft) && is_zero(host)) ||
+	  (is_NaN(soft) && is_NaN(host));
+}
+
+static float decode(uint32_t x) {
+   float result;
+   memcpy(&result, &x, sizeof(result));
+   return result;
+}
+
+int main(int argc, char** argv) {
+   const char* op_name = nullptr;
+   unsigned long long N = 10000000;
+   unsigned long long seed = 0x5eed;
+   Distribution dist = DIST_MIXED;
+   unsigned int max_print = 0;
+   FPUConfig config;
+
+   for(int i=1; i<argc; ++i) {
+      if(!strcmp(argv[i],"-op") && i+1 < argc) {
+	 op_name = argv[++i];
+      } else if(!strcmp(argv[i],"-n") && i+1 < argc) {
+	 N = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-seed") && i+1 < argc) {
+	 seed = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-dist") && i+1 < argc) {
+	 const char* name = argv[++i];
+	 if(!strcmp(name,"mixed")) {
+	    dist = DIST_MIXED;
+	 } else if(!strcmp(name,"normal")) {
+	    dist = DIST_NORMAL;
+	 } else if(!strcmp(name,"random")) {
+	    dist = DIST_RANDOM;
+	 } else {
+	    fprintf(stderr,"Unknown distribution %s\n",name);
+	    return 1;
+	 }
+      } else if(!strcmp(argv[i],"-print") && i+1 < argc) {
+	 max_print = (unsigned int)(atoi(argv[++i]));
+      } else if(!strcmp(argv[i],"-rounding") && i+1 < argc) {
+	 const char* name = argv[++i];
+	 if(!FPU_rounding_from_name(name, config.rounding)) {
+	    fprintf(stderr,"Unknown rounding mode %s\n",name);
+	    return 1;
+	 }
+      } else if(!strcmp(argv[i],"-denormals")) {
+	 config.denormals = true;
+      } else if(!strcmp(argv[i],"-guard_bits")) {
+	 config.guard_bits = true;
+      } else if(!strcmp(argv[i],"-ieee")) {
+	 config = FPUConfig::IEEE754();
+      } else {
+	 fprintf(
+	    stderr,
+	    "usage: %s <-op name> <-n N> <-seed S>"
+	    " <-dist mixed|normal|random> <-print N>"
+	    " <-rounding rne|rtz|rdn|rup|rmm> <-denormals> <-guard_bits> <-ieee>\n",
+	    argv[0]
+	 );
+	 return 1;
+      }
+   }
+
+   std::vector<FPUOp> ops;
+   for(unsigned int op=0; op<FPU_OP_NB; ++op) {
+      if(op_name == nullptr || !strcmp(op_name, FPU_op_name(FPUOp(op)))) {
+	 ops.push_back(FPUOp(op));
+      }
+   }
+   if(ops.empty()) {
+      fprintf(stderr,"Unknown operation %s\n",op_name);
+      return 1;
+   }
+
+   FPU_set_config(config);
+
+   const size_t BATCH = 1 << 16;
+   std::vector<uint32_t> x(BATCH), y(BATCH), z(BATCH);
+   std::vector<uint32_t> soft(BATCH), host(BATCH);
+
+   printf("%-8s %12s %10s %10s", "op", "evaluated", "soft Mop/s", "host Mop/s");
+   for(unsigned int c=0; c<MISMATCH_NB; ++c) {
+      printf(" %11s", mismatch_category_name[c]);
+   }
+   printf("\n");
+
+   bool ok = true;
+   for(FPUOp op: ops) {
+      unsigned int nb_args = FPU_op_nb_args(op);
+      Random R(seed + op);
+      uint64_t mismatches[MISMATCH_NB];
+      memset(mismatches, 0, sizeof(mismatches));
+      double soft_time = 0.0;
+      double host_time = 0.0;
+
+      for(unsigned long long done = 0; done < N; ) {
+	 size_t n = size_t(std::min<unsigned long long>(BATCH, N - done));
+	 for(size_t i=0; i<n; ++i) {
+	    x[i] = random_operand(R, dist, 0);
+	    y[i] = random_operand(R, dist, x[i]);
+	    z[i] = random_operand(R, dist, y[i]);
+	 }
+
+	 auto t0 = std::chrono::steady_clock::now();
+	 FPU_soft_bulk(op, x.data(), y.data(), z.data(), soft.data(), n);
+	 auto t1 = std::chrono::steady_clock::now();
+	 FPU_host_bulk(op, x.data(), y.data(), z.data(), host.data(), n);
+	 auto t2 = std::chrono::steady_clock::now();
+	 soft_time += std::chrono::duration<double>(t1-t0).count();
+	 host_time += std::chrono::duration<double>(t2-t1).count();
+
+	 for(size_t i=0; i<n; ++i) {
+	    if(same_result(soft[i], host[i])) {
+	       continue;
+	    }
+	    MismatchCategory c = classify(x[i], y[i], z[i], nb_args, host[i]);
+	    if(
+	       c == MISMATCH_OTHER && (soft[i] >> 31) == (host[i] >> 31) &&
+	       (soft[i] - host[i] == 1 || host[i] - soft[i] == 1)
+	    ) {
+	       c = MISMATCH_ULP;
+	    }
+	    if(mismatches[c] < max_print) {
+	       printf(
+		  "%s [%s] x=%08x (%g) y=%08x (%g)",
+		  FPU_op_name(op), mismatch_category_name[c],
+		  x[i], decode(x[i]), y[i], decode(y[i])
+	       );
+	       if(nb_args == 3) {
+		  printf(" z=%08x (%g)", z[i], decode(z[i]));
+	       }
+	       printf(
+		  " soft=%08x (%g) host=%08x (%g)\n",
+		  soft[i], decode(soft[i]), host[i], decode(host[i])
+	       );
+	    }
+	    ++mismatches[c];
+	    ok = false;
+	 }
+	 done += n;
+      }
+
+      printf(
+	 "%-8s %12llu %10.2f %10.2f", FPU_op_name(op), N,
+	 soft_time > 0.0 ? double(N)/soft_time*1e-6 : 0.0,
+	 host_time > 0.0 ? double(N)/host_time*1e-6 : 0.0
+      );
+      for(unsigned int c=0; c<MISMATCH_NB; ++c) {
+	 printf(" %11llu", (unsigned long long)(mismatches[c]));
+      }
+      printf("\n");
+   }
+
+   return ok ? 0 : 2;
+}
@@ -0,0 +1,238 @@
+/*
+ * femtorv32_iss: instruction set simulator of a femtorv32 processor
+ * (RV32IMFC) in a femtosoc (see ISS.h). Runs firmware ELF executables
+ * on the host, much faster than the verilated bench.
+ *
+ * Usage: femtorv32_iss <options> firmware.elf
+ *   -ram N          : size of the RAM in bytes (default: 65536 like the
+ *                     bench, or enough for the ELF executable)
+ *   -freq N         : frequency in MHz seen by the firmware (default: 1)
+ *   -max_cycles N   : stops after N instructions (one instruction per
+ *                     cycle, same option as the verilated bench)
+ *   -uart_in file   : sends the content of file to the UART
+ *   -uart_pty       : connects the UART to a pseudo-terminal
+ *   -ppm file       : saves the OLED display to file at the end
+ *   -trace file     : saves an execution trace (see Trace.h, trace_tool)
+ *   -stats          : prints a report at the end (MIPS)
+ *   -report file    : saves a summary, read by sim_batch
+ *   -fpu_rounding mode : rounding mode of the F instructions, rne, rtz,
+ *                     rdn, rup or rmm (default: rtz, like petitbateau)
+ *   -fpu_denormals  : gradual underflow (default: denormal results are
+ *                     flushed to zero)
+ *
+ * The simulation stops when the firmware calls exit() or sends EOT to
+ * the UART. Exit status is 0 on success, 1 if exit() was called with a
+ * non-zero code or on error (illegal instruction, bus error, EBREAK),
+ * 2 if stopped by -max_cycles (like the verilated bench).
+ */
+
+#include "ISS.h"
+#include "ElfSymbols.h"
+#include "FPU_funcs.h"
+#include "SimStats.h"
+#include "Trace.h"
+#include "UART.h"
+#include "femto_elf.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/*
+ * \brief Gets the size of the RAM needed by an ELF executable
+ * \details Power of two, with at least as much free space as the code
+ *  and data (for the stack and the heap)
+ */
+static uint32_t RAM_size_for_elf(const char* filename) {
+   uint32_t result = 65536;
+   Elf32Info info;
+   if(elf32_stat(filename, &info) == ELF32_OK) {
+      while(result < 2*info.max_address && result < 0x400000) {
+	 result *= 2;
+      }
+   }
+   return result;
+}
+
+int main(int argc, char** argv) {
+   uint32_t RAM_size = 0;
+   uint32_t freq = 1;
+   uint64_t max_cycles = 0;
+   const char* uart_in_filename = nullptr;
+   bool uart_pty = false;
+   const char* ppm_filename = nullptr;
+   const char* trace_filename = nullptr;
+   bool print_stats = false;
+   const char* report_filename = nullptr;
+   const char* elf_filename = nullptr;
+   FPUConfig fpu_config;
+
+   for(int i=1; i<argc; ++i) {
+      if(!strcmp(argv[i],"-ram") && i+1 < argc) {
+	 RAM_size = uint32_t(strtoul(argv[++i], nullptr, 0));
+      } else if(!strcmp(argv[i],"-freq") && i+1 < argc) {
+	 freq = uint32_t(strtoul(argv[++i], nullptr, 10));
+      } else if(!strcmp(argv[i],"-max_cycles") && i+1 < argc) {
+	 max_cycles = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-uart_in") && i+1 < argc) {
+	 uart_in_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-uart_pty")) {
+	 uart_pty = true;
+      } else if(!strcmp(argv[i],"-ppm") && i+1 < argc) {
+	 ppm_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-trace") && i+1 < argc) {
+	 trace_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-stats")) {
+	 print_stats = true;
+      } else if(!strcmp(argv[i],"-report") && i+1 < argc) {
+	 report_filename = argv[++i];
+      } else if(
+	 !strcmp(argv[i],"-fpu_rounding") && i+1 < argc &&
+	 FPU_rounding_from_name(argv[i+1], fpu_config.rounding)
+      ) {
+	 ++i;
+      } else if(!strcmp(argv[i],"-fpu_denormals")) {
+	 fpu_config.denormals = true;
+      } else if(argv[i][0] != '-' && elf_filename == nullptr) {
+	 elf_filename = argv[i];
+      } else {
+	 elf_filename = nullptr;
+	 break;
+      }
+   }
+
+   if(elf_filename == nullptr) {
+      fprintf(
+	 stderr,
+	 "usage: %s <-ram N> <-freq N> <-max_cycles N>"
+	 " <-uart_in file> <-uart_pty> <-ppm file> <-trace file>"
+	 " <-stats> <-report file> <-fpu_rounding rne|rtz|rdn|rup|rmm>"
+	 " <-fpu_denormals> firmware.elf\n",
+	 argv[0]
+      );
+      return 1;
+   }
+
+   if(RAM_size == 0) {
+      RAM_size = RAM_size_for_elf(elf_filename);
+   }
+
+   ISS iss(RAM_size);
+   int elf_status = iss.load_elf(elf_filename);
+   if(elf_status != ELF32_OK) {
+      fprintf(stderr,"Could not load %s (ELF error %d)\n",elf_filename,elf_status);
+      return 1;
+   }
+
+   ElfSymbols symbols;
+   if(symbols.load(elf_filename)) {
+      for(unsigned int i=0; i<symbols.nb_symbols(); ++i) {
+	 if(symbols.symbol(i).name == "exit") {
+	    iss.set_exit_address(symbols.symbol(i).address);
+	 }
+      }
+   }
+
+   UART uart;
+   if(uart_in_filename != nullptr && !uart.set_input_file(uart_in_filename)) {
+      fprintf(stderr,"Could not open %s\n",uart_in_filename);
+      return 1;
+   }
+   if(uart_pty && !uart.open_PTY()) {
+      fprintf(stderr,"Could not create pseudo-terminal\n");
+      return 1;
+   }
+   iss.IO().set_UART(&uart);
+   iss.IO().set_config(iss.RAM_size(), freq, 64);
+
+   TraceWriter trace;
+   if(trace_filename != nullptr && !trace.open(trace_filename)) {
+      fprintf(stderr,"Could not create trace %s\n",trace_filename);
+      return 1;
+   }
+
+   SimStats stats;
+   stats.set_instret(iss.instret_ptr());
+   FPU_set_config(fpu_config);
+
+   // Instructions executed between two checks of max_cycles
+   static const uint64_t BATCH = 1 << 20;
+
+   while(!iss.halted()) {
+      uint64_t nb_instr = BATCH;
+      if(max_cycles != 0) {
+	 if(iss.cycles() >= max_cycles) {
+	    break;
+	 }
+	 if(max_cycles - iss.cycles() < nb_instr) {
+	    nb_instr = max_cycles - iss.cycles();
+	 }
+      }
+      if(trace.is_open()) {
+	 TraceRecord R;
+	 for(uint64_t i=0; i<nb_instr; ++i) {
+	    uint64_t instret = iss.instret();
+	    iss.step(&R);
+	    if(iss.instret() == instret) {
+	       break; // stopped before executing the instruction
+	    }
+	    trace.retire(R.cycle, R.PC, R.instr);
+	    if(R.wb) {
+	       trace.writeback(R.rd, R.wb_data);
+	    }
+	    if(R.load) {
+	       trace.load(R.mem_addr);
+	    }
+	    if(R.store) {
+	       trace.store(R.mem_addr, R.mem_wdata, R.mem_wmask);
+	    }
+	    if(iss.halted()) {
+	       break;
+	    }
+	 }
+      } else {
+	 iss.run(nb_instr);
+      }
+   }
+
+   uart.flush();
+   bool finished = iss.halted();
+   bool success = finished && (
+      (!strcmp(iss.halt_reason(),"exit") && iss.exit_code() == 0) ||
+      uart.finished()
+   );
+
+   if(finished) {
+      if(!strcmp(iss.halt_reason(),"exit")) {
+	 fprintf(stderr,"[ISS] exit(%d)\n",iss.exit_code());
+      } else if(!uart.finished()) {
+	 fprintf(
+	    stderr,"[ISS] %s at PC=%08x\n",iss.halt_reason(),iss.PC()
+	 );
+      }
+   }
+
+   if(trace.is_open()) {
+      trace.close();
+   }
+
+   if(ppm_filename != nullptr && !iss.IO().save_OLED_PPM(ppm_filename)) {
+      fprintf(stderr,"Could not save %s\n",ppm_filename);
+   }
+
+   stats.set_cycles(iss.cycles());
+   if(print_stats) {
+      stats.report();
+   }
+   if(
+      report_filename != nullptr &&
+      !stats.save_report(report_filename, finished ? "finished" : "max_cycles")
+   ) {
+      fprintf(stderr,"Could not save report %s\n",report_filename);
+   }
+
+   if(!finished) {
+      return 2;
+   }
+   return success ? 0 : 1;
+}
@@ -0,0 +1,549 @@
+/*
+ * sim_batch: batch regression runner for the verilated SOCs.
+ *
+ * Simulates a list of firmwares in parallel (one process per firmware),
+ * captures their UART output, cycle counts and exit status, and writes
+ * a JSON and a CSV report.
+ *
+ * Usage: sim_batch <options> firmware1.elf ... firmwareN.elf -- simulator <args>
+ *   -j N              : number of simulations run in parallel
+ *                       (default: number of cores)
+ *   -out dir          : output directory (default: regression)
+ *   -timeout s        : kills a simulation after s seconds of wall time
+ *   -baseline file    : compares with a previous report.csv, and reports
+ *                       cycle count regressions and UART output changes
+ *   -tolerance p      : accepted increase of cycle counts, in percent
+ *
+ * Each firmware is simulated by:
+ *    simulator <args> -report dir/name.report firmware.elf
+ * with stdout (the UART) redirected to dir/name.uart and stderr to
+ * dir/name.log. The simulator is for instance the bench (BOARDS/bench.mk,
+ * make BENCH.regression), or a tutorial SOC (VSOC with SIM_RAM or
+ * SIM_PIPELINE, see TUTORIALS/FROM_BLINKER_TO_RISCV/run_verilator.sh).
+ * The simulator writes its summary (cycles, instret, wall time) with
+ * SimStats::save_report(), and exits with status 0 when the firmware
+ * terminates (EOT sent to the UART) or 2 when -max_cycles is reached.
+ *
+ * The exit status of sim_batch is 0 if all the simulations succeeded and
+ * no regression was detected, 1 otherwise.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/**
+ * \brief A simulation job (one firmware)
+ */
+struct Job {
+   std::string firmware;
+   std::string name;
+   pid_t pid = 0;
+   std::chrono::steady_clock::time_point start;
+   bool timed_out = false;
+
+   // Results
+   std::string status;   // ok, max_cycles, failed, crashed, timeout
+   int exit_code = -1;
+   unsigned long long cycles = 0;
+   unsigned long long instret = 0;
+   double sim_time = 0.0;   // wall time measured by the simulator
+   double wall_time = 0.0;  // wall time measured by sim_batch
+   uint64_t uart_hash = 0;
+   size_t uart_size = 0;
+
+   // Comparison with baseline
+   bool has_baseline = false;
+   long long cycles_delta = 0;
+   bool regression = false;
+   bool uart_changed = false;
+
+   double CPI() const {
+      return instret != 0 ? double(cycles)/double(instret) : 0.0;
+   }
+};
+
+/**
+ * \brief Gets the name of a firmware, used to name the output files.
+ * \details Removes the directory and the .elf / .baremetal.elf / .hex
+ *  extension (firmwares with the same name in different directories
+ *  are renamed by main()).
+ */
+std::string firmware_name(const std::string& filename) {
+   std::string result = filename;
+   size_t slash = result.rfind('/');
+   if(slash != std::string::npos) {
+      result = result.substr(slash+1);
+   }
+   size_t dot = result.find('.');
+   if(dot != std::string::npos && dot != 0) {
+      result = result.substr(0,dot);
+   }
+   return result;
+}
+
+/**
+ * \brief Reads a whole file and computes its FNV-1a hash.
+ * \return false if the file could not be opened.
+ */
+bool hash_file(const std::string& filename, uint64_t& hash, size_t& size) {
+   hash = 0xcbf29ce484222325ull;
+   size = 0;
+   FILE* f = fopen(filename.c_str(),"rb");
+   if(f == nullptr) {
+      return false;
+   }
+   unsigned char buffer[4096];
+   size_t nb_read;
+   while((nb_read = fread(buffer,1,sizeof(buffer),f)) != 0) {
+      for(size_t i=0; i<nb_read; ++i) {
+	 hash ^= buffer[i];
+	 hash *= 0x100000001b3ull;
+      }
+      size += nb_read;
+   }
+   fclose(f);
+   return true;
+}
+
+/**
+ * \brief Reads the summary saved by SimStats::save_report()
+ */
+bool read_report(const std::string& filename, Job& job) {
+   FILE* f = fopen(filename.c_str(),"r");
+   if(f == nullptr) {
+      return false;
+   }
+   char status[64];
+   int nb = fscanf(
+      f, "status=%63s cycles=%llu instret=%llu wall_time=%lf",
+      status, &job.cycles, &job.instret, &job.sim_time
+   );
+   fclose(f);
+   return (nb == 4);
+}
+
+/**
+ * \brief Starts the simulation of a job
+ * \param[in] job the job, pid and start are updated
+ * \param[in] simulator the simulator command followed by its arguments
+ * \param[in] out_dir the output directory
+ */
+void start_job(
+   Job& job, const std::vector<std::string>& simulator,
+   const std::string& out_dir
+) {
+   std::string report_file = out_dir + "/" + job.name + ".report";
+   std::string uart_file   = out_dir + "/" + job.name + ".uart";
+   std::string log_file    = out_dir + "/" + job.name + ".log";
+   unlink(report_file.c_str());
+
+   std::vector<std::string> args = simulator;
+   args.push_back("-report");
+   args.push_back(report_file);
+   args.push_back(job.firmware);
+
+   job.start = std::chrono::steady_clock::now();
+   job.pid = fork();
+   if(job.pid < 0) {
+      perror("fork");
+      exit(1);
+   }
+
+   if(job.pid == 0) {
+      int uart = open(uart_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      int log  = open(log_file.c_str(),  O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if(uart < 0 || log < 0) {
+	 perror("open");
+	 _exit(127);
+      }
+      dup2(uart, 1);
+      dup2(log, 2);
+      close(uart);
+      close(log);
+      std::vector<char*> argv;
+      for(std::string& arg: args) {
+	 argv.push_back(const_cast<char*>(arg.c_str()));
+      }
+      argv.push_back(nullptr);
+      execvp(argv[0], argv.data());
+      perror(argv[0]);
+      _exit(127);
+   }
+}
+
+/**
+ * \brief Gathers the results of a job once its process is terminated
+ * \param[in] job the job
+ * \param[in] wstatus the status returned by waitpid()
+ * \param[in] out_dir the output directory
+ */
+void finish_job(Job& job, int wstatus, const std::string& out_dir) {
+   job.wall_time = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - job.start
+   ).count();
+   job.pid = 0;
+
+   if(job.timed_out) {
+      job.status = "timeout";
+   } else if(WIFEXITED(wstatus)) {
+      job.exit_code = WEXITSTATUS(wstatus);
+      switch(job.exit_code) {
+      case 0:
+	 job.status = "ok";
+	 break;
+      case 2:
+	 job.status = "max_cycles";
+	 break;
+      default:
+	 job.status = "failed";
+	 break;
+      }
+   } else {
+      job.status = "crashed";
+   }
+
+   if(!read_report(out_dir + "/" + job.name + ".report", job)) {
+      if(job.status == "ok" || job.status == "max_cycles") {
+	 job.status = "failed"; // simulator did not write its summary
+      }
+   }
+   hash_file(out_dir + "/" + job.name + ".uart", job.uart_hash, job.uart_size);
+}
+
+/**
+ * \brief Runs all the jobs, with at most nb_parallel at the same time
+ */
+void run_jobs(
+   std::vector<Job>& jobs, const std::vector<std::string>& simulator,
+   const std::string& out_dir, unsigned int nb_parallel, double timeout
+) {
+   size_t next_job = 0;
+   size_t nb_finished = 0;
+   unsigned int nb_running = 0;
+
+   while(nb_finished < jobs.size()) {
+      while(nb_running < nb_parallel && next_job < jobs.size()) {
+	 start_job(jobs[next_job], simulator, out_dir);
+	 ++next_job;
+	 ++nb_running;
+      }
+
+      int wstatus;
+      pid_t pid = waitpid(-1, &wstatus, WNOHANG);
+      if(pid > 0) {
+	 for(Job& job: jobs) {
+	    if(job.pid == pid) {
+	       finish_job(job, wstatus, out_dir);
+	       --nb_running;
+	       ++nb_finished;
+	       fprintf(
+		  stderr,"[%3d/%3d] %-24s %-10s %12llu cycles  %.2f s\n",
+		  int(nb_finished), int(jobs.size()), job.name.c_str(),
+		  job.status.c_str(), job.cycles, job.wall_time
+	       );
+	       break;
+	    }
+	 }
+	 continue;
+      }
+
+      if(timeout > 0.0) {
+	 auto now = std::chrono::steady_clock::now();
+	 for(Job& job: jobs) {
+	    if(
+	       job.pid != 0 && !job.timed_out &&
+	       std::chrono::duration<double>(now - job.start).count() > timeout
+	    ) {
+	       job.timed_out = true;
+	       kill(job.pid, SIGKILL);
+	    }
+	 }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   }
+}
+
+/**
+ * \brief The results of a previous run, read from its report.csv
+ */
+struct Baseline {
+   unsigned long long cycles;
+   uint64_t uart_hash;
+};
+
+/**
+ * \brief Reads a baseline report.csv
+ * \param[in] filename the name of the file
+ * \param[out] baseline the results, indexed by firmware name
+ * \return false if the baseline could not be read
+ */
+bool read_baseline(
+   const std::string& filename, std::map<std::string, Baseline>& baseline
+) {
+   FILE* f = fopen(filename.c_str(),"r");
+   if(f == nullptr) {
+      return false;
+   }
+   char line[1024];
+   // Skip header
+   if(fgets(line, sizeof(line), f) == nullptr) {
+      fclose(f);
+      return false;
+   }
+   // name,firmware,status,exit_code,cycles,instret,CPI,sim_time,wall_time,
+   // uart_size,uart_hash,...
+   while(fgets(line, sizeof(line), f) != nullptr) {
+      std::vector<std::string> fields;
+      char* saveptr = nullptr;
+      for(
+	 char* field = strtok_r(line, ",\n", &saveptr); field != nullptr;
+	 field = strtok_r(nullptr, ",\n", &saveptr)
+      ) {
+	 fields.push_back(field);
+      }
+      if(fields.size() < 11) {
+	 continue;
+      }
+      Baseline& B = baseline[fields[0]];
+      B.cycles    = strtoull(fields[4].c_str(), nullptr, 10);
+      B.uart_hash = strtoull(fields[10].c_str(), nullptr, 16);
+   }
+   fclose(f);
+   return true;
+}
+
+/**
+ * \brief Compares the results with a baseline
+ * \param[in] tolerance accepted increase of cycle counts, in percent
+ */
+void compare_with_baseline(
+   std::vector<Job>& jobs, const std::map<std::string, Baseline>& baseline,
+   double tolerance
+) {
+   for(Job& job: jobs) {
+      auto it = baseline.find(job.name);
+      if(it == baseline.end()) {
+	 continue;
+      }
+      job.has_baseline = true;
+      job.cycles_delta = (long long)(job.cycles) - (long long)(it->second.cycles);
+      job.regression = double(job.cycles) >
+	               double(it->second.cycles) * (1.0 + tolerance / 100.0);
+      job.uart_changed = (job.uart_hash != it->second.uart_hash);
+   }
+}
+
+/**
+ * \brief Escapes a string for JSON output
+ */
+std::string json_string(const std::string& s) {
+   std::string result = "\"";
+   for(char c: s) {
+      if(c == '"' || c == '\\') {
+	 result += '\\';
+      }
+      result += c;
+   }
+   result += "\"";
+   return result;
+}
+
+bool save_CSV(const std::vector<Job>& jobs, const std::string& filename) {
+   FILE* f = fopen(filename.c_str(),"w");
+   if(f == nullptr) {
+      return false;
+   }
+   fprintf(
+      f,"name,firmware,status,exit_code,cycles,instret,CPI,sim_time,wall_time,"
+        "uart_size,uart_hash,cycles_delta,regression,uart_changed\n"
+   );
+   for(const Job& job: jobs) {
+      fprintf(
+	 f,"%s,%s,%s,%d,%llu,%llu,%.4f,%.3f,%.3f,%llu,%016llx,%lld,%d,%d\n",
+	 job.name.c_str(), job.firmware.c_str(), job.status.c_str(),
+	 job.exit_code, job.cycles, job.instret, job.CPI(),
+	 job.sim_time, job.wall_time,
+	 (unsigned long long)(job.uart_size),
+	 (unsigned long long)(job.uart_hash),
+	 job.cycles_delta, int(job.regression), int(job.uart_changed)
+      );
+   }
+   fclose(f);
+   return true;
+}
+
+bool save_JSON(const std::vector<Job>& jobs, const std::string& filename) {
+   FILE* f = fopen(filename.c_str(),"w");
+   if(f == nullptr) {
+      return false;
+   }
+   fprintf(f,"[\n");
+   for(size_t i=0; i<jobs.size(); ++i) {
+      const Job& job = jobs[i];
+      fprintf(f,"  {\n");
+      fprintf(f,"    \"name\": %s,\n", json_string(job.name).c_str());
+      fprintf(f,"    \"firmware\": %s,\n", json_string(job.firmware).c_str());
+      fprintf(f,"    \"status\": %s,\n", json_string(job.status).c_str());
+      fprintf(f,"    \"exit_code\": %d,\n", job.exit_code);
+      fprintf(f,"    \"cycles\": %llu,\n", job.cycles);
+      fprintf(f,"    \"instret\": %llu,\n", job.instret);
+      fprintf(f,"    \"CPI\": %.4f,\n", job.CPI());
+      fprintf(f,"    \"sim_time\": %.3f,\n", job.sim_time);
+      fprintf(f,"    \"wall_time\": %.3f,\n", job.wall_time);
+      fprintf(
+	 f,"    \"uart\": %s,\n", json_string(job.name + ".uart").c_str()
+      );
+      fprintf(
+	 f,"    \"uart_size\": %llu,\n", (unsigned long long)(job.uart_size)
+      );
+      fprintf(
+	 f,"    \"uart_hash\": \"%016llx\"", (unsigned long long)(job.uart_hash)
+      );
+      if(job.has_baseline) {
+	 fprintf(f,",\n    \"cycles_delta\": %lld,\n", job.cycles_delta);
+	 fprintf(f,"    \"regression\": %s,\n", job.regression ? "true" : "false");
+	 fprintf(
+	    f,"    \"uart_changed\": %s", job.uart_changed ? "true" : "false"
+	 );
+      }
+      fprintf(f,"\n  }%s\n", (i+1 < jobs.size()) ? "," : "");
+   }
+   fprintf(f,"]\n");
+   fclose(f);
+   return true;
+}
+
+void usage(const char* progname) {
+   fprintf(
+      stderr,
+      "usage: %s <-j N> <-out dir> <-timeout s> <-baseline report.csv>"
+      " <-tolerance percent> firmware1 ... firmwareN -- simulator <args>\n",
+      progname
+   );
+   exit(1);
+}
+
+int main(int argc, char** argv) {
+   unsigned int nb_parallel = std::thread::hardware_concurrency();
+   std::string out_dir = "regression";
+   double timeout = 0.0;
+   const char* baseline_filename = nullptr;
+   double tolerance = 0.0;
+   std::vector<std::string> firmwares;
+   std::vector<std::string> simulator;
+
+   int i=1;
+   for(; i<argc; ++i) {
+      if(!strcmp(argv[i],"--")) {
+	 ++i;
+	 break;
+      } else if(!strcmp(argv[i],"-j") && i+1 < argc) {
+	 nb_parallel = (unsigned int)(atoi(argv[++i]));
+      } else if(!strcmp(argv[i],"-out") && i+1 < argc) {
+	 out_dir = argv[++i];
+      } else if(!strcmp(argv[i],"-timeout") && i+1 < argc) {
+	 timeout = atof(argv[++i]);
+      } else if(!strcmp(argv[i],"-baseline") && i+1 < argc) {
+	 baseline_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-tolerance") && i+1 < argc) {
+	 tolerance = atof(argv[++i]);
+      } else if(argv[i][0] == '-') {
+	 usage(argv[0]);
+      } else {
+	 firmwares.push_back(argv[i]);
+      }
+   }
+   for(; i<argc; ++i) {
+      simulator.push_back(argv[i]);
+   }
+   if(firmwares.empty() || simulator.empty()) {
+      usage(argv[0]);
+   }
+   if(nb_parallel == 0) {
+      nb_parallel = 1;
+   }
+
+   mkdir(out_dir.c_str(), 0755);
+
+   std::vector<Job> jobs(firmwares.size());
+   std::map<std::string, int> nb_names;
+   for(size_t j=0; j<firmwares.size(); ++j) {
+      jobs[j].firmware = firmwares[j];
+      jobs[j].name = firmware_name(firmwares[j]);
+      int nb = nb_names[jobs[j].name]++;
+      if(nb != 0) {
+	 jobs[j].name += "_" + std::to_string(nb);
+      }
+   }
+
+   // Read the baseline before running the jobs, it may be
+   // in the output directory (and overwritten by the new report).
+   std::map<std::string, Baseline> baseline;
+   if(baseline_filename != nullptr && !read_baseline(baseline_filename, baseline)) {
+      fprintf(stderr,"Could not read baseline %s\n",baseline_filename);
+      return 1;
+   }
+
+   run_jobs(jobs, simulator, out_dir, nb_parallel, timeout);
+   compare_with_baseline(jobs, baseline, tolerance);
+
+   if(
+      !save_CSV(jobs, out_dir + "/report.csv") ||
+      !save_JSON(jobs, out_dir + "/report.json")
+   ) {
+      fprintf(stderr,"Could not save report in %s\n",out_dir.c_str());
+      return 1;
+   }
+
+   // Summary
+   int nb_failed = 0;
+   int nb_regressions = 0;
+   printf("\n");
+   printf("%-24s %-10s %12s %12s %7s %10s\n",
+	  "firmware","status","cycles","instret","CPI","delta");
+   for(const Job& job: jobs) {
+      printf(
+	 "%-24s %-10s %12llu %12llu %7.3f",
+	 job.name.c_str(), job.status.c_str(),
+	 job.cycles, job.instret, job.CPI()
+      );
+      if(job.has_baseline) {
+	 printf(" %+10lld", job.cycles_delta);
+	 if(job.regression) {
+	    printf("  CYCLES REGRESSION");
+	 }
+	 if(job.uart_changed) {
+	    printf("  UART OUTPUT CHANGED");
+	 }
+      }
+      printf("\n");
+      if(
+	 job.status == "failed" || job.status == "crashed" ||
+	 job.status == "timeout"
+      ) {
+	 ++nb_failed;
+      }
+      if(job.regression || job.uart_changed) {
+	 ++nb_regressions;
+      }
+   }
+   printf(
+      "\n%d firmwares, %d failed, %d regressions, report in %s/report.{csv,json}\n",
+      int(jobs.size()), nb_failed, nb_regressions, out_dir.c_str()
+   );
+
+   return (nb_failed == 0 && nb_regressions == 0) ? 0 : 1;
+}
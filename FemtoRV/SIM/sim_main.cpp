@@ -2,27 +2,705 @@
 #include "verilated.h"
 #include "FPU_funcs.h"
 #include "SSD1351.h"
+#include "SimStats.h"
+#include "UART.h"
+#include "Trace.h"
+#include "Profiler.h"
+#include "Cosim.h"
+#include "femto_elf.h"
+#include "VfemtoRV32_bench___024root.h"
+#include <vector>
+#include <string>
 #include <memory>
-#include <fenv.h>
-#include <xmmintrin.h>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef SIM_MT
+#include "SPSCQueue.h"
+#include <thread>
+#include <atomic>
+#endif
+
+#if defined(SIM_MT) && defined(SIM_SAVABLE)
+#error "Checkpoints (SIM_SAVABLE) are not supported with SIM_MT"
+#endif
+
+/*
+ * \brief Loads an ELF executable into the RAM of the simulated femtosoc
+ * \details The RAM is made visible by SIM/femtosoc_bench.vlt. It replaces
+ *  the content initialized with readmemh("FIRMWARE/firmware.hex").
+ * \param[in] top the verilated bench
+ * \param[in] filename the ELF executable
+ * \return ELF32_OK or an error code
+ */
+int load_elf(VfemtoRV32_bench& top, const char* filename) {
+   auto& MEM = top.rootp->femtoRV32_bench__DOT__uut__DOT__RAM;
+   size_t RAM_SIZE = sizeof(MEM);
+
+   Elf32Info info;
+   int elf_status = elf32_stat(filename, &info);
+   if(elf_status != ELF32_OK) {
+      return elf_status;
+   }
+   if(info.max_address > RAM_SIZE) {
+      fprintf(
+	 stderr,"ELF exceeds RAM (%d > %d)\n",
+	 int(info.max_address),int(RAM_SIZE)
+      );
+      exit(-1);
+   }
+
+   std::vector<unsigned char> RAM(RAM_SIZE,0);
+   elf_status = elf32_load_at(filename, &info, RAM.data());
+   if(elf_status != ELF32_OK) {
+      return elf_status;
+   }
+
+   size_t nb_words = RAM_SIZE / sizeof(IData);
+   for(size_t i=0; i<nb_words; ++i) {
+      MEM[i] = IData(RAM[4*i])           |
+	       IData(RAM[4*i+1])   << 8  |
+	       IData(RAM[4*i+2])   << 16 |
+	       IData(RAM[4*i+3])   << 24 ;
+   }
+   return ELF32_OK;
+}
+
+/*
+ * \brief Loads a firmware saved by firmware_words in a binary word format
+ *  (.fwb or .rle, see FIRMWARE/TOOLS/FIRMWARE_WORDS_SRC/firmware_words.cpp)
+ *  into the RAM of the simulated femtosoc
+ * \details Only the words of the saved region are replaced.
+ * \param[in] top the verilated bench
+ * \param[in] filename the .fwb or .rle file
+ * \return true on success, false otherwise
+ */
+bool load_firmware_words(VfemtoRV32_bench& top, const char* filename) {
+   auto& MEM = top.rootp->femtoRV32_bench__DOT__uut__DOT__RAM;
+   size_t RAM_WORDS = sizeof(MEM) / sizeof(IData);
+
+   FILE* f = fopen(filename,"rb");
+   if(f == nullptr) {
+      return false;
+   }
+   uint32_t header[3];
+   if(
+      fread(header, sizeof(uint32_t), 3, f) != 3 ||
+      (header[0] != 0x31525746 && header[0] != 0x31425746) // "FWR1", "FWB1"
+   ) {
+      fclose(f);
+      return false;
+   }
+   bool rle = (header[0] == 0x31525746);
+   size_t base = header[1] / 4;
+   size_t nb_words = header[2];
+   // (base + nb_words may overflow with a corrupted header)
+   if(base > RAM_WORDS || nb_words > RAM_WORDS - base) {
+      fprintf(
+	 stderr,"%s exceeds RAM (%llu > %d)\n", filename,
+	 4ull*(base+nb_words), int(4*RAM_WORDS)
+      );
+      fclose(f);
+      exit(-1);
+   }
+
+   std::vector<uint32_t> words(nb_words);
+   bool OK = true;
+   if(!rle) {
+      OK = (fread(words.data(), sizeof(uint32_t), nb_words, f) == nb_words);
+   }
+   // run-length records: bit 31 set: the next word repeated, else literals
+   for(size_t i=0; OK && rle && i<nb_words; ) {
+      uint32_t H;
+      OK = (fread(&H, sizeof(uint32_t), 1, f) == 1);
+      size_t count = H & 0x7fffffff;
+      OK = OK && (count != 0) && (i + count <= nb_words);
+      if(OK && (H & 0x80000000)) {
+	 uint32_t w;
+	 OK = (fread(&w, sizeof(uint32_t), 1, f) == 1);
+	 std::fill(words.begin()+i, words.begin()+i+count, w);
+      } else if(OK) {
+	 OK = (fread(words.data()+i, sizeof(uint32_t), count, f) == count);
+      }
+      i += count;
+   }
+   fclose(f);
+   if(!OK) {
+      return false;
+   }
+
+   for(size_t i=0; i<nb_words; ++i) {
+      MEM[base+i] = IData(words[i]);
+   }
+   return true;
+}
+
+/*
+ * \brief Gets the content of the RAM of the simulated femtosoc
+ * \param[in] top the verilated bench
+ * \param[out] RAM the content of the RAM, one byte per address
+ */
+void read_RAM(VfemtoRV32_bench& top, std::vector<uint8_t>& RAM) {
+   auto& MEM = top.rootp->femtoRV32_bench__DOT__uut__DOT__RAM;
+   size_t nb_words = sizeof(MEM) / sizeof(IData);
+   RAM.resize(4*nb_words);
+   for(size_t i=0; i<nb_words; ++i) {
+      RAM[4*i]   = uint8_t(MEM[i]);
+      RAM[4*i+1] = uint8_t(MEM[i] >> 8);
+      RAM[4*i+2] = uint8_t(MEM[i] >> 16);
+      RAM[4*i+3] = uint8_t(MEM[i] >> 24);
+   }
+}
+
+/*
+ * \brief Records the instruction executed in the current cycle, its
+ *  write-back and memory access (see the trace_xxx signals of
+ *  RTL/femtosoc_bench.v).
+ * \details Needs to be called when pclk is low, after top.eval().
+ */
+inline void trace_cycle(
+   TraceWriter& trace, const VfemtoRV32_bench& top, uint64_t cycle
+) {
+   if(top.trace_retire) {
+      trace.retire(cycle, top.trace_PC, top.trace_instr);
+   }
+   // Memory accesses and write-back may come after the retire cycle
+   // (EXECUTE2 on the tachyon, multi-cycle operations), they belong to
+   // the last retired instruction.
+   if(top.trace_load) {
+      trace.load(top.trace_mem_addr);
+   }
+   if(top.trace_store) {
+      trace.store(top.trace_mem_addr, top.trace_mem_wdata, top.trace_mem_wmask);
+   }
+   if(top.trace_wb) {
+      trace.writeback(top.trace_rd, top.trace_wb_data);
+   }
+}
+
+/*
+ * \brief Sends the instruction executed in the current cycle to the
+ *  co-simulation, same as trace_cycle().
+ */
+inline void cosim_cycle(
+   Cosim& cosim, const VfemtoRV32_bench& top, uint64_t cycle
+) {
+   if(top.trace_retire) {
+      cosim.retire(cycle, top.trace_PC, top.trace_instr);
+   }
+   if(top.trace_store) {
+      cosim.store(top.trace_mem_addr, top.trace_mem_wdata, top.trace_mem_wmask);
+   }
+   if(top.trace_wb) {
+      cosim.writeback(top.trace_rd, top.trace_wb_data);
+   }
+}
+
+#ifdef SIM_MT
+
+/*
+ * Multithreaded mode: the verilated model (itself multithreaded, see
+ * verilator --threads) runs in a simulation thread, and the OLED display
+ * model runs in the main thread (that owns the OLED display window). The
+ * simulation thread sends the transitions of the pins to the main thread
+ * through a lock-free queue. The UART model stays in the simulation thread:
+ * with BENCH_UART_PINS it drives RXD and counts the cycles of each bit, so
+ * it needs to be evaluated synchronously with the verilated model.
+ */
+
+// The pins of the OLED display, packed in a byte.
+inline uint8_t pack_OLED_pins(const VfemtoRV32_bench& top) {
+   return uint8_t(
+      (top.oled_DIN & 1)        | ((top.oled_CLK & 1) << 1) |
+      ((top.oled_CS & 1) << 2)  | ((top.oled_DC  & 1) << 3) |
+      ((top.oled_RST & 1) << 4)
+   );
+}
+
+struct OLEDPins {
+   CData DIN, CLK, CS, DC, RST;
+   void unpack(uint8_t pins) {
+      DIN = pins & 1;
+      CLK = (pins >> 1) & 1;
+      CS  = (pins >> 2) & 1;
+      DC  = (pins >> 3) & 1;
+      RST = (pins >> 4) & 1;
+   }
+};
+
+typedef SPSCQueue<uint8_t, 16> PinQueue;
+
+#endif
+
+#ifdef SIM_SAVABLE
+#include "verilated_save.h"
+
+/*
+ * Checkpoints: the state of the verilated model, of the OLED display and
+ * of the UART model, the number of simulated cycles and the configuration
+ * of the FPU functions are saved to / restored from a file (needs
+ * verilator --savable, see BOARDS/bench.mk).
+ */
+
+static const uint32_t CHECKPOINT_MAGIC = 0x32435246; // "FRC2"
+
+void save_checkpoint(
+   const char* filename, VfemtoRV32_bench& top, SSD1351& oled, UART& uart,
+   SimStats& stats
+) {
+   VerilatedSave os;
+   os.open(filename);
+   if(!os.isOpen()) {
+      fprintf(stderr,"Could not create checkpoint %s\n",filename);
+      exit(-1);
+   }
+   uint64_t cycles = stats.cycles();
+   const FPUConfig& fpu_config = FPU_config();
+   uint32_t fpu_rounding = uint32_t(fpu_config.rounding);
+   os << CHECKPOINT_MAGIC << cycles;
+   os << fpu_rounding << fpu_config.denormals << fpu_config.guard_bits;
+   os << top;
+   oled.save(os);
+   uart.save(os);
+   os.close();
+   fprintf(
+      stderr,"\n[checkpoint] saved %s at cycle %llu\n",
+      filename, (unsigned long long)(cycles)
+   );
+}
+
+void restore_checkpoint(
+   const char* filename, VfemtoRV32_bench& top, SSD1351& oled, UART& uart,
+   SimStats& stats
+) {
+   VerilatedRestore is;
+   is.open(filename);
+   if(!is.isOpen()) {
+      fprintf(stderr,"Could not open checkpoint %s\n",filename);
+      exit(-1);
+   }
+   uint32_t magic;
+   is >> magic;
+   if(magic != CHECKPOINT_MAGIC) {
+      fprintf(stderr,"%s is not a checkpoint (or an older version)\n",filename);
+      exit(-1);
+   }
+   uint64_t cycles;
+   uint32_t fpu_rounding;
+   FPUConfig fpu_config;
+   is >> cycles;
+   is >> fpu_rounding >> fpu_config.denormals >> fpu_config.guard_bits;
+   fpu_config.rounding = FPURoundingMode(fpu_rounding);
+   is >> top;
+   oled.restore(is);
+   uart.restore(is);
+   is.close();
+   stats.set_cycles(cycles);
+   // The FPU functions continue with the configuration of the checkpoint
+   const FPUConfig& cur_fpu_config = FPU_config();
+   if(
+      cur_fpu_config.rounding   != fpu_config.rounding  ||
+      cur_fpu_config.denormals  != fpu_config.denormals ||
+      cur_fpu_config.guard_bits != fpu_config.guard_bits
+   ) {
+      fprintf(
+	 stderr,"[checkpoint] using the FPU config of the checkpoint "
+	 "(rounding %s, denormals %s)\n",
+	 FPU_rounding_name(fpu_config.rounding),
+	 fpu_config.denormals ? "on" : "off"
+      );
+   }
+   FPU_set_config(fpu_config);
+   fprintf(
+      stderr,"[checkpoint] restored %s at cycle %llu\n",
+      filename, (unsigned long long)(cycles)
+   );
+}
+#endif
+
+/*
+ * Command line options:
+ *   -ppm basename   : basename of the PPM snapshots of the OLED display
+ *   -ppm_frames N   : saves a PPM snapshot every N frames (0: no snapshot)
+ *   -oled_fps N     : maximum frame rate of the OLED display window
+ *                     (0: redraws after each row, default: 60)
+ *   -stats N        : prints simulation statistics every N cycles (0: only
+ *                     at the end of the simulation)
+ *   -save N file    : saves a checkpoint to file at cycle N
+ *   -restore file   : resumes simulation from a checkpoint, with the FPU
+ *                     config of the checkpoint. The UART input that was
+ *                     not consumed when the checkpoint was saved is sent
+ *                     first, then the input of -uart_in and -uart_pty.
+ *                     (-save and -restore need SIM_SAVABLE)
+ *   -max_cycles N   : stops the simulation after N cycles (exit status 2)
+ *   -report file    : saves a machine-readable summary (see sim_batch.cpp)
+ *   -trace file     : saves an execution trace (read it with trace_tool)
+ *   -trace_start N  : starts the trace at cycle N
+ *   -trace_ring N   : only keeps the last N chunks (of 65536 instructions)
+ *   -profile base   : saves the profile of the firmware to base.flat (cycles
+ *                     per function) and base.folded (call stacks, for
+ *                     flamegraph.pl)
+ *   -profile_elf file : ELF executable with the symbols of the firmware
+ *                     (default: firmware.elf)
+ *   -cosim          : runs the instruction set simulator (ISS.h) in lock-step
+ *                     with the processor, and stops at the first divergence
+ *                     (exit status 1, see Cosim.h)
+ *   -uart_in file   : sends the content of file to the UART
+ *   -uart_pty       : connects the UART to a pseudo-terminal
+ *   -uart_bit_cycles N : duration of a bit on the UART pins, in cycles
+ *                     (with BENCH_UART_PINS, default is 10, that is,
+ *                      NRV_FREQ=1 MHz / 115200 bauds + 2, see buart)
+ *   -fpu_rounding mode : rounding mode of the FPU functions (FPU_funcs.h),
+ *                     rne, rtz, rdn, rup or rmm (default: rtz, like
+ *                     petitbateau)
+ *   -fpu_denormals  : gradual underflow in the FPU functions (default:
+ *                     denormal results are flushed to zero)
+ *   firmware.elf    : optional ELF executable to be loaded in the RAM,
+ *                     replaces the content of FIRMWARE/firmware.hex.
+ *                     Can also be a region of the RAM saved by
+ *                     firmware_words in binary words (.fwb) or run-length
+ *                     compressed binary words (.rle).
+ * Other options (+xxx) are passed to Verilator.
+ */
 
 int main(int argc, char** argv, char** env) {
 
-   // simplest rounding = ignore LSBs
-   fesetround(FE_TOWARDZERO);
+   Verilated::commandArgs(argc, argv);
+
+   const char* ppm_basename = "oled";
+   unsigned int ppm_frames  = 0;
+   unsigned int oled_fps    = 60;
+   unsigned long long stats_interval = 0;
+   unsigned long long save_cycle = 0;
+   const char* save_filename = nullptr;
+   const char* restore_filename = nullptr;
+   unsigned long long max_cycles = 0;
+   const char* report_filename = nullptr;
+   const char* elf_filename = nullptr;
+   const char* trace_filename = nullptr;
+   unsigned long long trace_start = 0;
+   unsigned int trace_ring = 0;
+   const char* profile_basename = nullptr;
+   const char* profile_elf_filename = nullptr;
+   bool cosim_enabled = false;
+   const char* uart_in_filename = nullptr;
+   bool uart_pty = false;
+   unsigned int uart_bit_cycles = 10;
+   FPUConfig fpu_config;
+
+   for(int i=1; i<argc; ++i) {
+      if(!strcmp(argv[i],"-ppm") && i+1 < argc) {
+	 ppm_basename = argv[++i];
+      } else if(!strcmp(argv[i],"-ppm_frames") && i+1 < argc) {
+	 ppm_frames = (unsigned int)(atoi(argv[++i]));
+      } else if(!strcmp(argv[i],"-oled_fps") && i+1 < argc) {
+	 oled_fps = (unsigned int)(atoi(argv[++i]));
+      } else if(!strcmp(argv[i],"-stats") && i+1 < argc) {
+	 stats_interval = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-save") && i+2 < argc) {
+	 save_cycle = strtoull(argv[++i], nullptr, 10);
+	 save_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-restore") && i+1 < argc) {
+	 restore_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-max_cycles") && i+1 < argc) {
+	 max_cycles = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-report") && i+1 < argc) {
+	 report_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-trace") && i+1 < argc) {
+	 trace_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-trace_start") && i+1 < argc) {
+	 trace_start = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-trace_ring") && i+1 < argc) {
+	 trace_ring = (unsigned int)(atoi(argv[++i]));
+      } else if(!strcmp(argv[i],"-profile") && i+1 < argc) {
+	 profile_basename = argv[++i];
+      } else if(!strcmp(argv[i],"-profile_elf") && i+1 < argc) {
+	 profile_elf_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-cosim")) {
+	 cosim_enabled = true;
+      } else if(!strcmp(argv[i],"-uart_in") && i+1 < argc) {
+	 uart_in_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-uart_pty")) {
+	 uart_pty = true;
+      } else if(!strcmp(argv[i],"-uart_bit_cycles") && i+1 < argc) {
+	 uart_bit_cycles = (unsigned int)(atoi(argv[++i]));
+      } else if(
+	 !strcmp(argv[i],"-fpu_rounding") && i+1 < argc &&
+	 FPU_rounding_from_name(argv[i+1], fpu_config.rounding)
+      ) {
+	 ++i;
+      } else if(!strcmp(argv[i],"-fpu_denormals")) {
+	 fpu_config.denormals = true;
+      } else if(argv[i][0] != '-' && argv[i][0] != '+') {
+	 elf_filename = argv[i];
+      } else if(argv[i][0] != '+') {
+	 fprintf(stderr,"usage: %s <-ppm basename> <-ppm_frames N> <-oled_fps N>"
+		 " <-stats N>"
+		 " <-save N file> <-restore file> <-max_cycles N>"
+		 " <-report file> <-trace file> <-trace_start N> <-trace_ring N>"
+		 " <-profile basename> <-profile_elf file> <-cosim>"
+		 " <-uart_in file> <-uart_pty>"
+		 " <-uart_bit_cycles N> <-fpu_rounding rne|rtz|rdn|rup|rmm>"
+		 " <-fpu_denormals> <firmware.elf|.fwb|.rle>\n",argv[0]);
+	 return 1;
+      }
+   }
+
+   FPU_set_config(fpu_config);
 
-   // for now, flush denormalized result to zero.   
-   _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON); 
-   
    VfemtoRV32_bench top;
+   SimStats stats;
+   stats.set_instret(&top.instret);
+   stats.set_interval(stats_interval);
+   top.pclk = 0;
+
+   // Call eval() so that readmemh()/initial blocks are executed
+   // before the firmware is loaded.
+   top.eval();
+   size_t l = (elf_filename != nullptr) ? strlen(elf_filename) : 0;
+   bool firmware_words = l > 4 && (
+      !strcmp(elf_filename+l-4,".fwb") || !strcmp(elf_filename+l-4,".rle")
+   );
+   if(firmware_words) {
+      if(!load_firmware_words(top, elf_filename)) {
+	 fprintf(stderr,"Could not load %s\n",elf_filename);
+	 return 1;
+      }
+   } else if(elf_filename != nullptr) {
+      int elf_status = load_elf(top, elf_filename);
+      if(elf_status != ELF32_OK) {
+	 fprintf(stderr,"Could not load %s (ELF error %d)\n",elf_filename,elf_status);
+	 return 1;
+      }
+   }
+
+   UART uart;
+   if(uart_in_filename != nullptr && !uart.set_input_file(uart_in_filename)) {
+      fprintf(stderr,"Could not open %s\n",uart_in_filename);
+      return 1;
+   }
+   if(uart_pty && !uart.open_PTY()) {
+      fprintf(stderr,"Could not create pseudo-terminal\n");
+      return 1;
+   }
+#ifdef BENCH_UART_PINS
+   uart.connect(&top.TXD, &top.RXD, uart_bit_cycles);
+#else
+   (void)uart_bit_cycles;
+#endif
+
+   TraceWriter trace;
+   if(trace_filename != nullptr && !trace.open(trace_filename, trace_ring)) {
+      fprintf(stderr,"Could not create trace %s\n",trace_filename);
+      return 1;
+   }
+   bool tracing = trace.is_open();
+
+   Profiler profiler;
+   bool profiling = (profile_basename != nullptr);
+   if(profiling) {
+      if(profile_elf_filename == nullptr && !firmware_words) {
+	 profile_elf_filename = elf_filename;
+      }
+      if(
+	 profile_elf_filename == nullptr ||
+	 !profiler.load_symbols(profile_elf_filename)
+      ) {
+	 fprintf(stderr,"Could not read symbols for the profile (-profile_elf)\n");
+	 return 1;
+      }
+   }
+
+   // The reference model starts with the same content of the RAM
+   // (FIRMWARE/firmware.hex or the loaded firmware).
+   std::unique_ptr<Cosim> cosim;
+   if(cosim_enabled) {
+#ifdef SIM_SAVABLE
+      if(restore_filename != nullptr) {
+	 fprintf(stderr,"-cosim cannot start from a checkpoint\n");
+	 return 1;
+      }
+#endif
+      std::vector<uint8_t> RAM;
+      read_RAM(top, RAM);
+      cosim.reset(new Cosim(RAM.data(), uint32_t(RAM.size())));
+   }
+
+   // Observes the processor in the current cycle (when pclk is low).
+   bool observing = tracing || profiling || cosim_enabled;
+   auto observe = [&]() {
+      if(tracing && stats.cycles() >= trace_start) {
+	 trace_cycle(trace, top, stats.cycles());
+      }
+      if(profiling) {
+	 profiler.tick(top.trace_PC);
+	 if(top.trace_retire) {
+	    profiler.retire(top.trace_PC, top.trace_instr);
+	 }
+      }
+      if(cosim_enabled) {
+	 cosim_cycle(*cosim, top, stats.cycles());
+      }
+   };
+
+   auto running = [&]() -> bool {
+      return !Verilated::gotFinish() &&
+	     (max_cycles == 0 || stats.cycles() < max_cycles) &&
+	     !(cosim_enabled && cosim->diverged());
+   };
+
+#ifdef SIM_MT
+
+   if(save_filename != nullptr || restore_filename != nullptr) {
+      fprintf(stderr,"Checkpoints not supported with SIM_MT\n");
+      return 1;
+   }
+
+   OLEDPins oled_pins;
+   oled_pins.unpack(pack_OLED_pins(top));
+   SSD1351 oled(
+      oled_pins.DIN, oled_pins.CLK, oled_pins.CS, oled_pins.DC, oled_pins.RST
+   );
+   oled.set_snapshots(ppm_basename, ppm_frames);
+   oled.set_max_fps(oled_fps);
+
+   PinQueue* queue = new PinQueue;
+   std::atomic<bool> sim_done(false);
+
+   std::thread simulation([&]() {
+      uint8_t prev_pins = pack_OLED_pins(top);
+      while(running()) {
+	 top.pclk = !top.pclk;
+	 top.eval();
+	 uint8_t pins = pack_OLED_pins(top);
+	 if(pins != prev_pins) {
+	    while(!queue->push(pins)) {
+	       std::this_thread::yield();
+	    }
+	    prev_pins = pins;
+	 }
+	 if(top.pclk) {
+	    stats.tick();
+#ifdef BENCH_UART_PINS
+	    uart.eval();
+#endif
+	 } else if(observing) {
+	    observe();
+	 }
+      }
+      sim_done.store(true, std::memory_order_release);
+   });
+
+   // OLED display model. Note: we need to test sim_done before
+   // popping, so that we do not miss the last transitions.
+   for(;;) {
+      bool done = sim_done.load(std::memory_order_acquire);
+      uint8_t pins;
+      if(queue->pop(pins)) {
+	 oled_pins.unpack(pins);
+	 oled.eval();
+      } else if(done) {
+	 break;
+      } else {
+	 oled.present();
+	 std::this_thread::yield();
+      }
+   }
+
+   simulation.join();
+   delete queue;
+
+#else
+
    SSD1351 oled(
       top.oled_DIN, top.oled_CLK, top.oled_CS, top.oled_DC, top.oled_RST
    );
-   top.pclk = 0;
-   while(!Verilated::gotFinish()) {
+   oled.set_snapshots(ppm_basename, ppm_frames);
+   oled.set_max_fps(oled_fps);
+
+#ifdef SIM_SAVABLE
+   if(restore_filename != nullptr) {
+      restore_checkpoint(restore_filename, top, oled, uart, stats);
+   }
+#else
+   if(save_filename != nullptr || restore_filename != nullptr) {
+      fprintf(stderr,"Checkpoints not supported (compile with SIM_SAVABLE)\n");
+      return 1;
+   }
+#endif
+
+   // The pins of the OLED display only change on the rising edge
+   // of the clock (femtosoc clk = pclk in the bench), and oled.eval()
+   // only does something on the edges of its CLK and CS pins.
+   while(running()) {
       top.pclk = !top.pclk;
       top.eval();
-      oled.eval();
+      if(top.pclk) {
+	 oled.eval();
+	 if((stats.cycles() & 0xfffff) == 0) {
+	    oled.present();
+	 }
+	 stats.tick();
+#ifdef BENCH_UART_PINS
+	 uart.eval();
+#endif
+#ifdef SIM_SAVABLE
+	 if(save_filename != nullptr && stats.cycles() == save_cycle) {
+	    save_checkpoint(save_filename, top, oled, uart, stats);
+	 }
+#endif
+      } else if(observing) {
+	 observe();
+      }
+   }
+
+#endif
+
+   bool finished = Verilated::gotFinish();
+   bool diverged = cosim_enabled && cosim->diverged();
+   uart.flush();
+   oled.present();
+   if(tracing) {
+      trace.close();
+      fprintf(
+	 stderr,"[trace] %llu instructions, %llu bytes\n",
+	 (unsigned long long)(trace.nb_records()),
+	 (unsigned long long)(trace.nb_bytes())
+      );
+   }
+   if(profiling) {
+      std::string flat = std::string(profile_basename) + ".flat";
+      std::string folded = std::string(profile_basename) + ".folded";
+      if(
+	 !profiler.save_flat(flat.c_str()) ||
+	 !profiler.save_folded(folded.c_str())
+      ) {
+	 fprintf(stderr,"Could not save profile %s\n",profile_basename);
+      }
+   }
+   if(cosim_enabled) {
+      fprintf(
+	 stderr,"[cosim] %llu instructions checked (%llu values from IO/counters)%s\n",
+	 (unsigned long long)(cosim->nb_checked()),
+	 (unsigned long long)(cosim->nb_synced()),
+	 diverged ? ", DIVERGED" : ""
+      );
+   }
+   top.final();
+   stats.report();
+   const char* status = finished ? "finished" : "max_cycles";
+   if(diverged) {
+      status = "diverged";
+   }
+   if(
+      report_filename != nullptr &&
+      !stats.save_report(report_filename, status)
+   ) {
+      fprintf(stderr,"Could not save report to %s\n",report_filename);
+   }
+   if(diverged) {
+      return 1;
    }
-   return 0;
+   return finished ? 0 : 2;
 }
@@ -0,0 +1,237 @@
+/*
+ * timing_tool: estimates the number of cycles of a firmware on the
+ * different femtorv cores, from an execution trace (see Trace.h, written
+ * by the bench or by femtorv32_iss with -trace) and the timing models of
+ * TimingModel.h.
+ *
+ * Usage: timing_tool <options> trace.bin
+ *   -core name      : only estimates for this core (default: all cores)
+ *   -flash mode     : SPI flash mode of the SOC (MappedSPIFlash.v): read,
+ *                     fast_read, dual_output or dual_io (default: read)
+ *   -twolevel_shifter : quark and tachyon with NRV_TWOLEVEL_SHIFTER
+ *   -elf file       : the firmware, to get the size of the instructions
+ *                     (otherwise deduced from the next PC)
+ *   -classes        : prints the cycles per instruction class
+ *   -max N          : stops after N instructions
+ *
+ * The cycles recorded in the trace are displayed as well: when the trace
+ * comes from the bench, they validate the model of the simulated core
+ * (the cycles between two instructions are attributed to the first one,
+ * in the trace and in the estimates).
+ */
+
+#include "TimingModel.h"
+#include "Trace.h"
+#include "femto_elf.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+/*
+ * \brief Cycles and instructions per instruction class of a core
+ */
+struct CoreStats {
+   std::unique_ptr<TimingModel> model;
+   uint64_t cycles;
+   uint64_t unsupported;
+   uint64_t class_instr[CLASS_NB];
+   uint64_t class_cycles[CLASS_NB];
+};
+
+int main(int argc, char** argv) {
+   const char* core_name = nullptr;
+   const char* elf_filename = nullptr;
+   bool print_classes = false;
+   unsigned long long max_records = 0;
+   TimingConfig config;
+   const char* filename = nullptr;
+
+   for(int i=1; i<argc; ++i) {
+      if(!strcmp(argv[i],"-core") && i+1 < argc) {
+	 core_name = argv[++i];
+      } else if(!strcmp(argv[i],"-flash") && i+1 < argc) {
+	 const char* mode = argv[++i];
+	 if(!strcmp(mode,"read")) {
+	    config.flash_read_cycles = 64;
+	 } else if(!strcmp(mode,"fast_read")) {
+	    config.flash_read_cycles = 72;
+	 } else if(!strcmp(mode,"dual_output")) {
+	    config.flash_read_cycles = 56;
+	 } else if(!strcmp(mode,"dual_io")) {
+	    config.flash_read_cycles = 44;
+	 } else {
+	    fprintf(stderr,"Unknown flash mode %s\n",mode);
+	    return 1;
+	 }
+      } else if(!strcmp(argv[i],"-twolevel_shifter")) {
+	 config.twolevel_shifter = true;
+      } else if(!strcmp(argv[i],"-elf") && i+1 < argc) {
+	 elf_filename = argv[++i];
+      } else if(!strcmp(argv[i],"-classes")) {
+	 print_classes = true;
+      } else if(!strcmp(argv[i],"-max") && i+1 < argc) {
+	 max_records = strtoull(argv[++i], nullptr, 10);
+      } else if(argv[i][0] != '-' && filename == nullptr) {
+	 filename = argv[i];
+      } else {
+	 filename = nullptr;
+	 break;
+      }
+   }
+   if(filename == nullptr) {
+      fprintf(
+	 stderr,
+	 "usage: %s <-core name> <-flash read|fast_read|dual_output|dual_io>"
+	 " <-twolevel_shifter> <-elf file> <-classes> <-max N> trace.bin\n",
+	 argv[0]
+      );
+      return 1;
+   }
+
+   std::vector<CoreStats> cores;
+   for(const std::string& name: TimingModel::names()) {
+      if(core_name != nullptr && name != core_name) {
+	 continue;
+      }
+      cores.emplace_back();
+      CoreStats& core = cores.back();
+      core.model.reset(TimingModel::create(name, config));
+      core.cycles = 0;
+      core.unsupported = 0;
+      memset(core.class_instr, 0, sizeof(core.class_instr));
+      memset(core.class_cycles, 0, sizeof(core.class_cycles));
+   }
+   if(cores.empty()) {
+      fprintf(stderr,"Unknown core %s\n",core_name);
+      return 1;
+   }
+
+   // The image of the firmware, to get the size of the instructions.
+   std::vector<uint8_t> image;
+   if(elf_filename != nullptr) {
+      Elf32Info info;
+      if(elf32_stat(elf_filename, &info) != ELF32_OK) {
+	 fprintf(stderr,"Could not read %s\n",elf_filename);
+	 return 1;
+      }
+      image.resize(info.max_address + 4, 0);
+      if(elf32_load_at(elf_filename, &info, image.data()) != ELF32_OK) {
+	 fprintf(stderr,"Could not read %s\n",elf_filename);
+	 return 1;
+      }
+   }
+
+   TraceReader reader;
+   if(!reader.open(filename)) {
+      fprintf(stderr,"Could not open trace %s\n",filename);
+      return 1;
+   }
+
+   uint32_t regs[32];
+   memset(regs, 0, sizeof(regs));
+   uint64_t trace_class_instr[CLASS_NB];
+   uint64_t trace_class_cycles[CLASS_NB];
+   memset(trace_class_instr, 0, sizeof(trace_class_instr));
+   memset(trace_class_cycles, 0, sizeof(trace_class_cycles));
+   uint64_t nb_records = 0;
+   uint64_t first_cycle = 0;
+   uint64_t last_cycle = 0;
+   int prev_class = -1;
+
+   // An instruction is processed when the next one is read (to know the
+   // next PC).
+   TraceRecord R, next;
+   bool has_R = reader.next(R);
+   while(has_R) {
+      bool has_next = (max_records == 0 || nb_records+1 < max_records) &&
+		      reader.next(next);
+
+      unsigned int len = 4;
+      if(R.PC + 4 <= image.size()) {
+	 len = ((image[R.PC] & 3) == 3) ? 4 : 2;
+      } else if(has_next && next.PC == R.PC + 2) {
+	 len = 2;
+      }
+      uint32_t next_PC = has_next ? next.PC : R.PC + len;
+
+      TimedInstr I;
+      I.decode(R.PC, R.instr, len, next_PC, regs[(R.instr >> 20) & 31]);
+      I.load = R.load;
+      I.store = R.store;
+      I.mem_addr = R.mem_addr;
+
+      for(CoreStats& core: cores) {
+	 unsigned int fetch = core.model->fetch_cycles(I);
+	 unsigned int execute = core.model->execute_cycles(I);
+	 core.cycles += fetch + execute;
+	 if(prev_class >= 0) {
+	    core.class_cycles[prev_class] += fetch;
+	 }
+	 core.class_instr[I.cls]++;
+	 core.class_cycles[I.cls] += execute;
+	 if(!core.model->supports(I)) {
+	    ++core.unsupported;
+	 }
+      }
+
+      if(nb_records == 0) {
+	 first_cycle = R.cycle;
+      }
+      last_cycle = R.cycle;
+      trace_class_instr[I.cls]++;
+      if(has_next) {
+	 trace_class_cycles[I.cls] += next.cycle - R.cycle;
+      }
+      prev_class = int(I.cls);
+      ++nb_records;
+
+      if(R.wb && R.rd != 0 && R.rd < 32) {
+	 regs[R.rd] = R.wb_data;
+      }
+      R = next;
+      has_R = has_next;
+   }
+
+   if(nb_records == 0) {
+      fprintf(stderr,"Empty trace\n");
+      return 1;
+   }
+
+   // The trace has no record after the last instruction
+   uint64_t trace_cycles = last_cycle - first_cycle;
+   uint64_t trace_instr = nb_records - 1;
+
+   printf("%-14s %14s %8s %12s %12s\n",
+	  "core","cycles","CPI","unsupported","mispredicts");
+   for(CoreStats& core: cores) {
+      printf("%-14s %14llu %8.3f %12llu %12llu\n",
+	     core.model->name(),
+	     (unsigned long long)(core.cycles),
+	     double(core.cycles)/double(nb_records),
+	     (unsigned long long)(core.unsupported),
+	     (unsigned long long)(core.model->nb_mispredicts()));
+   }
+   printf("%-14s %14llu %8.3f\n", "(trace)",
+	  (unsigned long long)(trace_cycles),
+	  trace_instr != 0 ? double(trace_cycles)/double(trace_instr) : 0.0);
+
+   if(print_classes) {
+      printf("\n%-14s %-8s %12s %10s %10s\n",
+	     "core","class","instructions","CPI","trace CPI");
+      for(CoreStats& core: cores) {
+	 for(unsigned int c=0; c<CLASS_NB; ++c) {
+	    if(core.class_instr[c] == 0) {
+	       continue;
+	    }
+	    printf("%-14s %-8s %12llu %10.3f %10.3f\n",
+		   core.model->name(), instr_class_name(InstrClass(c)),
+		   (unsigned long long)(core.class_instr[c]),
+		   double(core.class_cycles[c])/double(core.class_instr[c]),
+		   double(trace_class_cycles[c])/double(trace_class_instr[c]));
+	 }
+      }
+   }
+
+   return 0;
+}
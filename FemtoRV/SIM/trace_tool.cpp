@@ -0,0 +1,123 @@
+/*
+ * trace_tool: reads the execution traces written by the Verilator
+ * bench (sim_main.cpp -trace file, see Trace.h).
+ *
+ * Usage: trace_tool <-stats> <-from N> <-max N> trace.bin
+ *   (default)  : prints one line per instruction
+ *   -stats     : prints a summary (instructions, CPI, loads, stores,
+ *                bytes per instruction)
+ *   -from N    : skips the instructions executed before cycle N
+ *   -max N     : stops after N instructions
+ */
+
+#include "Trace.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const char* reg_name(unsigned int rd) {
+   static const char* names[64] = {
+      "zero","ra","sp","gp","tp","t0","t1","t2",
+      "s0","s1","a0","a1","a2","a3","a4","a5",
+      "a6","a7","s2","s3","s4","s5","s6","s7",
+      "s8","s9","s10","s11","t3","t4","t5","t6",
+      "ft0","ft1","ft2","ft3","ft4","ft5","ft6","ft7",
+      "fs0","fs1","fa0","fa1","fa2","fa3","fa4","fa5",
+      "fa6","fa7","fs2","fs3","fs4","fs5","fs6","fs7",
+      "fs8","fs9","fs10","fs11","ft8","ft9","ft10","ft11"
+   };
+   return names[rd & 63];
+}
+
+int main(int argc, char** argv) {
+   bool stats = false;
+   unsigned long long from_cycle = 0;
+   unsigned long long max_records = 0;
+   const char* filename = nullptr;
+
+   for(int i=1; i<argc; ++i) {
+      if(!strcmp(argv[i],"-stats")) {
+	 stats = true;
+      } else if(!strcmp(argv[i],"-from") && i+1 < argc) {
+	 from_cycle = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-max") && i+1 < argc) {
+	 max_records = strtoull(argv[++i], nullptr, 10);
+      } else if(argv[i][0] != '-' && filename == nullptr) {
+	 filename = argv[i];
+      } else {
+	 filename = nullptr;
+	 break;
+      }
+   }
+   if(filename == nullptr) {
+      fprintf(stderr,"usage: %s <-stats> <-from N> <-max N> trace.bin\n",argv[0]);
+      return 1;
+   }
+
+   TraceReader reader;
+   if(!reader.open(filename)) {
+      fprintf(stderr,"Could not open trace %s\n",filename);
+      return 1;
+   }
+
+   unsigned long long nb_records = 0;
+   unsigned long long nb_loads = 0;
+   unsigned long long nb_stores = 0;
+   unsigned long long nb_wb = 0;
+   unsigned long long first_cycle = 0;
+   unsigned long long last_cycle = 0;
+
+   TraceRecord R;
+   while(reader.next(R)) {
+      if(R.cycle < from_cycle) {
+	 continue;
+      }
+      if(nb_records == 0) {
+	 first_cycle = R.cycle;
+      }
+      last_cycle = R.cycle;
+      ++nb_records;
+      nb_loads  += R.load;
+      nb_stores += R.store;
+      nb_wb     += R.wb;
+      if(!stats) {
+	 printf("%12llu %08x %08x", (unsigned long long)(R.cycle), R.PC, R.instr);
+	 if(R.wb) {
+	    printf("  %-4s=%08x", reg_name(R.rd), R.wb_data);
+	 }
+	 if(R.load) {
+	    printf("  ld [%08x]", R.mem_addr);
+	 }
+	 if(R.store) {
+	    printf("  st [%08x]=%08x/%x", R.mem_addr, R.mem_wdata, R.mem_wmask);
+	 }
+	 printf("\n");
+      }
+      if(max_records != 0 && nb_records >= max_records) {
+	 break;
+      }
+   }
+
+   if(stats) {
+      FILE* f = fopen(filename,"rb");
+      long size = 0;
+      if(f != nullptr) {
+	 fseek(f, 0, SEEK_END);
+	 size = ftell(f);
+	 fclose(f);
+      }
+      unsigned long long nb_cycles = last_cycle - first_cycle;
+      printf("instructions   : %llu\n", nb_records);
+      printf("cycles         : %llu (%llu to %llu)\n",
+	     nb_cycles, first_cycle, last_cycle);
+      printf("CPI            : %.3f\n",
+	     nb_records > 1 ? double(nb_cycles)/double(nb_records-1) : 0.0);
+      printf("write-backs    : %llu\n", nb_wb);
+      printf("loads          : %llu\n", nb_loads);
+      printf("stores         : %llu\n", nb_stores);
+      printf("file size      : %ld bytes (%.2f bytes/instr)\n",
+	     size, nb_records != 0 ? double(size)/double(nb_records) : 0.0);
+   }
+
+   return 0;
+}
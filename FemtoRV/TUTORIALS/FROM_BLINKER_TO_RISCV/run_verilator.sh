@@ -1,6 +1,16 @@
 (cd obj_dir; rm -f *.cpp *.o *.a VSOC)
-verilator -CFLAGS '-I../../../FIRMWARE/LIBFEMTORV32 -DSTANDALONE_FEMTOELF' -DBENCH -DBOARD_FREQ=10 -DCPU_FREQ=10 -DPASSTHROUGH_PLL -Wno-fatal \
-	  --top-module SOC -cc -exe sim_main.cpp ../../FIRMWARE/LIBFEMTORV32/femto_elf.c $1
+# The pipelined processors have an instret counter, read by sim_main.cpp,
+# and separate PROGROM/DATARAM, where sim_main.cpp can load ELF executables.
+# For the steps that have a Memory module (step11 to step24), sim_main.cpp
+# can load ELF executables in their RAM (steps 1 to 10 have no RAM).
+case $1 in
+   pipeline*) SIM_CONFIG="-CFLAGS -DSIM_INSTRET -CFLAGS -DSIM_PIPELINE sim_pipeline.vlt";;
+   step1[1-8].v|step2[0-4].v) SIM_CONFIG="-CFLAGS -DSIM_RAM sim_ram.vlt";;
+   *)         SIM_CONFIG="";;
+esac
+verilator -CFLAGS '-I../../../FIRMWARE/LIBFEMTORV32 -I../../../SIM -DSTANDALONE_FEMTOELF' -DBENCH -DBOARD_FREQ=10 -DCPU_FREQ=10 -DPASSTHROUGH_PLL -Wno-fatal \
+	  --top-module SOC -cc -exe sim_main.cpp ../../FIRMWARE/LIBFEMTORV32/femto_elf.c ../../SIM/SimStats.cpp $SIM_CONFIG $1
 (cd obj_dir; make -f VSOC.mk)
-obj_dir/VSOC $2
+shift
+obj_dir/VSOC "$@"
 
@@ -1,16 +1,129 @@
 #include "VSOC.h"
 #include "verilated.h"
 #include "femto_elf.h"
+#include "SimStats.h"
 #include <iostream>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
 
+// If SIM_INSTRET is defined, the number of retired instructions is read
+// from the instret counter of the processor (pipeline*.v).
+// If SIM_RAM is defined, ELF executables can be loaded into the RAM of the
+// SOC (step11.v ... step24.v).
+// If SIM_PIPELINE is defined, ELF executables can be loaded into the
+// PROGROM and DATARAM of the processor (pipeline*.v).
+// The signals are made visible by sim_ram.vlt and sim_pipeline.vlt
+// (see run_verilator.sh).
+#if defined(SIM_INSTRET) || defined(SIM_RAM) || defined(SIM_PIPELINE)
+#include "VSOC___024root.h"
+#endif
+
+#if defined(SIM_RAM) || defined(SIM_PIPELINE)
+#define SIM_LOAD_ELF
+#endif
+
+#ifdef SIM_LOAD_ELF
+
+/*
+ * \brief Copies a range of bytes into a verilated memory array
+ * \param[out] MEM the verilated array of 32-bit words
+ * \param[in] RAM the bytes to be copied
+ * \param[in] from_addr the address of the first byte of MEM in RAM
+ */
+template <class MEMORY> void copy_to_verilated_memory(
+   MEMORY& MEM, const std::vector<unsigned char>& RAM, size_t from_addr
+) {
+   size_t nb_words = sizeof(MEM) / sizeof(IData);
+   for(size_t i=0; i<nb_words; ++i) {
+      size_t addr = from_addr + 4*i;
+      MEM[i] = IData(RAM[addr])           |
+	       IData(RAM[addr+1])   << 8  |
+	       IData(RAM[addr+2])   << 16 |
+	       IData(RAM[addr+3])   << 24 ;
+   }
+}
+
+/*
+ * \brief Loads an ELF executable into the memory of the simulated SOC
+ * \param[in] top the verilated SOC
+ * \param[in] filename the ELF executable
+ * \return ELF32_OK or an error code
+ */
+int load_elf(VSOC& top, const char* filename) {
+#ifdef SIM_PIPELINE
+   // PROGROM starts at 0x00000, DATARAM at 0x10000 (see FIRMWARE/pipeline.ld)
+   auto& PROGROM = top.rootp->SOC__DOT__CPU__DOT__PROGROM;
+   auto& DATARAM = top.rootp->SOC__DOT__CPU__DOT__DATARAM;
+   size_t RAM_SIZE = sizeof(PROGROM) + sizeof(DATARAM);
+#else
+   auto& MEM = top.rootp->SOC__DOT__RAM__DOT__MEM;
+   size_t RAM_SIZE = sizeof(MEM);
+#endif
+
+   Elf32Info info;
+   int elf_status = elf32_stat(filename, &info);
+   if(elf_status != ELF32_OK) {
+      return elf_status;
+   }
+   if(info.max_address > RAM_SIZE) {
+      printf("\nELF exceeds RAM (%d > %d)\n",int(info.max_address),int(RAM_SIZE));
+      exit(-1);
+   }
+
+   // Load the ELF into a temporary buffer, that is copied
+   // into the verilated memories.
+   std::vector<unsigned char> RAM(RAM_SIZE,0);
+   elf_status = elf32_load_at(filename, &info, RAM.data());
+   if(elf_status != ELF32_OK) {
+      return elf_status;
+   }
+
+#ifdef SIM_PIPELINE
+   copy_to_verilated_memory(PROGROM, RAM, 0);
+   copy_to_verilated_memory(DATARAM, RAM, sizeof(PROGROM));
+#else
+   copy_to_verilated_memory(MEM, RAM, 0);
+#endif
+
+   return ELF32_OK;
+}
+
+#endif
+
+/*
+ * Usage: VSOC <firmware.elf> <-stats N> <-max_cycles N> <-report file>
+ *   firmware.elf : optional ELF executable to be loaded in the RAM,
+ *                  replaces the content initialized with readmemh().
+ *   -stats N     : prints simulation statistics every N cycles.
+ *   -max_cycles N: stops the simulation after N cycles (exit status 2).
+ *   -report file : saves a machine-readable summary (see SIM/sim_batch.cpp).
+ */
 
 int main(int argc, char** argv, char** env) {
    VSOC top;
+   SimStats stats;
    top.CLK = 0;
-   CData prev_LEDS;
-   Elf32Info elf;
-   int elf_status;
-   // void* simulated_RAM = (void*)top.SOC__DOT__RAM__DOT__MEM;
+   CData prev_LEDS = 0;
+   const char* elf_filename = nullptr;
+   unsigned long long max_cycles = 0;
+   const char* report_filename = nullptr;
+
+   for(int i=1; i<argc; ++i) {
+      if(!strcmp(argv[i],"-stats") && i+1 < argc) {
+	 stats.set_interval(strtoull(argv[++i], nullptr, 10));
+      } else if(!strcmp(argv[i],"-max_cycles") && i+1 < argc) {
+	 max_cycles = strtoull(argv[++i], nullptr, 10);
+      } else if(!strcmp(argv[i],"-report") && i+1 < argc) {
+	 report_filename = argv[++i];
+      } else {
+	 elf_filename = argv[i];
+      }
+   }
+
+#ifdef SIM_INSTRET
+   stats.set_instret(&top.rootp->SOC__DOT__CPU__DOT__instret);
+#endif
 
    // Call eval() so that readmemh()/initial bocks are executed
    // before anything else.
@@ -19,9 +132,9 @@ int main(int argc, char** argv, char** env) {
    // If ELF is specified on command line, load it into
    // simulated RAM. It will overwrite the RAM that was
    // previously initialized with readmemh().
-   /*
-   if(argc > 1) {
-       elf_status = elf32_load_at(argv[1],&elf,simulated_RAM);
+   if(elf_filename != nullptr) {
+#ifdef SIM_LOAD_ELF
+       int elf_status = load_elf(top, elf_filename);
        if(elf_status != ELF32_OK) {
 	   switch(elf_status) {
 	   case ELF32_FILE_NOT_FOUND:
@@ -39,13 +152,22 @@ int main(int argc, char** argv, char** env) {
 	   }
 	   exit(-1);
        }
+#else
+       printf("\nThis SOC cannot load ELF executables\n");
+       exit(-1);
+#endif
    }
-   */
 
    // Main simulation loop.
-   while(!Verilated::gotFinish()) {
+   while(
+      !Verilated::gotFinish() &&
+      (max_cycles == 0 || stats.cycles() < max_cycles)
+   ) {
       top.CLK = !top.CLK;
       top.eval();
+      if(top.CLK) {
+	 stats.tick();
+      }
       if(prev_LEDS != top.LEDS) {
 	 std::cout << "LEDS: ";
 	 for(int i=0; i<5; ++i) {
@@ -55,5 +177,14 @@ int main(int argc, char** argv, char** env) {
       }
       prev_LEDS = top.LEDS;
    }
-   return 0;
+   bool finished = Verilated::gotFinish();
+   top.final();
+   stats.report();
+   if(
+      report_filename != nullptr &&
+      !stats.save_report(report_filename, finished ? "finished" : "max_cycles")
+   ) {
+      fprintf(stderr,"Could not save report to %s\n",report_filename);
+   }
+   return finished ? 0 : 2;
 }